@@ -6,6 +6,7 @@
 
 #include <base/bt_assert.h>
 #include <base/byteorder.h>
+#include <base/bt_atomic.h>
 #include <base/bt_buf.h>
 
 #if defined(CONFIG_BT_BUF_LOG)
@@ -17,24 +18,36 @@
 #endif
 #define GET_ALIGN(pool) MAX(sizeof(void *), pool->alloc->alignment)
 
+/* The free list head packs an ABA tag with the 1-based index of the first free buffer, the
+ * link to the next one lives in the buffer's node. Every successful push/pop bumps the tag.
+ */
+#define FREE_IDX_BITS  (ATOMIC_BITS / 2)
+#define FREE_IDX_MASK  ((1UL << FREE_IDX_BITS) - 1)
+#define FREE_TAG(head) ((head) >> FREE_IDX_BITS)
+
+static inline size_t pool_struct_size(struct bt_buf_pool *pool)
+{
+	return ROUND_UP(sizeof(struct bt_buf) + pool->user_data_size, __alignof__(struct bt_buf));
+}
+
+static inline struct bt_buf *pool_buf_get(struct bt_buf_pool *pool, size_t idx)
+{
+	return (struct bt_buf *)(((uint8_t *)pool->__bufs) + idx * pool_struct_size(pool));
+}
+
 int bt_buf_id(const struct bt_buf *buf)
 {
 	struct bt_buf_pool *pool = buf->pool;
-	size_t struct_size =
-		ROUND_UP(sizeof(struct bt_buf) + pool->user_data_size, __alignof__(struct bt_buf));
 	ptrdiff_t offset = (uint8_t *)buf - (uint8_t *)pool->__bufs;
 
-	return offset / struct_size;
+	return offset / pool_struct_size(pool);
 }
 
 static inline struct bt_buf *pool_get_uninit(struct bt_buf_pool *pool, uint16_t uninit_count)
 {
-	size_t struct_size =
-		ROUND_UP(sizeof(struct bt_buf) + pool->user_data_size, __alignof__(struct bt_buf));
-	size_t byte_offset = (pool->buf_count - uninit_count) * struct_size;
 	struct bt_buf *buf;
 
-	buf = (struct bt_buf *)(((uint8_t *)pool->__bufs) + byte_offset);
+	buf = pool_buf_get(pool, pool->buf_count - uninit_count);
 
 	buf->pool = pool;
 	buf->user_data_size = pool->user_data_size;
@@ -42,6 +55,99 @@ static inline struct bt_buf *pool_get_uninit(struct bt_buf_pool *pool, uint16_t
 	return buf;
 }
 
+static struct bt_buf *free_list_pop(struct bt_buf_pool *pool)
+{
+	bt_atomic_val_t head, next;
+	struct bt_buf *buf;
+
+	do {
+		head = bt_atomic_get(&pool->free_head);
+		if ((head & FREE_IDX_MASK) == 0) {
+			return NULL;
+		}
+
+		buf = pool_buf_get(pool, (head & FREE_IDX_MASK) - 1);
+		/* The link may already be overwritten by a racing owner; the tag catches it */
+		next = bt_atomic_get((bt_atomic_t *)&buf->node);
+	} while (!bt_atomic_cas(&pool->free_head, head,
+				((FREE_TAG(head) + 1) << FREE_IDX_BITS) | (next & FREE_IDX_MASK)));
+
+	return buf;
+}
+
+static void free_list_push(struct bt_buf_pool *pool, struct bt_buf *buf)
+{
+	bt_atomic_val_t idx = bt_buf_id(buf) + 1;
+	bt_atomic_val_t head;
+
+	do {
+		head = bt_atomic_get(&pool->free_head);
+		bt_atomic_set((bt_atomic_t *)&buf->node, head & FREE_IDX_MASK);
+	} while (!bt_atomic_cas(&pool->free_head, head,
+				((FREE_TAG(head) + 1) << FREE_IDX_BITS) | idx));
+}
+
+static struct bt_buf *pool_take_uninit(struct bt_buf_pool *pool)
+{
+	bt_atomic_val_t uninit_count;
+
+	do {
+		uninit_count = bt_atomic_get(&pool->uninit_count);
+		if (!uninit_count) {
+			return NULL;
+		}
+	} while (!bt_atomic_cas(&pool->uninit_count, uninit_count, uninit_count - 1));
+
+	return pool_get_uninit(pool, uninit_count);
+}
+
+static struct bt_buf *pool_alloc_wait(struct bt_buf_pool *pool, os_timeout_t timeout)
+{
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
+	os_timeout_t remaining = timeout;
+	struct bt_buf *buf;
+
+	os_mutex_lock(&pool->lock, OS_TIMEOUT_FOREVER);
+	bt_atomic_inc(&pool->waiters);
+
+	while (!(buf = free_list_pop(pool))) {
+		if (!TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
+			uint64_t now = os_time_get_ns();
+
+			remaining = now < deadline ? (os_timeout_t)(deadline - now) : 0;
+		}
+
+		if (os_cond_wait(&pool->wait, &pool->lock, remaining) == -ETIMEDOUT) {
+			/* A buffer may have been released right before the timeout */
+			buf = free_list_pop(pool);
+			break;
+		}
+	}
+
+	bt_atomic_dec(&pool->waiters);
+	os_mutex_unlock(&pool->lock);
+
+	return buf;
+}
+
+void bt_buf_pool_release(struct bt_buf_pool *pool, struct bt_buf *buf)
+{
+	free_list_push(pool, buf);
+
+	/* Pairs with the waiter registering itself before re-checking the list */
+	if (bt_atomic_get(&pool->waiters) != 0) {
+		os_mutex_lock(&pool->lock, OS_TIMEOUT_FOREVER);
+		os_cond_signal(&pool->wait);
+		os_mutex_unlock(&pool->lock);
+	}
+}
+
+bool bt_buf_pool_has_free(struct bt_buf_pool *pool)
+{
+	return bt_atomic_get(&pool->uninit_count) != 0 ||
+	       (bt_atomic_get(&pool->free_head) & FREE_IDX_MASK) != 0;
+}
+
 void bt_buf_reset(struct bt_buf *buf)
 {
 	__ASSERT_NO_MSG(buf->flags == 0U);
@@ -50,74 +156,354 @@ void bt_buf_reset(struct bt_buf *buf)
 	bt_buf_simple_reset(&buf->b);
 }
 
-#if 0
-static uint8_t *generic_data_ref(struct bt_buf *buf, uint8_t *data)
+/* Every variable-size allocation is prefixed with a header holding its data reference count
+ * and the requested length, padded to the pool alignment.
+ */
+struct data_hdr {
+	bt_atomic_t ref;
+	size_t len;
+};
+
+#define DATA_HDR_SIZE(pool) ROUND_UP(sizeof(struct data_hdr), GET_ALIGN(pool))
+
+static inline struct data_hdr *data_hdr_get(struct bt_buf_pool *pool, uint8_t *data)
 {
-	struct bt_buf_pool *buf_pool = buf->pool;
-	uint8_t *ref_count;
+	return (struct data_hdr *)(data - DATA_HDR_SIZE(pool));
+}
 
-	ref_count = data - GET_ALIGN(buf_pool);
-	(*ref_count)++;
+static uint8_t *generic_data_ref(struct bt_buf *buf, uint8_t *data)
+{
+	bt_atomic_inc(&data_hdr_get(buf->pool, data)->ref);
 
 	return data;
 }
 
-static uint8_t *mem_pool_data_alloc(struct bt_buf *buf, size_t *size, int32_t timeout)
+/* Slab page states, size classes are stored as class + 1 */
+#define SLAB_PAGE_FREE     0U
+#define SLAB_PAGE_RUN      0xfeU
+#define SLAB_PAGE_RUN_TAIL 0xffU
+
+static inline size_t slab_class_size(int cls)
 {
-	struct bt_buf_pool *buf_pool = buf->pool;
-	struct k_heap *pool = buf_pool->alloc->alloc_data;
-	uint8_t *ref_count;
-	void *b;
+	return (size_t)BT_BUF_SLAB_MIN_CHUNK << cls;
+}
 
-	if (buf_pool->alloc->alignment == 0) {
-		/* Reserve extra space for a ref-count (uint8_t) */
-		b = k_heap_alloc(pool, sizeof(void *) + *size, timeout);
+/* Size class for a chunk of @p need bytes, or -1 when it takes whole pages */
+static int slab_class_get(size_t need)
+{
+	int cls = 0;
 
-	} else {
-		if (*size < buf_pool->alloc->alignment) {
+	while (slab_class_size(cls) < need) {
+		cls++;
+	}
+
+	return slab_class_size(cls) < CONFIG_BT_BUF_SLAB_PAGE_SIZE ? cls : -1;
+}
+
+static inline struct bt_buf_slab_page *slab_page_of(struct bt_buf_slab *slab, void *mem)
+{
+	return &slab->pages[((uint8_t *)mem - slab->mem) / CONFIG_BT_BUF_SLAB_PAGE_SIZE];
+}
+
+static inline uint8_t *slab_page_mem(struct bt_buf_slab *slab, struct bt_buf_slab_page *page)
+{
+	return slab->mem + (page - slab->pages) * CONFIG_BT_BUF_SLAB_PAGE_SIZE;
+}
+
+/* First fit search for @p count contiguous free pages */
+static struct bt_buf_slab_page *slab_run_find(struct bt_buf_slab *slab, uint16_t count)
+{
+	uint16_t start = 0;
+	uint16_t len = 0;
+
+	for (uint16_t i = 0; i < slab->num_pages; i++) {
+		if (slab->pages[i].cls != SLAB_PAGE_FREE) {
+			len = 0;
+			continue;
+		}
+
+		if (len++ == 0) {
+			start = i;
+		}
+
+		if (len == count) {
+			return &slab->pages[start];
+		}
+	}
+
+	return NULL;
+}
+
+static void *slab_run_alloc(struct bt_buf_slab *slab, uint16_t count)
+{
+	struct bt_buf_slab_page *page = slab_run_find(slab, count);
+
+	if (!page) {
+		return NULL;
+	}
+
+	page->cls = SLAB_PAGE_RUN;
+	page->inuse = count;
+	for (uint16_t i = 1; i < count; i++) {
+		page[i].cls = SLAB_PAGE_RUN_TAIL;
+	}
+
+	return slab_page_mem(slab, page);
+}
+
+static void *slab_chunk_alloc(struct bt_buf_slab *slab, int cls)
+{
+	struct bt_buf_slab_page *page = slab->partial[cls];
+	void *chunk;
+
+	if (!page) {
+		size_t size = slab_class_size(cls);
+		uint8_t *mem;
+
+		/* Carve a fresh page into chunks of this class */
+		page = slab_run_find(slab, 1);
+		if (!page) {
 			return NULL;
 		}
 
-		/* Reserve extra space for a ref-count (uint8_t) */
-		b = k_heap_aligned_alloc(
-			pool, buf_pool->alloc->alignment,
-			GET_ALIGN(buf_pool) + ROUND_UP(*size, buf_pool->alloc->alignment), timeout);
+		mem = slab_page_mem(slab, page);
+		page->cls = cls + 1;
+		page->inuse = 0U;
+		page->free = NULL;
+		for (size_t off = CONFIG_BT_BUF_SLAB_PAGE_SIZE; off >= size; off -= size) {
+			*(void **)(mem + off - size) = page->free;
+			page->free = mem + off - size;
+		}
+
+		page->next = NULL;
+		slab->partial[cls] = page;
 	}
 
-	if (b == NULL) {
+	chunk = page->free;
+	page->free = *(void **)chunk;
+	page->inuse++;
+
+	if (!page->free) {
+		/* Page is full, it is the list head so unlinking is O(1) */
+		slab->partial[cls] = page->next;
+		page->next = NULL;
+	}
+
+	return chunk;
+}
+
+static void slab_chunk_free(struct bt_buf_slab *slab, struct bt_buf_slab_page *page, void *chunk)
+{
+	int cls = page->cls - 1;
+	bool was_full = page->free == NULL;
+
+	*(void **)chunk = page->free;
+	page->free = chunk;
+
+	if (--page->inuse > 0) {
+		if (was_full) {
+			page->next = slab->partial[cls];
+			slab->partial[cls] = page;
+		}
+		return;
+	}
+
+	/* Last chunk returned: hand the page back to the free page pool */
+	if (!was_full) {
+		struct bt_buf_slab_page **pp = &slab->partial[cls];
+
+		while (*pp != page) {
+			pp = &(*pp)->next;
+		}
+		*pp = page->next;
+	}
+
+	page->next = NULL;
+	page->free = NULL;
+	page->cls = SLAB_PAGE_FREE;
+}
+
+static size_t slab_reserved_size(size_t need)
+{
+	int cls = slab_class_get(need);
+
+	return cls < 0 ? ROUND_UP(need, CONFIG_BT_BUF_SLAB_PAGE_SIZE) : slab_class_size(cls);
+}
+
+static void *slab_alloc_locked(struct bt_buf_slab *slab, size_t need)
+{
+	int cls = slab_class_get(need);
+
+	if (cls < 0) {
+		return slab_run_alloc(slab, DIV_ROUND_UP(need, CONFIG_BT_BUF_SLAB_PAGE_SIZE));
+	}
+
+	return slab_chunk_alloc(slab, cls);
+}
+
+static uint8_t *var_data_alloc(struct bt_buf *buf, size_t *size, os_timeout_t timeout)
+{
+	struct bt_buf_pool *buf_pool = buf->pool;
+	struct bt_buf_slab *slab = buf_pool->alloc->alloc_data;
+	size_t hdr_size = DATA_HDR_SIZE(buf_pool);
+	size_t need = hdr_size + ROUND_UP(*size, MAX(buf_pool->alloc->alignment, 1));
+	size_t reserved = slab_reserved_size(need);
+	struct data_hdr *hdr;
+
+	if (reserved > (size_t)slab->num_pages * CONFIG_BT_BUF_SLAB_PAGE_SIZE) {
+		/* Can never be satisfied, do not block on it */
 		return NULL;
 	}
 
-	ref_count = (uint8_t *)b;
-	*ref_count = 1U;
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
+	os_timeout_t remaining = timeout;
+
+	os_mutex_lock(&slab->lock, OS_TIMEOUT_FOREVER);
+
+	while (!(hdr = slab_alloc_locked(slab, need))) {
+		if (timeout == OS_TIMEOUT_NO_WAIT) {
+			slab->failures++;
+			os_mutex_unlock(&slab->lock);
+			return NULL;
+		}
+
+		if (!TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
+			uint64_t now = os_time_get_ns();
+
+			remaining = now < deadline ? (os_timeout_t)(deadline - now) : 0;
+		}
+
+		slab->waiters++;
+		if (os_cond_wait(&slab->wait, &slab->lock, remaining) == -ETIMEDOUT) {
+			slab->waiters--;
+
+			/* Memory may have been released right before the timeout */
+			hdr = slab_alloc_locked(slab, need);
+			if (hdr) {
+				break;
+			}
+
+			slab->failures++;
+			os_mutex_unlock(&slab->lock);
+			return NULL;
+		}
+		slab->waiters--;
+	}
+
+	slab->allocs++;
+	slab->requested += *size;
+	slab->allocated += reserved;
+	slab->high_water = MAX(slab->high_water, slab->allocated);
 
-	/* Return pointer to the byte following the ref count */
-	return ref_count + GET_ALIGN(buf_pool);
+	os_mutex_unlock(&slab->lock);
+
+	bt_atomic_set(&hdr->ref, 1);
+	hdr->len = *size;
+
+	/* Hand out whatever the size class rounding left over */
+	*size = MIN(reserved - hdr_size, UINT16_MAX);
+
+	return (uint8_t *)hdr + hdr_size;
 }
 
-static void mem_pool_data_unref(struct bt_buf *buf, uint8_t *data)
+static void var_data_unref(struct bt_buf *buf, uint8_t *data)
 {
 	struct bt_buf_pool *buf_pool = buf->pool;
-	struct k_heap *pool = buf_pool->alloc->alloc_data;
-	uint8_t *ref_count;
+	struct bt_buf_slab *slab = buf_pool->alloc->alloc_data;
+	struct data_hdr *hdr = data_hdr_get(buf_pool, data);
+	struct bt_buf_slab_page *page;
 
-	ref_count = data - GET_ALIGN(buf_pool);
-	if (--(*ref_count)) {
+	if (bt_atomic_dec(&hdr->ref) != 1) {
 		return;
 	}
 
-	/* Need to copy to local variable due to alignment */
-	k_heap_free(pool, ref_count);
+	os_mutex_lock(&slab->lock, OS_TIMEOUT_FOREVER);
+
+	page = slab_page_of(slab, hdr);
+	if (page->cls == SLAB_PAGE_RUN) {
+		uint16_t count = page->inuse;
+
+		slab->allocated -= (size_t)count * CONFIG_BT_BUF_SLAB_PAGE_SIZE;
+		for (uint16_t i = 0; i < count; i++) {
+			page[i].cls = SLAB_PAGE_FREE;
+			page[i].inuse = 0U;
+		}
+	} else {
+		slab->allocated -= slab_class_size(page->cls - 1);
+		slab_chunk_free(slab, page, hdr);
+	}
+
+	slab->allocs--;
+	slab->requested -= hdr->len;
+
+	if (slab->waiters) {
+		(void)os_cond_broadcast(&slab->wait);
+	}
+
+	os_mutex_unlock(&slab->lock);
 }
 
 const struct bt_buf_data_cb bt_buf_var_cb = {
-	.alloc = mem_pool_data_alloc,
+	.alloc = var_data_alloc,
 	.ref = generic_data_ref,
-	.unref = mem_pool_data_unref,
+	.unref = var_data_unref,
 };
-#endif
 
-static uint8_t *fixed_data_alloc(struct bt_buf *buf, size_t *size, int32_t timeout)
+int bt_buf_pool_var_stats_get(struct bt_buf_pool *pool, struct bt_buf_pool_var_stats *stats)
+{
+	struct bt_buf_slab *slab;
+	uint16_t run = 0;
+	uint16_t longest = 0;
+	size_t free_bytes;
+
+	if (!pool || !stats || pool->alloc->cb != &bt_buf_var_cb) {
+		return -EINVAL;
+	}
+
+	slab = pool->alloc->alloc_data;
+
+	os_mutex_lock(&slab->lock, OS_TIMEOUT_FOREVER);
+
+	for (uint16_t i = 0; i < slab->num_pages; i++) {
+		if (slab->pages[i].cls == SLAB_PAGE_FREE) {
+			run++;
+			longest = MAX(longest, run);
+		} else {
+			run = 0;
+		}
+	}
+
+	stats->total = (size_t)slab->num_pages * CONFIG_BT_BUF_SLAB_PAGE_SIZE;
+	stats->requested = slab->requested;
+	stats->allocated = slab->allocated;
+	stats->high_water = slab->high_water;
+	stats->allocs = slab->allocs;
+	stats->failures = slab->failures;
+	stats->largest_free = (size_t)longest * CONFIG_BT_BUF_SLAB_PAGE_SIZE;
+
+	/* Free chunks inside partially used pages only serve their own size class */
+	ARRAY_FOR_EACH(slab->partial, cls) {
+		for (struct bt_buf_slab_page *page = slab->partial[cls]; page; page = page->next) {
+			size_t chunk = slab_class_size(cls);
+
+			stats->largest_free = MAX(stats->largest_free, chunk);
+		}
+	}
+
+	os_mutex_unlock(&slab->lock);
+
+	free_bytes = stats->total - stats->allocated;
+	stats->internal_frag =
+		stats->allocated ? (stats->allocated - stats->requested) * 100U / stats->allocated
+				 : 0U;
+	stats->external_frag =
+		free_bytes ? (free_bytes - MIN(stats->largest_free, free_bytes)) * 100U / free_bytes
+			   : 0U;
+
+	return 0;
+}
+
+static uint8_t *fixed_data_alloc(struct bt_buf *buf, size_t *size, os_timeout_t timeout)
 {
 	struct bt_buf_pool *pool = buf->pool;
 	const struct bt_buf_pool_fixed *fixed = pool->alloc->alloc_data;
@@ -137,34 +523,31 @@ const struct bt_buf_data_cb bt_buf_fixed_cb = {
 	.unref = fixed_data_unref,
 };
 
-#if (K_HEAP_MEM_POOL_SIZE > 0)
-
-static uint8_t *heap_data_alloc(struct bt_buf *buf, size_t *size, int32_t timeout)
+static uint8_t *heap_data_alloc(struct bt_buf *buf, size_t *size, os_timeout_t timeout)
 {
 	struct bt_buf_pool *buf_pool = buf->pool;
-	uint8_t *ref_count;
+	struct data_hdr *hdr;
 
-	ref_count = os_malloc(GET_ALIGN(buf_pool) + *size);
-	if (!ref_count) {
+	hdr = os_malloc(DATA_HDR_SIZE(buf_pool) + *size);
+	if (!hdr) {
 		return NULL;
 	}
 
-	*ref_count = 1U;
+	bt_atomic_set(&hdr->ref, 1);
+	hdr->len = *size;
 
-	return ref_count + GET_ALIGN(buf_pool);
+	return (uint8_t *)hdr + DATA_HDR_SIZE(buf_pool);
 }
 
 static void heap_data_unref(struct bt_buf *buf, uint8_t *data)
 {
-	struct bt_buf_pool *buf_pool = buf->pool;
-	uint8_t *ref_count;
+	struct data_hdr *hdr = data_hdr_get(buf->pool, data);
 
-	ref_count = data - GET_ALIGN(buf_pool);
-	if (--(*ref_count)) {
+	if (bt_atomic_dec(&hdr->ref) != 1) {
 		return;
 	}
 
-	os_free(ref_count);
+	os_free(hdr);
 }
 
 static const struct bt_buf_data_cb bt_buf_heap_cb = {
@@ -178,9 +561,7 @@ const struct bt_buf_data_alloc bt_buf_heap_alloc = {
 	.max_alloc_size = 0,
 };
 
-#endif /* K_HEAP_MEM_POOL_SIZE > 0 */
-
-static uint8_t *data_alloc(struct bt_buf *buf, size_t *size, int32_t timeout)
+static uint8_t *data_alloc(struct bt_buf *buf, size_t *size, os_timeout_t timeout)
 {
 	struct bt_buf_pool *pool = buf->pool;
 
@@ -195,64 +576,46 @@ static uint8_t *data_ref(struct bt_buf *buf, uint8_t *data)
 }
 
 #if defined(CONFIG_BT_BUF_LOG)
-struct bt_buf *bt_buf_alloc_len_debug(struct bt_buf_pool *pool, size_t size, int32_t timeout,
+struct bt_buf *bt_buf_alloc_len_debug(struct bt_buf_pool *pool, size_t size, os_timeout_t timeout,
 				      const char *func, int line)
 
 #else
-struct bt_buf *bt_buf_alloc_len(struct bt_buf_pool *pool, size_t size, int32_t timeout)
+struct bt_buf *bt_buf_alloc_len(struct bt_buf_pool *pool, size_t size, os_timeout_t timeout)
 #endif
 {
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
 	struct bt_buf *buf;
 
 	__ASSERT_NO_MSG(pool);
 
 	BT_BUF_DBG("%s():%d: pool %p size %zu", func, line, pool, size);
 
-	/* We need to prevent race conditions
-	 * when accessing pool->uninit_count.
-	 */
-	os_mutex_lock(&pool->lock, OS_TIMEOUT_FOREVER);
-
-	/* If there are uninitialized buffers we're guaranteed to succeed
-	 * with the allocation one way or another.
-	 */
-	if (pool->uninit_count) {
-		uint16_t uninit_count;
-
-		/* If this is not the first access to the pool, we can
-		 * be opportunistic and try to fetch a previously used
-		 * buffer from the queue with OS_TIMEOUT_NO_WAIT.
-		 */
-		if (pool->uninit_count < pool->buf_count) {
-			buf = bt_queue_get(&pool->free, OS_TIMEOUT_NO_WAIT);
-			if (buf) {
-				os_mutex_unlock(&pool->lock);
-				goto success;
-			}
-		}
-
-		uninit_count = pool->uninit_count--;
-		os_mutex_unlock(&pool->lock);
-
-		buf = pool_get_uninit(pool, uninit_count);
-		goto success;
+	/* Recycled buffers first, so a warmed-up pool keeps touching the same memory */
+	buf = free_list_pop(pool);
+	if (!buf) {
+		buf = pool_take_uninit(pool);
 	}
 
-	os_mutex_unlock(&pool->lock);
+	if (!buf && timeout != OS_TIMEOUT_NO_WAIT) {
+		buf = pool_alloc_wait(pool, timeout);
+	}
 
-	buf = bt_queue_get(&pool->free, timeout);
 	if (!buf) {
 		BT_BUF_ERR("%s():%d: Failed to get free buffer", func, line);
 		return NULL;
 	}
 
-success:
 	BT_BUF_DBG("allocated buf %p", buf);
 
 	if (size) {
 		__maybe_unused size_t req_size = size;
 
-		timeout = (timeout != OS_TIMEOUT_NO_WAIT) ? OS_TIMEOUT_FOREVER : OS_TIMEOUT_NO_WAIT;
+		/* Whatever waiting for the buffer left of the timeout */
+		if (timeout != OS_TIMEOUT_NO_WAIT && !TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
+			uint64_t now = os_time_get_ns();
+
+			timeout = now < deadline ? (os_timeout_t)(deadline - now) : OS_TIMEOUT_NO_WAIT;
+		}
 		buf->__buf = data_alloc(buf, &size, timeout);
 		if (!buf->__buf) {
 			BT_BUF_ERR("%s():%d: Failed to allocate data", func, line);
@@ -265,9 +628,10 @@ success:
 		buf->__buf = NULL;
 	}
 
-	buf->ref = 1U;
+	bt_atomic_set(&buf->ref, 1);
 	buf->flags = 0U;
 	buf->frags = NULL;
+	buf->ext_destroy = NULL;
 	buf->size = size;
 	memset(buf->user_data, 0, buf->user_data_size);
 	bt_buf_reset(buf);
@@ -276,20 +640,20 @@ success:
 }
 
 #if defined(CONFIG_BT_BUF_LOG)
-struct bt_buf *bt_buf_alloc_fixed_debug(struct bt_buf_pool *pool, int32_t timeout, const char *func,
+struct bt_buf *bt_buf_alloc_fixed_debug(struct bt_buf_pool *pool, os_timeout_t timeout, const char *func,
 					int line)
 {
 	return bt_buf_alloc_len_debug(pool, pool->alloc->max_alloc_size, timeout, func, line);
 }
 #else
-struct bt_buf *bt_buf_alloc_fixed(struct bt_buf_pool *pool, int32_t timeout)
+struct bt_buf *bt_buf_alloc_fixed(struct bt_buf_pool *pool, os_timeout_t timeout)
 {
 	return bt_buf_alloc_len(pool, pool->alloc->max_alloc_size, timeout);
 }
 #endif
 
 struct bt_buf *bt_buf_alloc_with_data(struct bt_buf_pool *pool, void *data, size_t size,
-				      int32_t timeout)
+				      os_timeout_t timeout)
 {
 	struct bt_buf *buf;
 
@@ -304,6 +668,25 @@ struct bt_buf *bt_buf_alloc_with_data(struct bt_buf_pool *pool, void *data, size
 	return buf;
 }
 
+struct bt_buf *bt_buf_alloc_with_ref(struct bt_buf_pool *pool, void *data, size_t len,
+				     bt_buf_ext_destroy_cb destroy, os_timeout_t timeout)
+{
+	struct bt_buf *buf;
+
+	CHECKIF(len > UINT16_MAX) {
+		return NULL;
+	}
+
+	buf = bt_buf_alloc_with_data(pool, data, len, timeout);
+	if (!buf) {
+		return NULL;
+	}
+
+	buf->ext_destroy = destroy;
+
+	return buf;
+}
+
 static os_mutex_t bt_buf_slist_lock = OS_MUTEX_INITIALIZER;
 
 void bt_buf_slist_put(bt_slist_t *list, struct bt_buf *buf)
@@ -343,19 +726,30 @@ void bt_buf_unref(struct bt_buf *buf)
 		struct bt_buf *frags = buf->frags;
 		struct bt_buf_pool *pool;
 
-		__ASSERT_NO_MSG(buf->ref);
-		if (!buf->ref) {
-			BT_BUF_ERR("%s():%d: buf %p double free", func, line, buf);
-			return;
-		}
+		bt_atomic_val_t ref;
 
-		BT_BUF_DBG("%s():%d: buf %p ref %u pool %p frags %p", func, line, buf, buf->ref,
+		/* Never decrement from zero, so a double free is reported rather than wrapping */
+		do {
+			ref = bt_atomic_get(&buf->ref);
+			__ASSERT_NO_MSG(ref);
+			if (!ref) {
+				BT_BUF_ERR("%s():%d: buf %p double free", func, line, buf);
+				return;
+			}
+		} while (!bt_atomic_cas(&buf->ref, ref, ref - 1));
+
+		BT_BUF_DBG("%s():%d: buf %p ref %lu pool %p frags %p", func, line, buf, ref,
 			   buf->pool, buf->frags);
 
-		if (--buf->ref > 0) {
+		if (ref > 1) {
 			return;
 		}
 
+		if (buf->ext_destroy) {
+			buf->ext_destroy(buf, buf->__buf);
+			buf->ext_destroy = NULL;
+		}
+
 		buf->data = NULL;
 		buf->frags = NULL;
 
@@ -373,14 +767,16 @@ void bt_buf_unref(struct bt_buf *buf)
 
 struct bt_buf *bt_buf_ref(struct bt_buf *buf)
 {
+	__maybe_unused bt_atomic_val_t old;
+
 	__ASSERT_NO_MSG(buf);
 
-	BT_BUF_DBG("buf %p (old) ref %u pool %p", buf, buf->ref, buf->pool);
-	buf->ref++;
+	old = bt_atomic_inc(&buf->ref);
+	BT_BUF_DBG("buf %p (old) ref %lu pool %p", buf, old, buf->pool);
 	return buf;
 }
 
-struct bt_buf *bt_buf_clone(struct bt_buf *buf, int32_t timeout)
+struct bt_buf *bt_buf_clone(struct bt_buf *buf, os_timeout_t timeout)
 {
 	struct bt_buf_pool *pool;
 	struct bt_buf *clone;
@@ -540,7 +936,7 @@ size_t bt_buf_linearize(void *dst, size_t dst_len, const struct bt_buf *src, siz
  * the data in current fragment then create new fragment and add it to
  * the buffer. It assumes that the buffer has at least one fragment.
  */
-size_t bt_buf_append_bytes(struct bt_buf *buf, size_t len, const void *value, int32_t timeout,
+size_t bt_buf_append_bytes(struct bt_buf *buf, size_t len, const void *value, os_timeout_t timeout,
 			   bt_buf_allocator_cb allocate_cb, void *user_data)
 {
 	struct bt_buf *frag = bt_buf_frag_last(buf);
@@ -619,3 +1015,157 @@ size_t bt_buf_data_match(const struct bt_buf *buf, size_t offset, const void *da
 
 	return compared;
 }
+
+int bt_buf_append_ref(struct bt_buf *buf, struct bt_buf_pool *pool, void *data, size_t len,
+		      bt_buf_ext_destroy_cb destroy, os_timeout_t timeout)
+{
+	struct bt_buf *frag;
+
+	__ASSERT_NO_MSG(buf);
+
+	frag = bt_buf_alloc_with_ref(pool ? pool : buf->pool, data, len, destroy, timeout);
+	if (!frag) {
+		return -ENOMEM;
+	}
+
+	bt_buf_frag_add(buf, frag);
+
+	return 0;
+}
+
+int bt_buf_iovec_get(const struct bt_buf *buf, size_t offset, size_t len, struct iovec *iov,
+		     int iovcnt)
+{
+	int count = 0;
+
+	while (buf && offset >= buf->len) {
+		offset -= buf->len;
+		buf = buf->frags;
+	}
+
+	while (buf && len > 0 && count < iovcnt) {
+		size_t chunk = MIN(len, buf->len - offset);
+
+		if (chunk) {
+			iov[count].iov_base = buf->data + offset;
+			iov[count].iov_len = chunk;
+			count++;
+			len -= chunk;
+		}
+
+		buf = buf->frags;
+		offset = 0;
+	}
+
+	return count;
+}
+
+/* Walk forward to the fragment holding the cursor, skipping empty ones */
+static void cursor_sync(struct bt_buf_cursor *cursor)
+{
+	while (cursor->frag && cursor->off >= cursor->frag_off + cursor->frag->len) {
+		cursor->frag_off += cursor->frag->len;
+		cursor->frag = cursor->frag->frags;
+	}
+}
+
+/* Copy out to dst or in from src at the cursor, advancing it */
+static size_t cursor_copy(struct bt_buf_cursor *cursor, void *dst, const void *src, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len && cursor->frag) {
+		size_t pos = cursor->off - cursor->frag_off;
+		size_t chunk = MIN(len - done, cursor->frag->len - pos);
+
+		if (dst) {
+			memcpy((uint8_t *)dst + done, cursor->frag->data + pos, chunk);
+		} else if (src) {
+			memcpy(cursor->frag->data + pos, (const uint8_t *)src + done, chunk);
+		}
+
+		done += chunk;
+		cursor->off += chunk;
+		cursor_sync(cursor);
+	}
+
+	return done;
+}
+
+void bt_buf_cursor_init(struct bt_buf_cursor *cursor, struct bt_buf *buf)
+{
+	__ASSERT_NO_MSG(cursor);
+
+	cursor->head = buf;
+	cursor->frag = buf;
+	cursor->frag_off = 0;
+	cursor->off = 0;
+
+	cursor_sync(cursor);
+}
+
+int bt_buf_cursor_seek(struct bt_buf_cursor *cursor, size_t offset)
+{
+	struct bt_buf_cursor saved = *cursor;
+
+	if (offset < cursor->frag_off) {
+		cursor->frag = cursor->head;
+		cursor->frag_off = 0;
+	}
+
+	cursor->off = offset;
+	cursor_sync(cursor);
+
+	/* Past the end frag_off holds the chain length */
+	if (!cursor->frag && offset > cursor->frag_off) {
+		*cursor = saved;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+size_t bt_buf_cursor_pull(struct bt_buf_cursor *cursor, void *dst, size_t len)
+{
+	__ASSERT_NO_MSG(cursor);
+
+	return cursor_copy(cursor, dst, NULL, len);
+}
+
+void *bt_buf_cursor_pull_mem(struct bt_buf_cursor *cursor, size_t len, void *scratch)
+{
+	struct bt_buf_cursor saved = *cursor;
+	void *mem;
+
+	if (cursor->frag && cursor->off - cursor->frag_off + len <= cursor->frag->len) {
+		mem = cursor->frag->data + (cursor->off - cursor->frag_off);
+		cursor->off += len;
+		cursor_sync(cursor);
+		return mem;
+	}
+
+	if (cursor_copy(cursor, scratch, NULL, len) < len) {
+		*cursor = saved;
+		return NULL;
+	}
+
+	return scratch;
+}
+
+int bt_buf_cursor_push(struct bt_buf_cursor *cursor, const void *src, size_t len)
+{
+	struct bt_buf_cursor start;
+
+	__ASSERT_NO_MSG(cursor);
+
+	if (len > cursor->off) {
+		return -EINVAL;
+	}
+
+	(void)bt_buf_cursor_seek(cursor, cursor->off - len);
+	start = *cursor;
+	(void)cursor_copy(cursor, NULL, src, len);
+	*cursor = start;
+
+	return 0;
+}
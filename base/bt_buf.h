@@ -2,8 +2,10 @@
 #define __BASE_BUF_H__
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <string.h>
 
+#include <base/bt_atomic.h>
 #include <base/byteorder.h>
 #include <utils/bt_slist.h>
 #include <osdep/os.h>
@@ -970,6 +972,17 @@ static inline void bt_buf_simple_restore(struct bt_buf_simple *buf,
  */
 #define BT_BUF_EXTERNAL_DATA BIT(0)
 
+struct bt_buf;
+
+/**
+ * @typedef bt_buf_ext_destroy_cb
+ * @brief Release callback for external memory referenced by a buffer.
+ *
+ * @param buf Buffer that referenced the memory, about to go back to its pool.
+ * @param data Start of the external memory as given at allocation time.
+ */
+typedef void (*bt_buf_ext_destroy_cb)(struct bt_buf *buf, void *data);
+
 /**
  * @brief Network buffer representation.
  *
@@ -984,19 +997,23 @@ struct bt_buf {
 	/** Fragments associated with this buffer. */
 	struct bt_buf *frags;
 
-	/** Reference count. */
-	uint8_t ref;
+	/** Reference count, updated atomically so buffers can be shared across threads. */
+	bt_atomic_t ref;
 
 	/** Bit-field of buffer flags. */
 	uint8_t flags;
 
 	/** Where the buffer should go when freed up. */
 	uint8_t pool_id;
-	struct bt_buf_pool *pool;
 
 	/** Size of user data on this buffer */
 	uint8_t user_data_size;
 
+	struct bt_buf_pool *pool;
+
+	/** Called on the last unref of a buffer referencing external memory. */
+	bt_buf_ext_destroy_cb ext_destroy;
+
 	/** Union for convenience access to the bt_buf_simple members, also
 	 * preserving the old API.
 	 */
@@ -1031,7 +1048,7 @@ struct bt_buf {
 /** @cond INTERNAL_HIDDEN */
 
 struct bt_buf_data_cb {
-	uint8_t *__must_check (*alloc)(struct bt_buf *buf, size_t *size, int32_t timeout);
+	uint8_t *__must_check (*alloc)(struct bt_buf *buf, size_t *size, os_timeout_t timeout);
 	uint8_t *__must_check (*ref)(struct bt_buf *buf, uint8_t *data);
 	void (*unref)(struct bt_buf *buf, uint8_t *data);
 };
@@ -1051,17 +1068,23 @@ struct bt_buf_data_alloc {
  * This struct is used to represent a pool of network buffers.
  */
 struct bt_buf_pool {
-	/** queue to place the buffer into when free */
-	struct bt_queue free;
+	/** Lock-free stack of free buffers: ABA tag above, 1-based buffer index below */
+	bt_atomic_t free_head;
+
+	/** Number of allocators blocked waiting for a free buffer */
+	bt_atomic_t waiters;
 
-	/** To prevent concurrent access/modifications */
+	/** Serializes blocked allocators against the release wakeup */
 	os_mutex_t lock;
 
+	/** Signalled when a buffer is released while allocators are waiting */
+	os_cond_t wait;
+
 	/** Number of buffers in pool */
 	const uint16_t buf_count;
 
 	/** Number of uninitialized buffers */
-	uint16_t uninit_count;
+	bt_atomic_t uninit_count;
 
 	/** Size of user data allocated to this pool */
 	uint8_t user_data_size;
@@ -1078,9 +1101,10 @@ struct bt_buf_pool {
 
 #define BT_BUF_POOL_INITIALIZER(_pool, _alloc, _bufs, _count, _ud_size, _destroy)                  \
 	{                                                                                          \
-		.free = BT_QUEUE_INITIALIZER(_pool.free), .lock = {}, .buf_count = _count,          \
-		.uninit_count = _count, .user_data_size = _ud_size, .destroy = _destroy,           \
-		.alloc = _alloc, .__bufs = (struct bt_buf *)_bufs,                                 \
+		.free_head = 0, .waiters = 0, .lock = OS_MUTEX_INITIALIZER,                         \
+		.wait = OS_COND_INITIALIZER, .buf_count = _count, .uninit_count = _count,          \
+		.user_data_size = _ud_size, .destroy = _destroy, .alloc = _alloc,                  \
+		.__bufs = (struct bt_buf *)_bufs,                                                  \
 	}
 
 #define _BT_BUF_ARRAY_DEFINE(_name, _count, _ud_size)                                              \
@@ -1098,7 +1122,6 @@ struct bt_buf_pool {
 		     "Size cannot be determined");                                                 \
 	static struct _bt_buf_##_name _bt_buf_##_name[_count] __noinit
 
-#if 0
 extern const struct bt_buf_data_alloc bt_buf_heap_alloc;
 /** @endcond */
 
@@ -1114,7 +1137,7 @@ extern const struct bt_buf_data_alloc bt_buf_heap_alloc;
  * extern declaration.
  *
  * The data payload of the buffers will be allocated from the heap using
- * k_malloc, so CONFIG_HEAP_MEM_POOL_SIZE must be set to a positive value.
+ * os_malloc().
  * This kind of pool does not support blocking on the data allocation, so
  * the timeout passed to bt_buf_alloc will be always treated as OS_TIMEOUT_NO_WAIT
  * when trying to allocate the data. This means that allocation failures,
@@ -1131,9 +1154,8 @@ extern const struct bt_buf_data_alloc bt_buf_heap_alloc;
  */
 #define BT_BUF_POOL_HEAP_DEFINE(_name, _count, _ud_size, _destroy)                                 \
 	_BT_BUF_ARRAY_DEFINE(_name, _count, _ud_size);                                             \
-	struct bt_buf_pool bt_buf_pool##_name = BT_BUF_POOL_INITIALIZER(                           \
+	struct bt_buf_pool _name = BT_BUF_POOL_INITIALIZER(                                        \
 		_name, &bt_buf_heap_alloc, _bt_buf_##_name, _count, _ud_size, _destroy)
-#endif
 /** @cond INTERNAL_HIDDEN */
 
 struct bt_buf_pool_fixed {
@@ -1186,11 +1208,94 @@ extern const struct bt_buf_data_cb bt_buf_fixed_cb;
 	struct bt_buf_pool _name = BT_BUF_POOL_INITIALIZER(                                        \
 		_name, &bt_buf_fixed_alloc_##_name, _bt_buf_##_name, _count, _ud_size, _destroy)
 
+/** Size of a slab page, the unit variable-size pools carve their data budget into. */
+#ifndef CONFIG_BT_BUF_SLAB_PAGE_SIZE
+#define CONFIG_BT_BUF_SLAB_PAGE_SIZE 256
+#endif
+
 /** @cond INTERNAL_HIDDEN */
-#if 0
+
+/* Smallest chunk handed out by a slab; size classes double from here up to half a page. */
+#define BT_BUF_SLAB_MIN_CHUNK 32
+#define BT_BUF_SLAB_CLASSES   8
+
+BUILD_ASSERT((CONFIG_BT_BUF_SLAB_PAGE_SIZE & (CONFIG_BT_BUF_SLAB_PAGE_SIZE - 1)) == 0,
+	     "Slab page size must be a power of 2");
+BUILD_ASSERT(CONFIG_BT_BUF_SLAB_PAGE_SIZE >= 2 * BT_BUF_SLAB_MIN_CHUNK &&
+		     CONFIG_BT_BUF_SLAB_PAGE_SIZE <= (BT_BUF_SLAB_MIN_CHUNK << BT_BUF_SLAB_CLASSES),
+	     "Slab page size out of range");
+
+struct bt_buf_slab_page {
+	/* Free chunks left in this page */
+	void *free;
+	/* Next page of the same size class with free chunks */
+	struct bt_buf_slab_page *next;
+	/* Chunks in use, or page count of a multi-page run */
+	uint16_t inuse;
+	/* Size class + 1, or one of the page states in bt_buf.c (0 means free) */
+	uint8_t cls;
+};
+
+struct bt_buf_slab {
+	uint8_t *const mem;
+	struct bt_buf_slab_page *const pages;
+	const uint16_t num_pages;
+	os_mutex_t lock;
+	os_cond_t wait;
+	uint16_t waiters;
+	/* Partially used pages per size class */
+	struct bt_buf_slab_page *partial[BT_BUF_SLAB_CLASSES];
+	size_t requested;
+	size_t allocated;
+	size_t high_water;
+	uint32_t allocs;
+	uint32_t failures;
+};
+
 extern const struct bt_buf_data_cb bt_buf_var_cb;
+
+#define _BT_BUF_SLAB_DEFINE(_name, _data_size, _align)                                             \
+	static uint8_t __noinit bt_buf_slab_mem_##_name[ROUND_UP(                                  \
+		_data_size, CONFIG_BT_BUF_SLAB_PAGE_SIZE)] __aligned(MAX(sizeof(void *), _align)); \
+	static struct bt_buf_slab_page bt_buf_slab_pages_##_name[DIV_ROUND_UP(                     \
+		_data_size, CONFIG_BT_BUF_SLAB_PAGE_SIZE)];                                        \
+	BUILD_ASSERT(DIV_ROUND_UP(_data_size, CONFIG_BT_BUF_SLAB_PAGE_SIZE) <= UINT16_MAX);        \
+	BUILD_ASSERT(((_align) & ((_align) - 1)) == 0 && (_align) <= CONFIG_BT_BUF_SLAB_PAGE_SIZE, \
+		     "Invalid alignment");                                                         \
+	static struct bt_buf_slab bt_buf_slab_##_name = {                                          \
+		.mem = bt_buf_slab_mem_##_name,                                                    \
+		.pages = bt_buf_slab_pages_##_name,                                                \
+		.num_pages = DIV_ROUND_UP(_data_size, CONFIG_BT_BUF_SLAB_PAGE_SIZE),               \
+		.lock = OS_MUTEX_INITIALIZER,                                                      \
+		.wait = OS_COND_INITIALIZER,                                                       \
+	}
+
 /** @endcond */
 
+/**
+ * @brief Statistics of a variable-size buffer pool.
+ */
+struct bt_buf_pool_var_stats {
+	/** Data budget of the pool in bytes. */
+	size_t total;
+	/** Bytes currently requested by live allocations. */
+	size_t requested;
+	/** Bytes currently reserved, including size class rounding. */
+	size_t allocated;
+	/** Peak of @ref allocated since the pool was defined. */
+	size_t high_water;
+	/** Largest free allocation the pool could currently satisfy, in bytes. */
+	size_t largest_free;
+	/** Number of live data allocations. */
+	uint32_t allocs;
+	/** Number of data allocations that failed for lack of memory. */
+	uint32_t failures;
+	/** Share of reserved bytes lost to headers and size class rounding, in percent. */
+	uint8_t internal_frag;
+	/** Share of free bytes not usable by the largest possible allocation, in percent. */
+	uint8_t external_frag;
+};
+
 /**
  *
  * @brief Define a new pool for buffers with variable size payloads
@@ -1202,8 +1307,12 @@ extern const struct bt_buf_data_cb bt_buf_var_cb;
  * this needs to happen with the help of a separate pointer rather than an
  * extern declaration.
  *
- * The data payload of the buffers will be based on a memory pool from which
- * variable size payloads may be allocated.
+ * The data payload of the buffers is carved from a slab of @p _data_size
+ * bytes: small payloads come from power-of-two size classes packed into
+ * pages of CONFIG_BT_BUF_SLAB_PAGE_SIZE bytes, larger ones take a run of
+ * whole pages. bt_buf_alloc_len() reserves only what is requested (rounded
+ * up to the size class), so the budget can be well below
+ * _count * worst-case MTU.
  *
  * If provided with a custom destroy callback, this callback is
  * responsible for eventually calling bt_buf_destroy() to complete the
@@ -1217,13 +1326,13 @@ extern const struct bt_buf_data_cb bt_buf_var_cb;
  */
 #define BT_BUF_POOL_VAR_DEFINE(_name, _count, _data_size, _ud_size, _destroy)                      \
 	_BT_BUF_ARRAY_DEFINE(_name, _count, _ud_size);                                             \
-	K_HEAP_DEFINE(bt_buf_mem_pool_##_name, _data_size);                                        \
+	_BT_BUF_SLAB_DEFINE(_name, _data_size, 0);                                                 \
 	static const struct bt_buf_data_alloc bt_buf_data_alloc_##_name = {                        \
 		.cb = &bt_buf_var_cb,                                                              \
-		.alloc_data = &bt_buf_mem_pool_##_name,                                            \
+		.alloc_data = &bt_buf_slab_##_name,                                                \
 		.max_alloc_size = 0,                                                               \
 	};                                                                                         \
-	struct bt_buf_pool bt_buf_pool##_name = BT_BUF_POOL_INITIALIZER(                           \
+	struct bt_buf_pool _name = BT_BUF_POOL_INITIALIZER(                                        \
 		_name, &bt_buf_data_alloc_##_name, _bt_buf_##_name, _count, _ud_size, _destroy)
 
 /**
@@ -1231,23 +1340,9 @@ extern const struct bt_buf_data_cb bt_buf_var_cb;
  * @brief Define a new pool for buffers with variable size payloads. Align the
  *        length and start of the buffer to the specified alignment.
  *
- * Defines a bt_buf_pool struct and the necessary memory storage (array of
- * structs) for the needed amount of buffers. After this, the buffers can be
- * accessed from the pool through bt_buf_alloc. The pool is defined as a
- * static variable, so if it needs to be exported outside the current module
- * this needs to happen with the help of a separate pointer rather than an
- * extern declaration.
- *
- * The data payload of the buffers will be based on a memory pool from which
- * variable size payloads may be allocated.
- *
- * If provided with a custom destroy callback, this callback is
- * responsible for eventually calling bt_buf_destroy() to complete the
- * process of returning the buffer to the pool.
- *
- * Both the length and start of the buffer will be aligned to the specified
- * alignment. The alignment must be a power of 2 and the size of the
- * alignment must be less than or equal to the size of the data payload.
+ * Same as BT_BUF_POOL_VAR_DEFINE(), but the start of every data payload
+ * is aligned to @p _align. The alignment must be a power of 2 no larger
+ * than CONFIG_BT_BUF_SLAB_PAGE_SIZE.
  *
  * @param _name      Name of the pool variable.
  * @param _count     Number of buffers in the pool.
@@ -1258,16 +1353,27 @@ extern const struct bt_buf_data_cb bt_buf_var_cb;
  */
 #define BT_BUF_POOL_VAR_ALIGN_DEFINE(_name, _count, _data_size, _ud_size, _destroy, _align)        \
 	_BT_BUF_ARRAY_DEFINE(_name, _count, _ud_size);                                             \
-	K_HEAP_DEFINE(bt_buf_mem_pool_##_name, _data_size);                                        \
+	_BT_BUF_SLAB_DEFINE(_name, _data_size, _align);                                            \
 	static const struct bt_buf_data_alloc bt_buf_data_alloc_##_name = {                        \
 		.cb = &bt_buf_var_cb,                                                              \
-		.alloc_data = &bt_buf_mem_pool_##_name,                                            \
+		.alloc_data = &bt_buf_slab_##_name,                                                \
 		.max_alloc_size = 0,                                                               \
 		.alignment = _align,                                                               \
 	};                                                                                         \
-	struct bt_buf_pool bt_buf_pool##_name = BT_BUF_POOL_INITIALIZER(                           \
+	struct bt_buf_pool _name = BT_BUF_POOL_INITIALIZER(                                        \
 		_name, &bt_buf_data_alloc_##_name, _bt_buf_##_name, _count, _ud_size, _destroy)
-#endif
+
+/**
+ * @brief Get the data allocation statistics of a variable-size pool.
+ *
+ * @param pool  Pool defined with BT_BUF_POOL_VAR_DEFINE() or
+ *              BT_BUF_POOL_VAR_ALIGN_DEFINE().
+ * @param stats Filled with a consistent snapshot of the pool statistics.
+ *
+ * @return 0 on success, -EINVAL if @p pool is not a variable-size pool.
+ */
+int bt_buf_pool_var_stats_get(struct bt_buf_pool *pool, struct bt_buf_pool_var_stats *stats);
+
 /**
  *
  * @brief Define a new pool for buffers
@@ -1321,18 +1427,18 @@ int bt_buf_id(const struct bt_buf *buf);
  * @return New buffer or NULL if out of buffers.
  */
 #if defined(CONFIG_BT_BUF_LOG)
-struct bt_buf *__must_check bt_buf_alloc_fixed_debug(struct bt_buf_pool *pool, int32_t timeout,
+struct bt_buf *__must_check bt_buf_alloc_fixed_debug(struct bt_buf_pool *pool, os_timeout_t timeout,
 						     const char *func, int line);
 #define bt_buf_alloc_fixed(pool, timeout)                                                          \
 	bt_buf_alloc_fixed_debug(pool, timeout, __func__, __LINE__)
 #else
-struct bt_buf *__must_check bt_buf_alloc_fixed(struct bt_buf_pool *pool, int32_t timeout);
+struct bt_buf *__must_check bt_buf_alloc_fixed(struct bt_buf_pool *pool, os_timeout_t timeout);
 #endif
 
 /**
  * @copydetails bt_buf_alloc_fixed
  */
-static inline struct bt_buf *__must_check bt_buf_alloc(struct bt_buf_pool *pool, int32_t timeout)
+static inline struct bt_buf *__must_check bt_buf_alloc(struct bt_buf_pool *pool, os_timeout_t timeout)
 {
 	return bt_buf_alloc_fixed(pool, timeout);
 }
@@ -1353,13 +1459,13 @@ static inline struct bt_buf *__must_check bt_buf_alloc(struct bt_buf_pool *pool,
  * @return New buffer or NULL if out of buffers.
  */
 #if defined(CONFIG_BT_BUF_LOG)
-struct bt_buf *bt_buf_alloc_len_debug(struct bt_buf_pool *pool, size_t size, int32_t timeout,
+struct bt_buf *bt_buf_alloc_len_debug(struct bt_buf_pool *pool, size_t size, os_timeout_t timeout,
 				      const char *func, int line);
 #define bt_buf_alloc_len(pool, size, timeout)                                                      \
 	bt_buf_alloc_len_debug(pool, size, timeout, __func__, __LINE__)
 #else
 struct bt_buf *__must_check bt_buf_alloc_len(struct bt_buf_pool *pool, size_t size,
-					     int32_t timeout);
+					     os_timeout_t timeout);
 #endif
 
 /**
@@ -1382,7 +1488,43 @@ struct bt_buf *__must_check bt_buf_alloc_len(struct bt_buf_pool *pool, size_t si
  * @return New buffer or NULL if out of buffers.
  */
 struct bt_buf *__must_check bt_buf_alloc_with_data(struct bt_buf_pool *pool, void *data,
-						   size_t size, int32_t timeout);
+						   size_t size, os_timeout_t timeout);
+
+/** @cond INTERNAL_HIDDEN */
+void bt_buf_pool_release(struct bt_buf_pool *pool, struct bt_buf *buf);
+/** @endcond */
+
+/**
+ * @brief Check whether a buffer can be allocated from a pool without blocking.
+ *
+ * The answer is only a snapshot: another thread may take or return a buffer
+ * right after the check.
+ *
+ * @param pool Pool to inspect.
+ *
+ * @return true if the pool has at least one free buffer, false otherwise.
+ */
+bool bt_buf_pool_has_free(struct bt_buf_pool *pool);
+
+/**
+ * @brief Allocate a new buffer referencing external memory.
+ *
+ * Like bt_buf_alloc_with_data(), but the memory already holds @a len bytes
+ * of payload and @a destroy is called once the last reference to the buffer
+ * is dropped, so the owner knows when the memory may be reused.
+ *
+ * @param pool Which pool to allocate the buffer from.
+ * @param data External data pointer.
+ * @param len Number of payload bytes at @a data.
+ * @param destroy Optional callback releasing @a data.
+ * @param timeout Affects the action taken should the pool be empty.
+ *
+ * @return New buffer or NULL if out of buffers. On failure @a destroy is
+ *         not called and the caller still owns @a data.
+ */
+struct bt_buf *__must_check bt_buf_alloc_with_ref(struct bt_buf_pool *pool, void *data,
+						  size_t len, bt_buf_ext_destroy_cb destroy,
+						  os_timeout_t timeout);
 
 /**
  * @brief Destroy buffer from custom destroy callback
@@ -1404,7 +1546,7 @@ static inline void bt_buf_destroy(struct bt_buf *buf)
 		buf->__buf = NULL;
 	}
 
-	bt_queue_prepend(&pool->free, buf);
+	bt_buf_pool_release(pool, buf);
 }
 
 /**
@@ -1478,7 +1620,7 @@ struct bt_buf *__must_check bt_buf_ref(struct bt_buf *buf);
  *
  * @return Cloned buffer or NULL if out of buffers.
  */
-struct bt_buf *__must_check bt_buf_clone(struct bt_buf *buf, int32_t timeout);
+struct bt_buf *__must_check bt_buf_clone(struct bt_buf *buf, os_timeout_t timeout);
 
 /**
  * @brief Get a pointer to the user data of a buffer.
@@ -2531,7 +2673,7 @@ size_t bt_buf_linearize(void *dst, size_t dst_len, const struct bt_buf *src, siz
  * @param user_data The user data given in bt_buf_append_bytes call.
  * @return pointer to allocated bt_buf or NULL on error.
  */
-typedef struct bt_buf *__must_check (*bt_buf_allocator_cb)(int32_t timeout, void *user_data);
+typedef struct bt_buf *__must_check (*bt_buf_allocator_cb)(os_timeout_t timeout, void *user_data);
 
 /**
  * @brief Append data to a list of bt_buf
@@ -2554,7 +2696,7 @@ typedef struct bt_buf *__must_check (*bt_buf_allocator_cb)(int32_t timeout, void
  *         length if other timeout than OS_TIMEOUT_FOREVER was used, and there
  *         were no free fragments in a pool to accommodate all data.
  */
-size_t bt_buf_append_bytes(struct bt_buf *buf, size_t len, const void *value, int32_t timeout,
+size_t bt_buf_append_bytes(struct bt_buf *buf, size_t len, const void *value, os_timeout_t timeout,
 			   bt_buf_allocator_cb allocate_cb, void *user_data);
 
 /**
@@ -2600,6 +2742,122 @@ static inline struct bt_buf *bt_buf_skip(struct bt_buf *buf, size_t len)
 	return buf;
 }
 
+/**
+ * @brief Append external memory to a chain of bufs by reference.
+ *
+ * Wraps @a data in a new fragment from @a pool (or from the pool of @a buf
+ * if @a pool is NULL) and adds it to the end of the chain without copying.
+ *
+ * @param buf Head of the fragment chain.
+ * @param pool Pool to allocate the fragment from, or NULL.
+ * @param data External data pointer.
+ * @param len Number of payload bytes at @a data.
+ * @param destroy Optional callback releasing @a data, see bt_buf_alloc_with_ref().
+ * @param timeout Affects the action taken should the pool be empty.
+ *
+ * @return 0 on success, -ENOMEM if no fragment could be allocated. On
+ *         failure @a destroy is not called and the caller still owns @a data.
+ */
+int bt_buf_append_ref(struct bt_buf *buf, struct bt_buf_pool *pool, void *data, size_t len,
+		      bt_buf_ext_destroy_cb destroy, os_timeout_t timeout);
+
+/**
+ * @brief Describe the data of a chain of bufs as an iovec array.
+ *
+ * Fills @a iov with one entry per non-empty fragment covering @a len bytes
+ * starting at @a offset, so the chain can be handed to writev() and friends
+ * without linearizing it. Stops early when @a iovcnt entries are used.
+ *
+ * @param buf Head of the fragment chain.
+ * @param offset Offset into the chain of the first byte to describe.
+ * @param len Maximum number of bytes to describe.
+ * @param iov Array to fill.
+ * @param iovcnt Number of entries in @a iov.
+ *
+ * @return Number of entries filled.
+ */
+int bt_buf_iovec_get(const struct bt_buf *buf, size_t offset, size_t len, struct iovec *iov,
+		     int iovcnt);
+
+/**
+ * @brief Position inside a chain of bufs.
+ *
+ * Cursors read and write headers that straddle fragment boundaries without
+ * modifying the chain itself. Initialize with bt_buf_cursor_init().
+ */
+struct bt_buf_cursor {
+	/** Head of the chain the cursor walks. */
+	struct bt_buf *head;
+
+	/** Fragment holding the cursor position, NULL past the end. */
+	struct bt_buf *frag;
+
+	/** Chain offset of the first byte of @a frag. */
+	size_t frag_off;
+
+	/** Chain offset of the cursor. */
+	size_t off;
+};
+
+/**
+ * @brief Initialize a cursor at the start of a chain of bufs.
+ *
+ * @param cursor Cursor to initialize.
+ * @param buf Head of the fragment chain.
+ */
+void bt_buf_cursor_init(struct bt_buf_cursor *cursor, struct bt_buf *buf);
+
+/**
+ * @brief Move a cursor to an absolute offset in its chain.
+ *
+ * @param cursor Cursor to move.
+ * @param offset New chain offset.
+ *
+ * @return 0 on success, -EINVAL if @a offset lies past the end of the chain.
+ */
+int bt_buf_cursor_seek(struct bt_buf_cursor *cursor, size_t offset);
+
+/**
+ * @brief Read bytes at a cursor and advance it.
+ *
+ * @param cursor Cursor to read from.
+ * @param dst Destination buffer, or NULL to only skip the bytes.
+ * @param len Number of bytes to read.
+ *
+ * @return Number of bytes read, less than @a len at the end of the chain.
+ */
+size_t bt_buf_cursor_pull(struct bt_buf_cursor *cursor, void *dst, size_t len);
+
+/**
+ * @brief Access bytes at a cursor and advance it, copying only if needed.
+ *
+ * Returns a pointer straight into the fragment when the @a len bytes are
+ * contiguous, otherwise gathers them into @a scratch.
+ *
+ * @param cursor Cursor to read from.
+ * @param len Number of bytes to access.
+ * @param scratch Buffer of at least @a len bytes used for straddling data.
+ *
+ * @return Pointer to the bytes, or NULL (cursor unchanged) if fewer than
+ *         @a len bytes remain.
+ */
+void *bt_buf_cursor_pull_mem(struct bt_buf_cursor *cursor, size_t len, void *scratch);
+
+/**
+ * @brief Write bytes in front of a cursor and move it back.
+ *
+ * The inverse of bt_buf_cursor_pull(): the @a len bytes preceding the cursor
+ * are overwritten with @a src and the cursor ends up in front of them, so
+ * nested headers can be filled in from the innermost layer outwards.
+ *
+ * @param cursor Cursor to write at.
+ * @param src Bytes to write.
+ * @param len Number of bytes to write.
+ *
+ * @return 0 on success, -EINVAL if fewer than @a len bytes precede the cursor.
+ */
+int bt_buf_cursor_push(struct bt_buf_cursor *cursor, const void *src, size_t len);
+
 /**
  * @brief Calculate amount of bytes stored in fragments.
  *
@@ -2622,6 +2880,25 @@ static inline size_t bt_buf_frags_len(const struct bt_buf *buf)
 	return bytes;
 }
 
+/**
+ * @brief Count the fragments of a chain of bufs.
+ *
+ * @param buf Buffer to start off with.
+ *
+ * @return Number of buffers in the chain, e.g. to size an iovec array.
+ */
+static inline size_t bt_buf_frags_count(const struct bt_buf *buf)
+{
+	size_t count = 0;
+
+	while (buf) {
+		count++;
+		buf = buf->frags;
+	}
+
+	return count;
+}
+
 /**
  * @}
  */
@@ -21,44 +21,265 @@
 #include <base/bt_mem_pool.h>
 #include <osdep/os.h>
 
-static os_mutex_t lock = OS_MUTEX_INITIALIZER;
+/* The free list head packs an ABA tag with the 1-based index of the first free block.
+ * Every successful push/pop bumps the tag so a stale head can never be swapped back in.
+ */
+#define FREE_IDX_BITS  (ATOMIC_BITS / 2)
+#define FREE_IDX_MASK  ((1UL << FREE_IDX_BITS) - 1)
+#define FREE_TAG(head) ((head) >> FREE_IDX_BITS)
 
-static int create_mem_pool_list(struct bt_mem_pool *mpool)
+static inline char *block_get(struct bt_mem_pool *mpool, bt_atomic_val_t idx)
 {
-	char *p;
+	return mpool->buffer + (idx - 1) * mpool->info.block_size;
+}
 
-	os_sem_init(&mpool->wait, 0, 1);
+static inline bt_atomic_val_t block_idx(struct bt_mem_pool *mpool, char *blk)
+{
+	return (bt_atomic_val_t)(blk - mpool->buffer) / mpool->info.block_size + 1;
+}
 
-	/* blocks must be word aligned */
-	CHECKIF(((mpool->info.block_size | (uintptr_t)mpool->buffer) & (sizeof(void *) - 1)) !=
-		0U) {
-		return -EINVAL;
+static void *free_list_pop(struct bt_mem_pool *mpool)
+{
+	bt_atomic_val_t head, next;
+	char *blk;
+
+	do {
+		head = bt_atomic_get(&mpool->free_head);
+		if ((head & FREE_IDX_MASK) == 0) {
+			return NULL;
+		}
+
+		blk = block_get(mpool, head & FREE_IDX_MASK);
+		/* The link may already be overwritten by a racing owner; the tag catches it */
+		next = bt_atomic_get((bt_atomic_t *)blk);
+	} while (!bt_atomic_cas(&mpool->free_head, head,
+				((FREE_TAG(head) + 1) << FREE_IDX_BITS) | (next & FREE_IDX_MASK)));
+
+	return blk;
+}
+
+/* Statically defined pools are never passed to bt_mem_pool_init(), so blocks are
+ * carved from the buffer on first use instead of being linked up front.
+ */
+static void *uninit_take(struct bt_mem_pool *mpool)
+{
+	bt_atomic_val_t left;
+
+	do {
+		left = bt_atomic_get(&mpool->uninit_count);
+		if (left == 0) {
+			return NULL;
+		}
+	} while (!bt_atomic_cas(&mpool->uninit_count, left, left - 1));
+
+	return block_get(mpool, mpool->info.num_blocks - left + 1);
+}
+
+static void *pool_take(struct bt_mem_pool *mpool)
+{
+	void *blk = free_list_pop(mpool);
+
+	return blk ? blk : uninit_take(mpool);
+}
+
+static void free_list_push(struct bt_mem_pool *mpool, void *mem)
+{
+	bt_atomic_val_t idx = block_idx(mpool, mem);
+	bt_atomic_val_t head;
+
+	do {
+		head = bt_atomic_get(&mpool->free_head);
+		bt_atomic_set((bt_atomic_t *)mem, head & FREE_IDX_MASK);
+	} while (!bt_atomic_cas(&mpool->free_head, head,
+				((FREE_TAG(head) + 1) << FREE_IDX_BITS) | idx));
+}
+
+static void mem_pool_release(struct bt_mem_pool *mpool, void *mem)
+{
+	free_list_push(mpool, mem);
+
+	/* Pairs with the waiter registering itself before re-checking the list */
+	if (bt_atomic_get(&mpool->waiters) != 0) {
+		(void)os_sem_give(&mpool->wait);
+	}
+}
+
+#if CONFIG_BT_MEM_POOL_MAGAZINE_SIZE > 0
+/* Per-thread magazines: each thread keeps a few free blocks of recently used pools so the
+ * common alloc/free pairs never touch the shared free list. Pools too small to spare
+ * CONFIG_BT_MEM_POOL_MAGAZINE_SIZE blocks per thread bypass the cache.
+ */
+struct mem_pool_mag {
+	struct bt_mem_pool *pool;
+	uint16_t count;
+	void *blocks[CONFIG_BT_MEM_POOL_MAGAZINE_SIZE];
+};
+
+struct mem_pool_cache {
+	struct mem_pool_mag mag[CONFIG_BT_MEM_POOL_MAGAZINE_SLOTS];
+};
+
+static os_tls_t cache_tls;
+static bt_atomic_t cache_tls_state;
+
+static void mag_drain(struct mem_pool_mag *mag, uint16_t keep)
+{
+	while (mag->count > keep) {
+		mem_pool_release(mag->pool, mag->blocks[--mag->count]);
 	}
+}
 
-	mpool->free_list = NULL;
-	p = mpool->buffer + mpool->info.block_size * (mpool->info.num_blocks - 1);
+static void cache_destroy(void *arg)
+{
+	struct mem_pool_cache *cache = arg;
 
-	while (p >= mpool->buffer) {
-		*(char **)p = mpool->free_list;
-		mpool->free_list = p;
-		p -= mpool->info.block_size;
+	ARRAY_FOR_EACH(cache->mag, i) {
+		mag_drain(&cache->mag[i], 0);
 	}
-	return 0;
+
+	os_free(cache);
 }
 
-static int mem_pool_list_init(void)
+static struct mem_pool_cache *cache_get(bool create)
 {
-	int rc = 0;
+	struct mem_pool_cache *cache;
+
+	if (bt_atomic_get(&cache_tls_state) != 2) {
+		if (bt_atomic_cas(&cache_tls_state, 0, 1)) {
+			(void)os_tls_create(&cache_tls, cache_destroy);
+			bt_atomic_set(&cache_tls_state, 2);
+		} else {
+			while (bt_atomic_get(&cache_tls_state) != 2) {
+				(void)os_thread_yield();
+			}
+		}
+	}
 
-	STRUCT_SECTION_FOREACH(bt_mem_pool, mpool) {
-		rc = create_mem_pool_list(mpool);
-		if (rc < 0) {
-			goto out;
+	cache = os_tls_get(&cache_tls);
+	if (!cache && create) {
+		cache = os_calloc(1, sizeof(*cache));
+		if (cache && os_tls_set(&cache_tls, cache) != 0) {
+			os_free(cache);
+			cache = NULL;
 		}
 	}
 
-out:
-	return rc;
+	return cache;
+}
+
+static inline bool mag_eligible(struct bt_mem_pool *mpool)
+{
+	return mpool->info.num_blocks >= 4U * CONFIG_BT_MEM_POOL_MAGAZINE_SIZE;
+}
+
+static inline struct mem_pool_mag *mag_slot(struct mem_pool_cache *cache,
+					    struct bt_mem_pool *mpool)
+{
+	return &cache->mag[(POINTER_TO_UINT(mpool) >> 4) % CONFIG_BT_MEM_POOL_MAGAZINE_SLOTS];
+}
+
+static void *mag_alloc(struct bt_mem_pool *mpool)
+{
+	struct mem_pool_cache *cache;
+	struct mem_pool_mag *mag;
+
+	if (!mag_eligible(mpool)) {
+		return NULL;
+	}
+
+	cache = cache_get(false);
+	if (!cache) {
+		return NULL;
+	}
+
+	mag = mag_slot(cache, mpool);
+	if (mag->pool != mpool || mag->count == 0) {
+		return NULL;
+	}
+
+	return mag->blocks[--mag->count];
+}
+
+static bool mag_free(struct bt_mem_pool *mpool, void *mem)
+{
+	struct mem_pool_cache *cache;
+	struct mem_pool_mag *mag;
+
+	/* Blocked allocators must see the block, never park it */
+	if (!mag_eligible(mpool) || bt_atomic_get(&mpool->waiters) != 0) {
+		return false;
+	}
+
+	cache = cache_get(true);
+	if (!cache) {
+		return false;
+	}
+
+	mag = mag_slot(cache, mpool);
+	if (mag->pool != mpool) {
+		mag_drain(mag, 0);
+		mag->pool = mpool;
+	} else if (mag->count == ARRAY_SIZE(mag->blocks)) {
+		/* Give half back so the shared list is refilled in batches */
+		mag_drain(mag, ARRAY_SIZE(mag->blocks) / 2);
+	}
+
+	mag->blocks[mag->count++] = mem;
+
+	return true;
+}
+
+void bt_mem_pool_cache_flush(void)
+{
+	struct mem_pool_cache *cache = cache_get(false);
+
+	if (!cache) {
+		return;
+	}
+
+	ARRAY_FOR_EACH(cache->mag, i) {
+		mag_drain(&cache->mag[i], 0);
+	}
+}
+#else
+static inline void *mag_alloc(struct bt_mem_pool *mpool)
+{
+	return NULL;
+}
+
+static inline bool mag_free(struct bt_mem_pool *mpool, void *mem)
+{
+	return false;
+}
+
+void bt_mem_pool_cache_flush(void)
+{
+}
+#endif /* CONFIG_BT_MEM_POOL_MAGAZINE_SIZE > 0 */
+
+static int create_mem_pool_list(struct bt_mem_pool *mpool)
+{
+	os_sem_init(&mpool->wait, 0, 1);
+	os_mutex_init(&mpool->lock);
+	mpool->wait_ready = true;
+
+	/* blocks must be word aligned */
+	CHECKIF(((mpool->info.block_size | (uintptr_t)mpool->buffer) & (sizeof(void *) - 1)) !=
+		0U) {
+		return -EINVAL;
+	}
+
+	CHECKIF(mpool->info.num_blocks > FREE_IDX_MASK ||
+		mpool->info.block_size < sizeof(bt_atomic_t)) {
+		return -EINVAL;
+	}
+
+	bt_atomic_clear(&mpool->waiters);
+	bt_atomic_clear(&mpool->info.num_used);
+	bt_atomic_clear(&mpool->free_head);
+	bt_atomic_set(&mpool->uninit_count, mpool->info.num_blocks);
+
+	return 0;
 }
 
 int bt_mem_pool_init(struct bt_mem_pool *mpool, void *buffer, size_t block_size,
@@ -78,51 +299,94 @@ int bt_mem_pool_init(struct bt_mem_pool *mpool, void *buffer, size_t block_size,
 	return 0;
 }
 
-int bt_mem_pool_alloc(struct bt_mem_pool *mpool, void **mem, os_timeout_t timeout)
+static int mem_pool_alloc_wait(struct bt_mem_pool *mpool, void **mem, os_timeout_t timeout)
 {
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
+	os_timeout_t remaining = timeout;
 	int result;
 
-	if (mpool->free_list != NULL) {
-		/* take a free block */
-		*mem = mpool->free_list;
-		mpool->free_list = *(char **)(mpool->free_list);
-		mpool->info.num_used++;
-		result = 0;
-	} else if (TIMEOUT_EQ(timeout, OS_TIMEOUT_NO_WAIT)) {
-		/* don't wait for a free block to become available */
-		*mem = NULL;
-		result = -ENOMEM;
-	} else {
-		result = os_sem_take(&mpool->wait, timeout);
+	/* One blocked allocator at a time keeps the wakeup handoff a simple binary signal */
+	result = os_mutex_lock(&mpool->lock, timeout);
+	if (result) {
+		return result;
+	}
+
+	if (!mpool->wait_ready) {
+		os_sem_init(&mpool->wait, 0, 1);
+		mpool->wait_ready = true;
+	}
+
+	bt_atomic_inc(&mpool->waiters);
+
+	while (1) {
+		*mem = pool_take(mpool);
+		if (*mem) {
+			result = 0;
+			break;
+		}
+
+		if (!TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
+			uint64_t now = os_time_get_ns();
+
+			remaining = now < deadline ? (os_timeout_t)(deadline - now) : 0;
+		}
+
+		result = os_sem_take(&mpool->wait, remaining);
 		if (result) {
-			os_mutex_unlock(&lock);
-			return result;
+			/* A block may have been released right before the timeout */
+			*mem = pool_take(mpool);
+			result = *mem ? 0 : result;
+			break;
 		}
+	}
 
-		__ASSERT_NO_MSG(mpool->free_list != NULL);
+	bt_atomic_dec(&mpool->waiters);
+	os_mutex_unlock(&mpool->lock);
 
-		*mem = mpool->free_list;
-		mpool->free_list = *(char **)(mpool->free_list);
-		mpool->info.num_used++;
+	return result;
+}
+
+int bt_mem_pool_alloc(struct bt_mem_pool *mpool, void **mem, os_timeout_t timeout)
+{
+	int result = 0;
+
+	*mem = mag_alloc(mpool);
+	if (!*mem) {
+		*mem = pool_take(mpool);
 	}
 
-	os_mutex_unlock(&lock);
+	if (*mem == NULL) {
+		if (TIMEOUT_EQ(timeout, OS_TIMEOUT_NO_WAIT)) {
+			/* don't wait for a free block to become available */
+			return -ENOMEM;
+		}
+
+		result = mem_pool_alloc_wait(mpool, mem, timeout);
+		if (result) {
+			*mem = NULL;
+			return result;
+		}
+	}
+
+	bt_atomic_inc(&mpool->info.num_used);
 
 	return result;
 }
 
 void bt_mem_pool_free(struct bt_mem_pool *mpool, void *mem)
 {
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	__ASSERT_NO_MSG(mem >= (void *)mpool->buffer &&
+			(char *)mem < mpool->buffer +
+					      mpool->info.num_blocks * mpool->info.block_size);
 
-	*(char **)mem = mpool->free_list;
-	mpool->free_list = (char *)mem;
-	mpool->info.num_used--;
+	bt_atomic_dec(&mpool->info.num_used);
 
-	(void)os_sem_give(&mpool->wait);
-
-	os_mutex_unlock(&lock);
+	if (!mag_free(mpool, mem)) {
+		mem_pool_release(mpool, mem);
+	}
 }
 
-STACK_INIT(mem_pool_list_init, STACK_BASE_INIT, 0);
\ No newline at end of file
+uint32_t bt_mem_pool_num_free_get(struct bt_mem_pool *mpool)
+{
+	return mpool->info.num_blocks - (uint32_t)bt_atomic_get(&mpool->info.num_used);
+}
@@ -2,26 +2,48 @@
 #define __BASE_MEM_POOL_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
+#include <base/bt_atomic.h>
 #include <osdep/os.h>
 
+/* Number of free blocks each thread may cache per pool; 0 disables the magazines. */
+#ifndef CONFIG_BT_MEM_POOL_MAGAZINE_SIZE
+#define CONFIG_BT_MEM_POOL_MAGAZINE_SIZE 0
+#endif
+
+/* Number of distinct pools a thread may cache blocks for at the same time. */
+#ifndef CONFIG_BT_MEM_POOL_MAGAZINE_SLOTS
+#define CONFIG_BT_MEM_POOL_MAGAZINE_SLOTS 4
+#endif
+
 struct bt_mem_pool_info {
 	uint32_t num_blocks;
 	size_t block_size;
-	uint32_t num_used;
+	bt_atomic_t num_used;
 };
 
 struct bt_mem_pool {
+	/* Signalled on free while allocators are blocked */
 	os_sem_t wait;
+	/* Serializes blocking allocators of this pool */
 	os_mutex_t lock;
 	char *buffer;
-	char *free_list;
+	/* Lock-free free list head: ABA tag in the upper half, block index + 1 in the lower */
+	bt_atomic_t free_head;
+	/* Blocks never handed out yet, carved in order once the free list runs dry */
+	bt_atomic_t uninit_count;
+	/* Number of allocators blocked in the slow path */
+	bt_atomic_t waiters;
+	/* wait is set up by the first blocking allocator of a statically defined pool */
+	bool wait_ready;
 	struct bt_mem_pool_info info;
 };
 
 #define BT_MEM_POOL_INITIALIZER(_pool, _pool_buffer, _pool_block_size, _pool_num_blocks)           \
 	{                                                                                          \
-		.lock = OS_MUTEX_INITIALIZER, .buffer = _pool_buffer, .free_list = NULL, .info = { \
+		.lock = OS_MUTEX_INITIALIZER, .buffer = _pool_buffer, .free_head = 0,              \
+		.uninit_count = _pool_num_blocks, .info = {                                        \
 			_pool_num_blocks,                                                          \
 			_pool_block_size,                                                          \
 			0                                                                          \
@@ -59,4 +81,10 @@ int bt_mem_pool_init(struct bt_mem_pool *mpool, void *buffer, size_t block_size,
 int bt_mem_pool_alloc(struct bt_mem_pool *mpool, void **mem, os_timeout_t timeout);
 void bt_mem_pool_free(struct bt_mem_pool *mpool, void *mem);
 
+/* Number of blocks not handed out to users (blocks parked in per-thread magazines included) */
+uint32_t bt_mem_pool_num_free_get(struct bt_mem_pool *mpool);
+
+/* Return all blocks cached by the calling thread to their pools */
+void bt_mem_pool_cache_flush(void);
+
 #endif /* __BASE_MEM_POOL_H__ */
\ No newline at end of file
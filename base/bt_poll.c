@@ -20,6 +20,7 @@
 #include <base/bt_poll.h>
 
 #include <osdep/os.h>
+#include <osdep/atomic/atomic.h>
 
 static os_mutex_t lock = OS_MUTEX_INITIALIZER;
 
@@ -62,6 +63,7 @@ static inline void register_event(struct bt_poll_event *event, struct bt_poller
 	case BT_POLL_TYPE_DATA_AVAILABLE:
 		__ASSERT_MSG(event->queue != NULL, "invalid queue\n");
 		add_event(&event->queue->poll_events, event, poller);
+		(void)os_atomic_word_fetch_add(&event->queue->pollers, 1, OS_ATOMIC_SEQ_CST);
 		break;
 	case BT_POLL_TYPE_SIGNAL:
 		__ASSERT_MSG(event->signal != NULL, "invalid poll signal\n");
@@ -88,6 +90,8 @@ static inline void clear_event_registration(struct bt_poll_event *event)
 	switch (event->type) {
 	case BT_POLL_TYPE_DATA_AVAILABLE:
 		__ASSERT_MSG(event->queue != NULL, "invalid queue\n");
+		/* Only ever called for registered events, see register_events() */
+		(void)os_atomic_word_fetch_sub(&event->queue->pollers, 1, OS_ATOMIC_SEQ_CST);
 		remove_event = true;
 		break;
 	case BT_POLL_TYPE_SIGNAL:
@@ -163,6 +167,15 @@ static inline int register_events(struct bt_poll_event *events, int num_events,
 		} else if (!just_check && poller->is_polling) {
 			register_event(&events[ii], poller);
 			events_registered += 1;
+
+			/* Lock-free queues publish data before looking for registered pollers,
+			 * re-check once registered so a racing insertion is never missed.
+			 */
+			os_atomic_thread_fence(OS_ATOMIC_SEQ_CST);
+			if (is_condition_met(&events[ii], &state)) {
+				set_event_ready(&events[ii], state);
+				poller->is_polling = false;
+			}
 		} else {
 			/* Event is not one of those identified in is_condition_met()
 			 * catching non-polling events, or is marked for just check,
@@ -231,8 +244,9 @@ int bt_poll(struct bt_poll_event *events, int num_events, os_timeout_t timeout)
 		return 0;
 	}
 
-	int ret = os_sem_take(&poller.sem, timeout);
+	/* Signalling needs the lock, the semaphore keeps a wakeup given before we block */
 	os_mutex_unlock(&lock);
+	int ret = os_sem_take(&poller.sem, timeout);
 
 	/*
 	 * Clear all event registrations. If events happen while we're in this
@@ -1,6 +1,7 @@
 
 #include <stdint.h>
 
+#include <base/bt_atomic.h>
 #include <base/bt_work.h>
 #include <osdep/os.h>
 
@@ -40,32 +41,103 @@ static inline uint32_t flags_get(const uint32_t *flagp)
 	return *flagp;
 }
 
-/* Lock to protect the internal state of all work items, work queues,
- * and pending_cancels.
+/* Lock domains.
+ *
+ * The state of a work item is protected by the lock of the queue it is
+ * bound to, i.e. the queue it was last submitted to, or by unbound_lock
+ * while it has never been submitted. An item only moves to another queue
+ * while it is neither queued nor running, and with the locks of both
+ * queues held, so holding either of them keeps work->queue stable.
+ * When two locks are needed they are taken in address order.
  */
-static os_mutex_t lock = OS_MUTEX_INITIALIZER;
+static os_mutex_t unbound_lock = OS_MUTEX_INITIALIZER;
+
+static inline os_mutex_t *queue_lock(struct bt_work_q *queue)
+{
+	return queue != NULL ? &queue->lock : &unbound_lock;
+}
+
+static inline struct bt_work_q *work_queue_peek(const struct bt_work *work)
+{
+	return bt_atomic_ptr_get((bt_atomic_ptr_t *)&work->queue);
+}
+
+static inline void work_queue_bind(struct bt_work *work, struct bt_work_q *queue)
+{
+	(void)bt_atomic_ptr_set((bt_atomic_ptr_t *)&work->queue, queue);
+}
+
+static void lock_pair(os_mutex_t *a, os_mutex_t *b)
+{
+	if (b == NULL || b == a) {
+		os_mutex_lock(a, OS_TIMEOUT_FOREVER);
+		return;
+	}
+
+	if ((uintptr_t)a > (uintptr_t)b) {
+		os_mutex_t *tmp = a;
+
+		a = b;
+		b = tmp;
+	}
+
+	os_mutex_lock(a, OS_TIMEOUT_FOREVER);
+	os_mutex_lock(b, OS_TIMEOUT_FOREVER);
+}
+
+static void unlock_pair(os_mutex_t *a, os_mutex_t *b)
+{
+	if (b != NULL && b != a) {
+		os_mutex_unlock(b);
+	}
+
+	os_mutex_unlock(a);
+}
+
+/* Lock the domain of @p work and, if not NULL, the queue @p target as well.
+ * Returns the queue the work is bound to, to be passed to work_unlock().
+ */
+static struct bt_work_q *work_lock(struct bt_work *work, struct bt_work_q *target)
+{
+	while (true) {
+		struct bt_work_q *queue = work_queue_peek(work);
+
+		lock_pair(queue_lock(queue), target != NULL ? &target->lock : NULL);
+		if (work->queue == queue) {
+			return queue;
+		}
+
+		/* Moved to another queue while we were waiting */
+		unlock_pair(queue_lock(queue), target != NULL ? &target->lock : NULL);
+	}
+}
+
+static inline void work_unlock(struct bt_work_q *queue, struct bt_work_q *target)
+{
+	unlock_pair(queue_lock(queue), target != NULL ? &target->lock : NULL);
+}
 
 /* Invoked by work thread */
 static void handle_flush(struct bt_work *work)
 {
 }
 
-static inline void init_flusher(struct bt_work_flusher *flusher)
+static inline void init_flusher(struct bt_work_flusher *flusher, struct bt_work *target)
 {
 	struct bt_work *work = &flusher->work;
 	os_sem_init(&flusher->sem, 0, 1);
 	bt_work_init(&flusher->work, handle_flush);
+	flusher->target = target;
 	flag_set(&work->flags, BT_WORK_FLUSHING_BIT);
 }
 
-/* List of pending cancellations. */
-static bt_slist_t pending_cancels = BT_SLIST_STATIC_INIT(pending_cancels);
-
 static inline void init_work_cancel(struct bt_work_canceller *canceler, struct bt_work *work)
 {
+	__ASSERT_NO_MSG(work->queue != NULL);
+
 	os_sem_init(&canceler->sem, 0, 1);
 	canceler->work = work;
-	bt_slist_append(&pending_cancels, &canceler->node);
+	bt_slist_append(&work->queue->cancels, &canceler->node);
 }
 
 static void finalize_flush_locked(struct bt_work *work)
@@ -77,7 +149,7 @@ static void finalize_flush_locked(struct bt_work *work)
 	os_sem_give(&flusher->sem);
 };
 
-static void finalize_cancel_locked(struct bt_work *work)
+static void finalize_cancel_locked(struct bt_work_q *queue, struct bt_work *work)
 {
 	struct bt_work_canceller *wc, *tmp;
 	bt_snode_t *prev = NULL;
@@ -87,9 +159,9 @@ static void finalize_cancel_locked(struct bt_work *work)
 	 */
 	flag_clear(&work->flags, BT_WORK_CANCELING_BIT);
 
-	BT_SLIST_FOR_EACH_CONTAINER_SAFE(&pending_cancels, wc, tmp, node) {
+	BT_SLIST_FOR_EACH_CONTAINER_SAFE(&queue->cancels, wc, tmp, node) {
 		if (wc->work == work) {
-			bt_slist_remove(&pending_cancels, prev, &wc->node);
+			bt_slist_remove(&queue->cancels, prev, &wc->node);
 			os_sem_give(&wc->sem);
 			break;
 		}
@@ -112,10 +184,10 @@ static inline int work_busy_get_locked(const struct bt_work *work)
 
 int bt_work_busy_get(const struct bt_work *work)
 {
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock((struct bt_work *)work, NULL);
 	int ret = work_busy_get_locked(work);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	return ret;
 }
@@ -123,7 +195,7 @@ int bt_work_busy_get(const struct bt_work *work)
 static void queue_flusher_locked(struct bt_work_q *queue, struct bt_work *work,
 				 struct bt_work_flusher *flusher)
 {
-	init_flusher(flusher);
+	init_flusher(flusher, work);
 
 	if ((flags_get(&work->flags) & BT_WORK_QUEUED) != 0U) {
 		bt_slist_insert(&queue->pending, &work->node, &flusher->work.node);
@@ -144,12 +216,29 @@ static inline bool notify_queue_locked(struct bt_work_q *queue)
 	bool rv = false;
 
 	if (queue != NULL) {
-		rv = os_sem_give(&queue->notifyq);
+		rv = os_cond_signal(&queue->notify) == 0;
 	}
 
 	return rv;
 }
 
+static bool queue_is_worker_locked(struct bt_work_q *queue, os_tid_t tid)
+{
+	if (tid == queue->thread_id) {
+		return true;
+	}
+
+#if CONFIG_BT_WORK_QUEUE_MAX_WORKERS > 1
+	for (uint8_t i = 0; i + 1 < queue->num_workers; i++) {
+		if (tid == queue->workers[i].thread_id) {
+			return true;
+		}
+	}
+#endif
+
+	return false;
+}
+
 static inline int queue_submit_locked(struct bt_work_q *queue, struct bt_work *work)
 {
 	if (queue == NULL) {
@@ -157,7 +246,7 @@ static inline int queue_submit_locked(struct bt_work_q *queue, struct bt_work *w
 	}
 
 	int ret;
-	bool chained = (os_thread_self() == queue->thread_id);
+	bool chained = queue_is_worker_locked(queue, os_thread_self());
 	bool draining = flag_test(&queue->flags, BT_WORK_QUEUE_DRAIN_BIT);
 	bool plugged = flag_test(&queue->flags, BT_WORK_QUEUE_PLUGGED_BIT);
 
@@ -183,6 +272,9 @@ static inline int queue_submit_locked(struct bt_work_q *queue, struct bt_work *w
 	return ret;
 }
 
+/* Called with the domain of @p work and the lock of the queue it ends up
+ * on held; see work_lock().
+ */
 static int submit_to_queue_locked(struct bt_work *work, struct bt_work_q **queuep)
 {
 	int ret = 0;
@@ -216,7 +308,9 @@ static int submit_to_queue_locked(struct bt_work *work, struct bt_work_q **queue
 			ret = rc;
 		} else {
 			flag_set(&work->flags, BT_WORK_QUEUED_BIT);
-			work->queue = *queuep;
+			if (work->queue != *queuep) {
+				work_queue_bind(work, *queuep);
+			}
 		}
 	} else {
 		/* Already queued, do nothing. */
@@ -234,11 +328,12 @@ static int work_submit_to_queue(struct bt_work_q *queue, struct bt_work *work)
 	__ASSERT_NO_MSG(work != NULL);
 	__ASSERT_NO_MSG(work->handler != NULL);
 
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *target = queue;
+	struct bt_work_q *bound = work_lock(work, target);
 
 	int ret = submit_to_queue_locked(work, &queue);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, target);
 
 	return ret;
 }
@@ -289,11 +384,11 @@ bool bt_work_flush(struct bt_work *work, struct bt_work_sync *sync)
 	__ASSERT_NO_MSG(sync != NULL);
 
 	struct bt_work_flusher *flusher = &sync->flusher;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(work, NULL);
 
 	bool need_flush = work_flush_locked(work, flusher);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	/* If necessary wait until the flusher item completes */
 	if (need_flush) {
@@ -340,9 +435,9 @@ int bt_work_cancel(struct bt_work *work)
 	__ASSERT_NO_MSG(work != NULL);
 	__ASSERT_NO_MSG(!flag_test(&work->flags, BT_WORK_DELAYABLE_BIT));
 
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(work, NULL);
 	int ret = cancel_async_locked(work);
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	return ret;
 }
@@ -354,7 +449,7 @@ bool bt_work_cancel_sync(struct bt_work *work, struct bt_work_sync *sync)
 	__ASSERT_NO_MSG(!flag_test(&work->flags, BT_WORK_DELAYABLE_BIT));
 
 	struct bt_work_canceller *canceller = &sync->canceller;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(work, NULL);
 	bool pending = (work_busy_get_locked(work) != 0U);
 	bool need_wait = false;
 
@@ -363,7 +458,7 @@ bool bt_work_cancel_sync(struct bt_work *work, struct bt_work_sync *sync)
 		need_wait = cancel_sync_locked(work, canceller);
 	}
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	if (need_wait) {
 		os_sem_take(&canceller->sem, OS_TIMEOUT_FOREVER);
@@ -372,84 +467,101 @@ bool bt_work_cancel_sync(struct bt_work *work, struct bt_work_sync *sync)
 	return pending;
 }
 
-/* Loop executed by a work queue thread.
- *
- * @param workq_ptr pointer to the work queue structure
+/* An item may not run while another worker runs it, and a flusher may not
+ * complete while the item it flushes is still running.
  */
-static void work_queue_main(void *workq_ptr)
+static bool work_runnable_locked(struct bt_work *work)
 {
-	struct bt_work_q *queue = (struct bt_work_q *)workq_ptr;
+	if (flag_test(&work->flags, BT_WORK_RUNNING_BIT)) {
+		return false;
+	}
 
-	queue->thread_id = os_thread_self();
+	if (flag_test(&work->flags, BT_WORK_FLUSHING_BIT)) {
+		struct bt_work_flusher *flusher = CONTAINER_OF(work, struct bt_work_flusher, work);
+
+		return flusher->target == NULL ||
+		       !flag_test(&flusher->target->flags, BT_WORK_RUNNING_BIT);
+	}
+
+	return true;
+}
+
+/* Take the first pending item that may run now. With a single worker that
+ * is always the head of the list.
+ */
+static struct bt_work *queue_next_locked(struct bt_work_q *queue)
+{
+	struct bt_work *work, *tmp;
+	bt_snode_t *prev = NULL;
+
+	BT_SLIST_FOR_EACH_CONTAINER_SAFE(&queue->pending, work, tmp, node) {
+		if (work_runnable_locked(work)) {
+			bt_slist_remove(&queue->pending, prev, &work->node);
+			return work;
+		}
+		prev = &work->node;
+	}
+
+	return NULL;
+}
+
+/* Loop executed by every worker thread of a work queue.
+ *
+ * @param queue pointer to the work queue structure
+ */
+static void work_queue_loop(struct bt_work_q *queue)
+{
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	while (true) {
-		bt_snode_t *node;
-		struct bt_work *work = NULL;
-		bt_work_handler_t handler = NULL;
-		os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+		struct bt_work *work;
+		bt_work_handler_t handler;
 		bool yield;
 
 		/* Check for and prepare any new work. */
-		node = bt_slist_get(&queue->pending);
-		if (node != NULL) {
-			/* Mark that there's some work active that's
-			 * not on the pending list.
-			 */
-			flag_set(&queue->flags, BT_WORK_QUEUE_BUSY_BIT);
-			work = CONTAINER_OF(node, struct bt_work, node);
-			flag_set(&work->flags, BT_WORK_RUNNING_BIT);
-			flag_clear(&work->flags, BT_WORK_QUEUED_BIT);
-
-			/* Static code analysis tool can raise a false-positive violation
-			 * in the line below that 'work' is checked for null after being
-			 * dereferenced.
-			 *
-			 * The work is figured out by CONTAINER_OF, as a container
-			 * of type struct bt_work that contains the node.
-			 * The only way for it to be NULL is if node would be a member
-			 * of struct bt_work object that has been placed at address NULL,
-			 * which should never happen, even line 'if (work != NULL)'
-			 * ensures that.
-			 * This means that if node is not NULL, then work will not be NULL.
-			 */
-			handler = work->handler;
-		} else if (flag_test_and_clear(&queue->flags, BT_WORK_QUEUE_DRAIN_BIT)) {
-			/* Not busy and draining: move threads waiting for
-			 * drain to ready state.  The held spinlock inhibits
-			 * immediate reschedule; released threads get their
-			 * chance when this invokes z_sched_wait() below.
-			 *
-			 * We don't touch BT_WORK_QUEUE_PLUGGABLE, so getting
-			 * here doesn't mean that the queue will allow new
-			 * submissions.
-			 */
-			os_sem_give(&queue->drainq);
-		} else if (flag_test(&queue->flags, BT_WORK_QUEUE_STOP_BIT)) {
-			/* User has requested that the queue stop. Clear the status flags and exit.
-			 */
-			flags_set(&queue->flags, 0);
-			os_mutex_unlock(&lock);
-			return;
-		} else {
-			/* No work is available and no queue state requires
-			 * special handling.
-			 */
-			;
-		}
-
+		work = queue_next_locked(queue);
 		if (work == NULL) {
-			/* Nothing's had a chance to add work since we took
-			 * the lock, and we didn't find work nor got asked to
-			 * stop.  Just go to sleep: when something happens the
-			 * work thread will be woken and we can check again.
+			if (queue->num_busy == 0 && bt_slist_is_empty(&queue->pending) &&
+			    flag_test_and_clear(&queue->flags, BT_WORK_QUEUE_DRAIN_BIT)) {
+				/* Not busy and draining: release the thread
+				 * waiting for the drain.
+				 *
+				 * We don't touch BT_WORK_QUEUE_PLUGGABLE, so
+				 * getting here doesn't mean that the queue will
+				 * allow new submissions.
+				 */
+				os_sem_give(&queue->drainq);
+			} else if (flag_test(&queue->flags, BT_WORK_QUEUE_STOP_BIT) &&
+				   bt_slist_is_empty(&queue->pending)) {
+				/* User has requested that the queue stop. The
+				 * last worker out clears the status flags.
+				 */
+				if (--queue->num_alive == 0) {
+					flags_set(&queue->flags, 0);
+				}
+				os_cond_broadcast(&queue->notify);
+				os_mutex_unlock(&queue->lock);
+				return;
+			}
+
+			/* Nothing runnable and no queue state requires
+			 * special handling. Sleep until something happens
+			 * and check again.
 			 */
-
-			os_mutex_unlock(&lock);
-			os_sem_take(&queue->notifyq, OS_TIMEOUT_FOREVER);
+			os_cond_wait(&queue->notify, &queue->lock, OS_TIMEOUT_FOREVER);
 			continue;
 		}
 
-		os_mutex_unlock(&lock);
+		/* Mark that there's some work active that's not on the
+		 * pending list.
+		 */
+		queue->num_busy++;
+		flag_set(&queue->flags, BT_WORK_QUEUE_BUSY_BIT);
+		flag_set(&work->flags, BT_WORK_RUNNING_BIT);
+		flag_clear(&work->flags, BT_WORK_QUEUED_BIT);
+		handler = work->handler;
+
+		os_mutex_unlock(&queue->lock);
 
 		__ASSERT_NO_MSG(handler != NULL);
 		handler(work);
@@ -459,28 +571,86 @@ static void work_queue_main(void *workq_ptr)
 		 * was running.  Clear the BUSY flag and optionally
 		 * yield to prevent starving other threads.
 		 */
-		os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+		os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 		flag_clear(&work->flags, BT_WORK_RUNNING_BIT);
 		if (flag_test(&work->flags, BT_WORK_FLUSHING_BIT)) {
 			finalize_flush_locked(work);
 		} else if (flag_test(&work->flags, BT_WORK_CANCELING_BIT)) {
-			finalize_cancel_locked(work);
+			finalize_cancel_locked(queue, work);
+		}
+
+		if (--queue->num_busy == 0) {
+			flag_clear(&queue->flags, BT_WORK_QUEUE_BUSY_BIT);
+		}
+
+		/* Items skipped while this one ran may be runnable now */
+		if (queue->num_workers > 1 && !bt_slist_is_empty(&queue->pending)) {
+			(void)notify_queue_locked(queue);
 		}
 
-		flag_clear(&queue->flags, BT_WORK_QUEUE_BUSY_BIT);
 		yield = !flag_test(&queue->flags, BT_WORK_QUEUE_NO_YIELD_BIT);
-		os_mutex_unlock(&lock);
 
 		/* Optionally yield to prevent the work queue from
 		 * starving other threads.
 		 */
 		if (yield) {
+			os_mutex_unlock(&queue->lock);
 			(void)os_thread_yield();
+			os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 		}
 	}
 }
 
+static void work_queue_main(void *workq_ptr)
+{
+	struct bt_work_q *queue = (struct bt_work_q *)workq_ptr;
+
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
+	queue->thread_id = os_thread_self();
+	os_mutex_unlock(&queue->lock);
+
+	work_queue_loop(queue);
+}
+
+#if CONFIG_BT_WORK_QUEUE_MAX_WORKERS > 1
+static void work_queue_worker(void *worker_ptr)
+{
+	struct bt_work_worker *worker = (struct bt_work_worker *)worker_ptr;
+
+	os_mutex_lock(&worker->queue->lock, OS_TIMEOUT_FOREVER);
+	worker->thread_id = os_thread_self();
+	os_mutex_unlock(&worker->queue->lock);
+
+	work_queue_loop(worker->queue);
+}
+#endif
+
+/* Common queue state setup; returns the queue flags to start with. */
+static uint32_t work_queue_setup(struct bt_work_q *queue, const struct bt_work_queue_config *cfg,
+				 uint8_t num_workers)
+{
+	uint32_t flags = BT_WORK_QUEUE_STARTED;
+
+	__ASSERT_MSG(num_workers <= CONFIG_BT_WORK_QUEUE_MAX_WORKERS,
+		     "num_workers exceeds CONFIG_BT_WORK_QUEUE_MAX_WORKERS");
+
+	if ((cfg != NULL) && cfg->no_yield) {
+		flags |= BT_WORK_QUEUE_NO_YIELD;
+	}
+
+	os_mutex_init(&queue->lock);
+	os_cond_init(&queue->notify);
+	bt_slist_init(&queue->pending);
+	bt_slist_init(&queue->cancels);
+	os_sem_init(&queue->drainq, 0, 1);
+	queue->num_workers = MIN(MAX(num_workers, 1), CONFIG_BT_WORK_QUEUE_MAX_WORKERS);
+	queue->num_alive = queue->num_workers;
+	queue->num_busy = 0;
+
+	return flags;
+}
+
 void bt_work_queue_init(struct bt_work_q *queue)
 {
 	__ASSERT_NO_MSG(queue != NULL);
@@ -488,28 +658,24 @@ void bt_work_queue_init(struct bt_work_q *queue)
 	*queue = (struct bt_work_q){
 		.flags = 0,
 	};
+	os_mutex_init(&queue->lock);
+	os_cond_init(&queue->notify);
 }
 
 void bt_work_queue_run(struct bt_work_q *queue, const struct bt_work_queue_config *cfg)
 {
 	__ASSERT_NO_MSG(!flag_test(&queue->flags, BT_WORK_QUEUE_STARTED_BIT));
 
-	uint32_t flags = BT_WORK_QUEUE_STARTED;
-
-	if ((cfg != NULL) && cfg->no_yield) {
-		flags |= BT_WORK_QUEUE_NO_YIELD;
-	}
+	/* The calling thread is the only worker */
+	uint32_t flags = work_queue_setup(queue, cfg, 1);
 
 	if ((cfg != NULL) && (cfg->name != NULL)) {
 		os_thread_name_set(&queue->thread, cfg->name);
 	}
 
-	bt_slist_init(&queue->pending);
-	os_sem_init(&queue->notifyq, 0, 1);
-	os_sem_init(&queue->drainq, 0, 1);
 	queue->thread_id = os_thread_self();
 	flags_set(&queue->flags, flags);
-	work_queue_main(queue);
+	work_queue_loop(queue);
 }
 
 void bt_work_queue_start(struct bt_work_q *queue, size_t stack_size, int prio,
@@ -518,15 +684,8 @@ void bt_work_queue_start(struct bt_work_q *queue, size_t stack_size, int prio,
 	__ASSERT_NO_MSG(queue);
 	__ASSERT_NO_MSG(!flag_test(&queue->flags, BT_WORK_QUEUE_STARTED_BIT));
 
-	uint32_t flags = BT_WORK_QUEUE_STARTED;
-
-	bt_slist_init(&queue->pending);
-	os_sem_init(&queue->notifyq, 0, 1);
-	os_sem_init(&queue->drainq, 0, 1);
-
-	if ((cfg != NULL) && cfg->no_yield) {
-		flags |= BT_WORK_QUEUE_NO_YIELD;
-	}
+	uint32_t cpu_mask = cfg != NULL ? cfg->cpu_mask : 0;
+	uint32_t flags = work_queue_setup(queue, cfg, cfg != NULL ? cfg->num_workers : 1);
 
 	/* It hasn't actually been started yet, but all the state is in place
 	 * so we can submit things and once the thread gets control it's ready
@@ -541,7 +700,25 @@ void bt_work_queue_start(struct bt_work_q *queue, size_t stack_size, int prio,
 		os_thread_name_set(&queue->thread, cfg->name);
 	}
 
+	if (cpu_mask != 0) {
+		(void)os_thread_affinity_set(&queue->thread, cpu_mask);
+	}
+
 	os_thread_start(&queue->thread);
+
+#if CONFIG_BT_WORK_QUEUE_MAX_WORKERS > 1
+	for (uint8_t i = 0; i + 1 < queue->num_workers; i++) {
+		struct bt_work_worker *worker = &queue->workers[i];
+
+		worker->queue = queue;
+		(void)os_thread_create(&worker->thread, work_queue_worker, worker,
+				       cfg ? cfg->name : NULL, prio, stack_size);
+		if (cpu_mask != 0) {
+			(void)os_thread_affinity_set(&worker->thread, cpu_mask);
+		}
+		os_thread_start(&worker->thread);
+	}
+#endif
 }
 
 int bt_work_queue_drain(struct bt_work_q *queue, bool plug)
@@ -549,7 +726,7 @@ int bt_work_queue_drain(struct bt_work_q *queue, bool plug)
 	__ASSERT_NO_MSG(queue);
 
 	int ret = 0;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	if (((flags_get(&queue->flags) & (BT_WORK_QUEUE_BUSY | BT_WORK_QUEUE_DRAIN)) != 0U) ||
 	    plug || !bt_slist_is_empty(&queue->pending)) {
@@ -558,11 +735,11 @@ int bt_work_queue_drain(struct bt_work_q *queue, bool plug)
 			flag_set(&queue->flags, BT_WORK_QUEUE_PLUGGED_BIT);
 		}
 
-		notify_queue_locked(queue);
-		os_mutex_unlock(&lock);
+		os_cond_broadcast(&queue->notify);
+		os_mutex_unlock(&queue->lock);
 		os_sem_take(&queue->drainq, OS_TIMEOUT_FOREVER);
 	} else {
-		os_mutex_unlock(&lock);
+		os_mutex_unlock(&queue->lock);
 	}
 
 	return ret;
@@ -573,13 +750,13 @@ int bt_work_queue_unplug(struct bt_work_q *queue)
 	__ASSERT_NO_MSG(queue);
 
 	int ret = -EALREADY;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	if (flag_test_and_clear(&queue->flags, BT_WORK_QUEUE_PLUGGED_BIT)) {
 		ret = 0;
 	}
 
-	os_mutex_unlock(&lock);
+	os_mutex_unlock(&queue->lock);
 
 	return ret;
 }
@@ -588,36 +765,70 @@ int bt_work_queue_stop(struct bt_work_q *queue, os_timeout_t timeout)
 {
 	__ASSERT_NO_MSG(queue);
 
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	int err;
+
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	if (!flag_test(&queue->flags, BT_WORK_QUEUE_STARTED_BIT)) {
-		os_mutex_unlock(&lock);
+		os_mutex_unlock(&queue->lock);
 		return -EALREADY;
 	}
 
 	if (!flag_test(&queue->flags, BT_WORK_QUEUE_PLUGGED_BIT)) {
-		os_mutex_unlock(&lock);
+		os_mutex_unlock(&queue->lock);
 		return -EBUSY;
 	}
 
 	flag_set(&queue->flags, BT_WORK_QUEUE_STOP_BIT);
-	notify_queue_locked(queue);
-	os_mutex_unlock(&lock);
-	if (os_thread_join(&queue->thread, timeout)) {
-		os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	os_cond_broadcast(&queue->notify);
+	os_mutex_unlock(&queue->lock);
+
+	err = os_thread_join(&queue->thread, timeout);
+#if CONFIG_BT_WORK_QUEUE_MAX_WORKERS > 1
+	for (uint8_t i = 0; !err && i + 1 < queue->num_workers; i++) {
+		err = os_thread_join(&queue->workers[i].thread, timeout);
+	}
+#endif
+
+	if (err) {
+		os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 		flag_clear(&queue->flags, BT_WORK_QUEUE_STOP_BIT);
-		os_mutex_unlock(&lock);
+		os_mutex_unlock(&queue->lock);
 		return -ETIMEDOUT;
 	}
 
 	return 0;
 }
 
-static void work_timeout(os_timer_t *timer, void *arg)
+/* Lock the domain of @p dwork together with the queue it is scheduled to be
+ * submitted to. Returns the bound queue; *targetp receives the extra queue
+ * locked, both to be passed to work_unlock().
+ */
+static struct bt_work_q *delayable_lock(struct bt_work_delayable *dwork,
+					struct bt_work_q **targetp)
+{
+	struct bt_work_q *target = NULL;
+
+	while (true) {
+		struct bt_work_q *bound = work_lock(&dwork->work, target);
+		struct bt_work_q *want = dwork->queue;
+
+		if (want == NULL || want == bound || want == target) {
+			*targetp = target;
+			return bound;
+		}
+
+		work_unlock(bound, target);
+		target = want;
+	}
+}
+
+void bt_work_timeout(os_timer_t *timer, void *arg)
 {
 	struct bt_work_delayable *dw = CONTAINER_OF(timer, struct bt_work_delayable, timeout);
 	struct bt_work *wp = &dw->work;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *target;
+	struct bt_work_q *bound = delayable_lock(dw, &target);
 	struct bt_work_q *queue = NULL;
 
 	/* If the work is still marked delayed (should be) then clear that
@@ -632,7 +843,7 @@ static void work_timeout(os_timer_t *timer, void *arg)
 		(void)submit_to_queue_locked(wp, &queue);
 	}
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, target);
 }
 
 void bt_work_init_delayable(struct bt_work_delayable *dwork, bt_work_handler_t handler)
@@ -647,7 +858,7 @@ void bt_work_init_delayable(struct bt_work_delayable *dwork, bt_work_handler_t h
 				.flags = BT_WORK_DELAYABLE,
 			},
 	};
-	os_timer_create(&dwork->timeout, work_timeout, NULL);
+	os_timer_create(&dwork->timeout, bt_work_timeout, NULL);
 	// TODO :delete timer when dwork is destroyed
 }
 
@@ -660,10 +871,10 @@ int bt_work_delayable_busy_get(const struct bt_work_delayable *dwork)
 {
 	__ASSERT_NO_MSG(dwork != NULL);
 
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock((struct bt_work *)&dwork->work, NULL);
 	int ret = work_delayable_busy_get_locked(dwork);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 	return ret;
 }
 
@@ -717,15 +928,16 @@ int bt_work_schedule_for_queue(struct bt_work_q *queue, struct bt_work_delayable
 	__ASSERT_NO_MSG(dwork != NULL);
 
 	struct bt_work *work = &dwork->work;
+	struct bt_work_q *target = queue;
 	int ret = 0;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(work, target);
 
 	/* Schedule the work item if it's idle or running. */
 	if ((work_busy_get_locked(work) & ~BT_WORK_RUNNING) == 0U) {
 		ret = schedule_for_queue_locked(&queue, dwork, delay);
 	}
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, target);
 
 	return ret;
 }
@@ -744,7 +956,8 @@ int bt_work_reschedule_for_queue(struct bt_work_q *queue, struct bt_work_delayab
 	__ASSERT_NO_MSG(dwork != NULL);
 
 	int ret;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *target = queue;
+	struct bt_work_q *bound = work_lock(&dwork->work, target);
 
 	/* Remove any active scheduling. */
 	(void)unschedule_locked(dwork);
@@ -752,7 +965,7 @@ int bt_work_reschedule_for_queue(struct bt_work_q *queue, struct bt_work_delayab
 	/* Schedule the work item with the new parameters. */
 	ret = schedule_for_queue_locked(&queue, dwork, delay);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, target);
 
 	return ret;
 }
@@ -769,10 +982,10 @@ int bt_work_cancel_delayable(struct bt_work_delayable *dwork)
 {
 	__ASSERT_NO_MSG(dwork != NULL);
 
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(&dwork->work, NULL);
 	int ret = cancel_delayable_async_locked(dwork);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	return ret;
 }
@@ -783,7 +996,7 @@ bool bt_work_cancel_delayable_sync(struct bt_work_delayable *dwork, struct bt_wo
 	__ASSERT_NO_MSG(sync != NULL);
 
 	struct bt_work_canceller *canceller = &sync->canceller;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *bound = work_lock(&dwork->work, NULL);
 	bool pending = (work_delayable_busy_get_locked(dwork) != 0U);
 	bool need_wait = false;
 
@@ -792,7 +1005,7 @@ bool bt_work_cancel_delayable_sync(struct bt_work_delayable *dwork, struct bt_wo
 		need_wait = cancel_sync_locked(&dwork->work, canceller);
 	}
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, NULL);
 
 	if (need_wait) {
 		os_sem_take(&canceller->sem, OS_TIMEOUT_FOREVER);
@@ -808,11 +1021,12 @@ bool bt_work_flush_delayable(struct bt_work_delayable *dwork, struct bt_work_syn
 
 	struct bt_work *work = &dwork->work;
 	struct bt_work_flusher *flusher = &sync->flusher;
-	os_mutex_lock(&lock, OS_TIMEOUT_FOREVER);
+	struct bt_work_q *target;
+	struct bt_work_q *bound = delayable_lock(dwork, &target);
 
 	/* If it's idle release the lock and return immediately. */
 	if (work_busy_get_locked(work) == 0U) {
-		os_mutex_unlock(&lock);
+		work_unlock(bound, target);
 
 		return false;
 	}
@@ -829,7 +1043,7 @@ bool bt_work_flush_delayable(struct bt_work_delayable *dwork, struct bt_work_syn
 	/* Wait for it to finish */
 	bool need_flush = work_flush_locked(work, flusher);
 
-	os_mutex_unlock(&lock);
+	work_unlock(bound, target);
 
 	/* If necessary wait until the flusher item completes */
 	if (need_flush) {
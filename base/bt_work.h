@@ -8,6 +8,10 @@
 
 #include <utils/bt_slist.h>
 
+#ifndef CONFIG_BT_WORK_QUEUE_MAX_WORKERS
+#define CONFIG_BT_WORK_QUEUE_MAX_WORKERS 4
+#endif
+
 struct bt_work_delayable;
 struct bt_work_sync;
 struct bt_work_q;
@@ -84,12 +88,16 @@ struct bt_work_delayable {
 	struct bt_work_q *queue;
 };
 
+/* Timer expiry handler of delayable work; internal, used by the initializer below. */
+void bt_work_timeout(os_timer_t *timer, void *arg);
+
 #define BT_WORK_DELAYABLE_INITIALIZER(work_handler)                                                \
 	{                                                                                          \
 		.work = {                                                                          \
 			.handler = (work_handler),                                                 \
 			.flags = BT_WORK_DELAYABLE,                                                \
 		},                                                                                 \
+		.timeout = OS_TIMER_INITIALIZER(bt_work_timeout, NULL),                            \
 	}
 
 #define BT_WORK_DELAYABLE_DEFINE(work, work_handler)                                               \
@@ -97,6 +105,8 @@ struct bt_work_delayable {
 
 struct bt_work_flusher {
 	struct bt_work work;
+	/* The item being flushed; the flusher does not run while it runs. */
+	struct bt_work *target;
 	os_sem_t sem;
 };
 
@@ -125,11 +135,31 @@ struct bt_work_queue_config {
 	bool essential;
 
 	uint32_t work_timeout_ms;
+
+	/** Number of worker threads, 0 is treated as 1. Distinct items run
+	 * in parallel, an item never runs concurrently with itself. At most
+	 * CONFIG_BT_WORK_QUEUE_MAX_WORKERS.
+	 */
+	uint8_t num_workers;
+
+	/** CPUs the worker threads may run on (bit n: CPU n), 0 for no
+	 * restriction. Not applied to the thread calling bt_work_queue_run().
+	 */
+	uint32_t cpu_mask;
+};
+
+/* An additional worker thread of a bt_work_q. */
+struct bt_work_worker {
+	os_thread_t thread;
+	os_tid_t thread_id;
+	struct bt_work_q *queue;
 };
 
 /** @brief A structure used to hold work until it can be processed. */
 struct bt_work_q {
-	/* The thread that animates the work. */
+	/* The thread that animates the work; the first worker of a
+	 * multi-worker queue.
+	 */
 	os_thread_t thread;
 
 	/* The thread ID that animates the work. This may be an external thread
@@ -137,19 +167,34 @@ struct bt_work_q {
 	 */
 	os_tid_t thread_id;
 
-	/* All the following fields must be accessed only while the
-	 * work module spinlock is held.
+#if CONFIG_BT_WORK_QUEUE_MAX_WORKERS > 1
+	/* Additional worker threads of a multi-worker queue. */
+	struct bt_work_worker workers[CONFIG_BT_WORK_QUEUE_MAX_WORKERS - 1];
+#endif
+
+	/* Protects the queue and the state of every work item bound to it
+	 * (submitted to it last). All the following fields must be accessed
+	 * only while it is held.
 	 */
+	os_mutex_t lock;
 
 	/* List of bt_work items to be worked. */
 	bt_slist_t pending;
 
-	/* Wait queue for idle work thread. */
-	os_sem_t notifyq;
+	/* Pending cancellations of items bound to this queue. */
+	bt_slist_t cancels;
+
+	/* Wait queue for idle work threads. */
+	os_cond_t notify;
 
 	/* Wait queue for threads waiting for the queue to drain. */
 	os_sem_t drainq;
 
+	/* Configured and live worker threads, items being run. */
+	uint8_t num_workers;
+	uint8_t num_alive;
+	uint8_t num_busy;
+
 	/* Flags describing queue state. */
 	uint32_t flags;
 };
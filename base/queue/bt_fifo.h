@@ -14,10 +14,19 @@ struct bt_fifo {
 		._queue = BT_QUEUE_INITIALIZER(obj._queue)                                         \
 	}
 
+#define BT_FIFO_MPSC_INITIALIZER(obj)                                                              \
+	{                                                                                          \
+		._queue = BT_QUEUE_MPSC_INITIALIZER(obj._queue)                                    \
+	}
+
 #define BT_FIFO_DEFINE(name) struct bt_fifo name = BT_FIFO_INITIALIZER(name)
 
+#define BT_FIFO_MPSC_DEFINE(name) struct bt_fifo name = BT_FIFO_MPSC_INITIALIZER(name)
+
 #define bt_fifo_init(fifo) ({ bt_queue_init(&(fifo)->_queue); })
 
+#define bt_fifo_init_mpsc(fifo) ({ bt_queue_init_mpsc(&(fifo)->_queue); })
+
 #define bt_fifo_cancel_wait(fifo) ({ bt_queue_cancel_wait(&(fifo)->_queue); })
 
 #define bt_fifo_put(fifo, data) ({ bt_queue_append(&(fifo)->_queue, data); })
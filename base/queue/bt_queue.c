@@ -2,6 +2,176 @@
 #include <errno.h>
 
 #include "base/queue/bt_queue.h"
+#include "base/bt_poll.h"
+#include "osdep/atomic/atomic.h"
+
+/* ===== Shared wakeup helpers ===== */
+
+static inline unsigned long waiters_get(struct bt_queue *queue)
+{
+	return os_atomic_word_load(&queue->waiters, OS_ATOMIC_SEQ_CST);
+}
+
+static void queue_poll_notify(struct bt_queue *queue, uint32_t state)
+{
+	/* Pairs with the fence bt_poll() issues between registering and re-checking the queue,
+	 * so either the poller sees the new data or we see its registration.
+	 */
+	os_atomic_thread_fence(OS_ATOMIC_SEQ_CST);
+	if (os_atomic_word_load(&queue->pollers, OS_ATOMIC_SEQ_CST) == 0) {
+		return;
+	}
+
+	bt_poll_handle_obj_events(&queue->poll_events, state);
+}
+
+/* Sleep on the queue until signalled, cancelled or past the deadline, called with lock held.
+ * Returns false once the wait is over for good.
+ */
+static bool queue_wait(struct bt_queue *queue, os_timeout_t timeout, uint64_t deadline)
+{
+	os_timeout_t remaining = timeout;
+	int rc;
+
+	if (queue->cancelled) {
+		queue->cancelled = false;
+		return false;
+	}
+
+	if (!TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
+		uint64_t now = os_time_get_ns();
+
+		if (now >= deadline) {
+			return false;
+		}
+		remaining = (os_timeout_t)(deadline - now);
+	}
+
+	rc = os_cond_wait(&queue->cond, &queue->lock, remaining);
+
+	return rc == 0 || rc == -EINTR;
+}
+
+/* ===== Lock-free MPSC list =====
+ *
+ * Intrusive Vyukov queue: producers swap themselves into the tail and then link the previous
+ * tail to their node, the single consumer follows the links from the head. The stub node keeps
+ * the list non-empty so the last item can be detached without racing producers.
+ */
+
+static inline bt_snode_t *mpsc_next(bt_snode_t *node)
+{
+	return os_atomic_ptr_get((void *volatile *)&node->next);
+}
+
+static void mpsc_push(struct bt_queue *queue, bt_snode_t *node)
+{
+	bt_snode_t *prev;
+
+	node->next = NULL;
+	prev = os_atomic_ptr_set((void *volatile *)&queue->tail, node);
+	(void)os_atomic_ptr_set((void *volatile *)&prev->next, node);
+}
+
+/* NULL when empty, and also while the producer of the next item has swapped the tail but not
+ * linked its node yet: the consumer may have preempted it, so it does not wait. The producer
+ * wakes the consumer once the node is linked.
+ */
+static bt_snode_t *mpsc_pop(struct bt_queue *queue)
+{
+	bt_snode_t *head = queue->head;
+	bt_snode_t *next = mpsc_next(head);
+
+	if (head == &queue->stub) {
+		if (!next) {
+			return NULL;
+		}
+
+		queue->head = next;
+		head = next;
+		next = mpsc_next(next);
+	}
+
+	if (!next) {
+		if (os_atomic_ptr_get((void *volatile *)&queue->tail) != head) {
+			/* A producer swapped the tail but has not linked its node yet */
+			return NULL;
+		}
+
+		/* head is the last item: queue the stub behind it so it can be detached */
+		mpsc_push(queue, &queue->stub);
+
+		next = mpsc_next(head);
+		if (!next) {
+			/* Another producer got in before the stub */
+			return NULL;
+		}
+	}
+
+	queue->head = next;
+
+	return head;
+}
+
+static void *mpsc_get_nowait(struct bt_queue *queue)
+{
+	bt_snode_t *node = bt_slist_get(&queue->list);
+
+	return node ? node : mpsc_pop(queue);
+}
+
+/* Move everything published so far into the consumer stash, keeping the order */
+static void mpsc_drain(struct bt_queue *queue)
+{
+	bt_snode_t *node;
+
+	while ((node = mpsc_pop(queue))) {
+		bt_slist_append(&queue->list, node);
+	}
+}
+
+static void mpsc_append(struct bt_queue *queue, bt_snode_t *node)
+{
+	mpsc_push(queue, node);
+
+	/* Pairs with the consumer registering as waiter before re-checking the list */
+	if (waiters_get(queue) != 0) {
+		os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
+		os_cond_signal(&queue->cond);
+		os_mutex_unlock(&queue->lock);
+	}
+
+	queue_poll_notify(queue, BT_POLL_STATE_DATA_AVAILABLE);
+}
+
+static void *mpsc_get(struct bt_queue *queue, os_timeout_t timeout)
+{
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
+	void *ret;
+
+	ret = mpsc_get_nowait(queue);
+	if (ret || TIMEOUT_EQ(timeout, OS_TIMEOUT_NO_WAIT)) {
+		return ret;
+	}
+
+	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
+	(void)os_atomic_word_fetch_add(&queue->waiters, 1, OS_ATOMIC_SEQ_CST);
+
+	while (!(ret = mpsc_pop(queue))) {
+		if (!queue_wait(queue, timeout, deadline)) {
+			/* An item may have been appended right before the timeout */
+			ret = mpsc_pop(queue);
+			break;
+		}
+	}
+
+	(void)os_atomic_word_fetch_sub(&queue->waiters, 1, OS_ATOMIC_SEQ_CST);
+	os_mutex_unlock(&queue->lock);
+
+	return ret;
+}
+
+/* ===== Public API ===== */
 
 void bt_queue_init(struct bt_queue *queue)
 {
@@ -9,11 +179,29 @@ void bt_queue_init(struct bt_queue *queue)
 		return;
 	}
 	bt_slist_init(&queue->list);
+	bt_dlist_init(&queue->poll_events);
+	queue->pollers = 0;
+	queue->waiters = 0;
+	queue->cancelled = false;
+	queue->mpsc = false;
 	/* Initialize lock and cond */
 	(void)os_mutex_init(&queue->lock);
 	(void)os_cond_init(&queue->cond);
 }
 
+void bt_queue_init_mpsc(struct bt_queue *queue)
+{
+	if (!queue) {
+		return;
+	}
+
+	bt_queue_init(queue);
+	queue->mpsc = true;
+	queue->stub.next = NULL;
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+}
+
 void bt_queue_append(struct bt_queue *queue, void *data)
 {
 	if (!queue) {
@@ -27,11 +215,18 @@ void bt_queue_append(struct bt_queue *queue, void *data)
 		return;
 	}
 
+	if (queue->mpsc) {
+		mpsc_append(queue, n);
+		return;
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 	bt_slist_append(&queue->list, n);
 	/* Wake one waiter */
 	os_cond_signal(&queue->cond);
 	os_mutex_unlock(&queue->lock);
+
+	queue_poll_notify(queue, BT_POLL_STATE_DATA_AVAILABLE);
 }
 
 void bt_queue_cancel_wait(struct bt_queue *queue)
@@ -40,8 +235,13 @@ void bt_queue_cancel_wait(struct bt_queue *queue)
 		return;
 	}
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
-	os_cond_signal(&queue->cond);
+	if (waiters_get(queue) != 0) {
+		queue->cancelled = true;
+		os_cond_signal(&queue->cond);
+	}
 	os_mutex_unlock(&queue->lock);
+
+	queue_poll_notify(queue, BT_POLL_STATE_CANCELLED);
 }
 
 void bt_queue_prepend(struct bt_queue *queue, void *data)
@@ -54,11 +254,20 @@ void bt_queue_prepend(struct bt_queue *queue, void *data)
 	if (!n) {
 		return;
 	}
+
+	if (queue->mpsc) {
+		/* Consumer only: the stash is served before the lock-free list */
+		bt_slist_prepend(&queue->list, n);
+		return;
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 	bt_slist_prepend(&queue->list, n);
 	/* Wake one waiter */
 	os_cond_signal(&queue->cond);
 	os_mutex_unlock(&queue->lock);
+
+	queue_poll_notify(queue, BT_POLL_STATE_DATA_AVAILABLE);
 }
 
 static void *pop_head_unlocked(struct bt_queue *queue)
@@ -77,7 +286,11 @@ void *bt_queue_get(struct bt_queue *queue, os_timeout_t timeout)
 		return NULL;
 	}
 
-	int32_t wait_ms = (int32_t)timeout;
+	if (queue->mpsc) {
+		return mpsc_get(queue, timeout);
+	}
+
+	uint64_t deadline = os_time_get_ns() + (uint64_t)timeout;
 	void *ret = NULL;
 
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
@@ -95,32 +308,14 @@ void *bt_queue_get(struct bt_queue *queue, os_timeout_t timeout)
 		return NULL;
 	}
 
-	if (TIMEOUT_EQ(timeout, OS_TIMEOUT_FOREVER)) {
-		/* Block until something arrives */
-		while (bt_slist_is_empty(&queue->list)) {
-			int rc = os_cond_wait(&queue->cond, &queue->lock, OS_TIMEOUT_FOREVER);
-			if (rc != 0 && rc != -EINTR) {
-				/* Unexpected error: break and return NULL */
-				break;
-			}
-		}
-	} else {
-		/* Timed wait in ms */
-		int32_t remaining = wait_ms;
-		while (bt_slist_is_empty(&queue->list)) {
-			int rc = os_cond_wait(&queue->cond, &queue->lock, remaining);
-			if (rc == -ETIMEDOUT) {
-				break;
-			}
-			if (rc != 0 && rc != -EINTR) {
-				break;
-			}
-			/* On EINTR, loop and wait for the remaining time;
-			 * os_cond_wait already accounts for absolute time */
-			/* For simplicity, treat EINTR as spurious and continue
-			 */
+	/* Block until something arrives, the wait is cancelled or the timeout expires */
+	(void)os_atomic_word_fetch_add(&queue->waiters, 1, OS_ATOMIC_SEQ_CST);
+	while (bt_slist_is_empty(&queue->list)) {
+		if (!queue_wait(queue, timeout, deadline)) {
+			break;
 		}
 	}
+	(void)os_atomic_word_fetch_sub(&queue->waiters, 1, OS_ATOMIC_SEQ_CST);
 
 	ret = pop_head_unlocked(queue);
 
@@ -133,6 +328,20 @@ void *bt_queue_peek_head(struct bt_queue *queue)
 	if (!queue) {
 		return NULL;
 	}
+
+	if (queue->mpsc) {
+		bt_snode_t *node = bt_slist_peek_head(&queue->list);
+
+		if (!node) {
+			node = mpsc_pop(queue);
+			if (node) {
+				bt_slist_prepend(&queue->list, node);
+			}
+		}
+
+		return node;
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 	bt_snode_t *node = bt_slist_peek_head(&queue->list);
 	void *ret = NULL;
@@ -148,6 +357,12 @@ void *bt_queue_peek_tail(struct bt_queue *queue)
 	if (!queue) {
 		return NULL;
 	}
+
+	if (queue->mpsc) {
+		mpsc_drain(queue);
+		return bt_slist_peek_tail(&queue->list);
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 	bt_snode_t *node = bt_slist_peek_tail(&queue->list);
 	void *ret = NULL;
@@ -167,6 +382,11 @@ bool bt_queue_remove(struct bt_queue *queue, void *data)
 	bt_snode_t *cur = queue->list.head;
 	bt_snode_t *prev = NULL;
 
+	if (queue->mpsc) {
+		mpsc_drain(queue);
+		return bt_slist_find_and_remove(&queue->list, data);
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	BT_SLIST_FOR_EACH_NODE_SAFE(&queue->list, cur, next) {
@@ -188,6 +408,24 @@ bool bt_queue_unique_append(struct bt_queue *queue, void *data)
 		return false;
 	}
 
+	if (queue->mpsc) {
+		bt_snode_t *cur;
+
+		if (!data) {
+			return false;
+		}
+
+		mpsc_drain(queue);
+		BT_SLIST_FOR_EACH_NODE(&queue->list, cur) {
+			if (cur == (bt_snode_t *)data) {
+				return false;
+			}
+		}
+
+		bt_slist_append(&queue->list, data);
+		return true;
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 
 	/* Check for existence */
@@ -210,6 +448,8 @@ bool bt_queue_unique_append(struct bt_queue *queue, void *data)
 	os_cond_signal(&queue->cond);
 
 	os_mutex_unlock(&queue->lock);
+
+	queue_poll_notify(queue, BT_POLL_STATE_DATA_AVAILABLE);
 	return true;
 }
 
@@ -218,6 +458,12 @@ bool bt_queue_is_empty(struct bt_queue *queue)
 	if (!queue) {
 		return true;
 	}
+
+	if (queue->mpsc) {
+		return bt_slist_is_empty(&queue->list) &&
+		       os_atomic_ptr_get((void *volatile *)&queue->tail) == &queue->stub;
+	}
+
 	os_mutex_lock(&queue->lock, OS_TIMEOUT_FOREVER);
 	bool empty = bt_slist_is_empty(&queue->list);
 	os_mutex_unlock(&queue->lock);
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "base/bt_atomic.h"
 #include "osdep/os.h"
 #include "utils/bt_slist.h"
 
@@ -13,10 +14,17 @@ extern "C" {
 
 /* Opaque queue type for consumers */
 struct bt_queue {
-	bt_slist_t list; /* singly linked list of queue_node */
+	bt_slist_t list; /* singly linked list of queue_node, consumer stash in MPSC mode */
 	os_mutex_t lock;  /* protects list & cond */
 	os_cond_t cond;   /* signaled when data becomes available */
 	bt_dlist_t poll_events;
+	bt_atomic_t pollers;   /* bt_poll() registrations, lets producers skip the poll lock */
+	bt_atomic_t waiters;   /* getters blocked on cond, read lock-free by MPSC producers */
+	bool cancelled;        /* bt_queue_cancel_wait() pending, protected by lock */
+	bool mpsc;             /* lock-free multi-producer/single-consumer mode */
+	bt_snode_t stub;       /* MPSC: placeholder node keeping the list non-empty */
+	bt_snode_t *head;      /* MPSC: consumer end, owned by the consumer */
+	bt_snode_t *tail;      /* MPSC: producer end, swapped atomically */
 };
 
 #define BT_QUEUE_INITIALIZER(obj)                                                                  \
@@ -26,14 +34,32 @@ struct bt_queue {
 		.poll_events = BT_DLIST_STATIC_INIT(&obj.poll_events),                            \
 	}
 
+#define BT_QUEUE_MPSC_INITIALIZER(obj)                                                             \
+	{                                                                                          \
+		.list = BT_SLIST_STATIC_INIT(&obj.list), .lock = OS_MUTEX_INITIALIZER,            \
+		.cond = OS_COND_INITIALIZER,                                                       \
+		.poll_events = BT_DLIST_STATIC_INIT(&obj.poll_events), .mpsc = true,              \
+		.head = &obj.stub, .tail = &obj.stub,                                              \
+	}
+
 /* Initialize a queue object */
 void bt_queue_init(struct bt_queue *queue);
 
+/* Initialize a queue in lock-free multi-producer/single-consumer mode.
+ *
+ * Appends from any thread and gets from the single consumer thread never take
+ * a lock; the consumer only parks on the queue's condition variable when the
+ * queue is empty. Prepend, remove, unique_append and peek_head/tail must be
+ * called from the consumer thread.
+ */
+void bt_queue_init_mpsc(struct bt_queue *queue);
+
 /* Append item to tail (FIFO) */
 void bt_queue_append(struct bt_queue *queue, void *data);
 
 void bt_queue_prepend(struct bt_queue *queue, void *data);
 
+/* Make the first blocked bt_queue_get() return NULL and cancel pollers */
 void bt_queue_cancel_wait(struct bt_queue *queue);
 
 /* Remove and return head item; blocks up to timeout if empty. */
@@ -6291,8 +6291,8 @@ int bt_l2cap_br_echo_req(struct bt_conn *conn, struct bt_buf *buf)
 
 	LOG_DBG("ACL conn %p buf %p len %u", conn, buf, buf->len);
 
-	if (buf->ref != 1) {
-		LOG_WRN("Expecting 1 ref, got %d", buf->ref);
+	if (bt_atomic_get(&buf->ref) != 1) {
+		LOG_WRN("Expecting 1 ref, got %lu", bt_atomic_get(&buf->ref));
 		return -EINVAL;
 	}
 
@@ -6348,8 +6348,8 @@ int bt_l2cap_br_echo_rsp(struct bt_conn *conn, uint8_t identifier, struct bt_buf
 
 	LOG_DBG("ACL conn %p buf %p len %u", conn, buf, buf->len);
 
-	if (buf->ref != 1) {
-		LOG_WRN("Expecting 1 ref, got %d", buf->ref);
+	if (bt_atomic_get(&buf->ref) != 1) {
+		LOG_WRN("Expecting 1 ref, got %lu", bt_atomic_get(&buf->ref));
 		return -EINVAL;
 	}
 
@@ -6462,8 +6462,8 @@ int bt_l2cap_br_connless_send(struct bt_conn *conn, uint16_t psm, struct bt_buf
 
 	LOG_DBG("ACL conn %p buf %p len %u", conn, buf, buf->len);
 
-	if (buf->ref != 1) {
-		LOG_WRN("Expecting 1 ref, got %d", buf->ref);
+	if (bt_atomic_get(&buf->ref) != 1) {
+		LOG_WRN("Expecting 1 ref, got %lu", bt_atomic_get(&buf->ref));
 		return -EINVAL;
 	}
 
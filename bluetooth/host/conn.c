@@ -284,13 +284,13 @@ static void tx_notify_process(struct bt_conn *conn)
 		bt_conn_tx_cb_t cb;
 		void *user_data;
 
-		os_sched_lock();
+		os_mutex_lock(&conn->tx_lock, OS_TIMEOUT_FOREVER);
 		if (!bt_slist_is_empty(&conn->tx_complete)) {
 			const bt_snode_t *node = bt_slist_get_not_empty(&conn->tx_complete);
 
 			tx = CONTAINER_OF(node, struct bt_conn_tx, node);
 		}
-		os_sched_unlock();
+		os_mutex_unlock(&conn->tx_lock);
 
 		if (!tx) {
 			return;
@@ -342,6 +342,8 @@ void bt_conn_tx_notify(struct bt_conn *conn, bool wait_for_completion)
 #endif /* CONFIG_BT_CONN_TX */
 }
 
+static struct bt_conn_handle_map conn_handles;
+
 struct bt_conn *bt_conn_new(struct bt_conn *conns, size_t size)
 {
 	struct bt_conn *conn = NULL;
@@ -358,6 +360,11 @@ struct bt_conn *bt_conn_new(struct bt_conn *conns, size_t size)
 		return NULL;
 	}
 
+	/* Released without going through a state without a handle */
+	if (bt_conn_is_handle_valid(conn)) {
+		bt_conn_handle_map_remove(&conn_handles, conn);
+	}
+
 	(void)memset(conn, 0, offsetof(struct bt_conn, ref));
 
 #if defined(CONFIG_BT_CONN)
@@ -514,7 +521,7 @@ enum {
 	FRAG_END
 };
 
-static int send_acl(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
+static int acl_hdr_push(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
 {
 	struct bt_hci_acl_hdr *hdr;
 
@@ -537,7 +544,7 @@ static int send_acl(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
 
 	bt_buf_push_u8(buf, BT_HCI_H4_ACL);
 
-	return bt_send(buf);
+	return 0;
 }
 
 static enum bt_iso_timestamp contains_iso_timestamp(struct bt_buf *buf)
@@ -554,7 +561,7 @@ static enum bt_iso_timestamp contains_iso_timestamp(struct bt_buf *buf)
 	return ts;
 }
 
-static int send_iso(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
+static int iso_hdr_push(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
 {
 	struct bt_hci_iso_hdr *hdr;
 	enum bt_iso_timestamp ts;
@@ -595,7 +602,7 @@ static int send_iso(struct bt_conn *conn, struct bt_buf *buf, uint8_t flags)
 
 	bt_buf_push_u8(buf, BT_HCI_H4_ISO);
 
-	return bt_send(buf);
+	return 0;
 }
 
 static inline uint16_t conn_mtu(struct bt_conn *conn)
@@ -640,6 +647,104 @@ static bool is_acl_conn(struct bt_conn *conn)
 	return is_le_conn(conn) || is_classic_conn(conn);
 }
 
+/* Fragments the TX processor sends per run, up to CONFIG_BT_CONN_TX_BURST */
+static volatile size_t tx_burst = CONFIG_BT_CONN_TX_BURST;
+
+/* Fragments of the current TX processor run, handed to the driver together */
+static struct {
+	struct bt_buf *frags[CONFIG_BT_CONN_TX_BURST];
+	struct {
+		struct bt_conn *conn;
+		struct bt_conn_tx *tx;
+		/* The parent buffer is still queued for its next fragment */
+		bool parent_queued;
+	} sent[CONFIG_BT_CONN_TX_BURST];
+	size_t count;
+} tx_batch;
+
+/* Takes back a fragment the driver did not take */
+static void tx_unsend(struct bt_conn *conn, struct bt_buf *frag, struct bt_conn_tx *tx)
+{
+	/* Remove buf from pending list */
+	bt_atomic_dec(&conn->in_ll);
+	os_mutex_lock(&conn->tx_lock, OS_TIMEOUT_FOREVER);
+	(void)bt_slist_find_and_remove(&conn->tx_pending, &tx->node);
+	os_mutex_unlock(&conn->tx_lock);
+
+	/* If we get here, something has seriously gone wrong: the `parent` buf
+	 * (of which the current fragment belongs) should also be destroyed.
+	 */
+	bt_buf_unref(frag);
+
+	/* `buf` might not get destroyed right away because it may
+	 * still be on a conn tx_queue, and its `tx` pointer will still
+	 * be reachable. Make sure that we don't try to use the
+	 * destroyed context later.
+	 */
+	conn_tx_destroy(conn, tx);
+	os_sem_give(bt_conn_get_pkts(conn));
+}
+
+static void tx_batch_add(struct bt_conn *conn, struct bt_buf *buf, struct bt_buf *frag,
+			 struct bt_conn_tx *tx)
+{
+	__ASSERT_NO_MSG(tx_batch.count < ARRAY_SIZE(tx_batch.frags));
+
+	tx_batch.frags[tx_batch.count] = frag;
+	tx_batch.sent[tx_batch.count].conn = bt_conn_ref(conn);
+	tx_batch.sent[tx_batch.count].tx = tx;
+	/* One reference went to the view, any other is the upper layer's queue */
+	tx_batch.sent[tx_batch.count].parent_queued = bt_atomic_get(&buf->ref) > 1;
+	tx_batch.count++;
+}
+
+/* Whether a batched fragment of conn still holds the view on a buffer the
+ * next pull may return again: the next fragment of a PDU, or the next
+ * segment of an SDU.
+ */
+static bool tx_batch_holds_view(struct bt_conn *conn)
+{
+	for (size_t i = 0; i < tx_batch.count; i++) {
+		if (tx_batch.sent[i].conn == conn && tx_batch.sent[i].parent_queued) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void tx_batch_flush(void)
+{
+	size_t taken;
+
+	if (!tx_batch.count) {
+		return;
+	}
+
+	taken = bt_send_batch(tx_batch.frags, tx_batch.count);
+
+	for (size_t i = 0; i < tx_batch.count; i++) {
+		struct bt_conn *conn = tx_batch.sent[i].conn;
+
+		if (i >= taken) {
+			LOG_ERR("Unable to send to driver");
+			tx_unsend(conn, tx_batch.frags[i], tx_batch.sent[i].tx);
+
+			LOG_ERR("Fatal error (%d). Disconnecting %p", -EIO, conn);
+			bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		}
+
+		bt_conn_unref(conn);
+	}
+
+	tx_batch.count = 0;
+}
+
+void bt_conn_tx_burst_set(size_t frags)
+{
+	tx_burst = CLAMP(frags, 1, CONFIG_BT_CONN_TX_BURST);
+}
+
 static int send_buf(struct bt_conn *conn, struct bt_buf *buf,
 		    size_t len, bt_conn_tx_cb_t cb, void *ud)
 {
@@ -699,7 +804,7 @@ static int send_buf(struct bt_conn *conn, struct bt_buf *buf,
 	 * from the conn tx_queue). It would be 2 if the
 	 * tx_data_pull kept it on the tx_queue for segmentation.
 	 */
-	__ASSERT_NO_MSG((buf->ref == 1) || (buf->ref == 2));
+	__ASSERT_NO_MSG((bt_atomic_get(&buf->ref) == 1) || (bt_atomic_get(&buf->ref) == 2));
 
 	/* The reference is always transferred to the frag, so when
 	 * the frag is destroyed, the parent reference is decremented.
@@ -735,39 +840,27 @@ static int send_buf(struct bt_conn *conn, struct bt_buf *buf,
 	 * callback node in the `tx_pending` list.
 	 */
 	bt_atomic_inc(&conn->in_ll);
+	os_mutex_lock(&conn->tx_lock, OS_TIMEOUT_FOREVER);
 	bt_slist_append(&conn->tx_pending, &tx->node);
+	os_mutex_unlock(&conn->tx_lock);
 
 	if (is_iso_tx_conn(conn)) {
-		err = send_iso(conn, frag, flags);
+		err = iso_hdr_push(conn, frag, flags);
 	} else if (is_acl_conn(conn)) {
-		err = send_acl(conn, frag, flags);
+		err = acl_hdr_push(conn, frag, flags);
 	} else {
 		err = -EINVAL; /* asserts may be disabled */
 		__ASSERT_MSG(false, "Invalid connection type %u", conn->type);
 	}
 
 	if (!err) {
+		/* Handed to the driver at the end of the TX processor run */
+		tx_batch_add(conn, buf, frag, tx);
 		return 0;
 	}
 
-	/* Remove buf from pending list */
-	bt_atomic_dec(&conn->in_ll);
-	(void)bt_slist_find_and_remove(&conn->tx_pending, &tx->node);
-
 	LOG_ERR("Unable to send to driver (err %d)", err);
-
-	/* If we get here, something has seriously gone wrong: the `parent` buf
-	 * (of which the current fragment belongs) should also be destroyed.
-	 */
-	bt_buf_unref(frag);
-
-	/* `buf` might not get destroyed right away because it may
-	 * still be on a conn tx_queue, and its `tx` pointer will still
-	 * be reachable. Make sure that we don't try to use the
-	 * destroyed context later.
-	 */
-	conn_tx_destroy(conn, tx);
-	os_sem_give(bt_conn_get_pkts(conn));
+	tx_unsend(conn, frag, tx);
 
 	/* Merge HCI driver errors */
 	return -EIO;
@@ -818,7 +911,9 @@ static bool acl_has_data(struct bt_conn *conn)
  * Partitions the controller's buffers to each connection according to some
  * heuristic. This is made to be tunable, fairness, simplicity, throughput etc.
  *
- * In the future, this will be a hook exposed to the application.
+ * Which of the connections that can send goes next is up to the policy in
+ * tx_scheds[], selected with bt_conn_tx_sched_set(). This decides when a
+ * connection gives up its place at the head of the queue.
  */
 static bool should_stop_tx(struct bt_conn *conn)
 {
@@ -828,24 +923,26 @@ static bool should_stop_tx(struct bt_conn *conn)
 		return true;
 	}
 
-	/* TODO: This function should be overridable by the application: they
-	 * should be able to provide their own heuristic.
-	 */
 	if (!conn->has_data(conn)) {
 		LOG_DBG("No more data for %p", conn);
 		return true;
 	}
 
-	/* Queue only 3 buffers per-conn for now */
-	if (bt_atomic_get(&conn->in_ll) < 3) {
+	if (bt_atomic_get(&conn->in_ll) < CONFIG_BT_CONN_TX_QUANTUM &&
+	    conn->tx_sched.turn + 1 < CONFIG_BT_CONN_TX_QUANTUM) {
 		/* The goal of this heuristic is to allow the link-layer to
 		 * extend an ACL connection event as long as the application
 		 * layer can provide data.
 		 *
-		 * Here we chose three buffers, as some LLs need two enqueued
+		 * The default is three buffers, as some LLs need two enqueued
 		 * packets to be able to set the more-data bit, and one more
 		 * buffer to allow refilling by the app while one of them is
 		 * being sent over-the-air.
+		 *
+		 * The turn also ends after that many fragments, as completions
+		 * can keep in_ll below the quantum for as long as the
+		 * connection has data when buffers or TX contexts run out
+		 * first.
 		 */
 		return false;
 	}
@@ -853,35 +950,102 @@ static bool should_stop_tx(struct bt_conn *conn)
 	return true;
 }
 
-void bt_conn_data_ready(struct bt_conn *conn)
+static volatile enum bt_conn_tx_sched tx_sched_policy = BT_CONN_TX_SCHED_RR;
+
+/* Start of the virtual time of the last fragment sent with WFQ, owned by the
+ * TX processor like the vtime of every connection.
+ */
+static uint64_t tx_vclock;
+
+static uint8_t tx_weight(const struct bt_conn *conn)
 {
-	bool added;
+	return conn->tx_sched.weight ? conn->tx_sched.weight : BT_CONN_TX_WEIGHT_DEFAULT;
+}
 
-	LOG_DBG("DR");
+/* A connection that was idle starts from the current virtual time, so it
+ * does not get to make up for the time it had nothing to send.
+ */
+static uint64_t wfq_start(const struct bt_conn *conn)
+{
+	return MAX(conn->tx_sched.vtime, tx_vclock);
+}
 
-	bt_conn_ref(conn);
+static bool wfq_precedes(const struct bt_conn *conn, const struct bt_conn *best)
+{
+	return wfq_start(conn) < wfq_start(best);
+}
 
-	/* This function is the only function which accesses conn_ready list  that can be called
-	 * from a preemptive thread context, therefore requires a critical section to ensure that
-	 * the conn_ready list is not modified while we are checking and appending to it.
+static void wfq_sent(struct bt_conn *conn, size_t len)
+{
+	tx_vclock = wfq_start(conn);
+	conn->tx_sched.vtime = tx_vclock + (((uint64_t)len << 8) / tx_weight(conn));
+}
+
+static bool prio_precedes(const struct bt_conn *conn, const struct bt_conn *best)
+{
+	return tx_weight(conn) > tx_weight(best);
+}
+
+static const struct tx_sched_ops {
+	/* Whether conn goes before best, which is ahead of it in the ready
+	 * queue. NULL to take the first connection that can send.
 	 */
-	os_sched_lock();
+	bool (*precedes)(const struct bt_conn *conn, const struct bt_conn *best);
+	/* A fragment of len bytes was handed to the driver */
+	void (*sent)(struct bt_conn *conn, size_t len);
+} tx_scheds[] = {
+	[BT_CONN_TX_SCHED_RR] = {},
+	[BT_CONN_TX_SCHED_WFQ] = {
+		.precedes = wfq_precedes,
+		.sent = wfq_sent,
+	},
+	[BT_CONN_TX_SCHED_PRIO] = {
+		.precedes = prio_precedes,
+	},
+};
 
-	if (!bt_slist_find(&bt_dev.le.conn_ready, &conn->_conn_ready, NULL)) {
-		bt_slist_append(&bt_dev.le.conn_ready, &conn->_conn_ready);
+static bool over_quota(struct bt_conn *conn)
+{
+	return conn->tx_sched.quota && bt_atomic_get(&conn->in_ll) >= conn->tx_sched.quota;
+}
 
-		added = true;
-	} else {
-		added = false;
+static void tx_sched_sent(struct bt_conn *conn, size_t len)
+{
+	const struct tx_sched_ops *sched = &tx_scheds[tx_sched_policy];
+
+	if (sched->sent) {
+		sched->sent(conn, len);
 	}
 
-	os_sched_unlock();
+	conn->tx_sched.turn++;
 
-	if (!added) {
-		bt_conn_unref(conn);
-	}
+#if defined(CONFIG_BT_CONN_TX_STATS)
+	conn->tx_sched.stats.frags++;
+	conn->tx_sched.stats.bytes += len;
+#endif /* CONFIG_BT_CONN_TX_STATS */
+}
+
+void bt_conn_data_ready(struct bt_conn *conn)
+{
+	LOG_DBG("DR");
 
-	LOG_DBG("Connection %p %s conn_ready list", conn, added ? "added to" : "already in");
+	/* Only the producer that raises the flag queues the connection, so a
+	 * ready connection costs producers one atomic operation, no lock, and
+	 * is never queued twice. The flag stays up until the TX processor takes
+	 * the connection off its ready list.
+	 */
+	if (!bt_atomic_test_and_set_bit(conn->flags, BT_CONN_TX_READY)) {
+		bt_conn_ref(conn);
+#if defined(CONFIG_BT_CONN_TX_STATS)
+		conn->tx_sched.ready_ns = os_time_get_ns();
+#endif /* CONFIG_BT_CONN_TX_STATS */
+
+		bt_fifo_put(&bt_dev.le.conn_ready_q, &conn->_conn_ready);
+
+		LOG_DBG("Connection %p added to conn_ready list", conn);
+	} else {
+		LOG_DBG("Connection %p already in conn_ready list", conn);
+	}
 
 	/* Kick the TX processor */
 	bt_tx_irq_raise();
@@ -895,16 +1059,7 @@ static bool cannot_send_to_controller(struct bt_conn *conn)
 static bool dont_have_viewbufs(void)
 {
 #if defined(CONFIG_BT_CONN_TX)
-	/* The queue only tracks buffers that have been destroyed at least once,
-	 * hence the uninit check beforehand.
-	 */
-	if (fragments.uninit_count > 0) {
-		/* If there are uninitialized bufs, we are guaranteed allocation. */
-		return false;
-	}
-
-	/* In practice bt_fifo == bt_queue. */
-	return bt_queue_is_empty(&fragments.free);
+	return !bt_buf_pool_has_free(&fragments);
 
 #else  /* !CONFIG_BT_CONN_TX */
 	return false;
@@ -918,10 +1073,35 @@ __maybe_unused static bool dont_have_methods(struct bt_conn *conn)
 		(conn->has_data == NULL);
 }
 
+#if defined(CONFIG_BT_CONN_TX_STATS)
+static void tx_sched_stats_turn(struct bt_conn *conn)
+{
+	struct bt_conn_tx_stats *stats = &conn->tx_sched.stats;
+	int64_t delay;
+
+	/* Only the first fragment of a turn waited in the queue */
+	if (!conn->tx_sched.ready_ns) {
+		return;
+	}
+
+	delay = os_time_get_ns() - conn->tx_sched.ready_ns;
+	conn->tx_sched.ready_ns = 0;
+
+	stats->waits++;
+	stats->delay_ns += delay;
+	stats->delay_max_ns = MAX(stats->delay_max_ns, (uint64_t)delay);
+}
+#endif /* CONFIG_BT_CONN_TX_STATS */
+
 static struct bt_conn *get_conn_ready(void)
 {
+	const struct tx_sched_ops *sched = &tx_scheds[tx_sched_policy];
 	struct bt_conn *conn, *tmp;
+	struct bt_conn *ready = NULL;
+	bt_snode_t *node;
 	bt_snode_t *prev = NULL;
+	bt_snode_t *ready_prev = NULL;
+	bool requeue = false;
 
 	if (dont_have_viewbufs()) {
 		/* We will get scheduled again when the (view) buffers are freed. If you
@@ -931,13 +1111,25 @@ static struct bt_conn *get_conn_ready(void)
 		return NULL;
 	}
 
+	/* Take over the connections producers have queued since the last call */
+	while ((node = bt_fifo_get(&bt_dev.le.conn_ready_q, OS_TIMEOUT_NO_WAIT))) {
+		bt_slist_append(&bt_dev.le.conn_ready, node);
+	}
+
 	BT_SLIST_FOR_EACH_CONTAINER_SAFE(&bt_dev.le.conn_ready, conn, tmp, _conn_ready) {
 		__ASSERT_NO_MSG(tmp != conn);
 
 		/* Iterate over the list of connections that have data to send
-		 * and return the first one that can be sent.
+		 * and pick one of those that can be sent, according to the policy.
 		 */
 
+		if (conn->state != BT_CONN_CONNECTED) {
+			/* Take it off the list right away, whatever the policy */
+			ready = conn;
+			ready_prev = prev;
+			break;
+		}
+
 		if (cannot_send_to_controller(conn)) {
 			/* When buffers are full, try next connection. */
 			LOG_DBG("no LL bufs for %p", conn);
@@ -959,25 +1151,60 @@ static struct bt_conn *get_conn_ready(void)
 			continue;
 		}
 
-		if (should_stop_tx(conn)) {
+		if (over_quota(conn)) {
+			/* Leave the remaining buffers to the other connections */
+			LOG_DBG("conn %p at its quota", conn);
+#if defined(CONFIG_BT_CONN_TX_STATS)
+			conn->tx_sched.stats.quota_hits++;
+#endif /* CONFIG_BT_CONN_TX_STATS */
+			prev = &conn->_conn_ready;
+			continue;
+		}
+
+		if (!ready || (sched->precedes && sched->precedes(conn, ready))) {
+			ready = conn;
+			ready_prev = prev;
+		}
+
+		if (!sched->precedes) {
+			break;
+		}
+
+		prev = &conn->_conn_ready;
+	}
+
+	if (ready) {
+#if defined(CONFIG_BT_CONN_TX_STATS)
+		tx_sched_stats_turn(ready);
+#endif /* CONFIG_BT_CONN_TX_STATS */
+
+		if (should_stop_tx(ready)) {
 			/* Move reference off the list */
-			__ASSERT_NO_MSG(prev != &conn->_conn_ready);
-			bt_slist_remove(&bt_dev.le.conn_ready, prev, &conn->_conn_ready);
+			__ASSERT_NO_MSG(ready_prev != &ready->_conn_ready);
+			bt_slist_remove(&bt_dev.le.conn_ready, ready_prev, &ready->_conn_ready);
+			ready->tx_sched.turn = 0;
+
+			/* Producers queue it again from here on. Data they added
+			 * before seeing the flag down is caught by the check below.
+			 */
+			bt_atomic_clear_bit(ready->flags, BT_CONN_TX_READY);
 
 			/* Append connection to list if it is connected and still has data */
-			if (conn->has_data(conn) && (conn->state == BT_CONN_CONNECTED)) {
-				LOG_DBG("appending %p to back of TX queue", conn);
-				bt_conn_data_ready(conn);
-			}
+			requeue = (ready->state == BT_CONN_CONNECTED) && ready->has_data(ready);
 
-			return conn;
+			/* The list's reference moves to the caller */
+		} else {
+			ready = bt_conn_ref(ready);
 		}
+	}
 
-		return bt_conn_ref(conn);
+	if (requeue) {
+		LOG_DBG("appending %p to back of TX queue", ready);
+		bt_conn_data_ready(ready);
 	}
 
-	/* No connection has data to send */
-	return NULL;
+	/* NULL: no connection has data to send */
+	return ready;
 }
 
 /* Crazy that this file is compiled even if this is not true, but here we are. */
@@ -1006,36 +1233,38 @@ void bt_conn_suspend_tx(bool suspend)
 }
 #endif	/* CONFIG_BT_TESTING */
 
-void bt_conn_tx_processor(void)
+/* Adds one fragment of the connection the scheduler picks to the batch.
+ * Returns true if the TX processor should go on, as it did before bursts
+ * when it kicked the TX work again.
+ */
+static bool tx_process_one(void)
 {
-	LOG_DBG("start");
 	struct bt_conn *conn;
 	struct bt_buf *buf;
 	bt_conn_tx_cb_t cb = NULL;
 	size_t buf_len;
 	void *ud = NULL;
-
-	if (!IS_ENABLED(CONFIG_BT_CONN_TX)) {
-		/* Mom, can we have a real compiler? */
-		return;
-	}
-
-	if (IS_ENABLED(CONFIG_BT_TESTING) && _suspend_tx) {
-		return;
-	}
+	bool more = true;
 
 	conn = get_conn_ready();
 
 	if (!conn) {
 		LOG_DBG("no connection wants to do stuff");
-		return;
+		return false;
 	}
 
 	LOG_DBG("processing conn %p", conn);
 
 	if (conn->state != BT_CONN_CONNECTED) {
 		LOG_DBG("conn %p: not connected: state %d", conn, conn->state);
-		goto raise_and_exit;
+		goto exit;
+	}
+
+	/* A buffer has one view at a time, so the next fragment or segment of
+	 * the same buffer has to wait for the driver to be done with this one.
+	 */
+	if (tx_batch_holds_view(conn)) {
+		tx_batch_flush();
 	}
 
 	/* now that we are guaranteed resources, we can pull data from the upper
@@ -1050,6 +1279,11 @@ void bt_conn_tx_processor(void)
 		 */
 		LOG_DBG("no buf returned");
 
+		/* End its turn: a channel raised with nothing to send must not
+		 * keep the connection at the head of the queue.
+		 */
+		conn->tx_sched.turn = CONFIG_BT_CONN_TX_QUANTUM;
+		more = false;
 		goto exit;
 	}
 
@@ -1066,23 +1300,112 @@ void bt_conn_tx_processor(void)
 	LOG_DBG("TX process: conn %p buf %p (%s)",
 		conn, buf, last_buf ? "last" : "frag");
 
+	size_t frag_len = MIN(conn_mtu(conn), buf_len);
 	int err = send_buf(conn, buf, buf_len, cb, ud);
 
 	if (err) {
 		LOG_ERR("Fatal error (%d). Disconnecting %p", err, conn);
 		bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+
+		more = false;
 		goto exit;
 	}
 
-raise_and_exit:
-	/* Always kick the TX work. It will self-suspend if it doesn't get
-	 * resources or there is nothing left to send.
-	 */
-	bt_tx_irq_raise();
+	tx_sched_sent(conn, frag_len);
 
 exit:
 	/* Give back the ref that `get_conn_ready()` gave us */
 	bt_conn_unref(conn);
+
+	return more;
+}
+
+void bt_conn_tx_processor(void)
+{
+	LOG_DBG("start");
+	size_t burst = tx_burst;
+	bool more = true;
+
+	if (!IS_ENABLED(CONFIG_BT_CONN_TX)) {
+		/* Mom, can we have a real compiler? */
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_TESTING) && _suspend_tx) {
+		return;
+	}
+
+	/* Every fragment needs a controller buffer, which get_conn_ready()
+	 * checks, and the scheduler moves on to the next connection once one
+	 * has had its quantum, so a burst is bounded by both.
+	 */
+	for (size_t i = 0; more && i < burst; i++) {
+		more = tx_process_one();
+	}
+
+	tx_batch_flush();
+
+	if (more) {
+		/* Always kick the TX work. It will self-suspend if it doesn't get
+		 * resources or there is nothing left to send.
+		 */
+		bt_tx_irq_raise();
+	}
+}
+
+int bt_conn_tx_sched_set(enum bt_conn_tx_sched sched)
+{
+	if ((size_t)sched >= ARRAY_SIZE(tx_scheds)) {
+		return -EINVAL;
+	}
+
+	tx_sched_policy = sched;
+	bt_tx_irq_raise();
+
+	return 0;
+}
+
+int bt_conn_tx_weight_set(struct bt_conn *conn, uint8_t weight)
+{
+	if (!weight) {
+		return -EINVAL;
+	}
+
+	conn->tx_sched.weight = weight;
+	bt_tx_irq_raise();
+
+	return 0;
+}
+
+int bt_conn_tx_quota_set(struct bt_conn *conn, uint8_t quota)
+{
+	conn->tx_sched.quota = quota;
+	bt_tx_irq_raise();
+
+	return 0;
+}
+
+int bt_conn_tx_stats_get(const struct bt_conn *conn, struct bt_conn_tx_stats *stats)
+{
+#if defined(CONFIG_BT_CONN_TX_STATS)
+	*stats = conn->tx_sched.stats;
+
+	return 0;
+#else
+	ARG_UNUSED(conn);
+	ARG_UNUSED(stats);
+
+	return -ENOTSUP;
+#endif /* CONFIG_BT_CONN_TX_STATS */
+}
+
+void bt_conn_tx_stats_reset(struct bt_conn *conn)
+{
+#if defined(CONFIG_BT_CONN_TX_STATS)
+	memset(&conn->tx_sched.stats, 0, sizeof(conn->tx_sched.stats));
+#else
+	ARG_UNUSED(conn);
+#endif /* CONFIG_BT_CONN_TX_STATS */
 }
 
 static void process_unack_tx(struct bt_conn *conn)
@@ -1094,7 +1417,9 @@ static void process_unack_tx(struct bt_conn *conn)
 		struct bt_conn_tx *tx;
 		bt_snode_t *node;
 
+		os_mutex_lock(&conn->tx_lock, OS_TIMEOUT_FOREVER);
 		node = bt_slist_get(&conn->tx_pending);
+		os_mutex_unlock(&conn->tx_lock);
 
 		if (!node) {
 			bt_tx_irq_raise();
@@ -1108,30 +1433,164 @@ static void process_unack_tx(struct bt_conn *conn)
 	}
 }
 
-static struct bt_conn *conn_lookup_handle(struct bt_conn *conns, size_t size,
-					  uint16_t handle)
+/* Marks a slot whose connection was removed, probing goes on past it */
+static const uint8_t handle_map_tombstone;
+#define HANDLE_MAP_TOMBSTONE ((void *)&handle_map_tombstone)
+
+#if defined(CONFIG_BT_CONN)
+#define HANDLE_MAP_ACL CONFIG_BT_MAX_CONN
+#else
+#define HANDLE_MAP_ACL 0
+#endif /* CONFIG_BT_CONN */
+
+#if defined(CONFIG_BT_ISO)
+#define HANDLE_MAP_ISO CONFIG_BT_ISO_MAX_CHAN
+#else
+#define HANDLE_MAP_ISO 0
+#endif /* CONFIG_BT_ISO */
+
+#if defined(CONFIG_BT_CLASSIC)
+#define HANDLE_MAP_SCO CONFIG_BT_MAX_SCO_CONN
+#else
+#define HANDLE_MAP_SCO 0
+#endif /* CONFIG_BT_CLASSIC */
+
+/* At most half full, so that probe sequences stay short */
+#define HANDLE_MAP_SIZE MAX(8, 2 * (HANDLE_MAP_ACL + HANDLE_MAP_ISO + HANDLE_MAP_SCO))
+
+static bt_atomic_ptr_t conn_handle_slots[HANDLE_MAP_SIZE];
+static struct bt_conn_handle_map conn_handles = {
+	.slots = conn_handle_slots,
+	.size = ARRAY_SIZE(conn_handle_slots),
+	.lock = OS_MUTEX_INITIALIZER,
+};
+
+static inline size_t handle_map_next(const struct bt_conn_handle_map *map, size_t i)
+{
+	return (i + 1 == map->size) ? 0 : i + 1;
+}
+
+void bt_conn_handle_map_init(struct bt_conn_handle_map *map, bt_atomic_ptr_t *slots,
+			     size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		bt_atomic_ptr_clear(&slots[i]);
+	}
+
+	map->slots = slots;
+	map->size = size;
+	os_mutex_init(&map->lock);
+}
+
+void bt_conn_handle_map_add(struct bt_conn_handle_map *map, struct bt_conn *conn)
 {
-	int i;
+	size_t i = bt_conn_handle_map_home(map, conn->handle);
+	size_t free_slot = map->size;
 
-	for (i = 0; i < size; i++) {
-		struct bt_conn *conn = bt_conn_ref(&conns[i]);
+	os_mutex_lock(&map->lock, OS_TIMEOUT_FOREVER);
+
+	/* Take the first tombstone or empty slot, unless it is already there */
+	for (size_t n = 0; n < map->size; n++, i = handle_map_next(map, i)) {
+		void *cur = bt_atomic_ptr_get(&map->slots[i]);
+
+		if (cur == conn) {
+			free_slot = map->size;
+			break;
+		}
+
+		if ((cur == HANDLE_MAP_TOMBSTONE || !cur) && free_slot == map->size) {
+			free_slot = i;
+		}
+
+		if (!cur) {
+			break;
+		}
+	}
+
+	if (free_slot < map->size) {
+		bt_atomic_ptr_set(&map->slots[free_slot], conn);
+	}
+
+	os_mutex_unlock(&map->lock);
+}
+
+void bt_conn_handle_map_remove(struct bt_conn_handle_map *map, struct bt_conn *conn)
+{
+	size_t i = bt_conn_handle_map_home(map, conn->handle);
+	size_t found = map->size;
+
+	os_mutex_lock(&map->lock, OS_TIMEOUT_FOREVER);
+
+	for (size_t n = 0; n < map->size; n++, i = handle_map_next(map, i)) {
+		void *cur = bt_atomic_ptr_get(&map->slots[i]);
+
+		if (cur == conn) {
+			found = i;
+			break;
+		}
+
+		if (!cur) {
+			break;
+		}
+	}
+
+	/* Not where its handle leads, if the handle changed after all */
+	for (i = 0; found == map->size && i < map->size; i++) {
+		if (bt_atomic_ptr_get(&map->slots[i]) == conn) {
+			found = i;
+		}
+	}
+
+	if (found == map->size) {
+		os_mutex_unlock(&map->lock);
+		return;
+	}
+
+	bt_atomic_ptr_set(&map->slots[found], HANDLE_MAP_TOMBSTONE);
+
+	/* A tombstone right before an empty slot ends every probe sequence
+	 * through it the same way an empty slot does, so empty it, and the
+	 * tombstones before it.
+	 */
+	for (size_t n = 0; n < map->size; n++) {
+		if (bt_atomic_ptr_get(&map->slots[found]) != HANDLE_MAP_TOMBSTONE ||
+		    bt_atomic_ptr_get(&map->slots[handle_map_next(map, found)])) {
+			break;
+		}
+
+		bt_atomic_ptr_clear(&map->slots[found]);
+		found = found ? found - 1 : map->size - 1;
+	}
+
+	os_mutex_unlock(&map->lock);
+}
+
+struct bt_conn *bt_conn_handle_map_lookup(struct bt_conn_handle_map *map, uint16_t handle)
+{
+	size_t i = bt_conn_handle_map_home(map, handle);
+
+	for (size_t n = 0; n < map->size; n++, i = handle_map_next(map, i)) {
+		struct bt_conn *conn = bt_atomic_ptr_get(&map->slots[i]);
 
 		if (!conn) {
-			continue;
+			break;
 		}
 
-		/* We only care about connections with a valid handle */
-		if (!bt_conn_is_handle_valid(conn)) {
-			bt_conn_unref(conn);
+		if ((void *)conn == HANDLE_MAP_TOMBSTONE) {
 			continue;
 		}
 
-		if (conn->handle != handle) {
-			bt_conn_unref(conn);
+		conn = bt_conn_ref(conn);
+		if (!conn) {
 			continue;
 		}
 
-		return conn;
+		/* We only care about connections with a valid handle */
+		if (bt_conn_is_handle_valid(conn) && conn->handle == handle) {
+			return conn;
+		}
+
+		bt_conn_unref(conn);
 	}
 
 	return NULL;
@@ -1140,6 +1599,7 @@ static struct bt_conn *conn_lookup_handle(struct bt_conn *conns, size_t size,
 void bt_conn_set_state(struct bt_conn *conn, bt_conn_state_t state)
 {
 	bt_conn_state_t old_state;
+	bool had_handle;
 
 	LOG_DBG("%s -> %s", state2str(conn->state), state2str(state));
 
@@ -1148,9 +1608,17 @@ void bt_conn_set_state(struct bt_conn *conn, bt_conn_state_t state)
 		return;
 	}
 
+	had_handle = bt_conn_is_handle_valid(conn);
 	old_state = conn->state;
 	conn->state = state;
 
+	/* The handle is assigned before the state that makes it valid */
+	if (!had_handle && bt_conn_is_handle_valid(conn)) {
+		bt_conn_handle_map_add(&conn_handles, conn);
+	} else if (had_handle && !bt_conn_is_handle_valid(conn)) {
+		bt_conn_handle_map_remove(&conn_handles, conn);
+	}
+
 	/* Actions needed for exiting the old state */
 	switch (old_state) {
 	case BT_CONN_DISCONNECTED:
@@ -1349,28 +1817,7 @@ struct bt_conn *bt_conn_lookup_handle(uint16_t handle, enum bt_conn_type type)
 {
 	struct bt_conn *conn;
 
-#if defined(CONFIG_BT_CONN)
-	conn = conn_lookup_handle(acl_conns, ARRAY_SIZE(acl_conns), handle);
-	if (conn) {
-		goto found;
-	}
-#endif /* CONFIG_BT_CONN */
-
-#if defined(CONFIG_BT_ISO)
-	conn = conn_lookup_handle(iso_conns, ARRAY_SIZE(iso_conns), handle);
-	if (conn) {
-		goto found;
-	}
-#endif
-
-#if defined(CONFIG_BT_CLASSIC)
-	conn = conn_lookup_handle(sco_conns, ARRAY_SIZE(sco_conns), handle);
-	if (conn) {
-		goto found;
-	}
-#endif
-
-found:
+	conn = bt_conn_handle_map_lookup(&conn_handles, handle);
 	if (conn) {
 		if (type & conn->type) {
 			return conn;
@@ -4218,10 +4665,42 @@ struct bt_conn *bt_conn_lookup_index(uint8_t index)
 	return bt_conn_ref(&acl_conns[index]);
 }
 
+static void conn_locks_init(void)
+{
+	static bool initialized;
+	int i;
+
+	/* The locks live outside the memset area of bt_conn_new(), set them up once */
+	if (initialized) {
+		return;
+	}
+
+	bt_fifo_init_mpsc(&bt_dev.le.conn_ready_q);
+
+	for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
+		os_mutex_init(&acl_conns[i].tx_lock);
+		os_mutex_init(&acl_conns[i].l2cap_data_ready_lock);
+	}
+#if defined(CONFIG_BT_CLASSIC)
+	for (i = 0; i < ARRAY_SIZE(sco_conns); i++) {
+		os_mutex_init(&sco_conns[i].tx_lock);
+	}
+#endif /* CONFIG_BT_CLASSIC */
+#if defined(CONFIG_BT_ISO)
+	for (i = 0; i < CONFIG_BT_ISO_MAX_CHAN; i++) {
+		os_mutex_init(&iso_conns[i].tx_lock);
+	}
+#endif /* CONFIG_BT_ISO */
+
+	initialized = true;
+}
+
 int bt_conn_init(void)
 {
 	int err, i;
 
+	conn_locks_init();
+
 	bt_fifo_init(&free_tx);
 	for (i = 0; i < ARRAY_SIZE(conn_tx); i++) {
 		bt_fifo_put(&free_tx, &conn_tx[i]);
@@ -4229,13 +4708,16 @@ int bt_conn_init(void)
 
 	bt_l2cap_init();
 
-	bt_att_init();
-
+	/* Fixed channels are accepted in registration order, SMP has to be
+	 * attached before ATT may ask for security on connection.
+	 */
 	err = bt_smp_init();
 	if (err) {
 		return err;
 	}
 
+	bt_att_init();
+
 	/* Initialize background scan */
 	if (IS_ENABLED(CONFIG_BT_CENTRAL)) {
 		for (i = 0; i < ARRAY_SIZE(acl_conns); i++) {
@@ -4355,11 +4837,12 @@ static int bt_conn_tx_workq_init(void)
 		.name = "BT CONN TX WQ",
 		.no_yield = false,
 		.essential = false,
+		.cpu_mask = CONFIG_BT_CONN_TX_NOTIFY_WQ_CPU_MASK,
 	};
 
 	bt_work_queue_init(&conn_tx_workq);
 	bt_work_queue_start(&conn_tx_workq, CONFIG_BT_CONN_TX_NOTIFY_WQ_STACK_SIZE,
-			   OS_PRIORITY(CONFIG_BT_CONN_TX_NOTIFY_WQ_PRIO), &cfg);
+			   OS_PRIORITY_COOP(CONFIG_BT_CONN_TX_NOTIFY_WQ_PRIO), &cfg);
 
 	return 0;
 }
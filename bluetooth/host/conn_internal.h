@@ -19,6 +19,16 @@
 
 #include "osdep/os.h"
 
+/* Fragments a connection sends per round-robin turn */
+#ifndef CONFIG_BT_CONN_TX_QUANTUM
+#define CONFIG_BT_CONN_TX_QUANTUM 3
+#endif
+
+/* Fragments the TX processor sends per run */
+#ifndef CONFIG_BT_CONN_TX_BURST
+#define CONFIG_BT_CONN_TX_BURST 8
+#endif
+
 typedef enum __packed {
 	BT_CONN_DISCONNECTED,         /* Disconnected, conn is completely down */
 	BT_CONN_DISCONNECT_COMPLETE,  /* Received disconn comp event, transition to DISCONNECTED */
@@ -92,6 +102,8 @@ enum {
 	BT_CONN_CTE_REQ_ENABLED,              /* CTE request procedure is enabled */
 	BT_CONN_CTE_RSP_ENABLED,              /* CTE response procedure is enabled */
 
+	BT_CONN_TX_READY,                     /* Queued for the TX processor */
+
 	/* Total number of flags - must be at the end of the enum */
 	BT_CONN_NUM_FLAGS,
 };
@@ -315,6 +327,18 @@ struct bt_conn {
 	 */
 	bt_atomic_t		in_ll;
 
+	/* TX scheduler state, see tx_scheds[] in conn.c */
+	struct {
+		uint8_t		weight;    /* 0: BT_CONN_TX_WEIGHT_DEFAULT */
+		uint8_t		quota;     /* 0: no limit of its own */
+		uint8_t		turn;      /* Fragments sent at the head of the queue */
+		uint64_t	vtime;     /* Virtual finish time for WFQ */
+#if defined(CONFIG_BT_CONN_TX_STATS)
+		int64_t		ready_ns;  /* Joined the ready queue, 0 once served */
+		struct bt_conn_tx_stats stats;
+#endif /* CONFIG_BT_CONN_TX_STATS */
+	} tx_sched;
+
 	/* Next buffer should be an ACL/ISO HCI fragment */
 	bool			next_is_frag;
 
@@ -322,6 +346,18 @@ struct bt_conn {
 	 * memset to zero without affecting the ref.
 	 */
 	bt_atomic_t		ref;
+
+	/* Guards tx_pending and tx_complete, which the TX processor, the RX
+	 * priority path and the TX notify queue all update. Kept past ref so it
+	 * survives bt_conn_new() and is initialized once in bt_conn_init().
+	 */
+	os_mutex_t		tx_lock;
+
+	/* Guards l2cap_data_ready for LE channels, which producers append to
+	 * and channel deletion unlinks from while the TX processor takes
+	 * channels off it. Kept past ref for the same reason as tx_lock.
+	 */
+	os_mutex_t		l2cap_data_ready_lock;
 };
 
 /* Holds the callback and a user-data field for the upper layer. This callback
@@ -447,6 +483,41 @@ static inline bool bt_conn_is_handle_valid(struct bt_conn *conn)
 	}
 }
 
+/* Handle to connection map of every connection whose handle is valid, so
+ * that incoming data and events find their connection in O(1).
+ *
+ * Open addressing with linear probing from bt_conn_handle_map_home(), where
+ * removed entries leave a tombstone behind. Lookups take no lock: a slot
+ * holds a pointer into a static connection array, so the lookup takes a
+ * reference and re-checks the state and handle, since the connection may
+ * have been recycled in between. Updates are serialized by the map's lock.
+ */
+struct bt_conn_handle_map {
+	bt_atomic_ptr_t *slots;
+	size_t size;
+	os_mutex_t lock;
+};
+
+void bt_conn_handle_map_init(struct bt_conn_handle_map *map, bt_atomic_ptr_t *slots,
+			     size_t size);
+
+/* Where probing for a handle starts. Controllers hand out handles in runs
+ * (ACL from 0, CIS from some base), so scatter them rather than take them
+ * modulo the size, which would pile the runs onto the same slots.
+ */
+static inline size_t bt_conn_handle_map_home(const struct bt_conn_handle_map *map,
+					     uint16_t handle)
+{
+	return (((uint32_t)handle * 0x9e3779b1U) >> 16) % map->size;
+}
+
+/* The handle must not change while the connection is in the map */
+void bt_conn_handle_map_add(struct bt_conn_handle_map *map, struct bt_conn *conn);
+void bt_conn_handle_map_remove(struct bt_conn_handle_map *map, struct bt_conn *conn);
+
+/* Returns a new reference to the connection, or NULL */
+struct bt_conn *bt_conn_handle_map_lookup(struct bt_conn_handle_map *map, uint16_t handle);
+
 /* Check if the connection is with the given peer. */
 bool bt_conn_is_peer_addr_le(const struct bt_conn *conn, uint8_t id,
 			     const bt_addr_le_t *peer);
@@ -583,6 +654,9 @@ os_sem_t *bt_conn_get_pkts(struct bt_conn *conn);
 
 void bt_conn_tx_processor(void);
 
+/* Fragments one TX processor run may send, from 1 up to CONFIG_BT_CONN_TX_BURST */
+void bt_conn_tx_burst_set(size_t frags);
+
 /* To be called by upper layers when they want to send something.
  * Functions just like an IRQ.
  *
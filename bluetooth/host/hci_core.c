@@ -91,6 +91,10 @@ void bt_tx_irq_raise(void);
 /* Stacks for the threads */
 static void rx_work_handler(struct bt_work *work);
 static BT_WORK_DEFINE(rx_work, rx_work_handler);
+/* Guards bt_dev.rx_queue, bt_dev.rx_queue_since and rx_work_retry */
+static os_mutex_t rx_queue_lock = OS_MUTEX_INITIALIZER;
+/* The last rx_work submission failed, the next rx_queue_put() retries it */
+static bool rx_work_retry;
 #if defined(CONFIG_BT_RECV_WORKQ_BT)
 static struct bt_work_q bt_workq;
 #endif /* CONFIG_BT_RECV_WORKQ_BT */
@@ -112,6 +116,8 @@ static bt_ready_cb_t ready_cb;
 
 #if defined(CONFIG_BT_HCI_VS_EVT_USER)
 static bt_hci_vnd_evt_cb_t *hci_vnd_evt_cb;
+static bt_slist_t vnd_evt_handlers;
+static os_mutex_t vnd_evt_lock = OS_MUTEX_INITIALIZER;
 #endif /* CONFIG_BT_HCI_VS_EVT_USER */
 
 struct cmd_data {
@@ -126,10 +132,27 @@ struct cmd_data {
 
 	/** Used by bt_hci_cmd_send_sync. */
 	os_sem_t *sync;
+
+	/** Used by bt_hci_cmd_send_async. */
+	bt_hci_cmd_cb_t cb;
+	void *user_data;
+
+	/** When the command was handed to the driver, in ns */
+	uint64_t sent_ns;
 };
 
 static struct cmd_data cmd_data[BT_BUF_CMD_TX_COUNT];
 
+/* Guards the command window and the in-flight commands in bt_dev */
+static os_mutex_t cmd_lock = OS_MUTEX_INITIALIZER;
+
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+/* Open addressing on the OpCode, free slots have OpCode 0 (HCI_NOP).
+ * Guarded by cmd_lock.
+ */
+static struct bt_hci_cmd_stats cmd_stats[CONFIG_BT_HCI_CMD_STATS_OPCODES];
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+
 #define cmd(buf) (&cmd_data[bt_buf_id(buf)])
 #define acl(buf) ((struct bt_conn_rx *)bt_buf_user_data(buf))
 
@@ -161,48 +184,107 @@ void bt_hci_cmd_state_set_init(struct bt_buf *buf,
 BT_BUF_POOL_FIXED_DEFINE(hci_cmd_pool, BT_BUF_CMD_TX_COUNT, CMD_BUF_SIZE, 0, NULL);
 
 struct event_handler {
-	uint8_t event;
 	uint8_t min_len;
 	void (*handler)(struct bt_buf *buf);
 };
 
+/* Handler tables are indexed by event code, so a lookup is a bounds check
+ * and a load. Codes without a handler are left zeroed.
+ */
 #define EVENT_HANDLER(_evt, _handler, _min_len) \
-{ \
-	.event = _evt, \
+[_evt] = { \
 	.handler = _handler, \
 	.min_len = _min_len, \
 }
 
-static int handle_event_common(uint8_t event, struct bt_buf *buf,
-			       const struct event_handler *handlers, size_t num_handlers)
+/* Event counters of one RX context. Only that context writes them, so they
+ * are updated without a lock, like bt_hci_rx_stats. A reset bumps
+ * evt_stats_gen; the writer clears its counters when it sees the change and
+ * readers report zeroes until then.
+ */
+struct evt_stats_set {
+	bt_atomic_t gen;
+	struct bt_hci_evt_stats stats[UINT8_MAX + 1];
+};
+
+#if defined(CONFIG_BT_HCI_EVT_STATS)
+/* The driver RX context and the RX work item count into separate sets, so
+ * an event handled by both is seen once in each.
+ */
+static struct evt_stats_set evt_stats;
+static struct evt_stats_set le_evt_stats;
+static struct evt_stats_set evt_prio_stats;
+static struct evt_stats_set le_evt_prio_stats;
+static bt_atomic_t evt_stats_gen;
+#define EVT_STATS(_stats) (&(_stats))
+#else
+#define EVT_STATS(_stats) NULL
+#endif /* CONFIG_BT_HCI_EVT_STATS */
+
+static void evt_stats_record(struct evt_stats_set *set, uint8_t event, bool handled,
+			     uint64_t ns)
 {
-	size_t i;
+#if defined(CONFIG_BT_HCI_EVT_STATS)
+	struct bt_hci_evt_stats *stats = &set->stats[event];
+	bt_atomic_val_t gen = bt_atomic_get(&evt_stats_gen);
 
-	for (i = 0; i < num_handlers; i++) {
-		const struct event_handler *handler = &handlers[i];
+	if (bt_atomic_get(&set->gen) != gen) {
+		memset(set->stats, 0, sizeof(set->stats));
+		bt_atomic_set(&set->gen, gen);
+	}
 
-		if (handler->event != event) {
-			continue;
+	if (handled) {
+		stats->count++;
+		stats->time_ns += ns;
+		stats->max_ns = MAX(stats->max_ns, ns);
+	} else {
+		stats->dropped++;
+	}
+#endif /* CONFIG_BT_HCI_EVT_STATS */
+}
+
+static int handle_event_common(uint8_t event, struct bt_buf *buf,
+			       const struct event_handler *handlers, size_t num_handlers,
+			       struct evt_stats_set *stats)
+{
+	const struct event_handler *handler;
+	uint64_t start;
+
+	if (event >= num_handlers || !handlers[event].handler) {
+		if (stats) {
+			evt_stats_record(stats, event, false, 0);
 		}
+		return -EOPNOTSUPP;
+	}
 
-		if (buf->len < handler->min_len) {
-			LOG_ERR("Too small (%u bytes) event 0x%02x", buf->len, event);
-			return -EINVAL;
+	handler = &handlers[event];
+
+	if (buf->len < handler->min_len) {
+		LOG_ERR("Too small (%u bytes) event 0x%02x", buf->len, event);
+		if (stats) {
+			evt_stats_record(stats, event, false, 0);
 		}
+		return -EINVAL;
+	}
 
+	if (!stats) {
 		handler->handler(buf);
 		return 0;
 	}
 
-	return -EOPNOTSUPP;
+	start = os_time_get_ns();
+	handler->handler(buf);
+	evt_stats_record(stats, event, true, os_time_get_ns() - start);
+
+	return 0;
 }
 
 static void handle_event(uint8_t event, struct bt_buf *buf, const struct event_handler *handlers,
-			 size_t num_handlers)
+			 size_t num_handlers, struct evt_stats_set *stats)
 {
 	int err;
 
-	err = handle_event_common(event, buf, handlers, num_handlers);
+	err = handle_event_common(event, buf, handlers, num_handlers, stats);
 	if (err == -EOPNOTSUPP) {
 		LOG_WRN("Unhandled event 0x%02x len %u: %s", event, buf->len,
 			bt_hex(buf->data, buf->len));
@@ -216,7 +298,7 @@ static void handle_vs_event(uint8_t event, struct bt_buf *buf,
 {
 	int err;
 
-	err = handle_event_common(event, buf, handlers, num_handlers);
+	err = handle_event_common(event, buf, handlers, num_handlers, NULL);
 	if (err == -EOPNOTSUPP) {
 		LOG_WRN("Unhandled vendor-specific event 0x%02x len %u: %s", event, buf->len,
 			bt_hex(buf->data, buf->len));
@@ -225,6 +307,45 @@ static void handle_vs_event(uint8_t event, struct bt_buf *buf,
 	/* Other possible errors are handled by handle_event_common function */
 }
 
+#if defined(CONFIG_BT_HCI_EVT_STATS)
+static void evt_stats_copy(struct bt_hci_evt_stats *dst, const struct evt_stats_set *set,
+			   uint8_t event)
+{
+	if (bt_atomic_get(&set->gen) != bt_atomic_get(&evt_stats_gen)) {
+		/* Reset, and not cleared by its writer yet */
+		memset(dst, 0, sizeof(*dst));
+		return;
+	}
+
+	*dst = set->stats[event];
+}
+
+void bt_hci_evt_stats_get(uint8_t evt, struct bt_hci_evt_stats *stats)
+{
+	evt_stats_copy(stats, &evt_stats, evt);
+}
+
+void bt_hci_le_evt_stats_get(uint8_t subevent, struct bt_hci_evt_stats *stats)
+{
+	evt_stats_copy(stats, &le_evt_stats, subevent);
+}
+
+void bt_hci_evt_prio_stats_get(uint8_t evt, struct bt_hci_evt_stats *stats)
+{
+	evt_stats_copy(stats, &evt_prio_stats, evt);
+}
+
+void bt_hci_le_evt_prio_stats_get(uint8_t subevent, struct bt_hci_evt_stats *stats)
+{
+	evt_stats_copy(stats, &le_evt_prio_stats, subevent);
+}
+
+void bt_hci_evt_stats_reset(void)
+{
+	bt_atomic_inc(&evt_stats_gen);
+}
+#endif /* CONFIG_BT_HCI_EVT_STATS */
+
 void bt_send_one_host_num_completed_packets(uint16_t handle)
 {
 	if (!IS_ENABLED(CONFIG_BT_HCI_ACL_FLOW_CONTROL)) {
@@ -260,13 +381,101 @@ __weak void bt_testing_trace_event_acl_pool_destroy(struct bt_buf *buf)
 #endif
 
 #if defined(CONFIG_BT_HCI_ACL_FLOW_CONTROL)
-void bt_hci_host_num_completed_packets(struct bt_buf *buf)
+/* Freed ACL buffers not yet reported to the controller, per connection index.
+ * They are reported together once NOCP_THRESHOLD have accumulated, or
+ * CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_DELAY_MS after the first one, so a burst
+ * of inbound data costs one Host Number Of Completed Packets command instead of
+ * one per buffer.
+ */
+static struct {
+	uint16_t handle;
+	uint16_t count;
+} nocp_pending[CONFIG_BT_MAX_CONN];
+static uint16_t nocp_total;
+static os_mutex_t nocp_lock = OS_MUTEX_INITIALIZER;
+
+/* A threshold above the buffers the controller may fill would leave it
+ * waiting for the timer.
+ */
+#define NOCP_THRESHOLD MIN(CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_THRESHOLD, BT_BUF_HCI_ACL_RX_COUNT)
+
+static void nocp_flush_handler(struct bt_work *work);
+static BT_WORK_DELAYABLE_DEFINE(nocp_flush_work, nocp_flush_handler);
+
+static void nocp_flush(void)
 {
 	struct bt_hci_cp_host_num_completed_packets *cp;
-	uint16_t handle = acl(buf)->handle;
+	struct {
+		uint16_t handle;
+		uint16_t count;
+	} counts[CONFIG_BT_MAX_CONN];
 	struct bt_hci_handle_count *hc;
 	struct bt_conn *conn;
+	struct bt_buf *buf;
+	uint8_t num = 0U;
+
+	os_mutex_lock(&nocp_lock, OS_TIMEOUT_FOREVER);
+	for (uint8_t i = 0; i < CONFIG_BT_MAX_CONN; i++) {
+		if (!nocp_pending[i].count) {
+			continue;
+		}
+
+		counts[num].handle = nocp_pending[i].handle;
+		counts[num].count = nocp_pending[i].count;
+		nocp_total -= nocp_pending[i].count;
+		nocp_pending[i].count = 0U;
+
+		/* Links that went down meanwhile no longer hold the buffers */
+		conn = bt_conn_lookup_index(i);
+		if (conn) {
+			if (conn->handle == counts[num].handle &&
+			    (conn->state == BT_CONN_CONNECTED ||
+			     conn->state == BT_CONN_DISCONNECTING)) {
+				num++;
+			}
+			bt_conn_unref(conn);
+		}
+	}
+	os_mutex_unlock(&nocp_lock);
+
+	if (!num) {
+		return;
+	}
+
+	buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
+	if (!buf) {
+		LOG_ERR("Unable to allocate new HCI command");
+		return;
+	}
+
+	cp = bt_buf_add(buf, sizeof(*cp));
+	cp->num_handles = num;
+
+	for (uint8_t i = 0; i < num; i++) {
+		LOG_DBG("Reporting %u completed packets for handle %u", counts[i].count,
+			counts[i].handle);
+
+		hc = bt_buf_add(buf, sizeof(*hc));
+		hc->handle = sys_cpu_to_le16(counts[i].handle);
+		hc->count = sys_cpu_to_le16(counts[i].count);
+	}
+
+	bt_hci_cmd_send(BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS, buf);
+}
+
+static void nocp_flush_handler(struct bt_work *work)
+{
+	ARG_UNUSED(work);
+
+	nocp_flush();
+}
+
+void bt_hci_host_num_completed_packets(struct bt_buf *buf)
+{
+	uint16_t handle = acl(buf)->handle;
+	struct bt_conn *conn;
 	uint8_t index = acl(buf)->index;
+	bool flush;
 
 	if (IS_ENABLED(CONFIG_BT_TESTING)) {
 		bt_testing_trace_event_acl_pool_destroy(buf);
@@ -294,22 +503,25 @@ void bt_hci_host_num_completed_packets(struct bt_buf *buf)
 
 	bt_conn_unref(conn);
 
-	LOG_DBG("Reporting completed packet for handle %u", handle);
-
-	buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
-	if (!buf) {
-		LOG_ERR("Unable to allocate new HCI command");
-		return;
+	os_mutex_lock(&nocp_lock, OS_TIMEOUT_FOREVER);
+	if (nocp_pending[index].handle != handle) {
+		/* Left over from an earlier link on this index */
+		nocp_total -= nocp_pending[index].count;
+		nocp_pending[index].handle = handle;
+		nocp_pending[index].count = 0U;
 	}
+	nocp_pending[index].count++;
+	nocp_total++;
+	flush = (nocp_total >= NOCP_THRESHOLD || CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_DELAY_MS == 0);
+	os_mutex_unlock(&nocp_lock);
 
-	cp = bt_buf_add(buf, sizeof(*cp));
-	cp->num_handles = 1;
-
-	hc = bt_buf_add(buf, sizeof(*hc));
-	hc->handle = sys_cpu_to_le16(handle);
-	hc->count  = sys_cpu_to_le16(1);
-
-	bt_hci_cmd_send(BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS, buf);
+	if (flush) {
+		nocp_flush();
+	} else {
+		/* Keeps the deadline of the first unreported buffer */
+		(void)bt_work_schedule(&nocp_flush_work,
+				       OS_MSEC(CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_DELAY_MS));
+	}
 }
 #endif /* defined(CONFIG_BT_HCI_ACL_FLOW_CONTROL) */
 
@@ -353,6 +565,7 @@ struct bt_buf *bt_hci_cmd_alloc(os_timeout_t timeout)
 
 	cmd(buf)->opcode = 0;
 	cmd(buf)->sync = NULL;
+	cmd(buf)->cb = NULL;
 	cmd(buf)->state = NULL;
 
 	return buf;
@@ -405,7 +618,85 @@ int bt_hci_cmd_send(uint16_t opcode, struct bt_buf *buf)
 	return 0;
 }
 
+int bt_hci_cmd_send_async(uint16_t opcode, struct bt_buf *buf, bt_hci_cmd_cb_t cb,
+			  void *user_data)
+{
+	if (!buf) {
+		buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
+		if (!buf) {
+			return -ENOBUFS;
+		}
+	} else if (buf->pool != &hci_cmd_pool) {
+		/* `cmd(buf)` depends on this  */
+		__ASSERT_NO_MSG(false);
+		return -EINVAL;
+	}
+
+	/* Host Number Of Completed Packets never completes */
+	if (opcode == BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS) {
+		__ASSERT_NO_MSG(false);
+		return -EINVAL;
+	}
+
+	cmd(buf)->cb = cb;
+	cmd(buf)->user_data = user_data;
+
+	return bt_hci_cmd_send(opcode, buf);
+}
+
 static bool process_pending_cmd(os_timeout_t timeout);
+
+/* Commands are sent from the system work queue, so a caller running on it
+ * has to send them itself, up to and including buf, before waiting for it.
+ */
+static void cmd_send_until(struct bt_buf *buf)
+{
+	struct bt_buf *cmd = NULL;
+
+	/* TODO: disallow sending sync commands from syswq altogether */
+	if (!os_thread_is_current(&main_work_q.thread)) {
+		return;
+	}
+
+	/* drain the command queue until we get to send the command of interest. */
+	do {
+		cmd = bt_fifo_peek_head(&bt_dev.cmd_tx_queue);
+		LOG_DBG("process cmd %p want %p", cmd, buf);
+
+		/* Wait for a response from the Bluetooth Controller.
+		 * The Controller may fail to respond if:
+		 *  - It was never programmed or connected.
+		 *  - There was a fatal error.
+		 *
+		 * See the `BT_HCI_OP_` macros in hci_types.h or
+		 * Core_v5.4, Vol 4, Part E, Section 5.4.1 and Section 7
+		 * to map the opcode to the HCI command documentation.
+		 * Example: 0x0c03 represents HCI_Reset command.
+		 */
+		__maybe_unused bool success = process_pending_cmd(HCI_CMD_TIMEOUT);
+
+		BT_ASSERT_MSG(success, "command opcode 0x%04x timeout", cmd(buf)->opcode);
+	} while (buf != cmd);
+}
+
+static int hci_status_to_err(uint8_t status)
+{
+	switch (status) {
+	case BT_HCI_ERR_SUCCESS:
+		return 0;
+	case BT_HCI_ERR_CONN_LIMIT_EXCEEDED:
+		return -ECONNREFUSED;
+	case BT_HCI_ERR_INSUFFICIENT_RESOURCES:
+		return -ENOMEM;
+	case BT_HCI_ERR_INVALID_PARAM:
+		return -EINVAL;
+	case BT_HCI_ERR_CMD_DISALLOWED:
+		return -EACCES;
+	default:
+		return -EIO;
+	}
+}
+
 int bt_hci_cmd_send_sync(uint16_t opcode, struct bt_buf *buf,
 			 struct bt_buf **rsp)
 {
@@ -441,34 +732,10 @@ int bt_hci_cmd_send_sync(uint16_t opcode, struct bt_buf *buf,
 		return err;
 	}
 
-	/* TODO: disallow sending sync commands from syswq altogether */
-
 	/* Since the commands are now processed in the syswq, we cannot suspend
 	 * and wait. We have to send the command from the current context.
 	 */
-		if (os_thread_is_current(&main_work_q.thread)) {
-		/* drain the command queue until we get to send the command of interest. */
-		struct bt_buf *cmd = NULL;
-
-		do {
-			cmd = bt_fifo_peek_head(&bt_dev.cmd_tx_queue);
-			LOG_DBG("process cmd %p want %p", cmd, buf);
-
-			/* Wait for a response from the Bluetooth Controller.
-			 * The Controller may fail to respond if:
-			 *  - It was never programmed or connected.
-			 *  - There was a fatal error.
-			 *
-			 * See the `BT_HCI_OP_` macros in hci_types.h or
-			 * Core_v5.4, Vol 4, Part E, Section 5.4.1 and Section 7
-			 * to map the opcode to the HCI command documentation.
-			 * Example: 0x0c03 represents HCI_Reset command.
-			 */
-			__maybe_unused bool success = process_pending_cmd(HCI_CMD_TIMEOUT);
-
-			BT_ASSERT_MSG(success, "command opcode 0x%04x timeout", opcode);
-		} while (buf != cmd);
-	}
+	cmd_send_until(buf);
 
 	/* Now that we have sent the command, suspend until the LL replies */
 	err = os_sem_take(&sync_sem, HCI_CMD_TIMEOUT);
@@ -482,18 +749,7 @@ int bt_hci_cmd_send_sync(uint16_t opcode, struct bt_buf *buf,
 			status, bt_hci_err_to_str(status));
 		bt_buf_unref(buf);
 
-		switch (status) {
-		case BT_HCI_ERR_CONN_LIMIT_EXCEEDED:
-			return -ECONNREFUSED;
-		case BT_HCI_ERR_INSUFFICIENT_RESOURCES:
-			return -ENOMEM;
-		case BT_HCI_ERR_INVALID_PARAM:
-			return -EINVAL;
-		case BT_HCI_ERR_CMD_DISALLOWED:
-			return -EACCES;
-		default:
-			return -EIO;
-		}
+		return hci_status_to_err(status);
 	}
 
 	LOG_DBG("rsp %p opcode 0x%04x len %u", buf, opcode, buf->len);
@@ -633,7 +889,12 @@ static void hci_num_completed_packets(struct bt_buf *buf)
 			/* move the next TX context from the `pending` list to
 			 * the `complete` list.
 			 */
+			os_mutex_lock(&conn->tx_lock, OS_TIMEOUT_FOREVER);
 			node = bt_slist_get(&conn->tx_pending);
+			if (node) {
+				bt_slist_append(&conn->tx_complete, node);
+			}
+			os_mutex_unlock(&conn->tx_lock);
 
 			if (!node) {
 				LOG_ERR("packets count mismatch");
@@ -643,8 +904,6 @@ static void hci_num_completed_packets(struct bt_buf *buf)
 
 			os_sem_give(bt_conn_get_pkts(conn));
 
-			bt_slist_append(&conn->tx_complete, node);
-
 			/* align the `pending` value */
 			__ASSERT_NO_MSG(bt_atomic_get(&conn->in_ll));
 			bt_atomic_dec(&conn->in_ll);
@@ -2496,6 +2755,117 @@ static void hci_reset_complete(void)
 	bt_atomic_set(bt_dev.flags, flags);
 }
 
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+static struct bt_hci_cmd_stats *cmd_stats_slot(uint16_t opcode, bool add)
+{
+	size_t i = (opcode ^ (opcode >> 7)) % ARRAY_SIZE(cmd_stats);
+
+	for (size_t n = 0; n < ARRAY_SIZE(cmd_stats); n++) {
+		if (cmd_stats[i].opcode == opcode) {
+			return &cmd_stats[i];
+		}
+
+		if (cmd_stats[i].opcode == 0) {
+			if (!add) {
+				return NULL;
+			}
+
+			cmd_stats[i].opcode = opcode;
+			return &cmd_stats[i];
+		}
+
+		i = (i + 1) % ARRAY_SIZE(cmd_stats);
+	}
+
+	return NULL;
+}
+
+/* Called with cmd_lock held */
+static void cmd_stats_record(uint16_t opcode, uint8_t status, uint64_t ns)
+{
+	struct bt_hci_cmd_stats *stats = cmd_stats_slot(opcode, true);
+	uint32_t us = MIN(ns / 1000U, UINT32_MAX);
+	unsigned int bucket;
+
+	if (!stats) {
+		return;
+	}
+
+	bucket = us ? find_msb_set(us) - 1 : 0;
+
+	stats->count++;
+	stats->failed += (status != BT_HCI_ERR_SUCCESS);
+	stats->time_ns += ns;
+	stats->max_ns = MAX(stats->max_ns, ns);
+	stats->hist[MIN(bucket, BT_HCI_CMD_LATENCY_BUCKETS - 1)]++;
+}
+
+int bt_hci_cmd_stats_get(uint16_t opcode, struct bt_hci_cmd_stats *stats)
+{
+	const struct bt_hci_cmd_stats *slot;
+	int err = -ENOENT;
+
+	os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+	slot = opcode ? cmd_stats_slot(opcode, false) : NULL;
+	if (slot) {
+		*stats = *slot;
+		err = 0;
+	}
+	os_mutex_unlock(&cmd_lock);
+
+	return err;
+}
+
+void bt_hci_cmd_stats_foreach(bt_hci_cmd_stats_cb_t func, void *user_data)
+{
+	struct bt_hci_cmd_stats stats;
+
+	for (size_t i = 0; i < ARRAY_SIZE(cmd_stats); i++) {
+		os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+		stats = cmd_stats[i];
+		os_mutex_unlock(&cmd_lock);
+
+		if (stats.opcode) {
+			func(&stats, user_data);
+		}
+	}
+}
+
+void bt_hci_cmd_stats_reset(void)
+{
+	os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+	memset(cmd_stats, 0, sizeof(cmd_stats));
+	os_mutex_unlock(&cmd_lock);
+}
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+
+/* Takes the in-flight command with this OpCode off the window */
+static struct bt_buf *cmd_in_flight_take(uint16_t opcode, uint8_t status)
+{
+	struct bt_buf *buf = NULL;
+
+	os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+	for (uint8_t i = 0; i < bt_dev.cmd_in_flight; i++) {
+		if (cmd(bt_dev.sent_cmds[i])->opcode != opcode) {
+			continue;
+		}
+
+		buf = bt_dev.sent_cmds[i];
+		bt_dev.cmd_in_flight--;
+		memmove(&bt_dev.sent_cmds[i], &bt_dev.sent_cmds[i + 1],
+			(bt_dev.cmd_in_flight - i) * sizeof(bt_dev.sent_cmds[0]));
+		bt_dev.sent_cmds[bt_dev.cmd_in_flight] = NULL;
+
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+		cmd_stats_record(opcode, status, os_time_get_ns() - cmd(buf)->sent_ns);
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+		break;
+	}
+	os_mutex_unlock(&cmd_lock);
+
+	return buf;
+}
+
 static void hci_cmd_done(uint16_t opcode, uint8_t status, struct bt_buf *evt_buf)
 {
 	/* Original command buffer. */
@@ -2511,22 +2881,16 @@ static void hci_cmd_done(uint16_t opcode, uint8_t status, struct bt_buf *evt_buf
 		goto exit;
 	}
 
-	/* Take the original command buffer reference. */
-	buf = bt_atomic_ptr_clear((bt_atomic_ptr_t *)&bt_dev.sent_cmd);
+	/* Take the original command buffer reference. At most one command
+	 * per OpCode is in flight, so the OpCode identifies it.
+	 */
+	buf = cmd_in_flight_take(opcode, status);
 
 	if (!buf) {
 		LOG_ERR("No command sent for cmd complete 0x%04x", opcode);
 		goto exit;
 	}
 
-	if (cmd(buf)->opcode != opcode) {
-		LOG_ERR("OpCode 0x%04x completed instead of expected 0x%04x", opcode,
-			cmd(buf)->opcode);
-		buf = bt_atomic_ptr_set((bt_atomic_ptr_t *)&bt_dev.sent_cmd, buf);
-		__ASSERT_NO_MSG(!buf);
-		goto exit;
-	}
-
 	/* Response data is to be delivered in the original command
 	 * buffer.
 	 */
@@ -2548,12 +2912,32 @@ static void hci_cmd_done(uint16_t opcode, uint8_t status, struct bt_buf *evt_buf
 		os_sem_give(cmd(buf)->sync);
 	}
 
+	if (cmd(buf)->cb) {
+		cmd(buf)->cb(opcode, status, buf, cmd(buf)->user_data);
+	}
+
 exit:
 	if (buf) {
 		bt_buf_unref(buf);
 	}
 }
 
+/* The controller announces how many commands it can take at once. Treat that
+ * as the size of the window, rather than as credits to add, since controllers
+ * differ in whether it counts the command just completed.
+ */
+static void cmd_window_update(uint8_t ncmd)
+{
+	os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+	bt_dev.ncmd = ncmd;
+	os_mutex_unlock(&cmd_lock);
+
+	if (ncmd) {
+		os_sem_give(&bt_dev.ncmd_sem);
+		bt_tx_irq_raise();
+	}
+}
+
 static void hci_cmd_complete(struct bt_buf *buf)
 {
 	struct bt_hci_evt_cmd_complete *evt;
@@ -2583,10 +2967,7 @@ static void hci_cmd_complete(struct bt_buf *buf)
 	hci_cmd_done(opcode, status, buf);
 
 	/* Allow next command to be sent */
-	if (ncmd) {
-		os_sem_give(&bt_dev.ncmd_sem);
-		bt_tx_irq_raise();
-	}
+	cmd_window_update(ncmd);
 }
 
 static void hci_cmd_status(struct bt_buf *buf)
@@ -2604,10 +2985,7 @@ static void hci_cmd_status(struct bt_buf *buf)
 	hci_cmd_done(opcode, evt->status, buf);
 
 	/* Allow next command to be sent */
-	if (ncmd) {
-		os_sem_give(&bt_dev.ncmd_sem);
-		bt_tx_irq_raise();
-	}
+	cmd_window_update(ncmd);
 }
 
 int bt_hci_get_conn_handle(const struct bt_conn *conn, uint16_t *conn_handle)
@@ -2651,6 +3029,77 @@ int bt_hci_register_vnd_evt_cb(bt_hci_vnd_evt_cb_t cb)
 	hci_vnd_evt_cb = cb;
 	return 0;
 }
+
+static struct bt_hci_vnd_evt_handler *vnd_evt_handler_find(uint8_t subevent)
+{
+	struct bt_hci_vnd_evt_handler *h;
+
+	BT_SLIST_FOR_EACH_CONTAINER(&vnd_evt_handlers, h, node) {
+		if (h->subevent == subevent) {
+			return h;
+		}
+	}
+
+	return NULL;
+}
+
+int bt_hci_vnd_evt_handler_register(struct bt_hci_vnd_evt_handler *h)
+{
+	int err = 0;
+
+	if (!h || !h->handler) {
+		return -EINVAL;
+	}
+
+	os_mutex_lock(&vnd_evt_lock, OS_TIMEOUT_FOREVER);
+	if (vnd_evt_handler_find(h->subevent)) {
+		err = -EALREADY;
+	} else {
+		bt_slist_append(&vnd_evt_handlers, &h->node);
+	}
+	os_mutex_unlock(&vnd_evt_lock);
+
+	return err;
+}
+
+int bt_hci_vnd_evt_handler_unregister(struct bt_hci_vnd_evt_handler *h)
+{
+	bool found;
+
+	os_mutex_lock(&vnd_evt_lock, OS_TIMEOUT_FOREVER);
+	found = bt_slist_find_and_remove(&vnd_evt_handlers, &h->node);
+	os_mutex_unlock(&vnd_evt_lock);
+
+	return found ? 0 : -ENOENT;
+}
+
+/* Registered handlers are few and only vendor events pay for the walk */
+static bool vnd_evt_handler_call(uint8_t subevent, struct bt_buf *buf)
+{
+	void (*handler)(struct bt_buf_simple *buf) = NULL;
+	struct bt_hci_vnd_evt_handler *h;
+	uint8_t min_len = 0U;
+
+	os_mutex_lock(&vnd_evt_lock, OS_TIMEOUT_FOREVER);
+	h = vnd_evt_handler_find(subevent);
+	if (h) {
+		handler = h->handler;
+		min_len = h->min_len;
+	}
+	os_mutex_unlock(&vnd_evt_lock);
+
+	if (!handler) {
+		return false;
+	}
+
+	if (buf->len < min_len) {
+		LOG_ERR("Too small (%u bytes) vendor-specific event 0x%02x", buf->len, subevent);
+		return true;
+	}
+
+	handler(&buf->b);
+	return true;
+}
 #endif /* CONFIG_BT_HCI_VS_EVT_USER */
 
 #if defined(CONFIG_BT_TRANSMIT_POWER_CONTROL)
@@ -2800,14 +3249,26 @@ static void hci_vendor_event(struct bt_buf *buf)
 	}
 #endif /* CONFIG_BT_HCI_VS_EVT_USER */
 
-	if (IS_ENABLED(CONFIG_BT_HCI_VS) && !handled) {
+	if (handled) {
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_HCI_VS) || IS_ENABLED(CONFIG_BT_HCI_VS_EVT_USER)) {
 		struct bt_hci_evt_vs *evt;
 
 		evt = bt_buf_pull_mem(buf, sizeof(*evt));
 
 		LOG_DBG("subevent 0x%02x", evt->subevent);
 
-		handle_vs_event(evt->subevent, buf, vs_events, ARRAY_SIZE(vs_events));
+#if defined(CONFIG_BT_HCI_VS_EVT_USER)
+		if (vnd_evt_handler_call(evt->subevent, buf)) {
+			return;
+		}
+#endif /* CONFIG_BT_HCI_VS_EVT_USER */
+
+		if (IS_ENABLED(CONFIG_BT_HCI_VS)) {
+			handle_vs_event(evt->subevent, buf, vs_events, ARRAY_SIZE(vs_events));
+		}
 	}
 }
 
@@ -2995,7 +3456,8 @@ static void hci_le_meta_event(struct bt_buf *buf)
 
 	LOG_DBG("subevent 0x%02x", evt->subevent);
 
-	handle_event(evt->subevent, buf, meta_events, ARRAY_SIZE(meta_events));
+	handle_event(evt->subevent, buf, meta_events, ARRAY_SIZE(meta_events),
+		     EVT_STATS(le_evt_stats));
 }
 
 static const struct event_handler normal_events[] = {
@@ -3132,38 +3594,65 @@ static void hci_event(struct bt_buf *buf)
 		BT_ASSERT(bt_hci_evt_get_flags(hdr->evt) & BT_HCI_EVT_FLAG_RECV);
 	}
 
-	handle_event(hdr->evt, buf, normal_events, ARRAY_SIZE(normal_events));
+	handle_event(hdr->evt, buf, normal_events, ARRAY_SIZE(normal_events), EVT_STATS(evt_stats));
 
 	bt_buf_unref(buf);
 }
 
-static void hci_core_send_cmd(void)
+/* Whether a command with this OpCode may be sent now, cmd_lock held */
+static bool cmd_window_open(uint16_t opcode)
 {
-	struct bt_buf *buf;
-	int err;
+	if (bt_dev.cmd_in_flight >= MIN(bt_dev.ncmd, CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT)) {
+		return false;
+	}
+
+	if (bt_dev.cmd_in_flight == 0) {
+		return true;
+	}
 
-	/* Get next command */
-	LOG_DBG("fetch cmd");
-	buf = bt_fifo_get(&bt_dev.cmd_tx_queue, OS_TIMEOUT_NO_WAIT);
-	BT_ASSERT(buf);
+	/* Completions are matched by OpCode, and HCI_Reset discards whatever
+	 * the controller is working on, so neither can overlap.
+	 */
+	if (opcode == BT_HCI_OP_RESET) {
+		return false;
+	}
+
+	for (uint8_t i = 0; i < bt_dev.cmd_in_flight; i++) {
+		uint16_t sent = cmd(bt_dev.sent_cmds[i])->opcode;
 
-	/* Clear out any existing sent command */
-	if (bt_dev.sent_cmd) {
-		LOG_ERR("Uncleared pending sent_cmd");
-		bt_buf_unref(bt_dev.sent_cmd);
-		bt_dev.sent_cmd = NULL;
+		if (sent == opcode || sent == BT_HCI_OP_RESET) {
+			return false;
+		}
 	}
 
-	bt_dev.sent_cmd = bt_buf_ref(buf);
+	return true;
+}
+
+/* Drops whatever a previous session left in flight */
+static void cmd_window_reset(uint8_t ncmd)
+{
+	os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+	while (bt_dev.cmd_in_flight) {
+		bt_dev.cmd_in_flight--;
+		bt_buf_unref(bt_dev.sent_cmds[bt_dev.cmd_in_flight]);
+		bt_dev.sent_cmds[bt_dev.cmd_in_flight] = NULL;
+	}
+	bt_dev.ncmd = ncmd;
+	os_mutex_unlock(&cmd_lock);
+}
+
+static void hci_core_send_cmd(struct bt_buf *buf)
+{
+	int err;
 
 	LOG_DBG("Sending command 0x%04x (buf %p) to driver", cmd(buf)->opcode, buf);
 
 	err = bt_send(buf);
 	if (err) {
 		LOG_ERR("Unable to send to driver (err %d)", err);
-		os_sem_give(&bt_dev.ncmd_sem);
 		hci_cmd_done(cmd(buf)->opcode, BT_HCI_ERR_UNSPECIFIED, buf);
 		bt_buf_unref(buf);
+		os_sem_give(&bt_dev.ncmd_sem);
 		bt_tx_irq_raise();
 	}
 }
@@ -3397,9 +3886,112 @@ static void le_read_resolving_list_size_complete(struct bt_buf *buf)
 }
 #endif /* defined(CONFIG_BT_SMP) */
 
+/* A parameterless read for hci_read_all() */
+struct hci_read {
+	uint16_t opcode;
+	/* Parses the return parameters, called in the RX context */
+	void (*complete)(struct bt_buf *rsp);
+	int err;
+	struct hci_read_batch *batch;
+};
+
+struct hci_read_batch {
+	os_sem_t done;
+	size_t pending;
+	/* Last read queued, referenced until sent */
+	struct bt_buf *last;
+};
+
+static void hci_read_done(uint16_t opcode, uint8_t status, struct bt_buf *rsp, void *user_data)
+{
+	struct hci_read *read = user_data;
+
+	if (status) {
+		LOG_WRN("opcode 0x%04x status 0x%02x %s", opcode, status,
+			bt_hci_err_to_str(status));
+	} else {
+		read->complete(rsp);
+	}
+
+	read->err = hci_status_to_err(status);
+	os_sem_give(&read->batch->done);
+}
+
+static void hci_read_wait(struct hci_read_batch *batch)
+{
+	if (batch->last) {
+		cmd_send_until(batch->last);
+		bt_buf_unref(batch->last);
+		batch->last = NULL;
+	}
+
+	for (; batch->pending; batch->pending--) {
+		__maybe_unused int err = os_sem_take(&batch->done, HCI_CMD_TIMEOUT);
+
+		BT_ASSERT_MSG(err == 0, "Controller unresponsive, %zu reads pending",
+			      batch->pending);
+	}
+}
+
+/* Queues every read at once so they share the controller's command window,
+ * and returns once all of them completed, each with its own err. Reads go
+ * out in order and fall back to waiting for earlier ones when command buffers
+ * run out.
+ */
+static void hci_read_all(struct hci_read *reads, size_t count)
+{
+	struct hci_read_batch batch = {
+		.pending = 0,
+		.last = NULL,
+	};
+	struct bt_buf *buf, *held;
+	int err;
+
+	os_sem_init(&batch.done, 0, MAX(count, 1));
+
+	for (size_t i = 0; i < count; i++) {
+		reads[i].batch = &batch;
+
+		buf = bt_hci_cmd_alloc(OS_TIMEOUT_NO_WAIT);
+		if (!buf) {
+			hci_read_wait(&batch);
+			buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
+		}
+
+		if (!buf) {
+			reads[i].err = -ENOBUFS;
+			continue;
+		}
+
+		/* Held until sent, see hci_read_wait() */
+		held = bt_buf_ref(buf);
+
+		err = bt_hci_cmd_send_async(reads[i].opcode, buf, hci_read_done, &reads[i]);
+		if (err) {
+			/* Not consumed */
+			bt_buf_unref(held);
+			bt_buf_unref(buf);
+			reads[i].err = err;
+			continue;
+		}
+
+		if (batch.last) {
+			bt_buf_unref(batch.last);
+		}
+		batch.last = held;
+		batch.pending++;
+	}
+
+	hci_read_wait(&batch);
+}
+
 static int common_init(void)
 {
-	struct bt_buf *rsp;
+	struct hci_read reads[] = {
+		{ BT_HCI_OP_READ_LOCAL_FEATURES, read_local_features_complete },
+		{ BT_HCI_OP_READ_LOCAL_VERSION_INFO, read_local_ver_complete },
+		{ BT_HCI_OP_READ_SUPPORTED_COMMANDS, read_supported_commands_complete },
+	};
 	int err;
 
 	if (!drv_quirk_no_reset()) {
@@ -3412,31 +4004,15 @@ static int common_init(void)
 		hci_reset_complete();
 	}
 
-	/* Read Local Supported Features */
-	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_FEATURES, NULL, &rsp);
-	if (err) {
-		return err;
-	}
-	read_local_features_complete(rsp);
-	bt_buf_unref(rsp);
-
-	/* Read Local Version Information */
-	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_LOCAL_VERSION_INFO, NULL,
-				   &rsp);
-	if (err) {
-		return err;
+	/* Read Local Supported Features, Version Information and Supported
+	 * Commands, all at once.
+	 */
+	hci_read_all(reads, ARRAY_SIZE(reads));
+	for (size_t i = 0; i < ARRAY_SIZE(reads); i++) {
+		if (reads[i].err) {
+			return reads[i].err;
+		}
 	}
-	read_local_ver_complete(rsp);
-	bt_buf_unref(rsp);
-
-	/* Read Local Supported Commands */
-	err = bt_hci_cmd_send_sync(BT_HCI_OP_READ_SUPPORTED_COMMANDS, NULL,
-				   &rsp);
-	if (err) {
-		return err;
-	}
-	read_supported_commands_complete(rsp);
-	bt_buf_unref(rsp);
 
 	if (IS_ENABLED(CONFIG_BT_HOST_CRYPTO)) {
 		/* Initialize crypto for host */
@@ -3669,7 +4245,9 @@ static int le_init_iso(void)
 static int le_init(void)
 {
 	struct bt_hci_cp_write_le_host_supp *cp_le;
-	struct bt_buf *buf, *rsp;
+	struct hci_read reads[4];
+	size_t count = 0;
+	struct bt_buf *buf;
 	int err;
 
 	/* For now we only support LE capable controllers */
@@ -3691,35 +4269,48 @@ static int le_init(void)
 		}
 	} else if (IS_ENABLED(CONFIG_BT_CONN)) {
 		/* Read LE Buffer Size */
-		err = bt_hci_cmd_send_sync(BT_HCI_OP_LE_READ_BUFFER_SIZE,
-					   NULL, &rsp);
-		if (err) {
-			return err;
-		}
-
-		le_read_buffer_size_complete(rsp);
-
-		bt_buf_unref(rsp);
+		reads[count++] = (struct hci_read){ BT_HCI_OP_LE_READ_BUFFER_SIZE,
+						    le_read_buffer_size_complete };
 	}
 
 #if defined(CONFIG_BT_BROADCASTER)
+	bt_dev.le.max_adv_data_len = 31;
 	if (IS_ENABLED(CONFIG_BT_EXT_ADV) && BT_DEV_FEAT_LE_EXT_ADV(bt_dev.le.features)) {
 		/* Read LE Max Adv Data Len */
-		err = bt_hci_cmd_send_sync(BT_HCI_OP_LE_READ_MAX_ADV_DATA_LEN, NULL, &rsp);
-		if (err == 0) {
-			le_read_maximum_adv_data_len_complete(rsp);
-			bt_buf_unref(rsp);
-		} else if (err == -EIO) {
+		reads[count++] = (struct hci_read){ BT_HCI_OP_LE_READ_MAX_ADV_DATA_LEN,
+						    le_read_maximum_adv_data_len_complete };
+	}
+#endif /* CONFIG_BT_BROADCASTER */
+
+	/* Read LE Supported States */
+	if (BT_CMD_LE_STATES(bt_dev.supported_commands)) {
+		reads[count++] = (struct hci_read){ BT_HCI_OP_LE_READ_SUPP_STATES,
+						    le_read_supp_states_complete };
+	}
+
+#if defined(CONFIG_BT_SMP)
+	if (BT_FEAT_LE_PRIVACY(bt_dev.le.features)) {
+		reads[count++] = (struct hci_read){ BT_HCI_OP_LE_READ_RL_SIZE,
+						    le_read_resolving_list_size_complete };
+	}
+#endif /* defined(CONFIG_BT_SMP) */
+
+	/* None of these depends on another, read them all at once */
+	hci_read_all(reads, count);
+	for (size_t i = 0; i < count; i++) {
+		if (reads[i].err == 0) {
+			continue;
+		}
+
+		if (reads[i].opcode == BT_HCI_OP_LE_READ_MAX_ADV_DATA_LEN &&
+		    reads[i].err == -EIO) {
 			LOG_WRN("Controller does not support 'LE_READ_MAX_ADV_DATA_LEN'. "
 				"Assuming maximum length is 31 bytes.");
-			bt_dev.le.max_adv_data_len = 31;
-		} else {
-			return err;
+			continue;
 		}
-	} else {
-		bt_dev.le.max_adv_data_len = 31;
+
+		return reads[i].err;
 	}
-#endif /* CONFIG_BT_BROADCASTER */
 
 	if (BT_FEAT_BREDR(bt_dev.features)) {
 		buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
@@ -3739,18 +4330,6 @@ static int le_init(void)
 		}
 	}
 
-	/* Read LE Supported States */
-	if (BT_CMD_LE_STATES(bt_dev.supported_commands)) {
-		err = bt_hci_cmd_send_sync(BT_HCI_OP_LE_READ_SUPP_STATES, NULL,
-					   &rsp);
-		if (err) {
-			return err;
-		}
-
-		le_read_supp_states_complete(rsp);
-		bt_buf_unref(rsp);
-	}
-
 	if (IS_ENABLED(CONFIG_BT_CONN) &&
 	    IS_ENABLED(CONFIG_BT_DATA_LEN_UPDATE) &&
 	    IS_ENABLED(CONFIG_BT_AUTO_DATA_LEN_UPDATE) &&
@@ -3779,9 +4358,8 @@ static int le_init(void)
 		}
 	}
 
-#if defined(CONFIG_BT_SMP)
-	if (BT_FEAT_LE_PRIVACY(bt_dev.le.features)) {
 #if defined(CONFIG_BT_PRIVACY)
+	if (BT_FEAT_LE_PRIVACY(bt_dev.le.features)) {
 		struct bt_hci_cp_le_set_rpa_timeout *cp;
 
 		buf = bt_hci_cmd_alloc(OS_TIMEOUT_FOREVER);
@@ -3796,17 +4374,8 @@ static int le_init(void)
 		if (err) {
 			return err;
 		}
-#endif /* defined(CONFIG_BT_PRIVACY) */
-
-		err = bt_hci_cmd_send_sync(BT_HCI_OP_LE_READ_RL_SIZE, NULL,
-					   &rsp);
-		if (err) {
-			return err;
-		}
-		le_read_resolving_list_size_complete(rsp);
-		bt_buf_unref(rsp);
 	}
-#endif
+#endif /* defined(CONFIG_BT_PRIVACY) */
 
 #if defined(CONFIG_BT_DF)
 	if (BT_FEAT_LE_CONNECTIONLESS_CTE_TX(bt_dev.le.features) ||
@@ -4201,6 +4770,20 @@ int bt_send(struct bt_buf *buf)
 	return bt_hci_send(bt_dev.hci, buf);
 }
 
+size_t bt_send_batch(struct bt_buf **bufs, size_t count)
+{
+	if (count == 1) {
+		return bt_send(bufs[0]) ? 0 : 1;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		bt_monitor_send(bt_monitor_opcode(bufs[i]->data[0], BT_MONITOR_TX),
+				bufs[i]->data + 1, bufs[i]->len - 1);
+	}
+
+	return bt_hci_send_batch(bt_dev.hci, bufs, count);
+}
+
 #if defined(CONFIG_BT_CONN)
 static void le_conn_complete_prio(uint8_t role)
 {
@@ -4250,7 +4833,8 @@ static void hci_le_meta_prio_event(struct bt_buf *buf)
 
 	LOG_DBG("subevent 0x%02x", evt->subevent);
 
-	handle_event(evt->subevent, buf, meta_prio_events, ARRAY_SIZE(meta_prio_events));
+	handle_event(evt->subevent, buf, meta_prio_events, ARRAY_SIZE(meta_prio_events),
+		     EVT_STATS(le_evt_prio_stats));
 }
 
 static const struct event_handler prio_events[] = {
@@ -4299,7 +4883,8 @@ static void hci_event_prio(struct bt_buf *buf)
 
 	BT_ASSERT(evt_flags & BT_HCI_EVT_FLAG_RECV_PRIO);
 
-	handle_event(hdr->evt, buf, prio_events, ARRAY_SIZE(prio_events));
+	handle_event(hdr->evt, buf, prio_events, ARRAY_SIZE(prio_events),
+		     EVT_STATS(evt_prio_stats));
 
 	if (evt_flags & BT_HCI_EVT_FLAG_RECV) {
 		bt_buf_simple_restore(&buf->b, &state);
@@ -4308,10 +4893,8 @@ static void hci_event_prio(struct bt_buf *buf)
 	}
 }
 
-static void rx_queue_put(struct bt_buf *buf)
+static int rx_work_submit(void)
 {
-	bt_buf_slist_put(&bt_dev.rx_queue, buf);
-
 #if defined(CONFIG_BT_RECV_WORKQ_SYS)
 	const int err = bt_work_submit(&rx_work);
 #elif defined(CONFIG_BT_RECV_WORKQ_BT)
@@ -4319,9 +4902,71 @@ static void rx_queue_put(struct bt_buf *buf)
 #endif /* CONFIG_BT_RECV_WORKQ_SYS */
 	if (err < 0) {
 		LOG_ERR("Could not submit rx_work: %d", err);
+
+		/* Nothing else would submit it while the queue stays non-empty */
+		os_mutex_lock(&rx_queue_lock, OS_TIMEOUT_FOREVER);
+		rx_work_retry = true;
+		os_mutex_unlock(&rx_queue_lock);
+		return err;
+	}
+
+	return 0;
+}
+
+static void rx_queue_put(struct bt_buf *buf)
+{
+	bool submit;
+
+	os_mutex_lock(&rx_queue_lock, OS_TIMEOUT_FOREVER);
+	submit = bt_slist_is_empty(&bt_dev.rx_queue);
+	if (submit) {
+		bt_dev.rx_queue_since = os_time_get_ns();
+	}
+	submit |= rx_work_retry;
+	rx_work_retry = false;
+	bt_slist_append(&bt_dev.rx_queue, &buf->node);
+	os_mutex_unlock(&rx_queue_lock);
+
+	/* A non-empty queue already has the work item pending or running, and
+	 * the handler resubmits itself for whatever it leaves behind, unless a
+	 * submission failed.
+	 */
+	if (submit) {
+		(void)rx_work_submit();
 	}
 }
 
+/* Moves every pending packet to bt_dev.rx_batch, which must be empty */
+static bool rx_queue_take(void)
+{
+	struct bt_hci_rx_stats *stats = &bt_dev.rx_stats;
+	uint64_t since;
+
+	os_mutex_lock(&rx_queue_lock, OS_TIMEOUT_FOREVER);
+	bt_dev.rx_batch = bt_dev.rx_queue;
+	bt_slist_init(&bt_dev.rx_queue);
+	since = bt_dev.rx_queue_since;
+	os_mutex_unlock(&rx_queue_lock);
+
+	if (bt_slist_is_empty(&bt_dev.rx_batch)) {
+		return false;
+	}
+
+	since = os_time_get_ns() - since;
+	stats->takes++;
+	stats->residency_ns += since;
+	if (since > stats->residency_max_ns) {
+		stats->residency_max_ns = since;
+	}
+
+	return true;
+}
+
+void bt_hci_rx_stats_get(struct bt_hci_rx_stats *stats)
+{
+	*stats = bt_dev.rx_stats;
+}
+
 static int bt_recv_unsafe(struct bt_buf *buf)
 {
 	/* Don't pull the type, snice we still need it in the rx queue */
@@ -4391,13 +5036,13 @@ static int bt_recv_unsafe(struct bt_buf *buf)
 int bt_hci_recv(const struct bt_hci_transport *transport, struct bt_buf *buf)
 {
 	ARG_UNUSED(transport);
-	int err;
 
-	os_sched_lock();
-	err = bt_recv_unsafe(buf);
-	os_sched_unlock();
-
-	return err;
+	/* Called from the transport's single RX context. The priority handlers
+	 * only touch state that is atomic or guarded by its own lock (command
+	 * window, sent_cmds, per-connection TX context lists), so no global
+	 * lock is needed here.
+	 */
+	return bt_recv_unsafe(buf);
 }
 
 int bt_hci_transport_register(const struct bt_hci_transport *transport)
@@ -4472,18 +5117,9 @@ static void init_work(struct bt_work *work)
 	}
 }
 
-static void rx_work_handler(struct bt_work *work)
+static void rx_process(struct bt_buf *buf)
 {
 	uint8_t type;
-	int err;
-
-	struct bt_buf *buf;
-
-	LOG_DBG("Getting bt_buf from queue");
-	buf = bt_buf_slist_get(&bt_dev.rx_queue);
-	if (!buf) {
-		return;
-	}
 
 	type = bt_buf_pull_u8(buf);
 
@@ -4508,23 +5144,57 @@ static void rx_work_handler(struct bt_work *work)
 		bt_buf_unref(buf);
 		break;
 	}
+}
+
+static void rx_work_handler(struct bt_work *work)
+{
+	struct bt_hci_rx_stats *stats = &bt_dev.rx_stats;
+	uint32_t count = 0U;
+	struct bt_buf *buf;
 
-	/* Schedule the work handler to be executed again if there are
-	 * additional items in the queue. This allows for other users of the
-	 * work queue to get a chance at running, which wouldn't be possible if
-	 * we used a while() loop with a os_thread_yield() statement.
+	/* Packets are taken off the shared queue all at once and processed from
+	 * bt_dev.rx_batch, which only this work item touches, so a burst costs
+	 * one lock acquisition instead of one per packet.
 	 */
-	if (!bt_slist_is_empty(&bt_dev.rx_queue)) {
+	while (count < CONFIG_BT_RECV_BATCH_BUDGET) {
+		if (bt_slist_is_empty(&bt_dev.rx_batch) && !rx_queue_take()) {
+			break;
+		}
 
-#if defined(CONFIG_BT_RECV_WORKQ_SYS)
-		err = bt_work_submit(&rx_work);
-#elif defined(CONFIG_BT_RECV_WORKQ_BT)
-		err = bt_work_submit_to_queue(&bt_workq, &rx_work);
-#endif
-		if (err < 0) {
-			LOG_ERR("Could not submit rx_work: %d", err);
+		buf = (void *)bt_slist_get_not_empty(&bt_dev.rx_batch);
+		rx_process(buf);
+		count++;
+	}
+
+	if (count) {
+		stats->batches++;
+		stats->packets += count;
+		if (count > stats->max_batch) {
+			stats->max_batch = count;
 		}
 	}
+
+	if (count < CONFIG_BT_RECV_BATCH_BUDGET) {
+		return;
+	}
+
+	/* Out of budget: schedule the work handler to be executed again if
+	 * there is more to do. This allows for other users of the work queue
+	 * to get a chance at running, which wouldn't be possible if we kept
+	 * looping here.
+	 */
+	if (bt_slist_is_empty(&bt_dev.rx_batch)) {
+		os_mutex_lock(&rx_queue_lock, OS_TIMEOUT_FOREVER);
+		count = bt_slist_is_empty(&bt_dev.rx_queue) ? 0U : 1U;
+		os_mutex_unlock(&rx_queue_lock);
+
+		if (!count) {
+			return;
+		}
+	}
+
+	stats->yields++;
+	(void)rx_work_submit();
 }
 
 #if defined(CONFIG_BT_TESTING)
@@ -4583,8 +5253,10 @@ int bt_enable(bt_ready_cb_t cb)
 	 * initial Command Complete for NOP.
 	 */
 	if (!IS_ENABLED(CONFIG_BT_WAIT_NOP)) {
+		cmd_window_reset(1);
 		os_sem_init(&bt_dev.ncmd_sem, 1, 1);
 	} else {
+		cmd_window_reset(0);
 		os_sem_init(&bt_dev.ncmd_sem, 0, 1);
 	}
 	bt_fifo_init(&bt_dev.cmd_tx_queue);
@@ -4593,12 +5265,13 @@ int bt_enable(bt_ready_cb_t cb)
 	/* RX thread */
 	const struct bt_work_queue_config bt_workq_cfg = {
 		.name = "BT RX WQ",
+		.cpu_mask = CONFIG_BT_RX_CPU_MASK,
 	};
 
 	bt_work_queue_init(&bt_workq);
 	bt_work_queue_start(&bt_workq,
 			   CONFIG_BT_RX_STACK_SIZE,
-			   OS_PRIORITY(CONFIG_BT_RX_PRIO), &bt_workq_cfg);
+			   OS_PRIORITY_COOP(CONFIG_BT_RX_PRIO), &bt_workq_cfg);
 	os_thread_name_set(&bt_workq.thread, "BT RX WQ");
 #endif
 
@@ -4983,11 +5656,28 @@ int bt_configure_data_path(uint8_t dir, uint8_t id, uint8_t vs_config_len,
 /* Return `true` if a command was processed/sent */
 static bool process_pending_cmd(os_timeout_t timeout)
 {
-	if (!bt_fifo_is_empty(&bt_dev.cmd_tx_queue)) {
-		if (os_sem_take(&bt_dev.ncmd_sem, timeout) == 0) {
-			hci_core_send_cmd();
+	struct bt_buf *buf;
+
+	/* Only this context takes commands off the queue, so the head stays */
+	while ((buf = bt_fifo_peek_head(&bt_dev.cmd_tx_queue))) {
+		os_mutex_lock(&cmd_lock, OS_TIMEOUT_FOREVER);
+		if (cmd_window_open(cmd(buf)->opcode)) {
+			buf = bt_fifo_get(&bt_dev.cmd_tx_queue, OS_TIMEOUT_NO_WAIT);
+			BT_ASSERT(buf);
+
+			cmd(buf)->sent_ns = os_time_get_ns();
+			bt_dev.sent_cmds[bt_dev.cmd_in_flight++] = bt_buf_ref(buf);
+			os_mutex_unlock(&cmd_lock);
+
+			hci_core_send_cmd(buf);
 			return true;
 		}
+		os_mutex_unlock(&cmd_lock);
+
+		/* Woken up by every completion and window update */
+		if (os_sem_take(&bt_dev.ncmd_sem, timeout) != 0) {
+			break;
+		}
 	}
 
 	return false;
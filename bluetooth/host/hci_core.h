@@ -12,10 +12,33 @@
 #include <bluetooth/addr.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/conn.h>
+#include <bluetooth/hci.h>
 #include <bluetooth/hci_types.h>
 
 #include "osdep/os.h"
 
+#ifndef CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_THRESHOLD
+#define CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_THRESHOLD 4
+#endif
+
+#ifndef CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_DELAY_MS
+#define CONFIG_BT_HCI_ACL_FLOW_CONTROL_NOCP_DELAY_MS 5
+#endif
+
+/* Incoming HCI packets processed per RX work item invocation */
+#ifndef CONFIG_BT_RECV_BATCH_BUDGET
+#define CONFIG_BT_RECV_BATCH_BUDGET 16
+#endif
+
+/* HCI commands awaiting Command Complete or Command Status at once */
+#ifndef CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT
+#define CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT 4
+#endif
+
+#ifndef CONFIG_BT_HCI_CMD_STATS_OPCODES
+#define CONFIG_BT_HCI_CMD_STATS_OPCODES 32
+#endif
+
 /* LL connection parameters */
 #define LE_CONN_LATENCY		0x0000
 #define LE_CONN_TIMEOUT		0x002a
@@ -305,11 +328,17 @@ struct bt_dev_le {
 	uint8_t                    rl_entries;
 #endif /* CONFIG_BT_SMP */
 	/* List of `struct bt_conn` that have either pending data to send, or
-	 * something to process (e.g. a disconnection event).
+	 * something to process (e.g. a disconnection event). Only the TX
+	 * processor uses it, producers hand connections over through
+	 * conn_ready_q.
 	 *
 	 * Each element in this list contains a reference to its `conn` object.
 	 */
 	bt_slist_t		conn_ready;
+	/* Lock-free MPSC queue of connections marked ready, the reference moves
+	 * with them to conn_ready. See bt_conn_data_ready().
+	 */
+	struct bt_fifo		conn_ready_q;
 };
 
 struct bt_dev_br {
@@ -393,15 +422,28 @@ struct bt_dev {
 	struct bt_dev_br	br;
 #endif
 
-	/* Number of commands controller can accept */
-	os_sem_t		ncmd_sem;
+	/* Number of commands controller can accept, from the last Command
+	 * Complete or Command Status, and the commands sent and not completed
+	 * yet. Guarded by the command lock in hci_core.c.
+	 */
+	uint8_t			ncmd;
+	uint8_t			cmd_in_flight;
+	struct bt_buf		*sent_cmds[CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT];
 
-	/* Last sent HCI command */
-	struct bt_buf		*sent_cmd;
+	/* Given whenever another command may have become sendable */
+	os_sem_t		ncmd_sem;
 
 	/* Queue for incoming HCI events & ACL data */
 	bt_slist_t rx_queue;
 
+	/* When the oldest packet in rx_queue was queued, in ns */
+	uint64_t		rx_queue_since;
+
+	/* Packets taken off rx_queue and not yet processed */
+	bt_slist_t		rx_batch;
+
+	struct bt_hci_rx_stats	rx_stats;
+
 	/* Queue for outgoing HCI commands */
 	struct bt_fifo		cmd_tx_queue;
 
@@ -483,6 +525,11 @@ const bt_addr_le_t *bt_lookup_id_addr(uint8_t id, const bt_addr_le_t *addr);
 
 int bt_send(struct bt_buf *buf);
 
+/* Sends bufs in order in one driver call where the driver supports it, returns
+ * how many the driver took; the caller still owns the rest.
+ */
+size_t bt_send_batch(struct bt_buf **bufs, size_t count);
+
 /* Don't require everyone to include keys.h */
 struct bt_keys;
 void bt_id_add(struct bt_keys *keys);
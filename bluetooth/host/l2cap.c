@@ -20,6 +20,7 @@
 #include <bluetooth/l2cap.h>
 
 #include "buf_view.h"
+#include "common/hci_common_internal.h"
 #include "hci_core.h"
 #include "conn_internal.h"
 #include "l2cap_internal.h"
@@ -35,6 +36,27 @@
 
 #define L2CAP_LE_MAX_CREDITS		(BT_BUF_ACL_RX_COUNT - 1)
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+#if defined(CONFIG_BT_HCI_ACL_FLOW_CONTROL)
+/* ACL buffers the controller may fill before it waits for the host */
+#define L2CAP_SDU_CHAIN_RX_BUFS BT_BUF_HCI_ACL_RX_COUNT
+#else
+/* Events share the RX pool, only its ACL part may be held */
+#define L2CAP_SDU_CHAIN_RX_BUFS (BT_BUF_RX_COUNT - CONFIG_BT_BUF_EVT_RX_COUNT)
+#endif /* CONFIG_BT_HCI_ACL_FLOW_CONTROL */
+
+/* Frames an SDU takes from the budget, its first K-frame came with the
+ * channel's own credit.
+ */
+#define L2CAP_SDU_CHAIN_SDU_FRAMES (CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES - 1)
+
+BUILD_ASSERT(CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET >= L2CAP_SDU_CHAIN_SDU_FRAMES,
+	     "A chained SDU does not fit in CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET");
+/* The whole budget plus a first K-frame, and one buffer left to receive into */
+BUILD_ASSERT(CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET + 1 < L2CAP_SDU_CHAIN_RX_BUFS,
+	     "Chained SDUs would hold every ACL RX buffer, reduce CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET");
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 #define L2CAP_LE_CID_FIXED_START 0x0001
 #define L2CAP_LE_CID_FIXED_END   0x003f
 #define L2CAP_LE_CID_IS_FIXED(_cid) \
@@ -247,6 +269,9 @@ static void l2cap_chan_set_state(struct bt_l2cap_chan *chan, bt_l2cap_chan_state
 
 static void cancel_data_ready(struct bt_l2cap_le_chan *lechan);
 static bool chan_has_data(struct bt_l2cap_le_chan *lechan);
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+static void sdu_chain_release(struct bt_l2cap_le_chan *chan);
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 static void l2cap_chan_del(struct bt_l2cap_chan *chan)
 {
 	const struct bt_l2cap_chan_ops *ops = chan->ops;
@@ -341,11 +366,17 @@ static void init_le_chan_private(struct bt_l2cap_le_chan *le_chan)
 #if defined(CONFIG_BT_L2CAP_DYNAMIC_CHANNEL)
 	le_chan->_sdu = NULL;
 	le_chan->_sdu_len = 0;
-#if defined(CONFIG_BT_L2CAP_SEG_RECV)
+#if defined(CONFIG_BT_L2CAP_SEG_RECV) || defined(CONFIG_BT_L2CAP_SDU_CHAIN)
 	le_chan->_sdu_len_done = 0;
-#endif /* CONFIG_BT_L2CAP_SEG_RECV */
+#endif /* CONFIG_BT_L2CAP_SEG_RECV || CONFIG_BT_L2CAP_SDU_CHAIN */
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	le_chan->_sdu_tail = NULL;
+	le_chan->_sdu_budget = false;
+	le_chan->_sdu_credits_held = 0U;
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 #endif /* CONFIG_BT_L2CAP_DYNAMIC_CHANNEL */
 	memset(&le_chan->_pdu_ready, 0, sizeof(le_chan->_pdu_ready));
+	bt_atomic_set(&le_chan->_pdu_ready_lock, 0);
 	le_chan->_pdu_remaining = 0;
 }
 
@@ -399,7 +430,9 @@ void bt_l2cap_connected(struct bt_conn *conn)
 		return;
 	}
 
-	STRUCT_SECTION_FOREACH(bt_l2cap_fixed_chan, fchan) {
+	struct bt_l2cap_fixed_chan *fchan;
+
+	BT_SLIST_FOR_EACH_CONTAINER(&le_fixed_chans, fchan, node) {
 		struct bt_l2cap_le_chan *le_chan;
 
 		__ASSERT_MSG(L2CAP_LE_CID_IS_FIXED(fchan->cid),
@@ -699,39 +732,46 @@ struct bt_buf *bt_l2cap_create_pdu_timeout(struct bt_buf_pool *pool,
 
 static void raise_data_ready(struct bt_l2cap_le_chan *le_chan)
 {
-	__maybe_unused bool added;
-
-	/* This function is the only function which accesses l2cap_data_ready list that can be
-	 * called from a preemptive thread context, therefore requires a critical section to ensure
-	 * that the data ready list is not modified while we are checking and appending to it.
+	/* Only the caller that raises the flag appends the channel, so a channel
+	 * that is already ready costs one atomic operation and is never listed
+	 * twice. The flag goes down when the channel leaves the list.
 	 */
-	os_sched_lock();
+	if (!bt_atomic_set(&le_chan->_pdu_ready_lock, 1)) {
+		struct bt_conn *conn = le_chan->chan.conn;
 
-	if (!bt_slist_find(&le_chan->chan.conn->l2cap_data_ready,
-				 &le_chan->_pdu_ready, NULL)) {
-		bt_slist_append(&le_chan->chan.conn->l2cap_data_ready,
-				 &le_chan->_pdu_ready);
+		os_mutex_lock(&conn->l2cap_data_ready_lock, OS_TIMEOUT_FOREVER);
+		bt_slist_append(&conn->l2cap_data_ready, &le_chan->_pdu_ready);
+		os_mutex_unlock(&conn->l2cap_data_ready_lock);
 
-		added = true;
+		LOG_DBG("L2CAP channel %p data ready added", le_chan);
 	} else {
-		added = false;
+		LOG_DBG("L2CAP channel %p data ready already added", le_chan);
 	}
 
-	os_sched_unlock();
-
-	LOG_DBG("L2CAP channel %p data ready %s", le_chan, added ? "added" : "already added");
-
 	bt_conn_data_ready(le_chan->chan.conn);
 }
 
 static void lower_data_ready(struct bt_l2cap_le_chan *le_chan)
 {
 	struct bt_conn *conn = le_chan->chan.conn;
-	__maybe_unused bt_snode_t *s = bt_slist_get(&conn->l2cap_data_ready);
+	__maybe_unused bt_snode_t *s;
 
 	LOG_DBG("%p", le_chan);
 
+	os_mutex_lock(&conn->l2cap_data_ready_lock, OS_TIMEOUT_FOREVER);
+	s = bt_slist_get(&conn->l2cap_data_ready);
+	os_mutex_unlock(&conn->l2cap_data_ready_lock);
+
 	__ASSERT_NO_MSG(s == &le_chan->_pdu_ready);
+
+	__maybe_unused bt_atomic_t old = bt_atomic_set(&le_chan->_pdu_ready_lock, 0);
+
+	__ASSERT_NO_MSG(old);
+}
+
+void bt_l2cap_le_chan_data_ready(struct bt_l2cap_le_chan *le_chan)
+{
+	raise_data_ready(le_chan);
 }
 
 static void cancel_data_ready(struct bt_l2cap_le_chan *le_chan)
@@ -740,16 +780,14 @@ static void cancel_data_ready(struct bt_l2cap_le_chan *le_chan)
 
 	LOG_DBG("%p", le_chan);
 
-	/* Use critical section here as this function can be called from
-	 * a preemptive thread context and we need to ensure that the data ready list is not
-	 * modified while we are removing the channel from it.
+	/* This function can be called from a preemptive thread context, the
+	 * data ready list must not be modified while we remove the channel.
 	 */
-	os_sched_lock();
+	os_mutex_lock(&conn->l2cap_data_ready_lock, OS_TIMEOUT_FOREVER);
+	bt_slist_find_and_remove(&conn->l2cap_data_ready, &le_chan->_pdu_ready);
+	os_mutex_unlock(&conn->l2cap_data_ready_lock);
 
-	bt_slist_find_and_remove(&conn->l2cap_data_ready,
-				  &le_chan->_pdu_ready);
-
-	os_sched_unlock();
+	bt_atomic_set(&le_chan->_pdu_ready_lock, 0);
 }
 
 int bt_l2cap_send_pdu(struct bt_l2cap_le_chan *le_chan, struct bt_buf *pdu,
@@ -759,13 +797,13 @@ int bt_l2cap_send_pdu(struct bt_l2cap_le_chan *le_chan, struct bt_buf *pdu,
 		return -ENOTCONN;
 	}
 
-	if (pdu->ref != 1) {
+	if (bt_atomic_get(&pdu->ref) != 1) {
 		/* The host may alter the buf contents when fragmenting. Higher
 		 * layers cannot expect the buf contents to stay intact. Extra
 		 * refs suggests a silent data corruption would occur if not for
 		 * this error.
 		 */
-		LOG_ERR("Expecting 1 ref, got %d", pdu->ref);
+		LOG_ERR("Expecting 1 ref, got %lu", bt_atomic_get(&pdu->ref));
 		return -EINVAL;
 	}
 
@@ -836,18 +874,25 @@ static void chan_take_credit(struct bt_l2cap_le_chan *lechan)
 #endif
 }
 
+static bt_snode_t *peek_ready_chan(struct bt_conn *conn)
+{
+	bt_snode_t *pdu_ready;
+
+	os_mutex_lock(&conn->l2cap_data_ready_lock, OS_TIMEOUT_FOREVER);
+	pdu_ready = bt_slist_peek_head(&conn->l2cap_data_ready);
+	os_mutex_unlock(&conn->l2cap_data_ready_lock);
+
+	return pdu_ready;
+}
+
 static struct bt_l2cap_le_chan *get_ready_chan(struct bt_conn *conn)
 {
 	struct bt_l2cap_le_chan *lechan;
+	bt_snode_t *pdu_ready;
 
-	bt_snode_t *pdu_ready = bt_slist_peek_head(&conn->l2cap_data_ready);
+	while ((pdu_ready = peek_ready_chan(conn)) != NULL) {
+		lechan = CONTAINER_OF(pdu_ready, struct bt_l2cap_le_chan, _pdu_ready);
 
-	if (!pdu_ready) {
-		LOG_DBG("nothing to send on this conn");
-		return NULL;
-	}
-
-	BT_SLIST_FOR_EACH_CONTAINER(&conn->l2cap_data_ready, lechan, _pdu_ready) {
 		if (chan_has_data(lechan)) {
 			LOG_DBG("sending from chan %p (%s) data %d", lechan,
 				L2CAP_LE_CID_IS_DYN(lechan->tx.cid) ? "dynamic" : "static",
@@ -857,8 +902,16 @@ static struct bt_l2cap_le_chan *get_ready_chan(struct bt_conn *conn)
 
 		LOG_DBG("chan %p has no data", lechan);
 		lower_data_ready(lechan);
+
+		/* A producer that queued data after the check above saw the flag
+		 * still up and left it to us.
+		 */
+		if (chan_has_data(lechan)) {
+			raise_data_ready(lechan);
+		}
 	}
 
+	LOG_DBG("nothing to send on this conn");
 	return NULL;
 }
 
@@ -969,6 +1022,11 @@ struct bt_buf *l2cap_data_pull(struct bt_conn *conn,
 		 */
 		LOG_DBG("no credits for new K-frame on %p", lechan);
 		lower_data_ready(lechan);
+
+		/* Credits given after the check above found the flag still up */
+		if (chan_has_credits(lechan)) {
+			raise_data_ready(lechan);
+		}
 		return NULL;
 	}
 
@@ -1275,10 +1333,24 @@ static void l2cap_chan_rx_init(struct bt_l2cap_le_chan *chan)
 	chan->rx.mps = MIN(chan->rx.mtu + BT_L2CAP_SDU_HDR_SIZE,
 			   BT_L2CAP_RX_MTU);
 
+	/* Without alloc_buf, segmented SDUs are chained K-frames, as many as
+	 * CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES of them.
+	 */
+	IF_ENABLED(CONFIG_BT_L2CAP_SDU_CHAIN, ({
+		if (!chan->chan.ops->alloc_buf &&
+		    (CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES * chan->rx.mps <
+		     chan->rx.mtu + BT_L2CAP_SDU_HDR_SIZE)) {
+			LOG_WRN("MTU needs more than %u K-frames, truncating MTU",
+				CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES);
+			chan->rx.mtu = CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES * chan->rx.mps -
+				       BT_L2CAP_SDU_HDR_SIZE;
+		}
+	}))
+
 	/* Truncate MTU if channel have disabled segmentation but still have
 	 * set an MTU which requires it.
 	 */
-	if (!chan->chan.ops->alloc_buf &&
+	if (!IS_ENABLED(CONFIG_BT_L2CAP_SDU_CHAIN) && !chan->chan.ops->alloc_buf &&
 	    (chan->rx.mps < chan->rx.mtu + BT_L2CAP_SDU_HDR_SIZE)) {
 		LOG_WRN("Segmentation disabled but MTU > MPS, truncating MTU");
 		chan->rx.mtu = chan->rx.mps - BT_L2CAP_SDU_HDR_SIZE;
@@ -1362,7 +1434,15 @@ static void l2cap_chan_destroy(struct bt_l2cap_chan *chan)
 		bt_buf_unref(le_chan->_sdu);
 		le_chan->_sdu = NULL;
 		le_chan->_sdu_len = 0U;
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+		le_chan->_sdu_tail = NULL;
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 	}
+
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	/* Also gives up an SDU the application has not completed yet */
+	sdu_chain_release(le_chan);
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 }
 
 static uint16_t le_err_to_result(int err)
@@ -2374,8 +2454,16 @@ static void l2cap_chan_shutdown(struct bt_l2cap_chan *chan)
 		bt_buf_unref(le_chan->_sdu);
 		le_chan->_sdu = NULL;
 		le_chan->_sdu_len = 0U;
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+		le_chan->_sdu_tail = NULL;
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 	}
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	/* Also gives up an SDU the application has not completed yet */
+	sdu_chain_release(le_chan);
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 	/* Remove buffers on the TX queue */
 	while ((buf = bt_fifo_get(&le_chan->tx_queue, OS_TIMEOUT_NO_WAIT))) {
 		bt_buf_unref(buf);
@@ -2423,6 +2511,78 @@ static void l2cap_chan_send_credits(struct bt_l2cap_le_chan *chan,
 	LOG_DBG("chan %p credits %lu", chan, bt_atomic_get(&chan->rx.credits));
 }
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+/* K-frames taken by chained SDUs of all channels, and the channels whose
+ * credits wait for room, oldest first.
+ */
+static os_mutex_t sdu_chain_lock = OS_MUTEX_INITIALIZER;
+static uint16_t sdu_chain_frames;
+static bt_slist_t sdu_chain_waiters = BT_SLIST_STATIC_INIT(&sdu_chain_waiters);
+
+/* Takes the budget for a new chained SDU. Returns the credits to send now,
+ * 0 if they are held back until sdu_chain_release() makes room.
+ */
+static uint16_t sdu_chain_take(struct bt_l2cap_le_chan *chan, uint16_t credits)
+{
+	os_mutex_lock(&sdu_chain_lock, OS_TIMEOUT_FOREVER);
+
+	if (bt_slist_is_empty(&sdu_chain_waiters) &&
+	    sdu_chain_frames + L2CAP_SDU_CHAIN_SDU_FRAMES <= CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET) {
+		sdu_chain_frames += L2CAP_SDU_CHAIN_SDU_FRAMES;
+		chan->_sdu_budget = true;
+	} else {
+		LOG_DBG("chan %p holding back %u credits", chan, credits);
+		chan->_sdu_credits_held = credits;
+		bt_slist_append(&sdu_chain_waiters, &chan->_sdu_wait_node);
+		credits = 0U;
+	}
+
+	os_mutex_unlock(&sdu_chain_lock);
+
+	return credits;
+}
+
+/* Returns chan's share of the budget, then passes it on to waiting channels */
+static void sdu_chain_release(struct bt_l2cap_le_chan *chan)
+{
+	struct bt_l2cap_le_chan *next;
+	uint16_t credits;
+
+	os_mutex_lock(&sdu_chain_lock, OS_TIMEOUT_FOREVER);
+
+	if (chan->_sdu_budget) {
+		sdu_chain_frames -= L2CAP_SDU_CHAIN_SDU_FRAMES;
+		chan->_sdu_budget = false;
+	}
+
+	if (chan->_sdu_credits_held) {
+		bt_slist_find_and_remove(&sdu_chain_waiters, &chan->_sdu_wait_node);
+		chan->_sdu_credits_held = 0U;
+	}
+
+	while (!bt_slist_is_empty(&sdu_chain_waiters) &&
+	       sdu_chain_frames + L2CAP_SDU_CHAIN_SDU_FRAMES <= CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET) {
+		next = CONTAINER_OF(bt_slist_get_not_empty(&sdu_chain_waiters),
+				    struct bt_l2cap_le_chan, _sdu_wait_node);
+		sdu_chain_frames += L2CAP_SDU_CHAIN_SDU_FRAMES;
+		next->_sdu_budget = true;
+		credits = next->_sdu_credits_held;
+		next->_sdu_credits_held = 0U;
+
+		os_mutex_unlock(&sdu_chain_lock);
+
+		LOG_DBG("chan %p sending %u held back credits", next, credits);
+		if (bt_l2cap_chan_get_state(&next->chan) == BT_L2CAP_CONNECTED) {
+			l2cap_chan_send_credits(next, credits);
+		}
+
+		os_mutex_lock(&sdu_chain_lock, OS_TIMEOUT_FOREVER);
+	}
+
+	os_mutex_unlock(&sdu_chain_lock);
+}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 #if defined(CONFIG_BT_L2CAP_SEG_RECV)
 static int l2cap_chan_send_credits_pdu(struct bt_conn *conn, uint16_t cid, uint16_t credits)
 {
@@ -2529,6 +2689,10 @@ int bt_l2cap_chan_recv_complete(struct bt_l2cap_chan *chan, struct bt_buf *buf)
 
 	LOG_DBG("chan %p buf %p", chan, buf);
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	sdu_chain_release(le_chan);
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 	if (bt_l2cap_chan_get_state(&le_chan->chan) == BT_L2CAP_CONNECTED) {
 		l2cap_chan_send_credits(le_chan, 1);
 	}
@@ -2563,6 +2727,14 @@ static void l2cap_chan_le_recv_sdu(struct bt_l2cap_le_chan *chan,
 
 	/* Receiving complete SDU, notify channel and reset SDU buf */
 	err = chan->chan.ops->recv(&chan->chan, buf);
+
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	/* The frames stay held while the application works on the SDU */
+	if (err != -EINPROGRESS) {
+		sdu_chain_release(chan);
+	}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 	if (err < 0) {
 		if (err != -EINPROGRESS) {
 			LOG_ERR("err %d", err);
@@ -2634,6 +2806,76 @@ static void l2cap_chan_le_recv_seg(struct bt_l2cap_le_chan *chan,
 	l2cap_chan_le_recv_sdu(chan, buf, seg);
 }
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+/* Same as l2cap_chan_le_recv_seg(), but the K-frame joins the SDU as a
+ * fragment instead of being copied into it. chan->_sdu is the first one.
+ */
+static void l2cap_chan_le_recv_chain(struct bt_l2cap_le_chan *chan,
+				     struct bt_buf *buf)
+{
+	struct bt_buf *tail = chan->_sdu_tail;
+	uint16_t len = buf->len;
+	uint16_t fill;
+
+	if (chan->_sdu_len_done + len > chan->_sdu_len) {
+		LOG_ERR("SDU length mismatch");
+		bt_l2cap_chan_disconnect(&chan->chan);
+		return;
+	}
+
+	LOG_DBG("chan %p len %u", chan, len);
+
+	chan->_sdu_len_done += len;
+
+	/* A K-frame short of the MPS is topped up by copying, so that the SDU
+	 * never needs more than CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES of them.
+	 */
+	fill = chan->rx.mps - (tail == chan->_sdu ? BT_L2CAP_SDU_HDR_SIZE : 0);
+	if (tail && tail->len < fill) {
+		fill = MIN(MIN(fill - tail->len, bt_buf_tailroom(tail)), len);
+		bt_buf_add_mem(tail, buf->data, fill);
+		if (fill == len) {
+			goto done;
+		}
+
+		/* Keep the rest where the K-frame's data starts, the room
+		 * after it is for the next short one.
+		 */
+		memmove(buf->data, buf->data + fill, len - fill);
+		bt_buf_remove_mem(buf, fill);
+	}
+
+	/* The caller keeps its own reference */
+	buf = bt_buf_ref(buf);
+	if (chan->_sdu) {
+		bt_buf_frag_insert(tail, buf);
+	} else {
+		chan->_sdu = buf;
+	}
+	chan->_sdu_tail = buf;
+
+done:
+	if (chan->_sdu_len_done < chan->_sdu_len) {
+		/* See l2cap_chan_le_recv_seg(), the first K-frame's credits
+		 * are sent by the caller.
+		 */
+		if (tail && bt_atomic_get(&chan->rx.credits) == 0) {
+			LOG_DBG("remote is not fully utilizing MPS");
+			l2cap_chan_send_credits(chan, 1);
+		}
+
+		return;
+	}
+
+	buf = chan->_sdu;
+	chan->_sdu = NULL;
+	chan->_sdu_tail = NULL;
+	chan->_sdu_len = 0U;
+
+	l2cap_chan_le_recv_sdu(chan, buf, 0);
+}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 #if defined(CONFIG_BT_L2CAP_SEG_RECV)
 static void l2cap_chan_le_recv_seg_direct(struct bt_l2cap_le_chan *chan, struct bt_buf *seg)
 {
@@ -2707,6 +2949,12 @@ static void l2cap_chan_le_recv(struct bt_l2cap_le_chan *chan,
 
 	/* Check if segments already exist */
 	if (chan->_sdu) {
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+		if (!chan->chan.ops->alloc_buf) {
+			l2cap_chan_le_recv_chain(chan, buf);
+			return;
+		}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 		l2cap_chan_le_recv_seg(chan, buf);
 		return;
 	}
@@ -2755,6 +3003,29 @@ static void l2cap_chan_le_recv(struct bt_l2cap_le_chan *chan,
 		return;
 	}
 
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	if (sdu_len > buf->len) {
+		chan->_sdu_len = sdu_len;
+		chan->_sdu_len_done = 0U;
+
+		/* Send sdu_len/mps worth of credits, the RX buffers to hold
+		 * them are bounded by the MTU, see l2cap_chan_rx_init(), and
+		 * come out of the budget shared by all channels.
+		 */
+		uint16_t credits = DIV_ROUND_UP(sdu_len - buf->len, chan->rx.mps);
+
+		credits = sdu_chain_take(chan, credits);
+		if (credits) {
+			LOG_DBG("sending %d extra credits (sdu_len %d buf_len %d mps %d)",
+				credits, sdu_len, buf->len, chan->rx.mps);
+			l2cap_chan_send_credits(chan, credits);
+		}
+
+		l2cap_chan_le_recv_chain(chan, buf);
+		return;
+	}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
 	owned_ref = bt_buf_ref(buf);
 	err = chan->chan.ops->recv(&chan->chan, owned_ref);
 	if (err != -EINPROGRESS) {
@@ -3369,7 +3640,7 @@ static int bt_l2cap_dyn_chan_send(struct bt_l2cap_le_chan *le_chan, struct bt_bu
 		return -EMSGSIZE;
 	}
 
-	if (buf->ref != 1) {
+	if (bt_atomic_get(&buf->ref) != 1) {
 		/* The host may alter the buf contents when segmenting. Higher
 		 * layers cannot expect the buf contents to stay intact. Extra
 		 * refs suggests a silent data corruption would occur if not for
@@ -3440,8 +3711,8 @@ int bt_l2cap_chan_send(struct bt_l2cap_chan *chan, struct bt_buf *buf)
 
 	LOG_DBG("chan %p buf %p len %u", chan, buf, buf->len);
 
-	if (buf->ref != 1) {
-		LOG_WRN("Expecting 1 ref, got %d", buf->ref);
+	if (bt_atomic_get(&buf->ref) != 1) {
+		LOG_WRN("Expecting 1 ref, got %lu", bt_atomic_get(&buf->ref));
 		return -EINVAL;
 	}
 
@@ -190,6 +190,9 @@ struct bt_buf *bt_l2cap_create_pdu_timeout(struct bt_buf_pool *pool,
 int bt_l2cap_send_pdu(struct bt_l2cap_le_chan *le_chan, struct bt_buf *pdu,
 		      bt_conn_tx_cb_t cb, void *user_data);
 
+/* Mark the channel as having data to send, harmless when it has none */
+void bt_l2cap_le_chan_data_ready(struct bt_l2cap_le_chan *le_chan);
+
 /* Receive a new L2CAP PDU from a connection */
 void bt_l2cap_recv(struct bt_conn *conn, struct bt_buf *buf, bool complete);
 
@@ -27,7 +27,10 @@ int bt_long_wq_submit(struct bt_work *work)
 static int long_wq_init(void)
 {
 
-	const struct bt_work_queue_config cfg = {.name = "BT LW WQ"};
+	const struct bt_work_queue_config cfg = {
+		.name = "BT LW WQ",
+		.cpu_mask = CONFIG_BT_LONG_WQ_CPU_MASK,
+	};
 
 	bt_work_queue_init(&bt_long_wq);
 
@@ -624,11 +624,19 @@ endif
 ifeq ($(BT_PLATFORM),linux)
   BT_SRCS_PLATFORM := \
 	$(BT_ROOT)/osdep/posix/os.c \
+	$(BT_ROOT)/drivers/h4_rx.c \
+	$(BT_ROOT)/drivers/h4_tx.c \
 	$(BT_ROOT)/drivers/hci_sock.c \
+	$(BT_ROOT)/drivers/loopback.c \
+	$(BT_ROOT)/drivers/shm.c \
+	$(BT_ROOT)/drivers/shm_peer.c \
+	$(BT_ROOT)/drivers/shm_ring.c \
 	$(BT_ROOT)/drivers/userchan.c
 else ifeq ($(BT_PLATFORM),nuttx)
   BT_SRCS_PLATFORM := \
 	$(BT_ROOT)/osdep/posix/os.c \
+	$(BT_ROOT)/drivers/h4_rx.c \
+	$(BT_ROOT)/drivers/h4_tx.c \
 	$(BT_ROOT)/drivers/h4.c
 else ifeq ($(BT_PLATFORM),freertos)
   BT_SRCS_PLATFORM := \
@@ -637,7 +645,20 @@ else
   $(warning Unknown BT_PLATFORM '$(BT_PLATFORM)'; defaulting to linux)
   BT_SRCS_PLATFORM := \
 	$(BT_ROOT)/osdep/posix/os.c \
-	$(BT_ROOT)/drivers/hci_sock.c
+	$(BT_ROOT)/drivers/h4_rx.c \
+	$(BT_ROOT)/drivers/h4_tx.c \
+	$(BT_ROOT)/drivers/hci_sock.c \
+	$(BT_ROOT)/drivers/loopback.c \
+	$(BT_ROOT)/drivers/shm.c \
+	$(BT_ROOT)/drivers/shm_peer.c \
+	$(BT_ROOT)/drivers/shm_ring.c
+endif
+
+# io_uring is Linux only
+ifeq ($(CONFIG_BT_H4_IO_URING),y)
+  ifeq ($(filter nuttx freertos,$(BT_PLATFORM)),)
+    BT_SRCS_PLATFORM += $(BT_ROOT)/drivers/h4_uring.c
+  endif
 endif
 
 # Combine all bluetooth-related sources
@@ -10,6 +10,8 @@
 extern int bt_driver_userchan_init(void);
 extern int bt_work_main_work_init(void);
 extern int bt_driver_h4_init(void);
+extern int bt_driver_loopback_init(void);
+extern int bt_driver_shm_init(void);
 
 int bt_stack_init_once(void)
 {
@@ -22,5 +24,13 @@ int bt_stack_init_once(void)
 	bt_driver_h4_init();
 #endif
 
+#ifdef CONFIG_OPENBLUE_BT_DRIVER_TYPE_LOOPBACK
+	bt_driver_loopback_init();
+#endif
+
+#ifdef CONFIG_OPENBLUE_BT_DRIVER_TYPE_SHM
+	bt_driver_shm_init();
+#endif
+
 	return 0;
 }
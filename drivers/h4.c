@@ -34,12 +34,19 @@
 #include <bluetooth/hci.h>
 #include <drivers/bluetooth.h>
 
+#include "h4_rx.h"
+#include "h4_tx.h"
+#if defined(CONFIG_BT_H4_IO_URING)
+#include "h4_uring.h"
+#endif
+
 #define HCI_DEV_NAME "/dev/ttyHCI0"
 struct h4_data {
 	int fd;
-	os_mutex_t mutex;
 	bool ready;
 	bt_hci_recv_t recv;
+	struct h4_rx rx;
+	struct h4_tx tx;
 };
 
 #define HCI_DEBUG 0
@@ -60,27 +67,6 @@ static void h4_data_dump(const char *tag, uint8_t type, uint8_t *data, uint32_t
 #endif
 }
 
-static int h4_send_data(struct h4_data *h4, uint8_t *buf, size_t count)
-{
-	ssize_t ret, nwritten = 0;
-
-	while (nwritten != count) {
-		ret = write(h4->fd, buf + nwritten, count - nwritten);
-		if (ret < 0) {
-			if (ret == -EAGAIN) {
-				usleep(500);
-				continue;
-			} else {
-				return ret;
-			}
-		}
-
-		nwritten += ret;
-	}
-
-	return nwritten;
-}
-
 static struct bt_buf *get_rx(const uint8_t *buf)
 {
 	bool discardable = false;
@@ -109,209 +95,76 @@ static struct bt_buf *get_rx(const uint8_t *buf)
 	return NULL;
 }
 
-/**
- * @brief Decode the length of an HCI H4 packet and check it's complete
- * @details Decodes packet length according to Bluetooth spec v5.4 Vol 4 Part E
- * @param buf	Pointer to a HCI packet buffer
- * @param buf_len	Bytes available in the buffer
- * @return Length of the complete HCI packet in bytes, -1 if cannot find an HCI
- *         packet, 0 if more data required.
- */
-static int32_t hci_packet_complete(const uint8_t *buf, uint16_t buf_len)
+static struct bt_buf *h4_rx_alloc_cb(const uint8_t *frame, size_t len, void *user_data)
 {
-	uint16_t payload_len = 0;
-	const uint8_t type = buf[0];
-	uint8_t header_len = sizeof(type);
-	const uint8_t *hdr = &buf[sizeof(type)];
-
-	switch (type) {
-	case BT_HCI_H4_CMD: {
-		if (buf_len < header_len + BT_HCI_CMD_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_cmd_hdr *cmd = (const struct bt_hci_cmd_hdr *)hdr;
-
-		/* Parameter Total Length */
-		payload_len = cmd->param_len;
-		header_len += BT_HCI_CMD_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_ACL: {
-		if (buf_len < header_len + BT_HCI_ACL_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_acl_hdr *acl = (const struct bt_hci_acl_hdr *)hdr;
+	struct bt_buf *buf = get_rx(frame);
 
-		/* Data Total Length */
-		payload_len = sys_le16_to_cpu(acl->len);
-		header_len += BT_HCI_ACL_HDR_SIZE;
-		break;
+	if (!buf && frame[0] == BT_HCI_H4_EVT) {
+		LOG_DBG("Discard adv report due to insufficient buf");
 	}
-	case BT_HCI_H4_SCO: {
-		if (buf_len < header_len + BT_HCI_SCO_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_sco_hdr *sco = (const struct bt_hci_sco_hdr *)hdr;
-
-		/* Data_Total_Length */
-		payload_len = sco->len;
-		header_len += BT_HCI_SCO_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_EVT: {
-		if (buf_len < header_len + BT_HCI_EVT_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_evt_hdr *evt = (const struct bt_hci_evt_hdr *)hdr;
-
-		/* Parameter Total Length */
-		payload_len = evt->len;
-		header_len += BT_HCI_EVT_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_ISO: {
-		if (buf_len < header_len + BT_HCI_ISO_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_iso_hdr *iso = (const struct bt_hci_iso_hdr *)hdr;
 
-		/* ISO_Data_Load_Length parameter */
-		payload_len = bt_iso_hdr_len(sys_le16_to_cpu(iso->len));
-		header_len += BT_HCI_ISO_HDR_SIZE;
-		break;
-	}
-	/* If no valid packet type found */
-	default:
-		LOG_WRN("Unknown packet type 0x%02x", type);
-		return -1;
-	}
-
-	/* Request more data */
-	if (buf_len < header_len + payload_len) {
-		return 0;
-	}
-
-	return (int32_t)header_len + payload_len;
+	return buf;
 }
 
-#if 1
-static bool h4_ready(struct h4_data *h4)
+static void h4_rx_recv_cb(struct bt_buf *buf, void *user_data)
 {
-	struct pollfd pollfd = {.fd = h4->fd, .events = POLLIN};
+	const struct bt_hci_transport *transport = user_data;
+	struct h4_data *h4 = transport->user_data;
+
+	LOG_DBG("Calling bt_recv(%p)", buf);
 
-	return (poll(&pollfd, 1, 0) == 1);
+	h4_data_dump("BT RX", buf->data[0], buf->data + 1, buf->len - 1);
+	h4->recv(transport, buf);
 }
-#endif
 
 static void h4_rx_thread(void *p1)
 {
 	const struct bt_hci_transport *transport = p1;
 	struct h4_data *h4 = transport->user_data;
+	struct pollfd pollfd = {.fd = h4->fd, .events = POLLIN};
+	int ret;
 
 	LOG_DBG("started");
 
-	ssize_t frame_size = 0;
+#if defined(CONFIG_BT_H4_IO_URING)
+	ret = h4_uring_rx_loop(&h4->rx, -1);
+	if (ret != -EOPNOTSUPP) {
+		goto out;
+	}
 
-	while (1) {
-		static uint8_t frame[1026];
-		struct bt_buf *buf;
-		size_t buf_tailroom;
-		size_t buf_add_len;
-		ssize_t len;
-		const uint8_t *frame_start = frame;
-
-#if 1
-		if (!h4_ready(h4)) {
-			os_sleep_ms(1);
-			continue;
-		}
+	LOG_WRN("io_uring not available, receiving with poll");
 #endif
 
-		LOG_DBG("calling read()");
-
-		len = read(h4->fd, frame + frame_size, sizeof(frame) - frame_size);
-		if (len < 0) {
+	while (1) {
+		h4->rx.stats.waits++;
+		if (poll(&pollfd, 1, -1) < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
-
-			if (len == -EAGAIN) {
-				usleep(500);
-				continue;
-			}
-
-			LOG_ERR("Reading hci failed, errno %d", errno);
-			close(h4->fd);
-			h4->fd = -1;
-			return;
+			ret = -errno;
+			break;
 		}
 
-		frame_size += len;
-
-		while (frame_size > 0) {
-			const uint8_t *buf_add;
-			const uint8_t packet_type = frame_start[0];
-			const int32_t decoded_len = hci_packet_complete(frame_start, frame_size);
-
-			if (decoded_len == -1) {
-				LOG_ERR("HCI Packet type is invalid, length could not be decoded");
-				frame_size = 0; /* Drop buffer */
-				break;
-			}
-
-			if (decoded_len == 0) {
-				if (frame_size == sizeof(frame)) {
-					LOG_ERR("HCI Packet (%d bytes) is too big for frame (%d "
-						"bytes)",
-						decoded_len, sizeof(frame));
-					frame_size = 0; /* Drop buffer */
-					break;
-				}
-				if (frame_start != frame) {
-					memmove(frame, frame_start, frame_size);
-				}
-				/* Read more */
-				break;
-			}
-
-			buf_add = frame_start + sizeof(packet_type);
-			buf_add_len = decoded_len - sizeof(packet_type);
-
-			buf = get_rx(frame_start);
-
-			frame_size -= decoded_len;
-			frame_start += decoded_len;
-
-			if (!buf) {
-				LOG_DBG("Discard adv report due to insufficient buf");
-				continue;
-			}
-
-			buf_tailroom = bt_buf_tailroom(buf);
-			if (buf_tailroom < buf_add_len) {
-				LOG_ERR("Not enough space in buffer %zu/%zu", buf_add_len,
-					buf_tailroom);
-				bt_buf_unref(buf);
-				continue;
-			}
-
-			bt_buf_add_mem(buf, buf_add, buf_add_len);
-
-			LOG_DBG("Calling bt_recv(%p)", buf);
-
-			h4_data_dump("BT RX", packet_type, buf->data, buf_add_len);
-			h4->recv(transport, buf);
-			os_thread_yield();
+		ret = h4_rx_drain(&h4->rx);
+		if (ret < 0) {
+			break;
 		}
+
+		os_thread_yield();
 	}
+
+#if defined(CONFIG_BT_H4_IO_URING)
+out:
+#endif
+	LOG_ERR("Reading hci failed, err %d", ret);
+	h4_rx_reset(&h4->rx);
+	close(h4->fd);
+	h4->fd = -1;
 }
 
-static int h4_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
+static int h4_prepare(struct bt_buf *buf)
 {
-	struct h4_data *h4 = transport->user_data;
 	enum bt_buf_type type = bt_buf_type_from_h4(bt_buf_pull_u8(buf), BT_BUF_OUT);
-	int len;
-	int ret;
 
 	LOG_DBG("buf %p type %u len %u", buf, type, buf->len);
 
@@ -334,17 +187,46 @@ static int h4_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
 
 	h4_data_dump("BT TX", buf->data[0], buf->data + 1, buf->len - 1);
 
-	os_mutex_lock(&h4->mutex, OS_TIMEOUT_FOREVER);
-	len = buf->len;
-	ret = h4_send_data(h4, buf->data, buf->len);
-	if (ret != len) {
-		ret = -EINVAL;
+	return 0;
+}
+
+static int h4_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	struct h4_data *h4 = transport->user_data;
+	int err = h4_prepare(buf);
+
+	if (err) {
+		return err;
 	}
 
-	bt_buf_unref(buf);
-	os_mutex_unlock(&h4->mutex);
+	h4_tx_send(&h4->tx, buf);
 
-	return ret < 0 ? ret : 0;
+	return 0;
+}
+
+static size_t h4_send_batch(const struct bt_hci_transport *transport, struct bt_buf **bufs,
+			    size_t count)
+{
+	struct h4_data *h4 = transport->user_data;
+	size_t n = 0;
+
+	while (n < count && h4_prepare(bufs[n]) == 0) {
+		n++;
+	}
+
+	h4_tx_send_batch(&h4->tx, bufs, n);
+
+	return n;
+}
+
+static int h4_get_stats(const struct bt_hci_transport *transport,
+			struct bt_hci_driver_stats *stats)
+{
+	struct h4_data *h4 = transport->user_data;
+
+	h4_rx_stats_fill(&h4->rx, stats);
+	h4_tx_stats_fill(&h4->tx, stats);
+	return 0;
 }
 
 static int h4_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
@@ -352,7 +234,7 @@ static int h4_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
 	int ret;
 	struct h4_data *h4 = transport->user_data;
 
-	ret = open(HCI_DEV_NAME, O_RDWR | O_BINARY | O_CLOEXEC);
+	ret = open(HCI_DEV_NAME, O_RDWR | O_BINARY | O_CLOEXEC | O_NONBLOCK);
 	if (ret < 0) {
 		goto bail;
 	}
@@ -360,15 +242,36 @@ static int h4_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
 	h4->fd = ret;
 	LOG_DBG("H4: %s opened as fd %d", HCI_DEV_NAME, h4->fd);
 
+	h4->recv = recv;
+
+	ret = h4_rx_init(&h4->rx, h4->fd, h4_rx_alloc_cb, h4_rx_recv_cb, (void *)transport);
+	if (ret < 0) {
+		goto bail;
+	}
+
+	ret = h4_tx_init(&h4->tx, h4->fd);
+	if (ret < 0) {
+		goto bail;
+	}
+
+#if defined(CONFIG_BT_H4_IO_URING)
+	if (h4_uring_tx_attach(&h4->tx) < 0) {
+		LOG_WRN("io_uring not available, sending with writev");
+	}
+#endif
+
 	ret = (int)os_thread_create(&rx_thread_handle, h4_rx_thread, (void *)transport,
-				    "BT H4 Driver", OS_PRIORITY(CONFIG_BT_RX_PRIO), 3072);
+				    "BT H4 Driver", OS_PRIORITY_COOP(CONFIG_BT_DRIVER_RX_HIGH_PRIO),
+				    3072);
 	if (ret < 0) {
 		goto bail;
 	} else {
 		ret = 0;
 	}
 
-	h4->recv = recv;
+	if (CONFIG_BT_DRIVER_RX_CPU_MASK != 0) {
+		(void)os_thread_affinity_set(&rx_thread_handle, CONFIG_BT_DRIVER_RX_CPU_MASK);
+	}
 
 	os_thread_name_set(&rx_thread_handle, "BT H4 Driver");
 	LOG_DBG("returning");
@@ -376,6 +279,9 @@ static int h4_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
 	return 0;
 
 bail:
+#if defined(CONFIG_BT_H4_IO_URING)
+	h4_uring_tx_detach(&h4->tx);
+#endif
 	close(h4->fd);
 	h4->fd = -1;
 
@@ -385,6 +291,8 @@ bail:
 static const struct bt_hci_driver_api h4_drv_api = {
 	.open = h4_open,
 	.send = h4_send,
+	.send_batch = h4_send_batch,
+	.get_stats = h4_get_stats,
 };
 
 static bool h4_is_ready(const struct bt_hci_transport *transport)
@@ -414,7 +322,6 @@ static int h4_init(void)
 	LOG_DBG("Bluetooth H4 driver init");
 	bt_hci_transport_register(&h4_transport);
 
-	os_mutex_init(&h4->mutex);
 	h4->fd = -1;
 	h4->ready = true;
 
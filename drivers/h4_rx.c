@@ -0,0 +1,474 @@
+/* h4_rx.c - H4 packet reception straight into bt_buf */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <base/byteorder.h>
+
+#include <bluetooth/hci_types.h>
+
+#include "h4_rx.h"
+
+/* Largest H4 header: type + ACL/ISO header */
+#define H4_HDR_MAX (1 + BT_HCI_ACL_HDR_SIZE)
+
+BUILD_ASSERT(H4_RX_STAGING_SIZE >= 1 + BT_HCI_CMD_HDR_SIZE + UINT8_MAX,
+	     "staging area must hold a complete event or command");
+
+/**
+ * @brief Decode an H4 packet header
+ * @details Header layouts per Bluetooth Core v5.4 Vol 4 Part E 5.4
+ * @param buf	Start of the packet, buf[0] is the packet type
+ * @param len	Bytes available at buf
+ * @param total	Set to the full packet length once the header is complete
+ * @return Header length including the type byte, 0 if more data is required
+ *         or -EBADMSG for an unknown packet type.
+ */
+static int frame_hdr(const uint8_t *buf, size_t len, size_t *total)
+{
+	size_t hdr_len;
+	size_t payload_len;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	switch (buf[0]) {
+	case BT_HCI_H4_CMD:
+		hdr_len = 1 + BT_HCI_CMD_HDR_SIZE;
+		if (len < hdr_len) {
+			return 0;
+		}
+		payload_len = buf[3];
+		break;
+	case BT_HCI_H4_ACL:
+		hdr_len = 1 + BT_HCI_ACL_HDR_SIZE;
+		if (len < hdr_len) {
+			return 0;
+		}
+		payload_len = sys_get_le16(&buf[3]);
+		break;
+	case BT_HCI_H4_SCO:
+		hdr_len = 1 + BT_HCI_SCO_HDR_SIZE;
+		if (len < hdr_len) {
+			return 0;
+		}
+		payload_len = buf[3];
+		break;
+	case BT_HCI_H4_EVT:
+		hdr_len = 1 + BT_HCI_EVT_HDR_SIZE;
+		if (len < hdr_len) {
+			return 0;
+		}
+		payload_len = buf[2];
+		break;
+	case BT_HCI_H4_ISO:
+		hdr_len = 1 + BT_HCI_ISO_HDR_SIZE;
+		if (len < hdr_len) {
+			return 0;
+		}
+		payload_len = bt_iso_hdr_len(sys_get_le16(&buf[3]));
+		break;
+	default:
+		return -EBADMSG;
+	}
+
+	*total = hdr_len + payload_len;
+
+	return (int)hdr_len;
+}
+
+/* Events and commands are at most 258 bytes and are handed to alloc complete */
+static bool frame_is_staged(uint8_t type)
+{
+	return type == BT_HCI_H4_EVT || type == BT_HCI_H4_CMD;
+}
+
+int h4_rx_frame_len(const uint8_t *buf, size_t len)
+{
+	size_t total;
+	int hdr_len;
+
+	hdr_len = frame_hdr(buf, len, &total);
+	if (hdr_len <= 0) {
+		return hdr_len;
+	}
+
+	return len < total ? 0 : (int)total;
+}
+
+int h4_rx_init(struct h4_rx *rx, int fd, h4_rx_alloc_t alloc, h4_rx_recv_t recv,
+	       void *user_data)
+{
+	int type;
+	socklen_t optlen = sizeof(type);
+
+	memset(rx, 0, offsetof(struct h4_rx, staging));
+	rx->fd = fd;
+	rx->alloc = alloc;
+	rx->recv = recv;
+	rx->user_data = user_data;
+
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &optlen) == 0) {
+		rx->socket = true;
+		rx->datagram = (type != SOCK_STREAM);
+	} else if (errno != ENOTSOCK) {
+		return -errno;
+	}
+
+	return 0;
+}
+
+void h4_rx_reset(struct h4_rx *rx)
+{
+	if (rx->buf) {
+		bt_buf_unref(rx->buf);
+		rx->buf = NULL;
+	}
+
+	rx->remaining = 0;
+	rx->staged = 0;
+}
+
+static ssize_t rx_readv(struct h4_rx *rx, struct iovec *iov, int iovcnt, int *msg_flags)
+{
+	ssize_t n;
+
+	rx->stats.reads++;
+
+	if (rx->socket) {
+		struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iovcnt};
+
+		n = recvmsg(rx->fd, &msg, MSG_DONTWAIT);
+		if (msg_flags) {
+			*msg_flags = msg.msg_flags;
+		}
+	} else {
+		n = readv(rx->fd, iov, iovcnt);
+	}
+
+	return n;
+}
+
+static void deliver(struct h4_rx *rx, struct bt_buf *buf)
+{
+	rx->stats.frames++;
+	rx->recv(buf, rx->user_data);
+}
+
+/* Allocates for the frame at frame[0] and checks it fits, NULL if it must be dropped */
+static struct bt_buf *frame_alloc(struct h4_rx *rx, const uint8_t *frame, size_t len,
+				  size_t total)
+{
+	struct bt_buf *buf;
+
+	buf = rx->alloc(frame, len, rx->user_data);
+	if (!buf) {
+		rx->stats.no_buf++;
+		return NULL;
+	}
+
+	if (bt_buf_tailroom(buf) < total - 1) {
+		rx->stats.oversize++;
+		bt_buf_unref(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/* Consumes whole frames from the staging area. A frame whose payload is still
+ * arriving is left in rx->buf/rx->remaining so the next read lands in it directly.
+ */
+static int staging_parse(struct h4_rx *rx)
+{
+	int frames = 0;
+	size_t off = 0;
+
+	while (off < rx->staged) {
+		const uint8_t *frame = &rx->staging[off];
+		size_t avail = rx->staged - off;
+		size_t total;
+		size_t copy;
+		int hdr_len;
+
+		if (rx->remaining) {
+			/* Discarding the rest of a dropped frame */
+			size_t skip = MIN(rx->remaining, avail);
+
+			rx->remaining -= skip;
+			off += skip;
+			continue;
+		}
+
+		hdr_len = frame_hdr(frame, avail, &total);
+		if (hdr_len < 0) {
+			/* Stream framing lost, drop everything buffered */
+			rx->stats.dropped++;
+			off = rx->staged;
+			break;
+		}
+
+		if (hdr_len == 0 || (frame_is_staged(frame[0]) && avail < total)) {
+			break;
+		}
+
+		rx->buf = frame_alloc(rx, frame, frame_is_staged(frame[0]) ? total : hdr_len,
+				      total);
+		if (!rx->buf) {
+			rx->remaining = total;
+			continue;
+		}
+
+		copy = MIN(total, avail) - 1;
+		bt_buf_add_mem(rx->buf, frame + 1, copy);
+		rx->stats.bytes_copied += copy;
+		off += 1 + copy;
+		rx->remaining = total - 1 - copy;
+
+		if (rx->remaining == 0) {
+			deliver(rx, rx->buf);
+			rx->buf = NULL;
+			frames++;
+		}
+	}
+
+	rx->staged -= off;
+	if (rx->staged && off) {
+		memmove(rx->staging, &rx->staging[off], rx->staged);
+	}
+
+	return frames;
+}
+
+static int drain_stream(struct h4_rx *rx)
+{
+	int frames = 0;
+
+	while (1) {
+		struct iovec iov[2];
+		int iovcnt = 0;
+		ssize_t n;
+
+		/* Payload first, then whatever follows it into the staging area */
+		if (rx->buf) {
+			iov[iovcnt].iov_base = bt_buf_tail(rx->buf);
+			iov[iovcnt].iov_len = rx->remaining;
+			iovcnt++;
+		}
+		iov[iovcnt].iov_base = &rx->staging[rx->staged];
+		iov[iovcnt].iov_len = sizeof(rx->staging) - rx->staged;
+		iovcnt++;
+
+		n = rx_readv(rx, iov, iovcnt, NULL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return frames;
+			}
+			return -errno;
+		}
+		if (n == 0) {
+			return -ECONNRESET;
+		}
+
+		if (rx->buf) {
+			size_t direct = MIN((size_t)n, rx->remaining);
+
+			bt_buf_add(rx->buf, direct);
+			rx->stats.bytes_direct += direct;
+			rx->remaining -= direct;
+			n -= direct;
+
+			if (rx->remaining == 0) {
+				deliver(rx, rx->buf);
+				rx->buf = NULL;
+				frames++;
+			}
+		}
+
+		rx->staged += n;
+		frames += staging_parse(rx);
+	}
+}
+
+static int drain_datagram(struct h4_rx *rx)
+{
+	int frames = 0;
+
+	while (1) {
+		uint8_t hdr[H4_HDR_MAX];
+		struct iovec iov[2];
+		struct bt_buf *buf;
+		uint8_t type;
+		size_t total;
+		int hdr_len;
+		int flags = 0;
+		ssize_t n;
+
+		/* Peek the header to pick the pool before the packet is consumed */
+		rx->stats.reads++;
+		n = recv(rx->fd, hdr, sizeof(hdr), MSG_PEEK | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return frames;
+			}
+			return -errno;
+		}
+		if (n == 0) {
+			return -ECONNRESET;
+		}
+
+		hdr_len = frame_hdr(hdr, n, &total);
+		if (hdr_len > 0 && frame_is_staged(hdr[0])) {
+			iov[0].iov_base = rx->staging;
+			iov[0].iov_len = sizeof(rx->staging);
+			n = rx_readv(rx, iov, 1, &flags);
+			if (n < 0) {
+				return -errno;
+			}
+
+			if ((flags & MSG_TRUNC) || h4_rx_frame_len(rx->staging, n) != n) {
+				rx->stats.dropped++;
+				continue;
+			}
+
+			buf = frame_alloc(rx, rx->staging, n, n);
+			if (buf) {
+				bt_buf_add_mem(buf, &rx->staging[1], n - 1);
+				rx->stats.bytes_copied += n - 1;
+				deliver(rx, buf);
+				frames++;
+			}
+			continue;
+		}
+
+		buf = NULL;
+		if (hdr_len > 0) {
+			buf = frame_alloc(rx, hdr, hdr_len, total);
+		} else {
+			rx->stats.dropped++;
+		}
+
+		if (!buf) {
+			/* Consume and discard the datagram */
+			iov[0].iov_base = &type;
+			iov[0].iov_len = sizeof(type);
+			if (rx_readv(rx, iov, 1, NULL) < 0) {
+				return -errno;
+			}
+			continue;
+		}
+
+		iov[0].iov_base = &type;
+		iov[0].iov_len = sizeof(type);
+		iov[1].iov_base = bt_buf_tail(buf);
+		iov[1].iov_len = bt_buf_tailroom(buf);
+
+		n = rx_readv(rx, iov, 2, &flags);
+		if (n < 0) {
+			int err = -errno;
+
+			bt_buf_unref(buf);
+			return err;
+		}
+
+		if ((flags & MSG_TRUNC) || (size_t)n != total) {
+			rx->stats.dropped++;
+			bt_buf_unref(buf);
+			continue;
+		}
+
+		bt_buf_add(buf, n - 1);
+		rx->stats.bytes_direct += n - 1;
+		deliver(rx, buf);
+		frames++;
+	}
+}
+
+int h4_rx_drain(struct h4_rx *rx)
+{
+	return rx->datagram ? drain_datagram(rx) : drain_stream(rx);
+}
+
+static int feed_stream(struct h4_rx *rx, const uint8_t *data, size_t len)
+{
+	int frames = 0;
+
+	while (len) {
+		size_t n;
+
+		if (rx->buf) {
+			n = MIN(len, rx->remaining);
+			bt_buf_add_mem(rx->buf, data, n);
+			rx->stats.bytes_copied += n;
+			rx->remaining -= n;
+
+			if (rx->remaining == 0) {
+				deliver(rx, rx->buf);
+				rx->buf = NULL;
+				frames++;
+			}
+		} else {
+			/* staging_parse() always leaves room: a staged frame is at most 259 bytes */
+			n = MIN(len, sizeof(rx->staging) - rx->staged);
+			memcpy(&rx->staging[rx->staged], data, n);
+			rx->staged += n;
+			frames += staging_parse(rx);
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return frames;
+}
+
+static int feed_datagram(struct h4_rx *rx, const uint8_t *data, size_t len)
+{
+	struct bt_buf *buf;
+	size_t total;
+	int hdr_len;
+
+	hdr_len = frame_hdr(data, len, &total);
+	if (hdr_len <= 0 || total != len) {
+		rx->stats.dropped++;
+		return 0;
+	}
+
+	buf = frame_alloc(rx, data, frame_is_staged(data[0]) ? len : (size_t)hdr_len, len);
+	if (!buf) {
+		return 0;
+	}
+
+	bt_buf_add_mem(buf, data + 1, len - 1);
+	rx->stats.bytes_copied += len - 1;
+	deliver(rx, buf);
+
+	return 1;
+}
+
+int h4_rx_feed(struct h4_rx *rx, const uint8_t *data, size_t len)
+{
+	return rx->datagram ? feed_datagram(rx, data, len) : feed_stream(rx, data, len);
+}
+
+void h4_rx_stats_fill(const struct h4_rx *rx, struct bt_hci_driver_stats *stats)
+{
+	stats->rx_packets = rx->stats.frames;
+	stats->rx_bytes = rx->stats.bytes_direct + rx->stats.bytes_copied;
+	stats->rx_syscalls = rx->stats.reads + rx->stats.waits;
+	stats->rx_dropped = rx->stats.dropped + rx->stats.no_buf + rx->stats.oversize;
+}
@@ -0,0 +1,88 @@
+/* h4_rx.h - H4 packet reception straight into bt_buf */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DRIVER_H4_RX_H
+#define __DRIVER_H4_RX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <base/bt_buf.h>
+#include <drivers/bluetooth.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Holds packet headers, whole events/commands and the start of the next frame.
+ * ACL, SCO and ISO payloads beyond what lands here are read into the bt_buf directly.
+ */
+#ifndef H4_RX_STAGING_SIZE
+#define H4_RX_STAGING_SIZE 512
+#endif
+
+/* Returns the buffer a frame is received into or NULL to drop it. frame[0] is the
+ * H4 packet type. Events and commands are passed complete, ACL/SCO/ISO only up to
+ * the end of their header. The frame minus the type byte is appended to the buffer.
+ */
+typedef struct bt_buf *(*h4_rx_alloc_t)(const uint8_t *frame, size_t len, void *user_data);
+typedef void (*h4_rx_recv_t)(struct bt_buf *buf, void *user_data);
+
+struct h4_rx_stats {
+	uint32_t frames;       /* Delivered to recv */
+	uint32_t reads;        /* read/recv system calls */
+	uint32_t waits;        /* epoll_wait/poll calls made by the caller's loop */
+	uint32_t dropped;      /* Bad packet type or truncated datagram */
+	uint32_t no_buf;       /* alloc returned NULL */
+	uint32_t oversize;     /* Frame larger than the buffer's tailroom */
+	uint64_t bytes_direct; /* Payload read straight into a bt_buf */
+	uint64_t bytes_copied; /* Payload copied from the staging area */
+};
+
+struct h4_rx {
+	int fd;
+	bool socket;   /* recv(MSG_DONTWAIT), otherwise fd must be O_NONBLOCK */
+	bool datagram; /* One packet per read, e.g. raw HCI user channel sockets */
+	h4_rx_alloc_t alloc;
+	h4_rx_recv_t recv;
+	void *user_data;
+	struct bt_buf *buf; /* Frame being received, NULL while discarding */
+	size_t remaining;   /* Bytes still owed to buf or to be discarded */
+	size_t staged;
+	struct h4_rx_stats stats;
+	uint8_t staging[H4_RX_STAGING_SIZE];
+};
+
+/* >0 complete frame length, 0 more data needed, -EBADMSG unknown packet type */
+int h4_rx_frame_len(const uint8_t *buf, size_t len);
+
+/* Detects the fd type and resets the reassembly state, 0 or -errno */
+int h4_rx_init(struct h4_rx *rx, int fd, h4_rx_alloc_t alloc, h4_rx_recv_t recv,
+	       void *user_data);
+
+/* Drops a partially received frame */
+void h4_rx_reset(struct h4_rx *rx);
+
+/* Reads until fd would block and delivers every complete frame.
+ * Returns the number of frames delivered, -ECONNRESET on EOF or -errno.
+ */
+int h4_rx_drain(struct h4_rx *rx);
+
+/* Parses data that was received by other means, e.g. through io_uring, as if it
+ * had been read from fd. For datagram fds data must be exactly one packet.
+ * Returns the number of frames delivered.
+ */
+int h4_rx_feed(struct h4_rx *rx, const uint8_t *data, size_t len);
+
+/* Fills the rx_ half of a driver stats snapshot */
+void h4_rx_stats_fill(const struct h4_rx *rx, struct bt_hci_driver_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DRIVER_H4_RX_H */
@@ -0,0 +1,236 @@
+/* h4_tx.c - Coalesced H4 packet transmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "h4_tx.h"
+#if defined(CONFIG_BT_H4_IO_URING)
+#include "h4_uring.h"
+#endif
+
+int h4_tx_init(struct h4_tx *tx, int fd)
+{
+	int type;
+	socklen_t optlen = sizeof(type);
+
+	memset(tx, 0, sizeof(*tx));
+	tx->fd = fd;
+	bt_queue_init(&tx->queue);
+	os_mutex_init(&tx->lock);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &optlen) == 0) {
+		tx->socket = true;
+		tx->datagram = (type != SOCK_STREAM);
+	} else if (errno != ENOTSOCK) {
+		return -errno;
+	}
+
+	return 0;
+}
+
+/* Backpressure: block until the fd drains instead of spinning on EAGAIN */
+static void wait_writable(struct h4_tx *tx)
+{
+	struct pollfd pfd = {.fd = tx->fd, .events = POLLOUT};
+
+	tx->stats.waits++;
+
+	while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+	}
+}
+
+static ssize_t tx_writev(struct h4_tx *tx, const struct iovec *iov, int iovcnt)
+{
+	tx->stats.syscalls++;
+
+	if (tx->socket) {
+		struct msghdr msg = {.msg_iov = (struct iovec *)iov, .msg_iovlen = iovcnt};
+
+		return sendmsg(tx->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	return writev(tx->fd, iov, iovcnt);
+}
+
+/* Returns the number of packets written completely or -errno */
+static int write_stream(struct h4_tx *tx, struct bt_buf **batch, int count)
+{
+	struct iovec iov[H4_TX_BATCH_MAX];
+	int idx = 0;
+
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = batch[i]->data;
+		iov[i].iov_len = batch[i]->len;
+	}
+
+	while (idx < count) {
+		ssize_t n = tx_writev(tx, &iov[idx], count - idx);
+
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				wait_writable(tx);
+				continue;
+			}
+			return -errno;
+		}
+
+		tx->stats.bytes += n;
+
+		/* Skip what was written, a packet may have gone out partially */
+		while (n > 0) {
+			if ((size_t)n < iov[idx].iov_len) {
+				iov[idx].iov_base = (uint8_t *)iov[idx].iov_base + n;
+				iov[idx].iov_len -= n;
+				break;
+			}
+
+			n -= iov[idx].iov_len;
+			idx++;
+			tx->stats.packets++;
+		}
+	}
+
+	return idx;
+}
+
+static int write_datagram(struct h4_tx *tx, struct bt_buf **batch, int count)
+{
+	struct mmsghdr msgs[H4_TX_BATCH_MAX];
+	struct iovec iov[H4_TX_BATCH_MAX];
+	int idx = 0;
+
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = batch[i]->data;
+		iov[i].iov_len = batch[i]->len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while (idx < count) {
+		int n;
+
+		tx->stats.syscalls++;
+		n = sendmmsg(tx->fd, &msgs[idx], count - idx, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				wait_writable(tx);
+				continue;
+			}
+			return -errno;
+		}
+
+		for (int i = 0; i < n; i++) {
+			tx->stats.bytes += msgs[idx + i].msg_len;
+		}
+		tx->stats.packets += n;
+		idx += n;
+	}
+
+	return idx;
+}
+
+static void flush(struct h4_tx *tx)
+{
+	struct bt_buf *batch[H4_TX_BATCH_MAX];
+
+	while (1) {
+		const uint32_t packets = tx->stats.packets;
+		struct bt_buf *buf;
+		int count = 0;
+		int sent;
+
+		while (count < H4_TX_BATCH_MAX &&
+		       (buf = bt_queue_get(&tx->queue, OS_TIMEOUT_NO_WAIT)) != NULL) {
+			batch[count++] = buf;
+		}
+
+		if (count == 0) {
+			return;
+		}
+
+#if defined(CONFIG_BT_H4_IO_URING)
+		if (tx->uring) {
+			sent = h4_uring_tx_write(tx, batch, count);
+		} else
+#endif
+		if (tx->datagram) {
+			sent = write_datagram(tx, batch, count);
+		} else {
+			sent = write_stream(tx, batch, count);
+		}
+
+		if (sent < 0) {
+			tx->err = sent;
+			tx->stats.errors += count - (tx->stats.packets - packets);
+		}
+
+		for (int i = 0; i < count; i++) {
+			bt_buf_unref(batch[i]);
+		}
+	}
+}
+
+static void kick(struct h4_tx *tx)
+{
+	/* Whoever holds the lock writes everything queued meanwhile. Re-check after
+	 * unlocking so a packet queued just before the unlock is not stranded.
+	 */
+	do {
+		if (os_mutex_lock(&tx->lock, OS_TIMEOUT_NO_WAIT) != 0) {
+			return;
+		}
+
+		flush(tx);
+		os_mutex_unlock(&tx->lock);
+	} while (!bt_queue_is_empty(&tx->queue));
+}
+
+void h4_tx_send(struct h4_tx *tx, struct bt_buf *buf)
+{
+	bt_queue_append(&tx->queue, buf);
+	kick(tx);
+}
+
+void h4_tx_send_batch(struct h4_tx *tx, struct bt_buf **bufs, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		bt_queue_append(&tx->queue, bufs[i]);
+	}
+
+	kick(tx);
+}
+
+void h4_tx_reset(struct h4_tx *tx)
+{
+	struct bt_buf *buf;
+
+	os_mutex_lock(&tx->lock, OS_TIMEOUT_FOREVER);
+	while ((buf = bt_queue_get(&tx->queue, OS_TIMEOUT_NO_WAIT)) != NULL) {
+		bt_buf_unref(buf);
+	}
+	os_mutex_unlock(&tx->lock);
+}
+
+void h4_tx_stats_fill(const struct h4_tx *tx, struct bt_hci_driver_stats *stats)
+{
+	stats->tx_packets = tx->stats.packets;
+	stats->tx_bytes = tx->stats.bytes;
+	stats->tx_syscalls = tx->stats.syscalls;
+	stats->tx_waits = tx->stats.waits;
+	stats->tx_errors = tx->stats.errors;
+}
@@ -0,0 +1,70 @@
+/* h4_tx.h - Coalesced H4 packet transmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DRIVER_H4_TX_H
+#define __DRIVER_H4_TX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <base/bt_buf.h>
+#include <base/queue/bt_queue.h>
+#include <osdep/os.h>
+#include <drivers/bluetooth.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Packets gathered into one writev()/sendmmsg() */
+#ifndef H4_TX_BATCH_MAX
+#define H4_TX_BATCH_MAX 32
+#endif
+
+struct h4_tx_stats {
+	uint32_t syscalls; /* writev/sendmmsg calls, including ones that hit EAGAIN */
+	uint32_t packets;
+	uint64_t bytes;
+	uint32_t waits;    /* poll() for POLLOUT after EAGAIN */
+	uint32_t errors;   /* Packets dropped on a write error */
+};
+
+struct h4_uring_tx;
+
+struct h4_tx {
+	int fd;
+	bool socket;
+	bool datagram; /* One packet per write, batched with sendmmsg() */
+	struct bt_queue queue;
+	os_mutex_t lock; /* Held by the thread currently flushing the queue */
+	int err;         /* Last write error, 0 if none */
+	struct h4_uring_tx *uring; /* io_uring backend, NULL for writev/sendmmsg */
+	struct h4_tx_stats stats;
+};
+
+/* Detects the fd type and resets the queue, 0 or -errno */
+int h4_tx_init(struct h4_tx *tx, int fd);
+
+/* Queues buf, whose data starts with the H4 type, and flushes the queue unless
+ * another thread already is. Ownership of buf always moves to tx: write errors
+ * are counted in stats.errors and kept in tx->err.
+ */
+void h4_tx_send(struct h4_tx *tx, struct bt_buf *buf);
+
+/* Same for count packets at once, so they share the writes of one flush */
+void h4_tx_send_batch(struct h4_tx *tx, struct bt_buf **bufs, size_t count);
+
+/* Drops every queued packet */
+void h4_tx_reset(struct h4_tx *tx);
+
+/* Fills the tx_ half of a driver stats snapshot */
+void h4_tx_stats_fill(const struct h4_tx *tx, struct bt_hci_driver_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DRIVER_H4_TX_H */
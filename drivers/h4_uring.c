@@ -0,0 +1,561 @@
+/* h4_uring.c - io_uring backend for H4 reception and transmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Talks to the kernel through the raw io_uring syscalls so there is no
+ * liburing dependency. Reception uses one ring owned by the RX thread with a
+ * provided-buffer ring the kernel fills; a busy link then costs one
+ * io_uring_enter() per wakeup however many packets it returns. Transmission
+ * uses a second ring driven by whichever thread holds the h4_tx lock and
+ * submits a whole batch as linked sends, so packets stay in order.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <base/utils.h>
+
+#include "h4_uring.h"
+
+BUILD_ASSERT((CONFIG_BT_H4_IO_URING_RX_BUFS & (CONFIG_BT_H4_IO_URING_RX_BUFS - 1)) == 0,
+	     "receive buffer count must be a power of two");
+
+#define URING_RX_ENTRIES 4
+/* A batch plus the poll that may precede it */
+#define URING_TX_ENTRIES (H4_TX_BATCH_MAX + 1)
+
+#define URING_RX_BGID 0
+
+enum {
+	URING_DATA_RX = 1,
+	URING_DATA_STOP,
+	URING_DATA_POLL = UINT16_MAX,
+};
+
+/* The ring indices are shared with the kernel */
+#define uring_load_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define uring_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct uring {
+	int fd;
+	/* Submission queue */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int sq_mask;
+	unsigned int sq_local_tail;
+	struct io_uring_sqe *sqes;
+	/* Completion queue */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	/* Mappings */
+	void *sq_map;
+	size_t sq_map_len;
+	void *cq_map;
+	size_t cq_map_len;
+	size_t sqes_len;
+};
+
+struct h4_uring_tx {
+	struct uring ring;
+};
+
+static int uring_enter(struct uring *r, unsigned int to_submit, unsigned int min_complete)
+{
+	int ret;
+
+	ret = syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete,
+		      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+	return ret < 0 ? -errno : ret;
+}
+
+static void uring_exit(struct uring *r)
+{
+	if (r->sqes) {
+		(void)munmap(r->sqes, r->sqes_len);
+	}
+	if (r->cq_map && r->cq_map != r->sq_map) {
+		(void)munmap(r->cq_map, r->cq_map_len);
+	}
+	if (r->sq_map) {
+		(void)munmap(r->sq_map, r->sq_map_len);
+	}
+	if (r->fd >= 0) {
+		(void)close(r->fd);
+	}
+
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+static int uring_init(struct uring *r, unsigned int entries)
+{
+	struct io_uring_params p;
+	unsigned int *sq_array;
+	int err;
+
+	memset(r, 0, sizeof(*r));
+
+	/* Completions are only looked at from io_uring_enter(), no need for IPIs */
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_COOP_TASKRUN;
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0 && errno == EINVAL) {
+		/* Before 5.19 */
+		memset(&p, 0, sizeof(p));
+		r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	}
+	if (r->fd < 0) {
+		err = -errno;
+		r->fd = -1;
+		return err;
+	}
+
+	r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->sq_map_len = MAX(r->sq_map_len, r->cq_map_len);
+	}
+
+	r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			 r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_map == MAP_FAILED) {
+		r->sq_map = NULL;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_map = r->sq_map;
+	} else {
+		r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_map == MAP_FAILED) {
+			r->cq_map = NULL;
+			goto fail;
+		}
+	}
+
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		       IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		goto fail;
+	}
+
+	r->sq_head = (unsigned int *)((uint8_t *)r->sq_map + p.sq_off.head);
+	r->sq_tail = (unsigned int *)((uint8_t *)r->sq_map + p.sq_off.tail);
+	r->sq_mask = *(unsigned int *)((uint8_t *)r->sq_map + p.sq_off.ring_mask);
+	r->sq_local_tail = *r->sq_tail;
+	r->cq_head = (unsigned int *)((uint8_t *)r->cq_map + p.cq_off.head);
+	r->cq_tail = (unsigned int *)((uint8_t *)r->cq_map + p.cq_off.tail);
+	r->cq_mask = *(unsigned int *)((uint8_t *)r->cq_map + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)((uint8_t *)r->cq_map + p.cq_off.cqes);
+
+	/* SQE i always sits in slot i */
+	sq_array = (unsigned int *)((uint8_t *)r->sq_map + p.sq_off.array);
+	for (unsigned int i = 0; i < p.sq_entries; i++) {
+		sq_array[i] = i;
+	}
+
+	return 0;
+
+fail:
+	err = -errno;
+	uring_exit(r);
+
+	return err;
+}
+
+/* Never NULL: callers never queue more than the ring was sized for */
+static struct io_uring_sqe *uring_sqe(struct uring *r)
+{
+	struct io_uring_sqe *sqe = &r->sqes[r->sq_local_tail & r->sq_mask];
+
+	r->sq_local_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+/* Publishes the queued SQEs, returns how many the next enter must submit */
+static unsigned int uring_flush(struct uring *r)
+{
+	uring_store_release(r->sq_tail, r->sq_local_tail);
+
+	return r->sq_local_tail - uring_load_acquire(r->sq_head);
+}
+
+static struct io_uring_cqe *uring_cqe(struct uring *r)
+{
+	unsigned int head = *r->cq_head;
+
+	if (head == uring_load_acquire(r->cq_tail)) {
+		return NULL;
+	}
+
+	return &r->cqes[head & r->cq_mask];
+}
+
+static void uring_cqe_seen(struct uring *r)
+{
+	uring_store_release(r->cq_head, *r->cq_head + 1);
+}
+
+struct uring_rx {
+	struct h4_rx *rx;
+	struct uring ring;
+	struct io_uring_buf_ring *br;
+	size_t br_len;
+	uint8_t *bufs;
+	size_t bufs_len;
+};
+
+static void rx_buf_recycle(struct uring_rx *u, uint16_t bid)
+{
+	const uint16_t mask = CONFIG_BT_H4_IO_URING_RX_BUFS - 1;
+	uint16_t tail = u->br->tail;
+	struct io_uring_buf *b = &u->br->bufs[tail & mask];
+
+	b->addr = (uintptr_t)&u->bufs[bid * H4_URING_RX_BUF_SIZE];
+	b->len = H4_URING_RX_BUF_SIZE;
+	b->bid = bid;
+	uring_store_release(&u->br->tail, (uint16_t)(tail + 1));
+}
+
+static int rx_bufs_init(struct uring_rx *u)
+{
+	struct io_uring_buf_reg reg;
+
+	u->br_len = CONFIG_BT_H4_IO_URING_RX_BUFS * sizeof(struct io_uring_buf);
+	u->br = mmap(NULL, u->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->br == MAP_FAILED) {
+		u->br = NULL;
+		return -errno;
+	}
+
+	u->bufs_len = CONFIG_BT_H4_IO_URING_RX_BUFS * H4_URING_RX_BUF_SIZE;
+	u->bufs = mmap(NULL, u->bufs_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+		       0);
+	if (u->bufs == MAP_FAILED) {
+		u->bufs = NULL;
+		return -errno;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)u->br;
+	reg.ring_entries = CONFIG_BT_H4_IO_URING_RX_BUFS;
+	reg.bgid = URING_RX_BGID;
+	if (syscall(__NR_io_uring_register, u->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		return -errno;
+	}
+
+	for (uint16_t bid = 0; bid < CONFIG_BT_H4_IO_URING_RX_BUFS; bid++) {
+		rx_buf_recycle(u, bid);
+	}
+
+	return 0;
+}
+
+static void rx_exit(struct uring_rx *u)
+{
+	/* Closing the ring cancels whatever is still armed */
+	uring_exit(&u->ring);
+
+	if (u->bufs) {
+		(void)munmap(u->bufs, u->bufs_len);
+	}
+	if (u->br) {
+		(void)munmap(u->br, u->br_len);
+	}
+}
+
+static void rx_arm(struct uring_rx *u)
+{
+	struct io_uring_sqe *sqe = uring_sqe(&u->ring);
+
+	sqe->fd = u->rx->fd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_RX_BGID;
+	sqe->user_data = URING_DATA_RX;
+
+	if (u->rx->socket) {
+		/* Stays armed and posts a completion per receive until it runs out of buffers */
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+	} else {
+		sqe->opcode = IORING_OP_READ;
+		sqe->len = H4_URING_RX_BUF_SIZE;
+		sqe->off = (uint64_t)-1;
+	}
+}
+
+static void stop_arm(struct uring_rx *u, int stop_fd)
+{
+	struct io_uring_sqe *sqe = uring_sqe(&u->ring);
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = stop_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_DATA_STOP;
+}
+
+/* Returns 1 to keep going, 0 when stopped or -errno */
+static int rx_complete(struct uring_rx *u, const struct io_uring_cqe *cqe, bool *rearm)
+{
+	uint16_t bid;
+
+	if (cqe->user_data == URING_DATA_STOP) {
+		return 0;
+	}
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		*rearm = true;
+	}
+
+	if (cqe->res == 0) {
+		return -ECONNRESET;
+	}
+
+	if (cqe->res < 0) {
+		switch (cqe->res) {
+		case -ENOBUFS:
+			/* Everything was in use; the buffers are back by the time it re-arms */
+		case -EINTR:
+		case -EAGAIN:
+			return 1;
+		case -EINVAL:
+			/* Kernel without multishot recv or buffer selection for this op */
+			if (u->rx->stats.frames == 0 && u->rx->stats.dropped == 0) {
+				return -EOPNOTSUPP;
+			}
+			__fallthrough;
+		default:
+			return cqe->res;
+		}
+	}
+
+	bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	(void)h4_rx_feed(u->rx, &u->bufs[bid * H4_URING_RX_BUF_SIZE], cqe->res);
+	rx_buf_recycle(u, bid);
+
+	return 1;
+}
+
+int h4_uring_rx_loop(struct h4_rx *rx, int stop_fd)
+{
+	struct uring_rx u = {.rx = rx};
+	int err;
+
+	err = uring_init(&u.ring, URING_RX_ENTRIES);
+	if (err < 0) {
+		LOG_DBG("io_uring_setup failed, err %d", err);
+		return -EOPNOTSUPP;
+	}
+
+	err = rx_bufs_init(&u);
+	if (err < 0) {
+		LOG_DBG("Registering receive buffers failed, err %d", err);
+		rx_exit(&u);
+		return -EOPNOTSUPP;
+	}
+
+	rx_arm(&u);
+	if (stop_fd >= 0) {
+		stop_arm(&u, stop_fd);
+	}
+
+	while (1) {
+		struct io_uring_cqe *cqe;
+		bool rearm = false;
+
+		rx->stats.reads++;
+		err = uring_enter(&u.ring, uring_flush(&u.ring), 1);
+		if (err < 0 && err != -EINTR) {
+			break;
+		}
+
+		err = 1;
+		while (err > 0 && (cqe = uring_cqe(&u.ring)) != NULL) {
+			err = rx_complete(&u, cqe, &rearm);
+			uring_cqe_seen(&u.ring);
+		}
+
+		if (err <= 0) {
+			break;
+		}
+
+		if (rearm) {
+			rx_arm(&u);
+		}
+	}
+
+	rx_exit(&u);
+
+	return err;
+}
+
+int h4_uring_tx_attach(struct h4_tx *tx)
+{
+	struct h4_uring_tx *ut;
+	int err;
+
+	if (tx->uring) {
+		return 0;
+	}
+
+	ut = os_calloc(1, sizeof(*ut));
+	if (!ut) {
+		return -EOPNOTSUPP;
+	}
+
+	err = uring_init(&ut->ring, URING_TX_ENTRIES);
+	if (err < 0) {
+		LOG_DBG("io_uring_setup failed, err %d", err);
+		os_free(ut);
+		return -EOPNOTSUPP;
+	}
+
+	tx->uring = ut;
+
+	return 0;
+}
+
+void h4_uring_tx_detach(struct h4_tx *tx)
+{
+	struct h4_uring_tx *ut = tx->uring;
+
+	if (!ut) {
+		return;
+	}
+
+	os_mutex_lock(&tx->lock, OS_TIMEOUT_FOREVER);
+	tx->uring = NULL;
+	os_mutex_unlock(&tx->lock);
+
+	uring_exit(&ut->ring);
+	os_free(ut);
+}
+
+static void tx_prep(struct h4_tx *tx, struct io_uring_sqe *sqe, const uint8_t *data,
+		    uint32_t len)
+{
+	sqe->fd = tx->fd;
+	sqe->addr = (uintptr_t)data;
+	sqe->len = len;
+
+	if (tx->socket) {
+		sqe->opcode = IORING_OP_SEND;
+		/* A short send on a stream would break the chain, let the kernel finish it */
+		sqe->msg_flags = MSG_NOSIGNAL | (tx->datagram ? 0 : MSG_WAITALL);
+	} else {
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->off = (uint64_t)-1;
+	}
+}
+
+int h4_uring_tx_write(struct h4_tx *tx, struct bt_buf **batch, int count)
+{
+	struct uring *r = &tx->uring->ring;
+	uint32_t done[H4_TX_BATCH_MAX];
+	int res[H4_TX_BATCH_MAX];
+	bool wait = false;
+	int idx = 0;
+
+	memset(done, 0, sizeof(done[0]) * count);
+
+	while (idx < count) {
+		struct io_uring_cqe *cqe;
+		unsigned int queued = 0;
+		int err;
+
+		if (wait) {
+			/* Backpressure: the chain only starts once fd is writable */
+			struct io_uring_sqe *sqe = uring_sqe(r);
+
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = tx->fd;
+			sqe->poll32_events = POLLOUT;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->user_data = URING_DATA_POLL;
+			tx->stats.waits++;
+			queued++;
+		}
+
+		for (int i = idx; i < count; i++) {
+			struct io_uring_sqe *sqe = uring_sqe(r);
+
+			tx_prep(tx, sqe, batch[i]->data + done[i], batch[i]->len - done[i]);
+			sqe->flags = (i + 1 < count) ? IOSQE_IO_LINK : 0;
+			sqe->user_data = i;
+			res[i] = 0;
+			queued++;
+		}
+
+		tx->stats.syscalls++;
+		err = uring_enter(r, uring_flush(r), queued);
+		if (err < 0 && err != -EINTR) {
+			return err;
+		}
+
+		/* Every SQE completes, a failed link cancels the rest of the chain */
+		while (queued) {
+			cqe = uring_cqe(r);
+			if (!cqe) {
+				err = uring_enter(r, 0, queued);
+				if (err < 0 && err != -EINTR) {
+					return err;
+				}
+				continue;
+			}
+
+			if (cqe->user_data != URING_DATA_POLL) {
+				if (cqe->res > 0) {
+					done[cqe->user_data] += cqe->res;
+					tx->stats.bytes += cqe->res;
+				} else {
+					res[cqe->user_data] = cqe->res;
+				}
+			}
+
+			uring_cqe_seen(r);
+			queued--;
+		}
+
+		while (idx < count && done[idx] == batch[idx]->len) {
+			tx->stats.packets++;
+			idx++;
+		}
+
+		if (idx == count) {
+			break;
+		}
+
+		/* First unfinished packet: retry what can be retried */
+		switch (res[idx]) {
+		case 0:
+		case -EINTR:
+		case -ECANCELED:
+			wait = false;
+			break;
+		case -EAGAIN:
+			wait = true;
+			break;
+		default:
+			return res[idx];
+		}
+	}
+
+	return idx;
+}
@@ -0,0 +1,53 @@
+/* h4_uring.h - io_uring backend for H4 reception and transmission */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DRIVER_H4_URING_H
+#define __DRIVER_H4_URING_H
+
+#include <bluetooth/buf.h>
+
+#include "h4_rx.h"
+#include "h4_tx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Receive buffers handed to the kernel, a power of two */
+#ifndef CONFIG_BT_H4_IO_URING_RX_BUFS
+#define CONFIG_BT_H4_IO_URING_RX_BUFS 64
+#endif
+
+/* Each receive buffer holds the largest frame the host can take, so a datagram
+ * never straddles two of them.
+ */
+#ifndef H4_URING_RX_BUF_SIZE
+#define H4_URING_RX_BUF_SIZE BT_BUF_RX_SIZE
+#endif
+
+/* Drop-in for hci_sock_rx_loop(): receives with a multishot recv (a re-armed read
+ * for non-sockets) into kernel-selected buffers and feeds them to rx. stop_fd may
+ * be -1. Returns 0 when stopped through stop_fd, -EOPNOTSUPP if io_uring is not
+ * usable here, before anything was received, or the error that ended the loop.
+ */
+int h4_uring_rx_loop(struct h4_rx *rx, int stop_fd);
+
+/* Makes tx write each batch as a chain of linked sends through io_uring,
+ * 0 or -EOPNOTSUPP, in which case tx keeps using writev()/sendmmsg().
+ */
+int h4_uring_tx_attach(struct h4_tx *tx);
+
+/* Goes back to writev()/sendmmsg() and releases the ring */
+void h4_uring_tx_detach(struct h4_tx *tx);
+
+/* Called by h4_tx with its lock held; same contract as its own writers */
+int h4_uring_tx_write(struct h4_tx *tx, struct bt_buf **batch, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DRIVER_H4_URING_H */
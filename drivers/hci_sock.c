@@ -21,6 +21,9 @@
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "hci_sock.h"
 
 #define BTPROTO_HCI      1
 #define HCI_CHANNEL_USER 1
@@ -126,3 +129,60 @@ int hci_sock_unix_connect(char socket_path[])
 
 	return fd;
 }
+
+int hci_sock_rx_loop(struct h4_rx *rx, int stop_fd)
+{
+	const int fd = rx->fd;
+	struct epoll_event ev = {.events = EPOLLIN};
+	int epfd;
+	int err = 0;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		return -errno;
+	}
+
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	ev.data.fd = stop_fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, stop_fd, &ev) < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	while (1) {
+		struct epoll_event events[2];
+		int n;
+
+		rx->stats.waits++;
+		n = epoll_wait(epfd, events, 2, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err = -errno;
+			goto out;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.fd == stop_fd) {
+				goto out;
+			}
+		}
+
+		/* EPOLLHUP/EPOLLERR surface as EOF or errno from recv() */
+		err = h4_rx_drain(rx);
+		if (err < 0) {
+			goto out;
+		}
+		err = 0;
+	}
+
+out:
+	close(epfd);
+	return err;
+}
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#include "h4_rx.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,6 +15,11 @@ int hci_sock_socket_open(unsigned short bt_dev_index);
 int hci_sock_net_connect(char ip_addr[], unsigned int port);
 int hci_sock_unix_connect(char socket_path[]);
 
+/* epoll loop draining rx->fd on every wakeup until stop_fd becomes readable.
+ * Returns 0 when stopped through stop_fd, otherwise the error that ended it.
+ */
+int hci_sock_rx_loop(struct h4_rx *rx, int stop_fd);
+
 #ifdef __cplusplus
 }
 #endif
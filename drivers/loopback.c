@@ -0,0 +1,1711 @@
+/* loopback.c - In-process virtual controller HCI driver */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * A controller thread models just enough of an LE controller for the host to
+ * initialise, connect to virtual peers and move ACL and ISO data:
+ *
+ * - send() only queues the packet; the thread answers commands and computes
+ *   when each response or data packet reaches the host.
+ * - Every link serialises its packets at link_rate_bps. Number Of Completed
+ *   Packets is reported when a packet has left the air, echo peers send the
+ *   packet back after that and injected peer data queues behind it.
+ * - Everything sent to the host is delayed by latency_us and delivered in due
+ *   order, so runs are repeatable for a given configuration.
+ * - Commands are answered as they arrive, every answer hands out cmd_credits
+ *   so a host that honours them can pipeline commands across the latency.
+ * - Once the host turns on controller to host flow control, ACL data waits
+ *   for a host buffer that Host Number Of Completed Packets has handed back.
+ *
+ * The thread stops taking new input while too few pending slots are free,
+ * which pushes back on the host the same way a slow HCI transport does.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <base/byteorder.h>
+#include <base/queue/bt_queue.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/loopback.h>
+
+#define LB_THREAD_STACK_SIZE 2048
+
+/* Packets on their way to the host */
+#define LB_PENDING_MAX 64
+
+#define LB_MAX_CIS BT_LOOPBACK_MAX_PEERS
+#define LB_ISO_HANDLE_BASE 0x0100
+#define LB_NO_HANDLE 0xffff
+
+/* A command answers with a status, up to one event per CIS and one more */
+#define LB_PENDING_HEADROOM (LB_MAX_CIS + 2)
+
+/* Peer data fragments in flight from the API to the controller thread */
+#define LB_INJECT_BUFS 16
+#define LB_INJECT_FRAG 251
+
+/* Private packet types for work queued by the API */
+#define LB_H4_PEER_ACL 0xf2
+#define LB_H4_PEER_DISCONN 0xf5
+
+/* Zeroed return parameters for commands the model does not know */
+#define LB_RP_PAD 16
+
+#define LB_MAX_OCTETS 251
+#define LB_MAX_TIME 17040
+
+struct lb_peer {
+	bt_addr_le_t addr;
+	enum bt_loopback_peer_mode mode;
+	bool used;
+	uint16_t handle; /* Connection handle, 0 while disconnected */
+	uint8_t tx_phy;
+	uint8_t rx_phy;
+	uint64_t air_free_ns; /* When the link is done with what it already carries */
+	uint16_t host_unacked; /* ACL packets the host has not reported completed */
+};
+
+struct lb_cis {
+	uint16_t handle; /* 0 while the slot is unused */
+	uint8_t cig_id;
+	uint8_t cis_id;
+	uint16_t acl_handle; /* 0 until established */
+	uint64_t air_free_ns;
+};
+
+struct lb_pkt {
+	uint64_t due;
+	struct bt_buf *buf; /* Data with the H4 type in front, NULL for events */
+	uint16_t handle;    /* Link the packet goes away with, LB_NO_HANDLE for none */
+	int16_t next;
+	uint8_t len;
+	uint8_t evt[BT_HCI_EVT_HDR_SIZE + UINT8_MAX];
+};
+
+struct lb_data {
+	bool ready;
+	bool configured;
+	bt_atomic_t open;
+	bt_hci_recv_t recv;
+	struct bt_loopback_config cfg;
+	os_mutex_t lock; /* Peer handles, read by the API threads */
+	struct lb_peer peers[BT_LOOPBACK_MAX_PEERS];
+	struct lb_cis cis[LB_MAX_CIS];
+
+	/* Owned by the controller thread */
+	struct bt_queue in;
+	struct bt_queue held; /* Input waiting for pending slots */
+	bt_snode_t stop;
+	uint64_t now;
+	uint64_t le_evt_mask;
+	uint64_t rand;
+	bool initiating;
+	struct lb_pkt pkts[LB_PENDING_MAX];
+	int16_t head;
+	int16_t tail;
+	int16_t free;
+	uint16_t nfree;
+
+	struct bt_hci_driver_stats stats;
+	bt_atomic_t tx_syscalls; /* Bumped by the sending threads */
+	struct bt_loopback_host_flow_stats host_flow;
+	struct bt_loopback_cmd_stats cmd;
+};
+
+static os_thread_t lb_thread_data;
+
+BT_BUF_POOL_FIXED_DEFINE(lb_inject_pool, LB_INJECT_BUFS,
+			 1 + BT_HCI_ACL_HDR_SIZE + LB_INJECT_FRAG, 0, NULL);
+
+static struct lb_data _lb_data = {
+	.lock = OS_MUTEX_INITIALIZER,
+};
+
+static uint64_t air_ns(const struct lb_data *lb, size_t bytes)
+{
+	if (lb->cfg.link_rate_bps == 0) {
+		return 0;
+	}
+
+	return (uint64_t)bytes * 8U * 1000000000ULL / lb->cfg.link_rate_bps;
+}
+
+/* Puts bytes on the air behind whatever the link already carries, returns when they are done */
+static uint64_t air_send(struct lb_data *lb, uint64_t *air_free_ns, size_t bytes)
+{
+	*air_free_ns = MAX(lb->now, *air_free_ns) + air_ns(lb, bytes);
+
+	return *air_free_ns;
+}
+
+static uint64_t to_host(const struct lb_data *lb, uint64_t t)
+{
+	return t + (uint64_t)lb->cfg.latency_us * 1000U;
+}
+
+static void pending_reset(struct lb_data *lb)
+{
+	for (int i = 0; i < LB_PENDING_MAX; i++) {
+		lb->pkts[i].next = (i + 1 < LB_PENDING_MAX) ? i + 1 : -1;
+	}
+	lb->free = 0;
+	lb->nfree = LB_PENDING_MAX;
+	lb->head = -1;
+	lb->tail = -1;
+}
+
+static struct lb_pkt *pending_alloc(struct lb_data *lb)
+{
+	struct lb_pkt *pkt;
+
+	if (lb->free < 0) {
+		return NULL;
+	}
+
+	pkt = &lb->pkts[lb->free];
+	lb->free = pkt->next;
+	lb->nfree--;
+	pkt->buf = NULL;
+	pkt->handle = LB_NO_HANDLE;
+	pkt->len = 0;
+
+	return pkt;
+}
+
+/* Inserts after every packet due no later, so equal due times keep their order */
+static void pending_insert(struct lb_data *lb, struct lb_pkt *pkt)
+{
+	int16_t idx = pkt - lb->pkts;
+	int16_t prev = -1;
+	int16_t cur;
+
+	if (lb->tail >= 0 && lb->pkts[lb->tail].due <= pkt->due) {
+		prev = lb->tail;
+	} else {
+		for (cur = lb->head; cur >= 0 && lb->pkts[cur].due <= pkt->due;
+		     cur = lb->pkts[cur].next) {
+			prev = cur;
+		}
+	}
+
+	if (prev < 0) {
+		pkt->next = lb->head;
+		lb->head = idx;
+	} else {
+		pkt->next = lb->pkts[prev].next;
+		lb->pkts[prev].next = idx;
+	}
+
+	if (pkt->next < 0) {
+		lb->tail = idx;
+	}
+}
+
+static void pending_unlink(struct lb_data *lb, int16_t prev, int16_t idx)
+{
+	struct lb_pkt *pkt = &lb->pkts[idx];
+
+	if (prev < 0) {
+		lb->head = pkt->next;
+	} else {
+		lb->pkts[prev].next = pkt->next;
+	}
+	if (lb->tail == idx) {
+		lb->tail = prev;
+	}
+
+	if (pkt->buf) {
+		bt_buf_unref(pkt->buf);
+		pkt->buf = NULL;
+	}
+
+	pkt->next = lb->free;
+	lb->free = idx;
+	lb->nfree++;
+}
+
+/* Drops what is still owed to the host for handle, or everything for LB_NO_HANDLE */
+static void pending_purge(struct lb_data *lb, uint16_t handle)
+{
+	int16_t prev = -1;
+	int16_t cur = lb->head;
+
+	while (cur >= 0) {
+		int16_t next = lb->pkts[cur].next;
+
+		if (handle == LB_NO_HANDLE || lb->pkts[cur].handle == handle) {
+			pending_unlink(lb, prev, cur);
+		} else {
+			prev = cur;
+		}
+		cur = next;
+	}
+}
+
+static void queue_evt(struct lb_data *lb, uint64_t due, uint16_t handle, uint8_t evt,
+		      const void *params, uint8_t len)
+{
+	struct lb_pkt *pkt = pending_alloc(lb);
+
+	/* LB_PENDING_HEADROOM keeps a slot for everything one input produces */
+	__ASSERT_NO_MSG(pkt);
+
+	pkt->due = due;
+	pkt->handle = handle;
+	pkt->evt[0] = evt;
+	pkt->evt[1] = len;
+	memcpy(&pkt->evt[BT_HCI_EVT_HDR_SIZE], params, len);
+	pkt->len = BT_HCI_EVT_HDR_SIZE + len;
+
+	pending_insert(lb, pkt);
+}
+
+static void queue_le_evt(struct lb_data *lb, uint8_t subevent, const void *params, uint8_t len)
+{
+	uint8_t meta[1 + UINT8_MAX - 1];
+
+	meta[0] = subevent;
+	memcpy(&meta[1], params, len);
+
+	queue_evt(lb, to_host(lb, lb->now), LB_NO_HANDLE, BT_HCI_EVT_LE_META_EVENT, meta, len + 1);
+}
+
+static void queue_data(struct lb_data *lb, uint64_t due, uint16_t handle, struct bt_buf *buf)
+{
+	struct lb_pkt *pkt = pending_alloc(lb);
+
+	__ASSERT_NO_MSG(pkt);
+
+	pkt->due = due;
+	pkt->handle = handle;
+	pkt->buf = buf;
+
+	pending_insert(lb, pkt);
+}
+
+static void queue_nocp(struct lb_data *lb, uint64_t due, uint16_t handle)
+{
+	struct {
+		struct bt_hci_evt_num_completed_packets nocp;
+		struct bt_hci_handle_count h;
+	} __packed ep = {
+		.nocp.num_handles = 1,
+		.h.handle = sys_cpu_to_le16(handle),
+		.h.count = sys_cpu_to_le16(1),
+	};
+
+	queue_evt(lb, due, handle, BT_HCI_EVT_NUM_COMPLETED_PACKETS, &ep, sizeof(ep));
+}
+
+static void cmd_complete(struct lb_data *lb, uint16_t opcode, const void *rp, uint8_t len)
+{
+	uint8_t ep[sizeof(struct bt_hci_evt_cmd_complete) + UINT8_MAX - 3];
+	struct bt_hci_evt_cmd_complete *cc = (void *)ep;
+
+	cc->ncmd = lb->cfg.cmd_credits;
+	cc->opcode = sys_cpu_to_le16(opcode);
+	memcpy(&ep[sizeof(*cc)], rp, len);
+
+	queue_evt(lb, to_host(lb, lb->now), LB_NO_HANDLE, BT_HCI_EVT_CMD_COMPLETE, ep,
+		  sizeof(*cc) + len);
+}
+
+static void cmd_complete_status(struct lb_data *lb, uint16_t opcode, uint8_t status)
+{
+	cmd_complete(lb, opcode, &status, sizeof(status));
+}
+
+static void cmd_status(struct lb_data *lb, uint16_t opcode, uint8_t status)
+{
+	struct bt_hci_evt_cmd_status cs = {
+		.status = status,
+		.ncmd = lb->cfg.cmd_credits,
+		.opcode = sys_cpu_to_le16(opcode),
+	};
+
+	queue_evt(lb, to_host(lb, lb->now), LB_NO_HANDLE, BT_HCI_EVT_CMD_STATUS, &cs, sizeof(cs));
+}
+
+static void read_le_features(const struct lb_data *lb, uint8_t features[8])
+{
+	uint64_t feat = BIT64(BT_LE_FEAT_BIT_DLE) | BIT64(BT_LE_FEAT_BIT_PHY_2M);
+
+	if (lb->cfg.iso_pkts) {
+		feat |= BIT64(BT_LE_FEAT_BIT_CIS_CENTRAL) | BIT64(BT_LE_FEAT_BIT_CIS_PERIPHERAL);
+	}
+
+	sys_put_le64(feat, features);
+}
+
+static struct lb_peer *peer_by_handle(struct lb_data *lb, uint16_t handle)
+{
+	if (handle == 0 || handle > BT_LOOPBACK_MAX_PEERS) {
+		return NULL;
+	}
+
+	if (lb->peers[handle - 1].handle != handle) {
+		return NULL;
+	}
+
+	return &lb->peers[handle - 1];
+}
+
+static struct lb_peer *peer_by_addr(struct lb_data *lb, const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < BT_LOOPBACK_MAX_PEERS; i++) {
+		if (lb->peers[i].used && bt_addr_le_eq(&lb->peers[i].addr, addr)) {
+			return &lb->peers[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct lb_cis *cis_by_handle(struct lb_data *lb, uint16_t handle)
+{
+	if (handle < LB_ISO_HANDLE_BASE || handle >= LB_ISO_HANDLE_BASE + LB_MAX_CIS) {
+		return NULL;
+	}
+
+	if (lb->cis[handle - LB_ISO_HANDLE_BASE].handle != handle) {
+		return NULL;
+	}
+
+	return &lb->cis[handle - LB_ISO_HANDLE_BASE];
+}
+
+static void disconn_complete(struct lb_data *lb, uint16_t handle, uint8_t reason)
+{
+	struct bt_hci_evt_disconn_complete ep = {
+		.status = BT_HCI_ERR_SUCCESS,
+		.handle = sys_cpu_to_le16(handle),
+		.reason = reason,
+	};
+
+	pending_purge(lb, handle);
+	queue_evt(lb, to_host(lb, lb->now), LB_NO_HANDLE, BT_HCI_EVT_DISCONN_COMPLETE, &ep,
+		  sizeof(ep));
+}
+
+static void cis_disconnect(struct lb_data *lb, struct lb_cis *cis, uint8_t reason)
+{
+	cis->acl_handle = 0;
+	disconn_complete(lb, cis->handle, reason);
+}
+
+static void peer_disconnect(struct lb_data *lb, struct lb_peer *peer, uint8_t reason)
+{
+	uint16_t handle = peer->handle;
+
+	for (int i = 0; i < LB_MAX_CIS; i++) {
+		if (lb->cis[i].handle && lb->cis[i].acl_handle == handle) {
+			cis_disconnect(lb, &lb->cis[i], reason);
+		}
+	}
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+	peer->handle = 0;
+	os_mutex_unlock(&lb->lock);
+
+	/* The host buffers of a link are considered free once it is gone */
+	lb->host_flow.in_use -= peer->host_unacked;
+	peer->host_unacked = 0;
+
+	disconn_complete(lb, handle, reason);
+}
+
+static void conn_complete(struct lb_data *lb, uint8_t status, struct lb_peer *peer,
+			  const bt_addr_le_t *addr, uint16_t interval, uint16_t latency,
+			  uint16_t timeout)
+{
+	struct bt_hci_evt_le_enh_conn_complete ep = {
+		.status = status,
+		.role = BT_HCI_ROLE_CENTRAL,
+		.interval = sys_cpu_to_le16(interval),
+		.latency = sys_cpu_to_le16(latency),
+		.supv_timeout = sys_cpu_to_le16(timeout),
+	};
+
+	bt_addr_le_copy(&ep.peer_addr, addr);
+
+	if (peer) {
+		os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+		peer->handle = (peer - lb->peers) + 1;
+		os_mutex_unlock(&lb->lock);
+
+		peer->tx_phy = BT_HCI_LE_PHY_1M;
+		peer->rx_phy = BT_HCI_LE_PHY_1M;
+		peer->air_free_ns = lb->now;
+		peer->host_unacked = 0;
+		ep.handle = sys_cpu_to_le16(peer->handle);
+	}
+
+	if (lb->le_evt_mask & BT_EVT_MASK_LE_ENH_CONN_COMPLETE) {
+		queue_le_evt(lb, BT_HCI_EVT_LE_ENH_CONN_COMPLETE, &ep, sizeof(ep));
+	} else {
+		struct bt_hci_evt_le_conn_complete legacy = {
+			.status = ep.status,
+			.handle = ep.handle,
+			.role = ep.role,
+			.interval = ep.interval,
+			.latency = ep.latency,
+			.supv_timeout = ep.supv_timeout,
+		};
+
+		bt_addr_le_copy(&legacy.peer_addr, addr);
+		queue_le_evt(lb, BT_HCI_EVT_LE_CONN_COMPLETE, &legacy, sizeof(legacy));
+	}
+}
+
+static void le_create_conn(struct lb_data *lb, uint16_t opcode, const bt_addr_le_t *addr,
+			   uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+	struct lb_peer *peer;
+
+	if (lb->initiating) {
+		cmd_status(lb, opcode, BT_HCI_ERR_CMD_DISALLOWED);
+		return;
+	}
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+	peer = peer_by_addr(lb, addr);
+	os_mutex_unlock(&lb->lock);
+
+	if (peer && peer->handle) {
+		cmd_status(lb, opcode, BT_HCI_ERR_CONN_ALREADY_EXISTS);
+		return;
+	}
+
+	cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+
+	if (!peer) {
+		/* Nobody advertises there: keep initiating until cancelled */
+		lb->initiating = true;
+		return;
+	}
+
+	conn_complete(lb, BT_HCI_ERR_SUCCESS, peer, addr, interval, latency, timeout);
+}
+
+static void le_set_cig_params(struct lb_data *lb, const uint8_t *params, uint8_t plen)
+{
+	const struct bt_hci_cp_le_set_cig_params *cp = (const void *)params;
+	uint8_t rp_buf[sizeof(struct bt_hci_rp_le_set_cig_params) + LB_MAX_CIS * 2];
+	struct bt_hci_rp_le_set_cig_params *rp = (void *)rp_buf;
+	struct lb_cis *slots[LB_MAX_CIS];
+
+	if (plen < sizeof(*cp) || plen < sizeof(*cp) + cp->num_cis * sizeof(cp->cis[0])) {
+		cmd_complete_status(lb, BT_HCI_OP_LE_SET_CIG_PARAMS, BT_HCI_ERR_INVALID_PARAM);
+		return;
+	}
+
+	if (cp->num_cis > LB_MAX_CIS) {
+		cmd_complete_status(lb, BT_HCI_OP_LE_SET_CIG_PARAMS,
+				    BT_HCI_ERR_MEM_CAPACITY_EXCEEDED);
+		return;
+	}
+
+	/* Reuse the handles of a reconfigured CIG, take free slots for new CIS */
+	for (int i = 0; i < cp->num_cis; i++) {
+		slots[i] = NULL;
+		for (int j = 0; j < LB_MAX_CIS; j++) {
+			if (lb->cis[j].handle && lb->cis[j].cig_id == cp->cig_id &&
+			    lb->cis[j].cis_id == cp->cis[i].cis_id) {
+				slots[i] = &lb->cis[j];
+			}
+		}
+	}
+	for (int i = 0; i < cp->num_cis; i++) {
+		for (int j = 0; j < LB_MAX_CIS && !slots[i]; j++) {
+			if (lb->cis[j].handle == 0) {
+				slots[i] = &lb->cis[j];
+				slots[i]->handle = LB_ISO_HANDLE_BASE + j;
+				slots[i]->cig_id = cp->cig_id;
+				slots[i]->cis_id = cp->cis[i].cis_id;
+				slots[i]->acl_handle = 0;
+			}
+		}
+		if (!slots[i]) {
+			cmd_complete_status(lb, BT_HCI_OP_LE_SET_CIG_PARAMS,
+					    BT_HCI_ERR_MEM_CAPACITY_EXCEEDED);
+			return;
+		}
+	}
+
+	rp->status = BT_HCI_ERR_SUCCESS;
+	rp->cig_id = cp->cig_id;
+	rp->num_handles = cp->num_cis;
+	for (int i = 0; i < cp->num_cis; i++) {
+		rp->handle[i] = sys_cpu_to_le16(slots[i]->handle);
+	}
+
+	cmd_complete(lb, BT_HCI_OP_LE_SET_CIG_PARAMS, rp,
+		     sizeof(*rp) + cp->num_cis * sizeof(rp->handle[0]));
+}
+
+static void le_create_cis(struct lb_data *lb, const uint8_t *params, uint8_t plen)
+{
+	const struct bt_hci_cp_le_create_cis *cp = (const void *)params;
+
+	if (plen < sizeof(*cp) || plen < sizeof(*cp) + cp->num_cis * sizeof(cp->cis[0]) ||
+	    cp->num_cis > LB_MAX_CIS) {
+		cmd_status(lb, BT_HCI_OP_LE_CREATE_CIS, BT_HCI_ERR_INVALID_PARAM);
+		return;
+	}
+
+	for (int i = 0; i < cp->num_cis; i++) {
+		struct lb_cis *cis = cis_by_handle(lb, sys_le16_to_cpu(cp->cis[i].cis_handle));
+
+		if (!cis || cis->acl_handle ||
+		    !peer_by_handle(lb, sys_le16_to_cpu(cp->cis[i].acl_handle))) {
+			cmd_status(lb, BT_HCI_OP_LE_CREATE_CIS, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			return;
+		}
+	}
+
+	cmd_status(lb, BT_HCI_OP_LE_CREATE_CIS, BT_HCI_ERR_SUCCESS);
+
+	for (int i = 0; i < cp->num_cis; i++) {
+		struct lb_cis *cis = cis_by_handle(lb, sys_le16_to_cpu(cp->cis[i].cis_handle));
+		struct bt_hci_evt_le_cis_established ep = {
+			.status = BT_HCI_ERR_SUCCESS,
+			.conn_handle = sys_cpu_to_le16(cis->handle),
+			.c_phy = BT_HCI_LE_PHY_2M,
+			.p_phy = BT_HCI_LE_PHY_2M,
+			.nse = 1,
+			.c_bn = 1,
+			.p_bn = 1,
+			.c_ft = 1,
+			.p_ft = 1,
+			.c_max_pdu = sys_cpu_to_le16(lb->cfg.iso_mtu),
+			.p_max_pdu = sys_cpu_to_le16(lb->cfg.iso_mtu),
+			.interval = sys_cpu_to_le16(8), /* 10 ms */
+		};
+
+		cis->acl_handle = sys_le16_to_cpu(cp->cis[i].acl_handle);
+		cis->air_free_ns = lb->now;
+		queue_le_evt(lb, BT_HCI_EVT_LE_CIS_ESTABLISHED, &ep, sizeof(ep));
+	}
+}
+
+static void le_remove_cig(struct lb_data *lb, uint8_t cig_id)
+{
+	struct bt_hci_rp_le_remove_cig rp = {
+		.status = BT_HCI_ERR_UNKNOWN_CONN_ID,
+		.cig_id = cig_id,
+	};
+
+	for (int i = 0; i < LB_MAX_CIS; i++) {
+		if (lb->cis[i].handle && lb->cis[i].cig_id == cig_id) {
+			if (lb->cis[i].acl_handle) {
+				rp.status = BT_HCI_ERR_CMD_DISALLOWED;
+				break;
+			}
+			rp.status = BT_HCI_ERR_SUCCESS;
+		}
+	}
+
+	if (rp.status == BT_HCI_ERR_SUCCESS) {
+		for (int i = 0; i < LB_MAX_CIS; i++) {
+			if (lb->cis[i].handle && lb->cis[i].cig_id == cig_id) {
+				lb->cis[i].handle = 0;
+			}
+		}
+	}
+
+	cmd_complete(lb, BT_HCI_OP_LE_REMOVE_CIG, &rp, sizeof(rp));
+}
+
+static void controller_reset(struct lb_data *lb)
+{
+	pending_purge(lb, LB_NO_HANDLE);
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+	for (int i = 0; i < BT_LOOPBACK_MAX_PEERS; i++) {
+		lb->peers[i].handle = 0;
+	}
+	os_mutex_unlock(&lb->lock);
+
+	memset(lb->cis, 0, sizeof(lb->cis));
+	lb->host_flow.enabled = false;
+	lb->host_flow.acl_pkts = 0;
+	lb->host_flow.in_use = 0;
+	/* Answers still on their way were purged */
+	lb->cmd.outstanding = 0;
+	lb->initiating = false;
+	lb->le_evt_mask = 0x1f; /* Default LE event mask, Core Vol 4 Part E 7.8.1 */
+	lb->rand = 0x9e3779b97f4a7c15ULL;
+}
+
+static uint64_t next_rand(struct lb_data *lb)
+{
+	/* xorshift64: repeatable across runs, which is what a benchmark wants */
+	lb->rand ^= lb->rand << 13;
+	lb->rand ^= lb->rand >> 7;
+	lb->rand ^= lb->rand << 17;
+
+	return lb->rand;
+}
+
+static void host_nocp(struct lb_data *lb, const uint8_t *params, uint8_t plen)
+{
+	const struct bt_hci_cp_host_num_completed_packets *cp = (const void *)params;
+
+	if (plen < sizeof(*cp) || plen < sizeof(*cp) + cp->num_handles * sizeof(cp->h[0])) {
+		lb->host_flow.nocp_errors++;
+		return;
+	}
+
+	lb->host_flow.nocp_cmds++;
+
+	for (uint8_t i = 0; i < cp->num_handles; i++) {
+		uint16_t handle = sys_le16_to_cpu(cp->h[i].handle);
+		uint16_t count = sys_le16_to_cpu(cp->h[i].count);
+		struct lb_peer *peer = peer_by_handle(lb, handle);
+
+		lb->host_flow.nocp_packets += count;
+
+		if (!peer) {
+			lb->host_flow.nocp_stale++;
+			continue;
+		}
+
+		if (count > peer->host_unacked) {
+			LOG_ERR("Host completed %u packets on handle %u, %u outstanding", count,
+				handle, peer->host_unacked);
+			lb->host_flow.nocp_errors++;
+			count = peer->host_unacked;
+		}
+
+		peer->host_unacked -= count;
+		lb->host_flow.in_use -= count;
+	}
+}
+
+static void handle_cmd(struct lb_data *lb, uint16_t opcode, const uint8_t *params, uint8_t plen)
+{
+	switch (opcode) {
+	case BT_HCI_OP_RESET:
+		controller_reset(lb);
+		cmd_complete_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		break;
+	case BT_HCI_OP_READ_LOCAL_VERSION_INFO: {
+		struct bt_hci_rp_read_local_version_info rp = {
+			.hci_version = BT_HCI_VERSION_5_4,
+			.lmp_version = BT_HCI_VERSION_5_4,
+			.manufacturer = sys_cpu_to_le16(0xffff), /* Internal use */
+		};
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_READ_SUPPORTED_COMMANDS: {
+		struct bt_hci_rp_read_supported_commands rp = {0};
+
+		rp.commands[0] = BIT(5);                    /* Disconnect */
+		rp.commands[5] = BIT(6) | BIT(7);           /* Set Event Mask, Reset */
+		/* Set Controller To Host Flow Control, Host Buffer Size, Host NOCP */
+		rp.commands[10] = BIT(5) | BIT(6) | BIT(7);
+		rp.commands[14] = BIT(3) | BIT(5) | BIT(7); /* Version, Features, Buffer Size */
+		rp.commands[15] = BIT(1);                   /* Read BD_ADDR */
+		rp.commands[25] = BIT(0) | BIT(1) | BIT(2); /* LE Event Mask, Buffer Size, Features */
+		rp.commands[26] = BIT(4) | BIT(5);          /* LE Create Connection (Cancel) */
+		rp.commands[27] = BIT(7);                   /* LE Rand */
+		rp.commands[28] = BIT(3);                   /* LE Read Supported States */
+		if (lb->cfg.iso_pkts) {
+			rp.commands[41] = BIT(5); /* LE Read Buffer Size v2 */
+		}
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_READ_LOCAL_FEATURES: {
+		struct bt_hci_rp_read_local_features rp = {0};
+
+		rp.features[4] = BIT(6); /* LE Supported (Controller) */
+		if (!lb->cfg.br_edr) {
+			rp.features[4] |= BIT(5); /* BR/EDR Not Supported */
+		}
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_READ_BUFFER_SIZE: {
+		struct bt_hci_rp_read_buffer_size rp = {
+			.acl_max_len = sys_cpu_to_le16(lb->cfg.acl_mtu),
+			.acl_max_num = sys_cpu_to_le16(lb->cfg.acl_pkts),
+		};
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_HOST_BUFFER_SIZE: {
+		const struct bt_hci_cp_host_buffer_size *cp = (const void *)params;
+
+		if (plen < sizeof(*cp) || lb->host_flow.enabled) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_INVALID_PARAM);
+			break;
+		}
+
+		lb->host_flow.acl_pkts = sys_le16_to_cpu(cp->acl_pkts);
+		cmd_complete_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		break;
+	}
+	case BT_HCI_OP_SET_CTL_TO_HOST_FLOW: {
+		bool enable = plen >= 1 && (params[0] & BIT(0));
+
+		if (enable && !lb->host_flow.acl_pkts) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_CMD_DISALLOWED);
+			break;
+		}
+
+		lb->host_flow.enabled = enable;
+		cmd_complete_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		break;
+	}
+	case BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS:
+		/* Never answered, Core Vol 4 Part E 7.3.40 */
+		host_nocp(lb, params, plen);
+		break;
+	case BT_HCI_OP_READ_BD_ADDR: {
+		struct bt_hci_rp_read_bd_addr rp = {0};
+
+		bt_addr_copy(&rp.bdaddr, &lb->cfg.public_addr);
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_SET_EVENT_MASK:
+		if (plen >= sizeof(struct bt_hci_cp_le_set_event_mask)) {
+			lb->le_evt_mask = sys_get_le64(params);
+		}
+		cmd_complete_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		break;
+	case BT_HCI_OP_LE_READ_LOCAL_FEATURES: {
+		struct bt_hci_rp_le_read_local_features rp = {0};
+
+		read_le_features(lb, rp.features);
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_READ_BUFFER_SIZE: {
+		struct bt_hci_rp_le_read_buffer_size rp = {
+			.le_max_len = sys_cpu_to_le16(lb->cfg.acl_mtu),
+			.le_max_num = lb->cfg.acl_pkts,
+		};
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_READ_BUFFER_SIZE_V2: {
+		struct bt_hci_rp_le_read_buffer_size_v2 rp = {
+			.acl_max_len = sys_cpu_to_le16(lb->cfg.acl_mtu),
+			.acl_max_num = lb->cfg.acl_pkts,
+			.iso_max_len = sys_cpu_to_le16(lb->cfg.iso_mtu),
+			.iso_max_num = lb->cfg.iso_pkts,
+		};
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_READ_SUPP_STATES: {
+		struct bt_hci_rp_le_read_supp_states rp = {0};
+
+		memset(rp.le_states, 0xff, sizeof(rp.le_states));
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_RAND: {
+		struct bt_hci_rp_le_rand rp = {0};
+
+		sys_put_le64(next_rand(lb), rp.rand);
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_READ_MAX_DATA_LEN: {
+		struct bt_hci_rp_le_read_max_data_len rp = {
+			.max_tx_octets = sys_cpu_to_le16(LB_MAX_OCTETS),
+			.max_tx_time = sys_cpu_to_le16(LB_MAX_TIME),
+			.max_rx_octets = sys_cpu_to_le16(LB_MAX_OCTETS),
+			.max_rx_time = sys_cpu_to_le16(LB_MAX_TIME),
+		};
+
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_CREATE_CONN: {
+		const struct bt_hci_cp_le_create_conn *cp = (const void *)params;
+
+		if (plen < sizeof(*cp)) {
+			cmd_status(lb, opcode, BT_HCI_ERR_INVALID_PARAM);
+			break;
+		}
+
+		le_create_conn(lb, opcode, &cp->peer_addr, sys_le16_to_cpu(cp->conn_interval_max),
+			       sys_le16_to_cpu(cp->conn_latency),
+			       sys_le16_to_cpu(cp->supervision_timeout));
+		break;
+	}
+	case BT_HCI_OP_LE_EXT_CREATE_CONN: {
+		const struct bt_hci_cp_le_ext_create_conn *cp = (const void *)params;
+
+		if (plen < sizeof(*cp) + sizeof(cp->p[0])) {
+			cmd_status(lb, opcode, BT_HCI_ERR_INVALID_PARAM);
+			break;
+		}
+
+		le_create_conn(lb, opcode, &cp->peer_addr,
+			       sys_le16_to_cpu(cp->p[0].conn_interval_max),
+			       sys_le16_to_cpu(cp->p[0].conn_latency),
+			       sys_le16_to_cpu(cp->p[0].supervision_timeout));
+		break;
+	}
+	case BT_HCI_OP_LE_CREATE_CONN_CANCEL:
+		if (!lb->initiating) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_CMD_DISALLOWED);
+			break;
+		}
+
+		lb->initiating = false;
+		cmd_complete_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		conn_complete(lb, BT_HCI_ERR_UNKNOWN_CONN_ID, NULL, BT_ADDR_LE_ANY, 0, 0, 0);
+		break;
+	case BT_HCI_OP_DISCONNECT: {
+		const struct bt_hci_cp_disconnect *cp = (const void *)params;
+		uint16_t handle = (plen >= sizeof(*cp)) ? sys_le16_to_cpu(cp->handle) : 0;
+		struct lb_peer *peer = peer_by_handle(lb, handle);
+		struct lb_cis *cis = cis_by_handle(lb, handle);
+
+		if (!peer && !(cis && cis->acl_handle)) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		if (peer) {
+			peer_disconnect(lb, peer, BT_HCI_ERR_LOCALHOST_TERM_CONN);
+		} else {
+			cis_disconnect(lb, cis, BT_HCI_ERR_LOCALHOST_TERM_CONN);
+		}
+		break;
+	}
+	case BT_HCI_OP_LE_READ_REMOTE_FEATURES: {
+		const struct bt_hci_cp_le_read_remote_features *cp = (const void *)params;
+		struct bt_hci_evt_le_remote_feat_complete ep = {0};
+
+		if (plen < sizeof(*cp) || !peer_by_handle(lb, sys_le16_to_cpu(cp->handle))) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		ep.handle = cp->handle;
+		read_le_features(lb, ep.features);
+		queue_le_evt(lb, BT_HCI_EVT_LE_REMOTE_FEAT_COMPLETE, &ep, sizeof(ep));
+		break;
+	}
+	case BT_HCI_OP_READ_REMOTE_VERSION_INFO: {
+		const struct bt_hci_cp_read_remote_version_info *cp = (const void *)params;
+		struct bt_hci_evt_remote_version_info ep = {
+			.version = BT_HCI_VERSION_5_4,
+			.manufacturer = sys_cpu_to_le16(0xffff),
+		};
+
+		if (plen < sizeof(*cp) || !peer_by_handle(lb, sys_le16_to_cpu(cp->handle))) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		ep.handle = cp->handle;
+		queue_evt(lb, to_host(lb, lb->now), LB_NO_HANDLE, BT_HCI_EVT_REMOTE_VERSION_INFO,
+			  &ep, sizeof(ep));
+		break;
+	}
+	case BT_HCI_OP_LE_SET_DATA_LEN: {
+		const struct bt_hci_cp_le_set_data_len *cp = (const void *)params;
+		struct bt_hci_rp_le_set_data_len rp = {0};
+		struct bt_hci_evt_le_data_len_change ep = {
+			.max_rx_octets = sys_cpu_to_le16(LB_MAX_OCTETS),
+			.max_rx_time = sys_cpu_to_le16(LB_MAX_TIME),
+		};
+
+		if (plen < sizeof(*cp) || !peer_by_handle(lb, sys_le16_to_cpu(cp->handle))) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		rp.handle = cp->handle;
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+
+		ep.handle = cp->handle;
+		ep.max_tx_octets = cp->tx_octets;
+		ep.max_tx_time = cp->tx_time;
+		queue_le_evt(lb, BT_HCI_EVT_LE_DATA_LEN_CHANGE, &ep, sizeof(ep));
+		break;
+	}
+	case BT_HCI_OP_LE_CONN_UPDATE: {
+		const struct hci_cp_le_conn_update *cp = (const void *)params;
+		struct bt_hci_evt_le_conn_update_complete ep = {0};
+
+		if (plen < sizeof(*cp) || !peer_by_handle(lb, sys_le16_to_cpu(cp->handle))) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		ep.handle = cp->handle;
+		ep.interval = cp->conn_interval_max;
+		ep.latency = cp->conn_latency;
+		ep.supv_timeout = cp->supervision_timeout;
+		queue_le_evt(lb, BT_HCI_EVT_LE_CONN_UPDATE_COMPLETE, &ep, sizeof(ep));
+		break;
+	}
+	case BT_HCI_OP_LE_READ_PHY: {
+		const struct bt_hci_cp_le_read_phy *cp = (const void *)params;
+		struct lb_peer *peer = (plen >= sizeof(*cp)) ?
+					       peer_by_handle(lb, sys_le16_to_cpu(cp->handle)) :
+					       NULL;
+		struct bt_hci_rp_le_read_phy rp = {0};
+
+		if (!peer) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		rp.handle = cp->handle;
+		rp.tx_phy = peer->tx_phy;
+		rp.rx_phy = peer->rx_phy;
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	case BT_HCI_OP_LE_SET_PHY: {
+		const struct bt_hci_cp_le_set_phy *cp = (const void *)params;
+		struct lb_peer *peer = (plen >= sizeof(*cp)) ?
+					       peer_by_handle(lb, sys_le16_to_cpu(cp->handle)) :
+					       NULL;
+		struct bt_hci_evt_le_phy_update_complete ep = {0};
+
+		if (!peer) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CONN_ID);
+			break;
+		}
+
+		cmd_status(lb, opcode, BT_HCI_ERR_SUCCESS);
+		peer->tx_phy = (cp->tx_phys & BT_HCI_LE_PHY_PREFER_2M) ? BT_HCI_LE_PHY_2M :
+									 BT_HCI_LE_PHY_1M;
+		peer->rx_phy = (cp->rx_phys & BT_HCI_LE_PHY_PREFER_2M) ? BT_HCI_LE_PHY_2M :
+									 BT_HCI_LE_PHY_1M;
+		ep.handle = cp->handle;
+		ep.tx_phy = peer->tx_phy;
+		ep.rx_phy = peer->rx_phy;
+		queue_le_evt(lb, BT_HCI_EVT_LE_PHY_UPDATE_COMPLETE, &ep, sizeof(ep));
+		break;
+	}
+	case BT_HCI_OP_LE_SET_CIG_PARAMS:
+		if (!lb->cfg.iso_pkts) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CMD);
+			break;
+		}
+		le_set_cig_params(lb, params, plen);
+		break;
+	case BT_HCI_OP_LE_CREATE_CIS:
+		if (!lb->cfg.iso_pkts) {
+			cmd_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CMD);
+			break;
+		}
+		le_create_cis(lb, params, plen);
+		break;
+	case BT_HCI_OP_LE_REMOVE_CIG:
+		if (plen < sizeof(struct bt_hci_cp_le_remove_cig)) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_INVALID_PARAM);
+			break;
+		}
+		le_remove_cig(lb, params[0]);
+		break;
+	case BT_HCI_OP_LE_SETUP_ISO_PATH:
+	case BT_HCI_OP_LE_REMOVE_ISO_PATH: {
+		struct bt_hci_rp_le_setup_iso_path rp = {0};
+		uint16_t handle = (plen >= 2) ? sys_get_le16(params) : 0;
+
+		rp.status = cis_by_handle(lb, handle) ? BT_HCI_ERR_SUCCESS :
+							BT_HCI_ERR_UNKNOWN_CONN_ID;
+		rp.handle = sys_cpu_to_le16(handle);
+		cmd_complete(lb, opcode, &rp, sizeof(rp));
+		break;
+	}
+	default: {
+		uint8_t rp[LB_RP_PAD] = {0};
+
+		if (BT_OGF(opcode) == BT_OGF_VS) {
+			cmd_complete_status(lb, opcode, BT_HCI_ERR_UNKNOWN_CMD);
+			break;
+		}
+
+		/* Settings and reads the model does not track succeed with zeroes */
+		cmd_complete(lb, opcode, rp, sizeof(rp));
+		break;
+	}
+	}
+}
+
+static void host_cmd(struct lb_data *lb, struct bt_buf *buf)
+{
+	const struct bt_hci_cmd_hdr *hdr = (const void *)&buf->data[1];
+	uint16_t opcode;
+
+	if (buf->len < 1 + sizeof(*hdr) || buf->len < 1 + sizeof(*hdr) + hdr->param_len) {
+		LOG_ERR("Truncated command, len %u", buf->len);
+		lb->stats.tx_errors++;
+		return;
+	}
+
+	opcode = sys_le16_to_cpu(hdr->opcode);
+	handle_cmd(lb, opcode, &buf->data[1 + sizeof(*hdr)], hdr->param_len);
+
+	/* Counted after handling, HCI Reset clears what it purged */
+	if (opcode != BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS) {
+		lb->cmd.cmds++;
+		lb->cmd.outstanding++;
+		lb->cmd.max_outstanding = MAX(lb->cmd.max_outstanding, lb->cmd.outstanding);
+	}
+}
+
+/* Whether an event answers a command */
+static bool is_cmd_answer(const struct lb_pkt *pkt)
+{
+	return !pkt->buf &&
+	       (pkt->evt[0] == BT_HCI_EVT_CMD_COMPLETE || pkt->evt[0] == BT_HCI_EVT_CMD_STATUS);
+}
+
+static void host_acl(struct lb_data *lb, struct bt_buf *buf)
+{
+	const struct bt_hci_acl_hdr *hdr = (const void *)&buf->data[1];
+	struct lb_peer *peer;
+	uint64_t done;
+
+	if (buf->len < 1 + sizeof(*hdr)) {
+		lb->stats.tx_errors++;
+		bt_buf_unref(buf);
+		return;
+	}
+
+	peer = peer_by_handle(lb, bt_acl_handle(sys_le16_to_cpu(hdr->handle)));
+	if (!peer) {
+		/* Raced with a disconnection, the host has already written it off */
+		bt_buf_unref(buf);
+		return;
+	}
+
+	done = air_send(lb, &peer->air_free_ns, buf->len - 1);
+	queue_nocp(lb, to_host(lb, done), peer->handle);
+
+	if (peer->mode != BT_LOOPBACK_PEER_ECHO) {
+		bt_buf_unref(buf);
+		return;
+	}
+
+	done = air_send(lb, &peer->air_free_ns, buf->len - 1);
+	queue_data(lb, to_host(lb, done), peer->handle, buf);
+}
+
+static void host_iso(struct lb_data *lb, struct bt_buf *buf)
+{
+	const struct bt_hci_iso_hdr *hdr = (const void *)&buf->data[1];
+	struct lb_cis *cis;
+	struct lb_peer *peer;
+	uint64_t done;
+
+	if (buf->len < 1 + sizeof(*hdr)) {
+		lb->stats.tx_errors++;
+		bt_buf_unref(buf);
+		return;
+	}
+
+	cis = cis_by_handle(lb, bt_iso_handle(sys_le16_to_cpu(hdr->handle)));
+	if (!cis || !cis->acl_handle) {
+		bt_buf_unref(buf);
+		return;
+	}
+
+	done = air_send(lb, &cis->air_free_ns, buf->len - 1);
+	queue_nocp(lb, to_host(lb, done), cis->handle);
+
+	peer = peer_by_handle(lb, cis->acl_handle);
+	if (!peer || peer->mode != BT_LOOPBACK_PEER_ECHO) {
+		bt_buf_unref(buf);
+		return;
+	}
+
+	done = air_send(lb, &cis->air_free_ns, buf->len - 1);
+	queue_data(lb, to_host(lb, done), cis->handle, buf);
+}
+
+static void peer_acl(struct lb_data *lb, struct bt_buf *buf)
+{
+	const struct bt_hci_acl_hdr *hdr = (const void *)&buf->data[1];
+	struct lb_peer *peer = peer_by_handle(lb, bt_acl_handle(sys_le16_to_cpu(hdr->handle)));
+
+	if (!peer) {
+		bt_buf_unref(buf);
+		return;
+	}
+
+	buf->data[0] = BT_HCI_H4_ACL;
+	queue_data(lb, to_host(lb, air_send(lb, &peer->air_free_ns, buf->len - 1)), peer->handle,
+		   buf);
+}
+
+static void process(struct lb_data *lb, struct bt_buf *buf)
+{
+	struct lb_peer *peer;
+
+	if (buf->data[0] == BT_HCI_H4_CMD || buf->data[0] == BT_HCI_H4_ACL ||
+	    buf->data[0] == BT_HCI_H4_ISO) {
+		lb->stats.tx_packets++;
+		lb->stats.tx_bytes += buf->len;
+	}
+
+	switch (buf->data[0]) {
+	case BT_HCI_H4_CMD:
+		host_cmd(lb, buf);
+		bt_buf_unref(buf);
+		break;
+	case BT_HCI_H4_ACL:
+		host_acl(lb, buf);
+		break;
+	case BT_HCI_H4_ISO:
+		host_iso(lb, buf);
+		break;
+	case LB_H4_PEER_ACL:
+		peer_acl(lb, buf);
+		break;
+	case LB_H4_PEER_DISCONN:
+		peer = peer_by_handle(lb, sys_get_le16(&buf->data[1]));
+		if (peer) {
+			peer_disconnect(lb, peer, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+		}
+		bt_buf_unref(buf);
+		break;
+	default:
+		LOG_ERR("Unknown packet type: %u", buf->data[0]);
+		lb->stats.tx_errors++;
+		bt_buf_unref(buf);
+		break;
+	}
+}
+
+/* 0 with *out set, -ENOBUFS to retry later or -EMSGSIZE if it never fits */
+static int host_buf(struct lb_data *lb, const struct lb_pkt *pkt, struct bt_buf **out)
+{
+	struct bt_buf *buf;
+	uint16_t handle;
+
+	if (!pkt->buf) {
+		buf = bt_buf_get_evt(pkt->evt[0], false, OS_TIMEOUT_FOREVER);
+		bt_buf_add_mem(buf, pkt->evt, pkt->len);
+		*out = buf;
+		return 0;
+	}
+
+	buf = bt_buf_get_rx(pkt->buf->data[0] == BT_HCI_H4_ISO ? BT_BUF_ISO_IN : BT_BUF_ACL_IN,
+			    OS_TIMEOUT_NO_WAIT);
+	if (!buf) {
+		return -ENOBUFS;
+	}
+
+	if (bt_buf_tailroom(buf) < pkt->buf->len - 1U) {
+		bt_buf_unref(buf);
+		return -EMSGSIZE;
+	}
+
+	bt_buf_add_mem(buf, &pkt->buf->data[1], pkt->buf->len - 1U);
+
+	if (pkt->buf->data[0] == BT_HCI_H4_ACL) {
+		/* The host sends first fragments as non-flushable, the peer sees a start */
+		handle = sys_get_le16(&buf->data[1]);
+		if (bt_acl_flags_pb(bt_acl_flags(handle)) == BT_ACL_START_NO_FLUSH) {
+			sys_put_le16(bt_acl_handle_pack(bt_acl_handle(handle), BT_ACL_START),
+				     &buf->data[1]);
+		}
+	}
+
+	*out = buf;
+	return 0;
+}
+
+/* Whether pkt is ACL data the host has no flow control buffer left for */
+static bool host_acl_full(const struct lb_data *lb, const struct lb_pkt *pkt)
+{
+	return lb->host_flow.enabled && pkt->buf && pkt->buf->data[0] == BT_HCI_H4_ACL &&
+	       lb->host_flow.in_use >= lb->host_flow.acl_pkts;
+}
+
+static void host_acl_take(struct lb_data *lb, const struct bt_buf *buf)
+{
+	struct lb_peer *peer = peer_by_handle(lb, bt_acl_handle(sys_get_le16(&buf->data[1])));
+
+	if (peer) {
+		peer->host_unacked++;
+		lb->host_flow.in_use++;
+	}
+}
+
+/* Hands everything due to the host, returns when to look again */
+static uint64_t deliver(struct lb_data *lb, const struct bt_hci_transport *transport)
+{
+	bool data_blocked = false;
+	int16_t prev = -1;
+	int16_t cur = lb->head;
+
+	while (cur >= 0 && lb->pkts[cur].due <= lb->now) {
+		struct lb_pkt *pkt = &lb->pkts[cur];
+		int16_t next = pkt->next;
+		struct bt_buf *buf;
+		bool answer;
+		int err;
+
+		/* Data keeps its order behind a packet waiting for a host buffer,
+		 * events such as Number Of Completed Packets may pass it.
+		 */
+		if (pkt->buf && data_blocked) {
+			prev = cur;
+			cur = next;
+			continue;
+		}
+
+		if (host_acl_full(lb, pkt)) {
+			lb->host_flow.stalls++;
+			err = -ENOBUFS;
+		} else {
+			err = host_buf(lb, pkt, &buf);
+		}
+		if (err == -ENOBUFS) {
+			data_blocked = true;
+			prev = cur;
+			cur = next;
+			continue;
+		}
+
+		answer = is_cmd_answer(pkt);
+		pending_unlink(lb, prev, cur);
+		cur = next;
+
+		if (err) {
+			LOG_ERR("Packet does not fit a host buffer");
+			lb->stats.rx_dropped++;
+			continue;
+		}
+
+		if (lb->host_flow.enabled && buf->data[0] == BT_HCI_H4_ACL) {
+			host_acl_take(lb, buf);
+		} else if (answer && lb->cmd.outstanding) {
+			lb->cmd.outstanding--;
+		}
+
+		lb->stats.rx_packets++;
+		lb->stats.rx_bytes += buf->len;
+		lb->recv(transport, buf);
+	}
+
+	if (data_blocked) {
+		return lb->now + 1000000U;
+	}
+
+	return lb->head >= 0 ? lb->pkts[lb->head].due : UINT64_MAX;
+}
+
+/* Whether buf may queue packets for the host, Host Number Of Completed Packets never does */
+static bool needs_slots(const struct bt_buf *buf)
+{
+	const struct bt_hci_cmd_hdr *hdr = (const void *)&buf->data[1];
+
+	return buf->data[0] != BT_HCI_H4_CMD || buf->len < 1 + sizeof(*hdr) ||
+	       sys_le16_to_cpu(hdr->opcode) != BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS;
+}
+
+static void lb_thread(void *p1)
+{
+	const struct bt_hci_transport *transport = p1;
+	struct lb_data *lb = transport->user_data;
+	uint64_t wake;
+	bool throttled;
+	void *item;
+
+	LOG_DBG("started");
+
+	for (;;) {
+		os_timeout_t timeout;
+
+		lb->now = os_time_get_ns();
+		wake = deliver(lb, transport);
+
+		lb->now = os_time_get_ns();
+		if (wake == UINT64_MAX) {
+			timeout = OS_TIMEOUT_FOREVER;
+		} else {
+			timeout = (wake > lb->now) ? OS_NSEC(wake - lb->now) : OS_TIMEOUT_NO_WAIT;
+		}
+
+		/* Held input goes first, nothing that needs slots passes it */
+		throttled = lb->nfree < LB_PENDING_HEADROOM;
+		if (!throttled && (item = bt_queue_get(&lb->held, OS_TIMEOUT_NO_WAIT)) != NULL) {
+			lb->now = os_time_get_ns();
+			process(lb, item);
+			continue;
+		}
+
+		item = bt_queue_get(&lb->in, timeout);
+		if (item == &lb->stop) {
+			break;
+		}
+		if (!item) {
+			continue;
+		}
+
+		/* Let the host catch up before taking more from it, but keep reading
+		 * its completions: ACL data held back by host flow control only
+		 * drains after them.
+		 */
+		if (throttled && needs_slots(item)) {
+			lb->stats.tx_waits++;
+			bt_queue_append(&lb->held, item);
+			continue;
+		}
+
+		lb->now = os_time_get_ns();
+		process(lb, item);
+	}
+
+	LOG_DBG("stopped");
+}
+
+/* tx_syscalls counts the calls that handed packets over, the nearest thing
+ * to a write here.
+ */
+static int lb_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	struct lb_data *lb = transport->user_data;
+
+	if (!bt_atomic_get(&lb->open)) {
+		return -EIO;
+	}
+
+	bt_atomic_inc(&lb->tx_syscalls);
+	bt_queue_append(&lb->in, buf);
+	return 0;
+}
+
+static size_t lb_send_batch(const struct bt_hci_transport *transport, struct bt_buf **bufs,
+			    size_t count)
+{
+	struct lb_data *lb = transport->user_data;
+
+	if (!bt_atomic_get(&lb->open)) {
+		return 0;
+	}
+
+	bt_atomic_inc(&lb->tx_syscalls);
+	for (size_t i = 0; i < count; i++) {
+		bt_queue_append(&lb->in, bufs[i]);
+	}
+	return count;
+}
+
+static int lb_get_stats(const struct bt_hci_transport *transport,
+			struct bt_hci_driver_stats *stats)
+{
+	struct lb_data *lb = transport->user_data;
+
+	*stats = lb->stats;
+	stats->tx_syscalls = bt_atomic_get(&lb->tx_syscalls);
+	return 0;
+}
+
+static int lb_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
+{
+	struct lb_data *lb = transport->user_data;
+	int err;
+
+	if (bt_atomic_get(&lb->open)) {
+		return -EALREADY;
+	}
+
+	lb->recv = recv;
+	memset(&lb->stats, 0, sizeof(lb->stats));
+	bt_atomic_clear(&lb->tx_syscalls);
+	memset(&lb->host_flow, 0, sizeof(lb->host_flow));
+	memset(&lb->cmd, 0, sizeof(lb->cmd));
+	pending_reset(lb);
+	controller_reset(lb);
+	bt_queue_init_mpsc(&lb->in);
+	bt_queue_init(&lb->held);
+	bt_atomic_set(&lb->open, 1);
+
+	err = os_thread_create(&lb_thread_data, lb_thread, (void *)transport, "bt_loopback",
+			       OS_PRIORITY_COOP(CONFIG_BT_DRIVER_RX_HIGH_PRIO), LB_THREAD_STACK_SIZE);
+	if (err < 0) {
+		bt_atomic_set(&lb->open, 0);
+		return err;
+	}
+	if (CONFIG_BT_DRIVER_RX_CPU_MASK != 0) {
+		(void)os_thread_affinity_set(&lb_thread_data, CONFIG_BT_DRIVER_RX_CPU_MASK);
+	}
+
+	return 0;
+}
+
+static int lb_close(const struct bt_hci_transport *transport)
+{
+	struct lb_data *lb = transport->user_data;
+	struct bt_buf *buf;
+
+	if (!bt_atomic_set(&lb->open, 0)) {
+		return -ENETDOWN;
+	}
+
+	bt_queue_append(&lb->in, &lb->stop);
+	(void)os_thread_join(&lb_thread_data, OS_TIMEOUT_FOREVER);
+
+	while ((buf = bt_queue_get(&lb->held, OS_TIMEOUT_NO_WAIT)) != NULL) {
+		bt_buf_unref(buf);
+	}
+	while ((buf = bt_queue_get(&lb->in, OS_TIMEOUT_NO_WAIT)) != NULL) {
+		if ((void *)buf != &lb->stop) {
+			bt_buf_unref(buf);
+		}
+	}
+
+	controller_reset(lb);
+
+	return 0;
+}
+
+static const struct bt_hci_driver_api lb_drv_api = {
+	.open = lb_open,
+	.close = lb_close,
+	.send = lb_send,
+	.send_batch = lb_send_batch,
+	.get_stats = lb_get_stats,
+};
+
+static bool lb_is_ready(const struct bt_hci_transport *transport)
+{
+	struct lb_data *lb = transport->user_data;
+
+	return lb->ready;
+}
+
+const struct bt_hci_transport loopback_transport = {
+	.name = "loopback",
+	.bus = BT_HCI_BUS_VIRTUAL,
+	.api = &lb_drv_api,
+	.user_data = &_lb_data,
+	.is_ready = lb_is_ready,
+};
+
+void bt_loopback_config_default(struct bt_loopback_config *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->acl_mtu = LB_MAX_OCTETS;
+	cfg->acl_pkts = 8;
+	cfg->iso_mtu = LB_MAX_OCTETS;
+	cfg->iso_pkts = 8;
+	cfg->cmd_credits = 1;
+	/* Static-looking public address in the locally administered range */
+	cfg->public_addr = (bt_addr_t){{0x01, 0x00, 0x00, 0x00, 0xb1, 0x02}};
+}
+
+int bt_loopback_configure(const struct bt_loopback_config *cfg)
+{
+	struct lb_data *lb = &_lb_data;
+
+	if (bt_atomic_get(&lb->open)) {
+		return -EBUSY;
+	}
+
+	/* Echoed packets have to fit the host's receive buffers */
+	if (cfg->acl_mtu == 0 || cfg->acl_pkts == 0 || cfg->acl_mtu > CONFIG_BT_BUF_ACL_RX_SIZE) {
+		return -EINVAL;
+	}
+
+	if (cfg->iso_pkts && cfg->iso_mtu == 0) {
+		return -EINVAL;
+	}
+
+	if (cfg->cmd_credits == 0) {
+		return -EINVAL;
+	}
+
+	lb->cfg = *cfg;
+	lb->configured = true;
+	return 0;
+}
+
+int bt_loopback_peer_add(const bt_addr_le_t *addr, enum bt_loopback_peer_mode mode)
+{
+	struct lb_data *lb = &_lb_data;
+	int err = -ENOMEM;
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+
+	if (peer_by_addr(lb, addr)) {
+		err = -EALREADY;
+		goto unlock;
+	}
+
+	for (int i = 0; i < BT_LOOPBACK_MAX_PEERS; i++) {
+		if (!lb->peers[i].used) {
+			/* handle is already 0 and read by the controller thread */
+			bt_addr_le_copy(&lb->peers[i].addr, addr);
+			lb->peers[i].mode = mode;
+			lb->peers[i].used = true;
+			err = 0;
+			break;
+		}
+	}
+
+unlock:
+	os_mutex_unlock(&lb->lock);
+	return err;
+}
+
+void bt_loopback_peer_clear(void)
+{
+	struct lb_data *lb = &_lb_data;
+
+	if (bt_atomic_get(&lb->open)) {
+		return;
+	}
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+	memset(lb->peers, 0, sizeof(lb->peers));
+	os_mutex_unlock(&lb->lock);
+}
+
+static uint16_t peer_handle_get(struct lb_data *lb, const bt_addr_le_t *peer)
+{
+	struct lb_peer *p;
+	uint16_t handle = 0;
+
+	os_mutex_lock(&lb->lock, OS_TIMEOUT_FOREVER);
+	p = peer_by_addr(lb, peer);
+	if (p) {
+		handle = p->handle;
+	}
+	os_mutex_unlock(&lb->lock);
+
+	return handle;
+}
+
+int bt_loopback_inject_acl(const bt_addr_le_t *peer, const void *data, uint16_t len,
+			   os_timeout_t timeout)
+{
+	struct lb_data *lb = &_lb_data;
+	struct bt_buf *frags[LB_INJECT_BUFS];
+	const uint8_t *src = data;
+	uint16_t handle;
+	int n = DIV_ROUND_UP(MAX(len, 1U), LB_INJECT_FRAG);
+
+	if (!bt_atomic_get(&lb->open)) {
+		return -ENETDOWN;
+	}
+
+	if (n > LB_INJECT_BUFS) {
+		return -EMSGSIZE;
+	}
+
+	handle = peer_handle_get(lb, peer);
+	if (!handle) {
+		return -ENOTCONN;
+	}
+
+	/* Take every fragment up front so a frame never goes out half way */
+	for (int i = 0; i < n; i++) {
+		uint16_t frag = MIN(len, LB_INJECT_FRAG);
+		uint8_t pb = (i == 0) ? BT_ACL_START : BT_ACL_CONT;
+
+		frags[i] = bt_buf_alloc(&lb_inject_pool, timeout);
+		if (!frags[i]) {
+			while (i--) {
+				bt_buf_unref(frags[i]);
+			}
+			return -ENOBUFS;
+		}
+
+		bt_buf_add_u8(frags[i], LB_H4_PEER_ACL);
+		bt_buf_add_le16(frags[i], bt_acl_handle_pack(handle, pb));
+		bt_buf_add_le16(frags[i], frag);
+		bt_buf_add_mem(frags[i], src, frag);
+		src += frag;
+		len -= frag;
+	}
+
+	for (int i = 0; i < n; i++) {
+		bt_queue_append(&lb->in, frags[i]);
+	}
+
+	return 0;
+}
+
+void bt_loopback_host_flow_stats_get(struct bt_loopback_host_flow_stats *stats)
+{
+	*stats = _lb_data.host_flow;
+}
+
+void bt_loopback_cmd_stats_get(struct bt_loopback_cmd_stats *stats)
+{
+	*stats = _lb_data.cmd;
+}
+
+int bt_loopback_peer_disconnect(const bt_addr_le_t *peer)
+{
+	struct lb_data *lb = &_lb_data;
+	struct bt_buf *buf;
+	uint16_t handle;
+
+	if (!bt_atomic_get(&lb->open)) {
+		return -ENETDOWN;
+	}
+
+	handle = peer_handle_get(lb, peer);
+	if (!handle) {
+		return -ENOTCONN;
+	}
+
+	buf = bt_buf_alloc(&lb_inject_pool, OS_TIMEOUT_FOREVER);
+	bt_buf_add_u8(buf, LB_H4_PEER_DISCONN);
+	bt_buf_add_le16(buf, handle);
+	bt_queue_append(&lb->in, buf);
+
+	return 0;
+}
+
+static int lb_init(void)
+{
+	struct lb_data *lb = &_lb_data;
+
+	LOG_DBG("lb_init");
+	bt_hci_transport_register(&loopback_transport);
+
+	if (!lb->configured) {
+		bt_loopback_config_default(&lb->cfg);
+	}
+	lb->ready = true;
+
+	return 0;
+}
+
+int bt_driver_loopback_init(void)
+{
+	return lb_init();
+}
+
+STACK_INIT(lb_init, STACK_BASE_INIT, 0);
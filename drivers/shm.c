@@ -0,0 +1,418 @@
+/* shm.c - Shared-memory ring HCI transport */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host side of a channel created with bt_shm_channel_create(). Frames are
+ * copied straight between bt_bufs and the rings; the doorbell eventfds are
+ * only touched when one side is about to sleep, so under load a packet costs
+ * two copies and a handful of atomics.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/shm.h>
+
+#include "shm_ring.h"
+
+#define SHM_THREAD_STACK_SIZE 2048
+
+/* Receive buffers are retried at this interval; the frame stays in the ring
+ * meanwhile, which stalls the controller instead of dropping data.
+ */
+#define SHM_RX_ALLOC_WAIT OS_MSEC(10)
+
+struct shm_data {
+	os_mutex_t tx_lock; /* Serializes producers of the to-controller ring */
+	bt_atomic_t open;
+	bool ready;
+	bool configured;
+	struct bt_shm_channel ch; /* Duplicates owned by the driver */
+	struct shm_seg *seg;
+	size_t seg_len;
+	struct shm_ring_end tx;
+	struct shm_ring_end rx;
+	int stop_fd;
+	bt_hci_recv_t recv;
+	os_thread_t rx_thread;
+	/* tx_ counters under tx_lock, rx_ counters owned by the RX thread */
+	struct bt_hci_driver_stats stats;
+};
+
+static struct bt_buf *get_rx(const uint8_t *hdr, uint32_t len, bool *drop)
+{
+	struct bt_buf *buf;
+
+	switch (hdr[0]) {
+	case BT_HCI_H4_EVT:
+		if (len > 3 && hdr[1] == BT_HCI_EVT_LE_META_EVENT &&
+		    hdr[3] == BT_HCI_EVT_LE_ADVERTISING_REPORT) {
+			buf = bt_buf_get_evt(hdr[1], true, OS_TIMEOUT_NO_WAIT);
+			if (!buf) {
+				LOG_DBG("Discard adv report due to insufficient buf");
+				*drop = true;
+			}
+			return buf;
+		}
+
+		return bt_buf_get_evt(hdr[1], false, SHM_RX_ALLOC_WAIT);
+	case BT_HCI_H4_ACL:
+		return bt_buf_get_rx(BT_BUF_ACL_IN, SHM_RX_ALLOC_WAIT);
+	case BT_HCI_H4_ISO:
+		if (IS_ENABLED(CONFIG_BT_ISO)) {
+			return bt_buf_get_rx(BT_BUF_ISO_IN, SHM_RX_ALLOC_WAIT);
+		}
+		break;
+	default:
+		break;
+	}
+
+	LOG_ERR("Unknown packet type: %u", hdr[0]);
+	*drop = true;
+
+	return NULL;
+}
+
+/* Delivers the oldest frame, false if the transport closed while waiting for a buffer */
+static bool rx_frame(const struct bt_hci_transport *transport, uint32_t len)
+{
+	struct shm_data *shm = transport->user_data;
+	uint8_t hdr[4] = {0};
+	struct bt_buf *buf = NULL;
+	bool drop = (len < 2);
+
+	shm_ring_read(&shm->rx, 0, hdr, MIN(len, sizeof(hdr)));
+
+	while (!drop && !buf) {
+		if (!bt_atomic_get(&shm->open)) {
+			return false;
+		}
+		buf = get_rx(hdr, len, &drop);
+	}
+
+	if (buf && len - 1 > bt_buf_tailroom(buf)) {
+		LOG_WRN("Dropping %u byte frame of type %u", len, hdr[0]);
+		bt_buf_unref(buf);
+		buf = NULL;
+		drop = true;
+	}
+
+	if (buf) {
+		/* The H4 type is already in place */
+		shm_ring_read(&shm->rx, 1, bt_buf_add(buf, len - 1), len - 1);
+	}
+
+	if (shm_ring_consume(&shm->rx, len)) {
+		shm->stats.rx_syscalls++;
+	}
+
+	if (drop) {
+		shm->stats.rx_dropped++;
+		return true;
+	}
+
+	shm->stats.rx_packets++;
+	shm->stats.rx_bytes += len;
+	shm->recv(transport, buf);
+
+	return true;
+}
+
+static void rx_thread(void *p1)
+{
+	const struct bt_hci_transport *transport = p1;
+	struct shm_data *shm = transport->user_data;
+	struct shm_ring *ring = shm->rx.ring;
+	uint32_t len;
+	int err;
+
+	LOG_DBG("started");
+
+	while (1) {
+		err = shm_ring_peek(&shm->rx, &len);
+		if (err == 0) {
+			if (!rx_frame(transport, len)) {
+				break;
+			}
+			continue;
+		} else if (err == -EBADMSG) {
+			/* Record boundaries are lost, resynchronize on the producer */
+			LOG_ERR("Corrupt record from the controller, flushing the ring");
+			if (shm_ring_flush(&shm->rx)) {
+				shm->stats.rx_syscalls++;
+			}
+			shm->stats.rx_dropped++;
+			continue;
+		}
+
+		/* Announce the sleep, then look once more before committing to it */
+		bt_atomic_set(&ring->consumer_waiting, 1);
+		if (!shm_ring_empty(&shm->rx)) {
+			(void)bt_atomic_cas(&ring->consumer_waiting, 1, 0);
+			continue;
+		}
+
+		shm->stats.rx_syscalls++;
+		err = shm_bell_wait(shm->rx.data_bell, shm->stop_fd, -1);
+		if (err == -ECANCELED) {
+			break;
+		} else if (err < 0) {
+			LOG_ERR("Waiting for the controller failed, err %d", err);
+			break;
+		}
+	}
+
+	(void)bt_atomic_cas(&ring->consumer_waiting, 1, 0);
+
+	LOG_DBG("stopped: %u frames", shm->stats.rx_packets);
+}
+
+static int shm_hci_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	struct shm_data *shm = transport->user_data;
+	struct shm_ring *ring = shm->tx.ring;
+	bool rang;
+	int err;
+
+	LOG_DBG("buf %p type %u len %u", buf, buf->data[0], buf->len);
+
+	os_mutex_lock(&shm->tx_lock, OS_TIMEOUT_FOREVER);
+
+	if (!bt_atomic_get(&shm->open)) {
+		os_mutex_unlock(&shm->tx_lock);
+		return -ENETDOWN;
+	}
+
+	while (1) {
+		err = shm_ring_put(&shm->tx, buf->data, buf->len, &rang);
+		if (err != -EAGAIN) {
+			break;
+		}
+
+		bt_atomic_set(&ring->producer_waiting, 1);
+		if (shm_ring_space(&shm->tx) >= buf->len + SHM_REC_HDR) {
+			(void)bt_atomic_cas(&ring->producer_waiting, 1, 0);
+			continue;
+		}
+
+		shm->stats.tx_waits++;
+		err = shm_bell_wait(shm->tx.space_bell, shm->stop_fd, -1);
+		if (err < 0) {
+			(void)bt_atomic_cas(&ring->producer_waiting, 1, 0);
+			break;
+		}
+	}
+
+	if (err == 0) {
+		shm->stats.tx_packets++;
+		shm->stats.tx_bytes += buf->len;
+		if (rang) {
+			shm->stats.tx_syscalls++;
+		}
+	} else if (err == -EMSGSIZE) {
+		shm->stats.tx_errors++;
+	}
+
+	os_mutex_unlock(&shm->tx_lock);
+
+	if (err < 0) {
+		LOG_ERR("Failed to send %u byte frame, err %d", buf->len, err);
+		return err == -ECANCELED ? -ENETDOWN : err;
+	}
+
+	bt_buf_unref(buf);
+
+	return 0;
+}
+
+static int shm_hci_get_stats(const struct bt_hci_transport *transport,
+			 struct bt_hci_driver_stats *stats)
+{
+	struct shm_data *shm = transport->user_data;
+
+	*stats = shm->stats;
+	return 0;
+}
+
+static int shm_hci_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
+{
+	struct shm_data *shm = transport->user_data;
+	int err;
+
+	if (!shm->configured) {
+		LOG_ERR("No shared-memory channel configured");
+		return -ENODEV;
+	}
+
+	if (bt_atomic_get(&shm->open)) {
+		return -EALREADY;
+	}
+
+	err = shm_seg_map(&shm->ch, &shm->seg, &shm->seg_len);
+	if (err < 0) {
+		LOG_ERR("Invalid shared-memory segment, err %d", err);
+		return err;
+	}
+
+	shm_seg_ends(shm->seg, &shm->ch, true, &shm->tx, &shm->rx);
+	bt_atomic_clear(&shm->tx.ring->producer_waiting);
+	bt_atomic_clear(&shm->rx.ring->consumer_waiting);
+
+	shm->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shm->stop_fd < 0) {
+		err = -errno;
+		goto bail;
+	}
+
+	memset(&shm->stats, 0, sizeof(shm->stats));
+	shm->recv = recv;
+	bt_atomic_set(&shm->open, 1);
+
+	err = os_thread_create(&shm->rx_thread, rx_thread, (void *)transport, "shm_rx",
+			       OS_PRIORITY_COOP(CONFIG_BT_DRIVER_RX_HIGH_PRIO), SHM_THREAD_STACK_SIZE);
+	if (err < 0) {
+		bt_atomic_clear(&shm->open);
+		goto bail;
+	}
+	if (CONFIG_BT_DRIVER_RX_CPU_MASK != 0) {
+		(void)os_thread_affinity_set(&shm->rx_thread, CONFIG_BT_DRIVER_RX_CPU_MASK);
+	}
+
+	LOG_DBG("%u byte rings", shm->seg->ring_size);
+
+	return 0;
+
+bail:
+	if (shm->stop_fd >= 0) {
+		(void)close(shm->stop_fd);
+		shm->stop_fd = -1;
+	}
+	(void)munmap(shm->seg, shm->seg_len);
+	shm->seg = NULL;
+
+	return err;
+}
+
+static int shm_hci_close(const struct bt_hci_transport *transport)
+{
+	struct shm_data *shm = transport->user_data;
+
+	if (!bt_atomic_get(&shm->open)) {
+		return -ENETDOWN;
+	}
+
+	bt_atomic_clear(&shm->open);
+
+	/* Wakes the RX thread and any sender waiting for room */
+	if (eventfd_write(shm->stop_fd, 1) < 0) {
+		LOG_ERR("Failed to stop RX thread, errno %d", errno);
+	}
+	(void)os_thread_join(&shm->rx_thread, OS_TIMEOUT_FOREVER);
+
+	os_mutex_lock(&shm->tx_lock, OS_TIMEOUT_FOREVER);
+	(void)munmap(shm->seg, shm->seg_len);
+	shm->seg = NULL;
+	(void)close(shm->stop_fd);
+	shm->stop_fd = -1;
+	os_mutex_unlock(&shm->tx_lock);
+
+	if (shm->stats.rx_dropped || shm->stats.tx_errors) {
+		LOG_WRN("Dropped %u received and %u sent frames", shm->stats.rx_dropped,
+			shm->stats.tx_errors);
+	}
+
+	return 0;
+}
+
+static const struct bt_hci_driver_api shm_drv_api = {
+	.open = shm_hci_open,
+	.close = shm_hci_close,
+	.send = shm_hci_send,
+	.get_stats = shm_hci_get_stats,
+};
+
+static bool shm_hci_is_ready(const struct bt_hci_transport *transport)
+{
+	struct shm_data *shm = transport->user_data;
+
+	return shm->ready;
+}
+
+static struct shm_data _shm_data = {
+	.tx_lock = OS_MUTEX_INITIALIZER,
+	.ch = {.mem_fd = -1, .host_rx_bell = -1, .host_tx_bell = -1, .peer_bell = -1},
+	.stop_fd = -1,
+	.ready = false,
+};
+
+const struct bt_hci_transport shm_transport = {
+	.name = "shm",
+	.bus = BT_HCI_BUS_IPC,
+	.api = &shm_drv_api,
+	.user_data = &_shm_data,
+	.is_ready = shm_hci_is_ready,
+};
+
+static int dup_fd(int fd)
+{
+	int nfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+
+	return nfd < 0 ? -errno : nfd;
+}
+
+int bt_shm_configure(const struct bt_shm_channel *ch)
+{
+	struct shm_data *shm = &_shm_data;
+	struct bt_shm_channel dup = {.mem_fd = -1, .host_rx_bell = -1, .host_tx_bell = -1,
+				     .peer_bell = -1};
+
+	if (bt_atomic_get(&shm->open)) {
+		return -EBUSY;
+	}
+
+	dup.mem_fd = dup_fd(ch->mem_fd);
+	dup.host_rx_bell = dup_fd(ch->host_rx_bell);
+	dup.host_tx_bell = dup_fd(ch->host_tx_bell);
+	dup.peer_bell = dup_fd(ch->peer_bell);
+	if (dup.mem_fd < 0 || dup.host_rx_bell < 0 || dup.host_tx_bell < 0 || dup.peer_bell < 0) {
+		int err = MIN(MIN(dup.mem_fd, dup.host_rx_bell), MIN(dup.host_tx_bell, dup.peer_bell));
+
+		bt_shm_channel_close(&dup);
+		return err;
+	}
+
+	bt_shm_channel_close(&shm->ch);
+	shm->ch = dup;
+	shm->configured = true;
+
+	return 0;
+}
+
+static int shm_init(void)
+{
+	struct shm_data *shm = &_shm_data;
+
+	LOG_DBG("shm_init");
+	bt_hci_transport_register(&shm_transport);
+
+	shm->ready = true;
+
+	return 0;
+}
+
+int bt_driver_shm_init(void)
+{
+	return shm_init();
+}
+
+STACK_INIT(shm_init, STACK_BASE_INIT, 0);
@@ -0,0 +1,231 @@
+/* shm_peer.c - Reference controller side of the shared-memory transport */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Serves one channel from a thread: commands get a successful Command
+ * Complete without parameters and data is either dropped or echoed. It is
+ * meant for tests and for measuring the transport itself, not as a
+ * controller the host can initialise against.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <base/byteorder.h>
+#include <bluetooth/hci.h>
+#include <drivers/shm.h>
+
+#include "shm_ring.h"
+
+#define SHM_PEER_STACK_SIZE 2048
+
+/* The peer doorbell is shared between the serving thread and callers of
+ * bt_shm_peer_send(); one may swallow the other's wakeup, so waits are bounded.
+ */
+#define SHM_PEER_WAIT_MS 5
+
+struct shm_peer_priv {
+	struct shm_seg *seg;
+	size_t seg_len;
+	struct shm_ring_end tx;
+	struct shm_ring_end rx;
+	os_mutex_t tx_lock;
+	int bell;
+	int stop_fd;
+	os_thread_t thread;
+	uint8_t *frame; /* One ring's worth, the largest frame that can arrive */
+};
+
+int bt_shm_peer_send(struct bt_shm_peer *peer, const void *frame, uint32_t len)
+{
+	struct shm_peer_priv *priv = peer->priv;
+	struct shm_ring *ring = priv->tx.ring;
+	bool rang;
+	int err;
+
+	os_mutex_lock(&priv->tx_lock, OS_TIMEOUT_FOREVER);
+
+	while (1) {
+		err = shm_ring_put(&priv->tx, frame, len, &rang);
+		if (err != -EAGAIN) {
+			break;
+		}
+
+		bt_atomic_set(&ring->producer_waiting, 1);
+		if (shm_ring_space(&priv->tx) >= len + SHM_REC_HDR) {
+			(void)bt_atomic_cas(&ring->producer_waiting, 1, 0);
+			continue;
+		}
+
+		peer->waits++;
+		err = shm_bell_wait(priv->bell, priv->stop_fd, SHM_PEER_WAIT_MS);
+		if (err < 0 && err != -ETIMEDOUT) {
+			(void)bt_atomic_cas(&ring->producer_waiting, 1, 0);
+			break;
+		}
+	}
+
+	if (err == 0) {
+		peer->tx_frames++;
+	}
+
+	os_mutex_unlock(&priv->tx_lock);
+
+	return err;
+}
+
+static void peer_handle(struct bt_shm_peer *peer, uint32_t len)
+{
+	struct shm_peer_priv *priv = peer->priv;
+	uint8_t *frame = priv->frame;
+
+	shm_ring_read(&priv->rx, 0, frame, len);
+	(void)shm_ring_consume(&priv->rx, len);
+	peer->rx_frames++;
+
+	if (len == 0) {
+		return;
+	}
+
+	switch (frame[0]) {
+	case BT_HCI_H4_CMD: {
+		uint8_t cc[] = {BT_HCI_H4_EVT, BT_HCI_EVT_CMD_COMPLETE, 4, 1, 0, 0,
+				BT_HCI_ERR_SUCCESS};
+
+		if (len < 1 + sizeof(struct bt_hci_cmd_hdr)) {
+			return;
+		}
+
+		/* Opcode */
+		cc[4] = frame[1];
+		cc[5] = frame[2];
+		(void)bt_shm_peer_send(peer, cc, sizeof(cc));
+		break;
+	}
+	case BT_HCI_H4_ACL:
+	case BT_HCI_H4_ISO:
+		if (peer->mode == BT_SHM_PEER_ECHO) {
+			(void)bt_shm_peer_send(peer, frame, len);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void peer_thread(void *arg)
+{
+	struct bt_shm_peer *peer = arg;
+	struct shm_peer_priv *priv = peer->priv;
+	struct shm_ring *ring = priv->rx.ring;
+	uint32_t len;
+	int err;
+
+	while (1) {
+		err = shm_ring_peek(&priv->rx, &len);
+		if (err == 0) {
+			peer_handle(peer, len);
+			continue;
+		} else if (err == -EBADMSG) {
+			(void)shm_ring_flush(&priv->rx);
+			continue;
+		}
+
+		bt_atomic_set(&ring->consumer_waiting, 1);
+		if (!shm_ring_empty(&priv->rx)) {
+			(void)bt_atomic_cas(&ring->consumer_waiting, 1, 0);
+			continue;
+		}
+
+		peer->waits++;
+		err = shm_bell_wait(priv->bell, priv->stop_fd, SHM_PEER_WAIT_MS);
+		if (err < 0 && err != -ETIMEDOUT) {
+			break;
+		}
+	}
+
+	(void)bt_atomic_cas(&ring->consumer_waiting, 1, 0);
+}
+
+int bt_shm_peer_start(struct bt_shm_peer *peer, const struct bt_shm_channel *ch,
+		      enum bt_shm_peer_mode mode)
+{
+	struct shm_peer_priv *priv;
+	int err;
+
+	priv = os_calloc(1, sizeof(*priv));
+	if (!priv) {
+		return -ENOMEM;
+	}
+
+	priv->stop_fd = -1;
+
+	err = shm_seg_map(ch, &priv->seg, &priv->seg_len);
+	if (err < 0) {
+		os_free(priv);
+		return err;
+	}
+
+	priv->frame = os_malloc(priv->seg->ring_size);
+	if (!priv->frame) {
+		err = -ENOMEM;
+		goto fail;
+	}
+
+	priv->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (priv->stop_fd < 0) {
+		err = -errno;
+		goto fail;
+	}
+
+	shm_seg_ends(priv->seg, ch, false, &priv->tx, &priv->rx);
+	priv->bell = ch->peer_bell;
+	os_mutex_init(&priv->tx_lock);
+
+	memset(peer, 0, sizeof(*peer));
+	peer->mode = mode;
+	peer->priv = priv;
+
+	err = os_thread_create(&priv->thread, peer_thread, peer, "shm_peer", OS_PRIORITY(0),
+			       SHM_PEER_STACK_SIZE);
+	if (err < 0) {
+		peer->priv = NULL;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	if (priv->stop_fd >= 0) {
+		(void)close(priv->stop_fd);
+	}
+	os_free(priv->frame);
+	(void)munmap(priv->seg, priv->seg_len);
+	os_free(priv);
+
+	return err;
+}
+
+void bt_shm_peer_stop(struct bt_shm_peer *peer)
+{
+	struct shm_peer_priv *priv = peer->priv;
+
+	if (!priv) {
+		return;
+	}
+
+	(void)eventfd_write(priv->stop_fd, 1);
+	(void)os_thread_join(&priv->thread, OS_TIMEOUT_FOREVER);
+
+	(void)close(priv->stop_fd);
+	(void)munmap(priv->seg, priv->seg_len);
+	os_free(priv->frame);
+	os_free(priv);
+	peer->priv = NULL;
+}
@@ -0,0 +1,386 @@
+/* shm_ring.c - Shared-memory HCI rings */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <base/byteorder.h>
+#include <base/utils.h>
+
+#include "shm_ring.h"
+
+#define SHM_RING_MIN_SIZE 256U
+#define SHM_RING_MAX_SIZE (1U << 30)
+#define SHM_CHANNEL_FDS   4
+
+static bool ring_size_valid(uint32_t size)
+{
+	return size >= SHM_RING_MIN_SIZE && size <= SHM_RING_MAX_SIZE && (size & (size - 1)) == 0;
+}
+
+void shm_seg_format(struct shm_seg *seg, uint32_t ring_size)
+{
+	seg->magic = SHM_SEG_MAGIC;
+	seg->version = SHM_SEG_VERSION;
+	seg->hdr_size = sizeof(*seg);
+	seg->ring_size = ring_size;
+}
+
+int shm_seg_map(const struct bt_shm_channel *ch, struct shm_seg **seg, size_t *len)
+{
+	struct stat st;
+	struct shm_seg *s;
+
+	if (fstat(ch->mem_fd, &st) < 0) {
+		return -errno;
+	}
+
+	if ((size_t)st.st_size < sizeof(*s)) {
+		return -EINVAL;
+	}
+
+	s = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, ch->mem_fd, 0);
+	if (s == MAP_FAILED) {
+		return -errno;
+	}
+
+	if (s->magic != SHM_SEG_MAGIC || s->version != SHM_SEG_VERSION ||
+	    s->hdr_size != sizeof(*s) || !ring_size_valid(s->ring_size) ||
+	    shm_seg_size(s->ring_size) > (size_t)st.st_size) {
+		(void)munmap(s, st.st_size);
+		return -EINVAL;
+	}
+
+	*seg = s;
+	*len = st.st_size;
+
+	return 0;
+}
+
+void shm_seg_ends(struct shm_seg *seg, const struct bt_shm_channel *ch, bool host,
+		  struct shm_ring_end *tx, struct shm_ring_end *rx)
+{
+	uint8_t *to_peer = (uint8_t *)seg + sizeof(*seg);
+	uint8_t *to_host = to_peer + seg->ring_size;
+	struct shm_ring_end down = {
+		.ring = &seg->to_peer,
+		.data = to_peer,
+		.size = seg->ring_size,
+		.data_bell = ch->peer_bell,
+		.space_bell = ch->host_tx_bell,
+	};
+	struct shm_ring_end up = {
+		.ring = &seg->to_host,
+		.data = to_host,
+		.size = seg->ring_size,
+		.data_bell = ch->host_rx_bell,
+		.space_bell = ch->peer_bell,
+	};
+
+	*tx = host ? down : up;
+	*rx = host ? up : down;
+}
+
+static void copy_in(struct shm_ring_end *end, bt_atomic_val_t pos, const void *src, uint32_t len)
+{
+	uint32_t off = pos & (end->size - 1);
+	uint32_t first = MIN(len, end->size - off);
+
+	memcpy(&end->data[off], src, first);
+	memcpy(end->data, (const uint8_t *)src + first, len - first);
+}
+
+static void copy_out(struct shm_ring_end *end, bt_atomic_val_t pos, void *dst, uint32_t len)
+{
+	uint32_t off = pos & (end->size - 1);
+	uint32_t first = MIN(len, end->size - off);
+
+	memcpy(dst, &end->data[off], first);
+	memcpy((uint8_t *)dst + first, end->data, len - first);
+}
+
+uint32_t shm_ring_space(const struct shm_ring_end *end)
+{
+	bt_atomic_val_t head = bt_atomic_get(&end->ring->head);
+
+	return end->size - (uint32_t)(head - bt_atomic_get(&end->ring->tail));
+}
+
+bool shm_ring_empty(const struct shm_ring_end *end)
+{
+	return bt_atomic_get(&end->ring->head) == bt_atomic_get(&end->ring->tail);
+}
+
+int shm_ring_put(struct shm_ring_end *end, const void *frame, uint32_t len, bool *rang)
+{
+	bt_atomic_val_t head = bt_atomic_get(&end->ring->head);
+	uint8_t hdr[SHM_REC_HDR];
+
+	*rang = false;
+
+	if (len > end->size - SHM_REC_HDR) {
+		return -EMSGSIZE;
+	}
+
+	if (shm_ring_space(end) < len + SHM_REC_HDR) {
+		return -EAGAIN;
+	}
+
+	sys_put_le32(len, hdr);
+	copy_in(end, head, hdr, sizeof(hdr));
+	copy_in(end, head + SHM_REC_HDR, frame, len);
+
+	/* Publishes the record; pairs with the consumer setting consumer_waiting
+	 * before its last emptiness check, so one of the two always sees the other.
+	 */
+	bt_atomic_set(&end->ring->head, head + SHM_REC_HDR + len);
+
+	if (bt_atomic_cas(&end->ring->consumer_waiting, 1, 0)) {
+		(void)shm_bell_ring(end->data_bell);
+		*rang = true;
+	}
+
+	return 0;
+}
+
+int shm_ring_peek(struct shm_ring_end *end, uint32_t *len)
+{
+	bt_atomic_val_t tail = bt_atomic_get(&end->ring->tail);
+	uint32_t avail = (uint32_t)(bt_atomic_get(&end->ring->head) - tail);
+	uint8_t hdr[SHM_REC_HDR];
+
+	if (!avail) {
+		return -EAGAIN;
+	}
+
+	/* The peer is not trusted: a record must lie within what it published */
+	if (avail > end->size || avail < SHM_REC_HDR) {
+		return -EBADMSG;
+	}
+
+	copy_out(end, tail, hdr, sizeof(hdr));
+	*len = sys_get_le32(hdr);
+
+	if (*len > avail - SHM_REC_HDR) {
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+void shm_ring_read(struct shm_ring_end *end, uint32_t offset, void *dst, uint32_t len)
+{
+	copy_out(end, bt_atomic_get(&end->ring->tail) + SHM_REC_HDR + offset, dst, len);
+}
+
+bool shm_ring_consume(struct shm_ring_end *end, uint32_t len)
+{
+	bt_atomic_val_t tail = bt_atomic_get(&end->ring->tail);
+
+	bt_atomic_set(&end->ring->tail, tail + SHM_REC_HDR + len);
+
+	if (bt_atomic_cas(&end->ring->producer_waiting, 1, 0)) {
+		(void)shm_bell_ring(end->space_bell);
+		return true;
+	}
+
+	return false;
+}
+
+bool shm_ring_flush(struct shm_ring_end *end)
+{
+	bt_atomic_set(&end->ring->tail, bt_atomic_get(&end->ring->head));
+
+	if (bt_atomic_cas(&end->ring->producer_waiting, 1, 0)) {
+		(void)shm_bell_ring(end->space_bell);
+		return true;
+	}
+
+	return false;
+}
+
+int shm_bell_wait(int bell, int stop_fd, int timeout_ms)
+{
+	struct pollfd pfd[2] = {
+		{.fd = bell, .events = POLLIN},
+		{.fd = stop_fd, .events = POLLIN},
+	};
+	eventfd_t v;
+	int n;
+
+	do {
+		n = poll(pfd, ARRAY_SIZE(pfd), timeout_ms);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		return -errno;
+	}
+
+	if (pfd[1].revents) {
+		return -ECANCELED;
+	}
+
+	if (n == 0) {
+		return -ETIMEDOUT;
+	}
+
+	/* Non-blocking: a racing waiter on the same bell may have cleared it */
+	(void)eventfd_read(bell, &v);
+
+	return 0;
+}
+
+int shm_bell_ring(int bell)
+{
+	return eventfd_write(bell, 1) < 0 ? -errno : 0;
+}
+
+static int *channel_fds(struct bt_shm_channel *ch, int i)
+{
+	int *fds[SHM_CHANNEL_FDS] = {&ch->mem_fd, &ch->host_rx_bell, &ch->host_tx_bell,
+				     &ch->peer_bell};
+
+	return fds[i];
+}
+
+int bt_shm_channel_create(uint32_t ring_size, struct bt_shm_channel *ch)
+{
+	struct shm_seg *seg;
+	int err;
+
+	for (int i = 0; i < SHM_CHANNEL_FDS; i++) {
+		*channel_fds(ch, i) = -1;
+	}
+
+	if (!ring_size_valid(ring_size)) {
+		return -EINVAL;
+	}
+
+	ch->mem_fd = memfd_create("openblue-hci", MFD_CLOEXEC);
+	if (ch->mem_fd < 0) {
+		return -errno;
+	}
+
+	if (ftruncate(ch->mem_fd, shm_seg_size(ring_size)) < 0) {
+		err = -errno;
+		goto fail;
+	}
+
+	seg = mmap(NULL, sizeof(*seg), PROT_READ | PROT_WRITE, MAP_SHARED, ch->mem_fd, 0);
+	if (seg == MAP_FAILED) {
+		err = -errno;
+		goto fail;
+	}
+
+	shm_seg_format(seg, ring_size);
+	(void)munmap(seg, sizeof(*seg));
+
+	for (int i = 1; i < SHM_CHANNEL_FDS; i++) {
+		*channel_fds(ch, i) = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (*channel_fds(ch, i) < 0) {
+			err = -errno;
+			goto fail;
+		}
+	}
+
+	return 0;
+
+fail:
+	bt_shm_channel_close(ch);
+
+	return err;
+}
+
+void bt_shm_channel_close(struct bt_shm_channel *ch)
+{
+	for (int i = 0; i < SHM_CHANNEL_FDS; i++) {
+		int *fd = channel_fds(ch, i);
+
+		if (*fd >= 0) {
+			(void)close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+int bt_shm_channel_send(int sock, const struct bt_shm_channel *ch)
+{
+	union {
+		char buf[CMSG_SPACE(SHM_CHANNEL_FDS * sizeof(int))];
+		struct cmsghdr align;
+	} ctrl;
+	uint8_t tag = SHM_SEG_VERSION;
+	struct iovec iov = {.iov_base = &tag, .iov_len = sizeof(tag)};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctrl.buf,
+		.msg_controllen = sizeof(ctrl.buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	const int fds[SHM_CHANNEL_FDS] = {ch->mem_fd, ch->host_rx_bell, ch->host_tx_bell,
+					  ch->peer_bell};
+
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 ? -errno : 0;
+}
+
+int bt_shm_channel_recv(int sock, struct bt_shm_channel *ch)
+{
+	union {
+		char buf[CMSG_SPACE(SHM_CHANNEL_FDS * sizeof(int))];
+		struct cmsghdr align;
+	} ctrl;
+	uint8_t tag;
+	struct iovec iov = {.iov_base = &tag, .iov_len = sizeof(tag)};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctrl.buf,
+		.msg_controllen = sizeof(ctrl.buf),
+	};
+	struct cmsghdr *cmsg;
+	int fds[SHM_CHANNEL_FDS];
+	ssize_t n;
+
+	do {
+		n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0) {
+		return -errno;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (n == 0 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+		return -EPROTO;
+	}
+
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	if (tag != SHM_SEG_VERSION || (msg.msg_flags & MSG_CTRUNC)) {
+		for (int i = 0; i < SHM_CHANNEL_FDS; i++) {
+			(void)close(fds[i]);
+		}
+		return -EPROTO;
+	}
+
+	for (int i = 0; i < SHM_CHANNEL_FDS; i++) {
+		*channel_fds(ch, i) = fds[i];
+	}
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+/* shm_ring.h - Shared-memory HCI rings */
+
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __DRIVER_SHM_RING_H
+#define __DRIVER_SHM_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <base/bt_atomic.h>
+#include <drivers/shm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHM_SEG_MAGIC   0x4f424853 /* "SHBO" */
+#define SHM_SEG_VERSION 1
+#define SHM_CACHE_LINE  64
+
+/* Every record is a little-endian length followed by the H4 frame */
+#define SHM_REC_HDR 4
+
+/* Indices count bytes and run freely; the ring size is a power of two.
+ * Producer and consumer fields live on separate cache lines.
+ */
+struct shm_ring {
+	bt_atomic_t head;             /* Written by the producer */
+	bt_atomic_t producer_waiting; /* Producer sleeps on the space doorbell */
+	uint8_t _pad0[SHM_CACHE_LINE - 2 * sizeof(bt_atomic_t)];
+	bt_atomic_t tail;             /* Written by the consumer */
+	bt_atomic_t consumer_waiting; /* Consumer sleeps on the data doorbell */
+	uint8_t _pad1[SHM_CACHE_LINE - 2 * sizeof(bt_atomic_t)];
+};
+
+/* Start of the memfd: header, both ring controls, then the two data areas */
+struct shm_seg {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_size;
+	uint32_t ring_size;
+	uint8_t _pad[SHM_CACHE_LINE - 12];
+	struct shm_ring to_peer;
+	struct shm_ring to_host;
+};
+
+/* One side's view of one ring */
+struct shm_ring_end {
+	struct shm_ring *ring;
+	uint8_t *data;
+	uint32_t size;
+	int data_bell;  /* Rung by the producer when the consumer waits */
+	int space_bell; /* Rung by the consumer when the producer waits */
+};
+
+/* Bytes the whole segment takes for a given ring size */
+static inline size_t shm_seg_size(uint32_t ring_size)
+{
+	return sizeof(struct shm_seg) + 2 * (size_t)ring_size;
+}
+
+/* Writes a fresh header into a zeroed segment */
+void shm_seg_format(struct shm_seg *seg, uint32_t ring_size);
+
+/* Maps and validates the segment behind ch->mem_fd, 0 or -errno */
+int shm_seg_map(const struct bt_shm_channel *ch, struct shm_seg **seg, size_t *len);
+
+/* Fills the host (or peer) ends of both rings */
+void shm_seg_ends(struct shm_seg *seg, const struct bt_shm_channel *ch, bool host,
+		  struct shm_ring_end *tx, struct shm_ring_end *rx);
+
+/* Appends one frame and rings the data doorbell if the consumer sleeps.
+ * Returns 0, -EAGAIN while there is not enough room or -EMSGSIZE if the
+ * frame can never fit. *rang tells whether a doorbell write was needed.
+ */
+int shm_ring_put(struct shm_ring_end *end, const void *frame, uint32_t len, bool *rang);
+
+/* Length of the oldest frame, -EAGAIN if the ring is empty or -EBADMSG if
+ * the record does not fit in what the producer published.
+ */
+int shm_ring_peek(struct shm_ring_end *end, uint32_t *len);
+
+/* Copies len bytes of the oldest frame starting at offset */
+void shm_ring_read(struct shm_ring_end *end, uint32_t offset, void *dst, uint32_t len);
+
+/* Drops the oldest frame and rings the space doorbell if the producer sleeps */
+bool shm_ring_consume(struct shm_ring_end *end, uint32_t len);
+
+/* Drops everything published so far, used to recover from a corrupt record */
+bool shm_ring_flush(struct shm_ring_end *end);
+
+/* Free bytes, a frame of len bytes fits when this is at least len + SHM_REC_HDR */
+uint32_t shm_ring_space(const struct shm_ring_end *end);
+
+bool shm_ring_empty(const struct shm_ring_end *end);
+
+/* Blocks on bell and stop_fd, then clears bell.
+ * Returns 0 on a doorbell, -ECANCELED once stop_fd is readable, -ETIMEDOUT
+ * after timeout_ms (negative waits forever) or -errno.
+ */
+int shm_bell_wait(int bell, int stop_fd, int timeout_ms);
+
+int shm_bell_ring(int bell);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DRIVER_SHM_RING_H */
@@ -14,12 +14,17 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/poll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include <base/byteorder.h>
 
+#include "h4_tx.h"
 #include "hci_sock.h"
+#if defined(CONFIG_BT_H4_IO_URING)
+#include "h4_uring.h"
+#endif
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -27,8 +32,11 @@
 
 struct uc_data {
 	int fd;
+	int stop_fd; /* eventfd that wakes rx_thread up for shutdown */
 	bt_hci_recv_t recv;
 	bool ready;
+	struct h4_rx rx;
+	struct h4_tx tx;
 };
 
 #define UC_THREAD_STACK_SIZE 2048
@@ -147,185 +155,51 @@ static struct bt_buf *get_rx(const uint8_t *buf)
 	return NULL;
 }
 
-/**
- * @brief Decode the length of an HCI H4 packet and check it's complete
- * @details Decodes packet length according to Bluetooth spec v5.4 Vol 4 Part E
- * @param buf	Pointer to a HCI packet buffer
- * @param buf_len	Bytes available in the buffer
- * @return Length of the complete HCI packet in bytes, -1 if cannot find an HCI
- *         packet, 0 if more data required.
- */
-static int32_t hci_packet_complete(const uint8_t *buf, uint16_t buf_len)
+static struct bt_buf *uc_rx_alloc(const uint8_t *frame, size_t len, void *user_data)
 {
-	uint16_t payload_len = 0;
-	const uint8_t type = buf[0];
-	uint8_t header_len = sizeof(type);
-	const uint8_t *hdr = &buf[sizeof(type)];
-
-	switch (type) {
-	case BT_HCI_H4_CMD: {
-		if (buf_len < header_len + BT_HCI_CMD_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_cmd_hdr *cmd = (const struct bt_hci_cmd_hdr *)hdr;
-
-		/* Parameter Total Length */
-		payload_len = cmd->param_len;
-		header_len += BT_HCI_CMD_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_ACL: {
-		if (buf_len < header_len + BT_HCI_ACL_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_acl_hdr *acl = (const struct bt_hci_acl_hdr *)hdr;
-
-		/* Data Total Length */
-		payload_len = sys_le16_to_cpu(acl->len);
-		header_len += BT_HCI_ACL_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_SCO: {
-		if (buf_len < header_len + BT_HCI_SCO_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_sco_hdr *sco = (const struct bt_hci_sco_hdr *)hdr;
-
-		/* Data_Total_Length */
-		payload_len = sco->len;
-		header_len += BT_HCI_SCO_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_EVT: {
-		if (buf_len < header_len + BT_HCI_EVT_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_evt_hdr *evt = (const struct bt_hci_evt_hdr *)hdr;
-
-		/* Parameter Total Length */
-		payload_len = evt->len;
-		header_len += BT_HCI_EVT_HDR_SIZE;
-		break;
-	}
-	case BT_HCI_H4_ISO: {
-		if (buf_len < header_len + BT_HCI_ISO_HDR_SIZE) {
-			return 0;
-		}
-		const struct bt_hci_iso_hdr *iso = (const struct bt_hci_iso_hdr *)hdr;
+	return get_rx(frame);
+}
 
-		/* ISO_Data_Load_Length parameter */
-		payload_len = bt_iso_hdr_len(sys_le16_to_cpu(iso->len));
-		header_len += BT_HCI_ISO_HDR_SIZE;
-		break;
-	}
-	/* If no valid packet type found */
-	default:
-		LOG_WRN("Unknown packet type 0x%02x", type);
-		return -1;
-	}
+static void uc_rx_recv(struct bt_buf *buf, void *user_data)
+{
+	const struct bt_hci_transport *transport = user_data;
+	struct uc_data *uc = transport->user_data;
 
-	/* Request more data */
-	if (buf_len < header_len + payload_len) {
-		return 0;
-	}
+	LOG_DBG("Calling bt_recv(%p)", buf);
 
-	return (int32_t)header_len + payload_len;
+	uc->recv(transport, buf);
 }
 
 static void rx_thread(void *p1)
 {
 	const struct bt_hci_transport *transport = p1;
 	struct uc_data *uc = transport->user_data;
+	const struct h4_rx_stats *stats = &uc->rx.stats;
+	int err;
 
 	LOG_DBG("started");
 
-	long frame_size = 0;
-
-	while (1) {
-		static uint8_t frame[1021];
-		struct bt_buf *buf;
-		size_t buf_tailroom;
-		size_t buf_add_len;
-		long len;
-		const uint8_t *frame_start = frame;
-
-		if (!hci_sock_rx_ready(uc->fd)) {
-			os_sleep_ms(1);
-			continue;
-		}
-
-		if (frame_size >= sizeof(frame)) {
-			LOG_ERR("HCI Packet is too big for frame (%zu "
-				"bytes). Dropping data",
-				sizeof(frame));
-			frame_size = 0; /* Drop buffer */
-		}
-
-		LOG_DBG("calling read()");
-
-		len = read(uc->fd, frame + frame_size, sizeof(frame) - frame_size);
-		if (len < 0) {
-			if (errno == EINTR) {
-				os_thread_yield();
-				continue;
-			}
-
-			LOG_ERR("Reading socket failed, errno %d", errno);
-			(void)close(uc->fd);
-			uc->fd = -1;
-			return;
-		}
-
-		frame_size += len;
-
-		while (frame_size > 0) {
-			const uint8_t *buf_add;
-			const uint8_t packet_type = frame_start[0];
-			const int32_t decoded_len = hci_packet_complete(frame_start, frame_size);
-
-			if (decoded_len == -1) {
-				LOG_ERR("HCI Packet type is invalid, length could not be decoded");
-				frame_size = 0; /* Drop buffer */
-				break;
-			}
-
-			if (decoded_len == 0) {
-				if ((frame_start != frame) && (frame_size < sizeof(frame))) {
-					memmove(frame, frame_start, frame_size);
-				}
-				/* Read more */
-				break;
-			}
-
-			buf_add = frame_start + sizeof(packet_type);
-			buf_add_len = decoded_len - sizeof(packet_type);
-
-			buf = get_rx(frame_start);
-
-			frame_size -= decoded_len;
-			frame_start += decoded_len;
-
-			if (!buf) {
-				continue;
-			}
-
-			buf_tailroom = bt_buf_tailroom(buf);
-			if (buf_tailroom < buf_add_len) {
-				LOG_ERR("Not enough space in buffer %zu/%zu", buf_add_len,
-					buf_tailroom);
-				bt_buf_unref(buf);
-				continue;
-			}
-
-			bt_buf_add_mem(buf, buf_add, buf_add_len);
-
-			LOG_DBG("Calling bt_recv(%p)", buf);
+#if defined(CONFIG_BT_H4_IO_URING)
+	err = h4_uring_rx_loop(&uc->rx, uc->stop_fd);
+	if (err == -EOPNOTSUPP) {
+		LOG_WRN("io_uring not available, receiving with epoll");
+		err = hci_sock_rx_loop(&uc->rx, uc->stop_fd);
+	}
+#else
+	err = hci_sock_rx_loop(&uc->rx, uc->stop_fd);
+#endif
+	if (err < 0) {
+		LOG_ERR("Reading socket failed, err %d", err);
+	}
 
-			uc->recv(transport, buf);
-		}
+	h4_rx_reset(&uc->rx);
 
-		os_thread_yield();
+	if (stats->dropped || stats->oversize) {
+		LOG_WRN("Dropped %u malformed and %u oversized HCI packets", stats->dropped,
+			stats->oversize);
 	}
+
+	LOG_DBG("stopped: %u frames in %u reads", stats->frames, stats->reads);
 }
 
 static int uc_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
@@ -339,17 +213,38 @@ static int uc_send(const struct bt_hci_transport *transport, struct bt_buf *buf)
 		return -EIO;
 	}
 
-	if (write(uc->fd, buf->data, buf->len) < 0) {
-		return -errno;
+	h4_tx_send(&uc->tx, buf);
+	return 0;
+}
+
+static size_t uc_send_batch(const struct bt_hci_transport *transport, struct bt_buf **bufs,
+			    size_t count)
+{
+	struct uc_data *uc = transport->user_data;
+
+	if (uc->fd < 0) {
+		LOG_ERR("User channel not open");
+		return 0;
 	}
 
-	bt_buf_unref(buf);
+	h4_tx_send_batch(&uc->tx, bufs, count);
+	return count;
+}
+
+static int uc_get_stats(const struct bt_hci_transport *transport,
+			struct bt_hci_driver_stats *stats)
+{
+	struct uc_data *uc = transport->user_data;
+
+	h4_rx_stats_fill(&uc->rx, stats);
+	h4_tx_stats_fill(&uc->tx, stats);
 	return 0;
 }
 
 static int uc_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
 {
 	struct uc_data *uc = transport->user_data;
+	int err;
 
 	switch (conn_type) {
 	case HCI_USERCHAN:
@@ -369,16 +264,58 @@ static int uc_open(const struct bt_hci_transport *transport, bt_hci_recv_t recv)
 		return uc->fd;
 	}
 
+	uc->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (uc->stop_fd < 0) {
+		err = -errno;
+		goto bail;
+	}
+
 	uc->recv = recv;
 
+	err = h4_rx_init(&uc->rx, uc->fd, uc_rx_alloc, uc_rx_recv, (void *)transport);
+	if (err < 0) {
+		goto bail;
+	}
+
+	err = h4_tx_init(&uc->tx, uc->fd);
+	if (err < 0) {
+		goto bail;
+	}
+
+#if defined(CONFIG_BT_H4_IO_URING)
+	if (h4_uring_tx_attach(&uc->tx) < 0) {
+		LOG_WRN("io_uring not available, sending with %s",
+			uc->tx.datagram ? "sendmmsg" : "writev");
+	}
+#endif
+
 	LOG_DBG("User Channel opened as fd %d", uc->fd);
 
-	os_thread_create(&rx_thread_data, rx_thread, (void *)transport, "user_chan",
-			 OS_PRIORITY(CONFIG_BT_DRIVER_RX_HIGH_PRIO), UC_THREAD_STACK_SIZE);
+	err = os_thread_create(&rx_thread_data, rx_thread, (void *)transport, "user_chan",
+			       OS_PRIORITY_COOP(CONFIG_BT_DRIVER_RX_HIGH_PRIO), UC_THREAD_STACK_SIZE);
+	if (err < 0) {
+		goto bail;
+	}
+	if (CONFIG_BT_DRIVER_RX_CPU_MASK != 0) {
+		(void)os_thread_affinity_set(&rx_thread_data, CONFIG_BT_DRIVER_RX_CPU_MASK);
+	}
 
 	LOG_DBG("returning");
 
 	return 0;
+
+bail:
+#if defined(CONFIG_BT_H4_IO_URING)
+	h4_uring_tx_detach(&uc->tx);
+#endif
+	if (uc->stop_fd >= 0) {
+		(void)close(uc->stop_fd);
+		uc->stop_fd = -1;
+	}
+	(void)close(uc->fd);
+	uc->fd = -1;
+
+	return err;
 }
 
 static int uc_close(const struct bt_hci_transport *transport)
@@ -390,6 +327,24 @@ static int uc_close(const struct bt_hci_transport *transport)
 		return -ENETDOWN;
 	}
 
+	if (eventfd_write(uc->stop_fd, 1) < 0) {
+		LOG_ERR("Failed to stop RX thread, errno %d", errno);
+	} else {
+		(void)os_thread_join(&rx_thread_data, OS_TIMEOUT_FOREVER);
+	}
+
+	(void)close(uc->stop_fd);
+	uc->stop_fd = -1;
+
+	h4_tx_reset(&uc->tx);
+#if defined(CONFIG_BT_H4_IO_URING)
+	h4_uring_tx_detach(&uc->tx);
+#endif
+	if (uc->tx.stats.errors) {
+		LOG_WRN("%u packets lost to write errors, last %d", uc->tx.stats.errors,
+			uc->tx.err);
+	}
+
 	rc = close(uc->fd);
 	if (rc < 0) {
 		return rc;
@@ -404,6 +359,8 @@ static const struct bt_hci_driver_api uc_drv_api = {
 	.open = uc_open,
 	.close = uc_close,
 	.send = uc_send,
+	.send_batch = uc_send_batch,
+	.get_stats = uc_get_stats,
 };
 
 static bool uc_is_ready(const struct bt_hci_transport *transport)
@@ -415,6 +372,7 @@ static bool uc_is_ready(const struct bt_hci_transport *transport)
 
 static struct uc_data _uc_data = {
 	.fd = -1,
+	.stop_fd = -1,
 	.ready = false,
 };
 
@@ -434,6 +392,7 @@ static int uc_init(void)
 	bt_hci_transport_register(&uc_transport);
 
 	uc->fd = -1;
+	uc->stop_fd = -1;
 	uc->ready = true;
 
 	return 0;
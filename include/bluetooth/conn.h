@@ -1437,6 +1437,103 @@ int bt_conn_le_set_default_phy(uint8_t pref_tx_phy, uint8_t pref_rx_phy);
  */
 int bt_conn_disconnect(struct bt_conn *conn, uint8_t reason);
 
+/** How the TX processor picks the next connection to send a fragment from,
+ *  among the ones with data that may use a controller buffer.
+ */
+enum bt_conn_tx_sched {
+	/** Round-robin. A connection keeps its turn for
+	 *  @kconfig{CONFIG_BT_CONN_TX_QUANTUM} fragments, or until it has
+	 *  that many buffers in the controller. This is the default.
+	 */
+	BT_CONN_TX_SCHED_RR,
+
+	/** Weighted fair queuing. Connections that have data share the
+	 *  bytes sent in proportion to their weights, and an idle connection
+	 *  does not save up a share for later.
+	 */
+	BT_CONN_TX_SCHED_WFQ,
+
+	/** Strict priority. A connection with a higher weight is always
+	 *  served first, equal weights take turns as with round-robin.
+	 */
+	BT_CONN_TX_SCHED_PRIO,
+};
+
+/** Weight of a connection until bt_conn_tx_weight_set() */
+#define BT_CONN_TX_WEIGHT_DEFAULT 1
+
+/** @brief Select the TX scheduling policy of every connection.
+ *
+ *  Takes effect from the next fragment on.
+ *
+ *  @param sched Scheduling policy.
+ *
+ *  @return Zero on success or -EINVAL if the policy is unknown.
+ */
+int bt_conn_tx_sched_set(enum bt_conn_tx_sched sched);
+
+/** @brief Set the TX weight of a connection.
+ *
+ *  The share of @ref BT_CONN_TX_SCHED_WFQ or the priority of
+ *  @ref BT_CONN_TX_SCHED_PRIO, kept across policy changes. Reset to
+ *  @ref BT_CONN_TX_WEIGHT_DEFAULT when the connection object is reused.
+ *
+ *  @param conn Connection object.
+ *  @param weight Weight, 1 to 255.
+ *
+ *  @return Zero on success or -EINVAL if the weight is 0.
+ */
+int bt_conn_tx_weight_set(struct bt_conn *conn, uint8_t weight);
+
+/** @brief Limit the controller buffers a connection may hold.
+ *
+ *  A connection with @p quota packets sent to the controller and not yet
+ *  completed is passed over by every policy until one completes, leaving
+ *  the rest of the shared buffers to other connections.
+ *
+ *  @param conn Connection object.
+ *  @param quota Controller buffers, 0 for no limit of its own.
+ *
+ *  @return Zero on success.
+ */
+int bt_conn_tx_quota_set(struct bt_conn *conn, uint8_t quota);
+
+/** TX scheduling counters of a connection, cumulative since it was
+ *  established or the last bt_conn_tx_stats_reset().
+ *
+ *  A wait is the time from a connection joining the queue of connections
+ *  with data until the TX processor takes its first fragment, so waits
+ *  counts turns and delay_ns / waits is the average queueing delay. A
+ *  connection rejoins the queue after every turn it ends with data left.
+ */
+struct bt_conn_tx_stats {
+	uint32_t frags;         /* Fragments handed to the driver */
+	uint64_t bytes;         /* Their payload, without HCI headers */
+	uint32_t waits;
+	uint64_t delay_ns;
+	uint64_t delay_max_ns;
+	uint32_t quota_hits;    /* Times it was passed over for its quota */
+};
+
+/** @brief Get the TX scheduling counters of a connection.
+ *
+ *  Requires @kconfig{CONFIG_BT_CONN_TX_STATS}. The counters are updated by
+ *  the TX processor without a lock, so a snapshot taken while data is
+ *  flowing may be slightly inconsistent.
+ *
+ *  @param conn Connection object.
+ *  @param stats Filled with the counters.
+ *
+ *  @return Zero on success or -ENOTSUP if the counters are not compiled in.
+ */
+int bt_conn_tx_stats_get(const struct bt_conn *conn, struct bt_conn_tx_stats *stats);
+
+/** @brief Clear the TX scheduling counters of a connection.
+ *
+ *  @param conn Connection object.
+ */
+void bt_conn_tx_stats_reset(struct bt_conn *conn);
+
 enum {
 	/** Convenience value when no options are specified. */
 	BT_CONN_LE_OPT_NONE = 0,
@@ -106,6 +106,44 @@ int bt_hci_cmd_send(uint16_t opcode, struct bt_buf *buf);
 int bt_hci_cmd_send_sync(uint16_t opcode, struct bt_buf *buf,
 			 struct bt_buf **rsp);
 
+/** @typedef bt_hci_cmd_cb_t
+  * @brief Completion callback of bt_hci_cmd_send_async().
+  *
+  * Called from the context that processes Command Complete and Command
+  * Status events, normally the driver's RX context, or from the TX context
+  * with BT_HCI_ERR_UNSPECIFIED if the driver did not take the command. It
+  * must not block, so it must not call bt_hci_cmd_send_sync().
+  *
+  * @param opcode    Command OpCode.
+  * @param status    HCI status of the command.
+  * @param rsp       Command Complete return parameters, starting with the
+  *                  status, or empty after a Command Status. Only valid
+  *                  during the call.
+  * @param user_data As passed to bt_hci_cmd_send_async().
+  */
+typedef void (*bt_hci_cmd_cb_t)(uint16_t opcode, uint8_t status, struct bt_buf *rsp,
+				void *user_data);
+
+/** Send a HCI command and get its result through a callback.
+  *
+  * Like bt_hci_cmd_send(), but @p cb is called once the command completes.
+  * Queued commands are sent in order, as many at a time as both the
+  * controller's Num_HCI_Command_Packets and
+  * @kconfig{CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT} allow, so independent commands
+  * queued back to back share one round trip instead of taking one each.
+  * Commands with the same OpCode, and HCI_Reset, still go one at a time.
+  *
+  * @param opcode    Command OpCode, not Host Number Of Completed Packets.
+  * @param buf       Command buffer or NULL (if no parameters).
+  * @param cb        Completion callback, may be NULL.
+  * @param user_data Passed to @p cb.
+  *
+  * @return 0 on success or negative error value on failure, in which case a
+  *         @p buf that was passed in was not consumed.
+  */
+int bt_hci_cmd_send_async(uint16_t opcode, struct bt_buf *buf, bt_hci_cmd_cb_t cb,
+			  void *user_data);
+
 /** @brief Get connection handle for a connection.
  *
  * @param conn Connection object.
@@ -198,6 +236,45 @@ typedef bool bt_hci_vnd_evt_cb_t(struct bt_buf_simple *buf);
   */
 int bt_hci_register_vnd_evt_cb(bt_hci_vnd_evt_cb_t cb);
 
+/** Handler for one Vendor-Specific Event subevent code.
+ *
+ *  Registered with bt_hci_vnd_evt_handler_register(). The handler is called
+ *  from the RX context with @p buf positioned after the subevent code, for
+ *  events not claimed by the bt_hci_register_vnd_evt_cb() callback, and
+ *  before the stack's own Vendor-Specific Event handling.
+ */
+struct bt_hci_vnd_evt_handler {
+	/** Subevent code, the first parameter of the Vendor-Specific Event */
+	uint8_t subevent;
+
+	/** Shorter events are dropped without calling the handler */
+	uint8_t min_len;
+
+	void (*handler)(struct bt_buf_simple *buf);
+
+	/** Internally used field for list handling */
+	bt_snode_t node;
+};
+
+/** Register a handler for a Vendor-Specific Event subevent.
+ *
+ *  @param h Handler, which must stay valid until unregistered.
+ *
+ *  @return 0 on success, -EINVAL if @p h has no handler or -EALREADY if the
+ *          subevent already has one.
+ */
+int bt_hci_vnd_evt_handler_register(struct bt_hci_vnd_evt_handler *h);
+
+/** Unregister a Vendor-Specific Event subevent handler.
+ *
+ *  Does not wait for a call that is already in progress.
+ *
+ *  @param h Handler passed to bt_hci_vnd_evt_handler_register().
+ *
+ *  @return 0 on success or -ENOENT if @p h is not registered.
+ */
+int bt_hci_vnd_evt_handler_unregister(struct bt_hci_vnd_evt_handler *h);
+
 /** @brief Get Random bytes from the LE Controller.
  *
  * Send the HCI_LE_Rand to the LE Controller as many times as required to
@@ -213,6 +290,136 @@ int bt_hci_register_vnd_evt_cb(bt_hci_vnd_evt_cb_t cb);
  */
 int bt_hci_le_rand(void *buffer, size_t len);
 
+/** Host RX processing counters, cumulative since boot.
+ *
+ *  Packets per invocation is packets / batches. Residency is measured from the
+ *  moment a packet is queued by bt_hci_recv() until the RX work item takes it
+ *  off the queue, for the oldest packet of each take, so residency_ns / takes
+ *  is the average and residency_max_ns the worst head-of-line wait.
+ */
+struct bt_hci_rx_stats {
+	uint32_t batches;          /* RX work invocations that processed a packet */
+	uint32_t packets;
+	uint32_t max_batch;        /* Most packets processed in one invocation */
+	uint32_t yields;           /* Invocations that ran out of budget */
+	uint32_t takes;            /* Times the pending queue was taken as a whole */
+	uint64_t residency_ns;
+	uint64_t residency_max_ns;
+};
+
+/** @brief Get the host RX processing counters.
+ *
+ *  The counters are updated by the RX work item without a lock, so a snapshot
+ *  taken while packets are flowing may be slightly inconsistent.
+ *
+ *  @param stats Filled with the current counters.
+ */
+void bt_hci_rx_stats_get(struct bt_hci_rx_stats *stats);
+
+/** Counters of one HCI event or LE subevent code, cumulative since boot or
+ *  the last bt_hci_evt_stats_reset().
+ *
+ *  Events handled in the driver RX context and in the RX work item are
+ *  counted separately, see bt_hci_evt_prio_stats_get(). The LE Meta event's
+ *  own time includes its subevent handler. Each context updates its counters
+ *  without a lock, so a snapshot taken while events are flowing may be
+ *  slightly inconsistent.
+ */
+struct bt_hci_evt_stats {
+	uint32_t count;    /* Handler invocations */
+	uint32_t dropped;  /* No handler, or shorter than the handler accepts */
+	uint64_t time_ns;  /* Time spent in the handler */
+	uint64_t max_ns;
+};
+
+/** @brief Get the counters of an HCI event code handled in the RX work item.
+ *
+ *  Requires @kconfig{CONFIG_BT_HCI_EVT_STATS}.
+ *
+ *  @param evt HCI event code.
+ *  @param stats Filled with the counters.
+ */
+void bt_hci_evt_stats_get(uint8_t evt, struct bt_hci_evt_stats *stats);
+
+/** @brief Get the counters of an LE Meta event subevent code handled in the
+ *  RX work item.
+ *
+ *  Requires @kconfig{CONFIG_BT_HCI_EVT_STATS}.
+ *
+ *  @param subevent LE subevent code.
+ *  @param stats Filled with the counters.
+ */
+void bt_hci_le_evt_stats_get(uint8_t subevent, struct bt_hci_evt_stats *stats);
+
+/** @brief Get the counters of an HCI event code handled in the driver RX context.
+ *
+ *  Requires @kconfig{CONFIG_BT_HCI_EVT_STATS}.
+ *
+ *  @param evt HCI event code.
+ *  @param stats Filled with the counters.
+ */
+void bt_hci_evt_prio_stats_get(uint8_t evt, struct bt_hci_evt_stats *stats);
+
+/** @brief Get the counters of an LE Meta event subevent code handled in the
+ *  driver RX context.
+ *
+ *  Requires @kconfig{CONFIG_BT_HCI_EVT_STATS}.
+ *
+ *  @param subevent LE subevent code.
+ *  @param stats Filled with the counters.
+ */
+void bt_hci_le_evt_prio_stats_get(uint8_t subevent, struct bt_hci_evt_stats *stats);
+
+/** @brief Clear the counters of every event and LE subevent code. */
+void bt_hci_evt_stats_reset(void);
+
+/** Latency buckets of struct bt_hci_cmd_stats */
+#define BT_HCI_CMD_LATENCY_BUCKETS 16
+
+/** Latency of one HCI command OpCode, from handing the command to the driver
+ *  until its Command Complete or Command Status is processed, cumulative
+ *  since boot or the last bt_hci_cmd_stats_reset().
+ */
+struct bt_hci_cmd_stats {
+	uint16_t opcode;
+	uint32_t count;
+	uint32_t failed;   /* Non-zero status, including not taken by the driver */
+	uint64_t time_ns;
+	uint64_t max_ns;
+	/* hist[i] counts latencies from 2^i up to 2^(i+1) microseconds, the
+	 * first bucket also shorter ones and the last everything longer.
+	 */
+	uint32_t hist[BT_HCI_CMD_LATENCY_BUCKETS];
+};
+
+/** @brief Get the latency counters of an HCI command OpCode.
+ *
+ *  Requires @kconfig{CONFIG_BT_HCI_CMD_STATS}. Only the first
+ *  @kconfig{CONFIG_BT_HCI_CMD_STATS_OPCODES} distinct OpCodes since the last
+ *  reset are tracked.
+ *
+ *  @param opcode Command OpCode.
+ *  @param stats Filled with the counters.
+ *
+ *  @return 0, or -ENOENT if no command with this OpCode was tracked.
+ */
+int bt_hci_cmd_stats_get(uint16_t opcode, struct bt_hci_cmd_stats *stats);
+
+/** @typedef bt_hci_cmd_stats_cb_t
+ *  @brief Callback of bt_hci_cmd_stats_foreach(), gets a copy of the counters.
+ */
+typedef void (*bt_hci_cmd_stats_cb_t)(const struct bt_hci_cmd_stats *stats, void *user_data);
+
+/** @brief Call @p func for every tracked OpCode, in no particular order.
+ *
+ *  @param func Callback function.
+ *  @param user_data Passed to @p func.
+ */
+void bt_hci_cmd_stats_foreach(bt_hci_cmd_stats_cb_t func, void *user_data);
+
+/** @brief Clear the latency counters of every OpCode. */
+void bt_hci_cmd_stats_reset(void);
+
 
 #ifdef __cplusplus
 }
@@ -69,7 +69,8 @@ extern "C" {
  *  The MTU for incoming L2CAP SDUs with segmentation is defined by the
  *  size of the application buffer pool. The application will have to define
  *  an alloc_buf callback for the channel in order to support receiving
- *  segmented L2CAP SDUs.
+ *  segmented L2CAP SDUs, unless @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN} is
+ *  enabled.
  */
 #define BT_L2CAP_SDU_RX_MTU (BT_L2CAP_RX_MTU - BT_L2CAP_SDU_HDR_SIZE)
 
@@ -245,6 +246,12 @@ struct bt_l2cap_le_chan {
 	 *  MTU of the receiving endpoint will be initialized to
 	 *  @ref BT_L2CAP_SDU_RX_MTU by the stack.
 	 *
+	 *  With @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN} the MTU of a channel
+	 *  without alloc_buf may be set as well, up to
+	 *  @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES} K-frames worth of data.
+	 *  Channels share @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET}, so a
+	 *  segmented SDU may wait for others to be released.
+	 *
 	 *  This is the source of the MTU, MPS and credit values when sending
 	 *  L2CAP_LE_CREDIT_BASED_CONNECTION_REQ/RSP and
 	 *  L2CAP_CONFIGURATION_REQ.
@@ -268,9 +275,18 @@ struct bt_l2cap_le_chan {
 	/** Segment SDU packet from upper layer */
 	struct bt_buf			*_sdu;
 	uint16_t			_sdu_len;
-#if defined(CONFIG_BT_L2CAP_SEG_RECV)
+#if defined(CONFIG_BT_L2CAP_SEG_RECV) || defined(CONFIG_BT_L2CAP_SDU_CHAIN)
 	uint16_t			_sdu_len_done;
-#endif /* CONFIG_BT_L2CAP_SEG_RECV */
+#endif /* CONFIG_BT_L2CAP_SEG_RECV || CONFIG_BT_L2CAP_SDU_CHAIN */
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+	/* Last K-frame chained to _sdu */
+	struct bt_buf			*_sdu_tail;
+	/* K-frames of the SDU are taken from the shared chaining budget */
+	bool				_sdu_budget;
+	/* Credits of the SDU held back until the budget has room */
+	uint16_t			_sdu_credits_held;
+	bt_snode_t			_sdu_wait_node;
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
 
 	struct bt_work			rx_work;
 	struct bt_fifo			rx_queue;
@@ -291,6 +307,8 @@ struct bt_l2cap_le_chan {
 
 	/** @internal To be used with @ref bt_conn.upper_data_ready */
 	bt_snode_t			_pdu_ready;
+	/** @internal To be used with @ref bt_conn.upper_data_ready */
+	bt_atomic_t			_pdu_ready_lock;
 	/** @internal Holds the length of the current PDU/segment */
 	size_t				_pdu_remaining;
 };
@@ -645,7 +663,9 @@ struct bt_l2cap_chan_ops {
 	 *  buffers to store incoming data. Channels that requires segmentation
 	 *  must set this callback.
 	 *  If the application has not set a callback the L2CAP SDU MTU will be
-	 *  truncated to @ref BT_L2CAP_SDU_RX_MTU.
+	 *  truncated to @ref BT_L2CAP_SDU_RX_MTU, or with
+	 *  @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN} segmented SDUs are received
+	 *  as chains of the K-frame buffers instead of being copied.
 	 *
 	 *  @param chan The channel requesting a buffer.
 	 *
@@ -656,7 +676,10 @@ struct bt_l2cap_chan_ops {
 	/** @brief Channel recv callback
 	 *
 	 *  @param chan The channel receiving data.
-	 *  @param buf Buffer containing incoming data.
+	 *  @param buf Buffer containing incoming data. Segmented SDUs
+	 *  reassembled with @kconfig{CONFIG_BT_L2CAP_SDU_CHAIN} continue in
+	 *  @p buf's fragments, see @ref bt_buf_frags_len and
+	 *  @ref bt_buf_iovec_get.
 	 *
 	 *  @note This callback is mandatory, unless
 	 *  @kconfig{CONFIG_BT_L2CAP_SEG_RECV} is enabled and seg_recv is
@@ -96,10 +96,31 @@ struct bt_hci_transport {
 
 typedef int (*bt_hci_recv_t)(const struct bt_hci_transport *transport, struct bt_buf *buf);
 
+/** Transport I/O counters, cumulative since open().
+ *
+ *  Syscalls per packet is tx_syscalls / tx_packets and bytes per syscall is
+ *  tx_bytes / tx_syscalls; likewise for the rx_ counters.
+ */
+struct bt_hci_driver_stats {
+	uint32_t tx_packets;
+	uint64_t tx_bytes;
+	uint32_t tx_syscalls;
+	uint32_t tx_waits;    /* Blocked on a full transport */
+	uint32_t tx_errors;   /* Packets dropped on a write error */
+	uint32_t rx_packets;
+	uint64_t rx_bytes;
+	uint32_t rx_syscalls;
+	uint32_t rx_dropped;  /* Malformed, oversized or no buffer available */
+};
+
 struct bt_hci_driver_api {
 	int (*open)(const struct bt_hci_transport *transport, bt_hci_recv_t recv);
 	int (*close)(const struct bt_hci_transport *transport);
 	int (*send)(const struct bt_hci_transport *transport, struct bt_buf *buf);
+	/* Optional, see bt_hci_send_batch() */
+	size_t (*send_batch)(const struct bt_hci_transport *transport, struct bt_buf **bufs,
+			     size_t count);
+	int (*get_stats)(const struct bt_hci_transport *transport, struct bt_hci_driver_stats *stats);
 #if defined(CONFIG_BT_HCI_SETUP)
 	int (*setup)(const struct bt_hci_transport *transport, const struct bt_hci_setup_params *param);
 #endif /* defined(CONFIG_BT_HCI_SETUP) */
@@ -173,6 +194,63 @@ static inline int bt_hci_send(const struct bt_hci_transport *transport, struct b
 	return api->send(transport, buf);
 }
 
+/**
+ * @brief Send several HCI buffers to the controller.
+ *
+ * Sends @p bufs in order, as the same H:4 encoded packets as bt_hci_send().
+ * Drivers that implement send_batch() hand them to the transport at once,
+ * e.g. as one writev(); others get one send() call per buffer.
+ *
+ * @note This function must only be called from a cooperative thread.
+ *
+ * @param transport HCI transport
+ * @param bufs Buffers to send.
+ * @param count Number of buffers.
+ *
+ * @return The number of buffers whose reference moved to the driver, from
+ *         the first one on. The caller still owns the rest, which were not
+ *         sent.
+ */
+static inline size_t bt_hci_send_batch(const struct bt_hci_transport *transport,
+				       struct bt_buf **bufs, size_t count)
+{
+	const struct bt_hci_driver_api *api = transport->api;
+	size_t sent = 0;
+
+	if (api->send_batch != NULL) {
+		return api->send_batch(transport, bufs, count);
+	}
+
+	while (sent < count && api->send(transport, bufs[sent]) == 0) {
+		sent++;
+	}
+
+	return sent;
+}
+
+/**
+ * @brief Read the transport I/O counters.
+ *
+ * The counters are updated without locking, so a snapshot taken while traffic
+ * is flowing may mix values from slightly different moments.
+ *
+ * @param transport HCI transport
+ * @param stats Filled in with the current counters.
+ *
+ * @return 0 on success, -ENOSYS if the driver does not keep counters.
+ */
+static inline int bt_hci_get_stats(const struct bt_hci_transport *transport,
+				   struct bt_hci_driver_stats *stats)
+{
+	const struct bt_hci_driver_api *api = transport->api;
+
+	if (api->get_stats == NULL) {
+		return -ENOSYS;
+	}
+
+	return api->get_stats(transport, stats);
+}
+
 #if defined(CONFIG_BT_HCI_SETUP) || defined(__DOXYGEN__)
 /**
  * @brief HCI vendor-specific setup
@@ -0,0 +1,131 @@
+/** @file
+ *  @brief In-process virtual controller for benchmarking without a radio.
+ *
+ *  SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __INCLUDE_BLUETOOTH_DRIVERS_LOOPBACK_H_
+#define __INCLUDE_BLUETOOTH_DRIVERS_LOOPBACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <bluetooth/addr.h>
+#include <drivers/bluetooth.h>
+#include <osdep/os.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Virtual peers that can be connected at the same time */
+#ifndef BT_LOOPBACK_MAX_PEERS
+#define BT_LOOPBACK_MAX_PEERS 8
+#endif
+
+/** Controller configuration, applied while the transport is closed. */
+struct bt_loopback_config {
+	/** Air rate of every link in bits per second, 0 for no air time */
+	uint32_t link_rate_bps;
+	/** Added to everything the controller sends to the host */
+	uint32_t latency_us;
+	/** LE ACL buffers reported to the host */
+	uint16_t acl_mtu;
+	uint8_t acl_pkts;
+	/** ISO buffers reported to the host, iso_pkts 0 disables CIS support */
+	uint16_t iso_mtu;
+	uint8_t iso_pkts;
+	/** Report BR/EDR support; BR/EDR commands get zeroed responses */
+	bool br_edr;
+	/** Num_HCI_Command_Packets of every Command Complete and Command Status */
+	uint8_t cmd_credits;
+	bt_addr_t public_addr;
+};
+
+/** What a connected peer does with the data the host sends it. */
+enum bt_loopback_peer_mode {
+	/** Acknowledges and discards */
+	BT_LOOPBACK_PEER_SINK,
+	/** Sends every ACL and ISO packet back to the host unchanged */
+	BT_LOOPBACK_PEER_ECHO,
+};
+
+extern const struct bt_hci_transport loopback_transport;
+
+/** Fills cfg with the defaults: no air time or latency, 8 x 251 byte ACL buffers, LE only,
+ *  one command at a time
+ */
+void bt_loopback_config_default(struct bt_loopback_config *cfg);
+
+/** Replaces the configuration, -EBUSY while open or -EINVAL */
+int bt_loopback_configure(const struct bt_loopback_config *cfg);
+
+/** Adds a peer that LE Create Connection to addr will reach, -ENOMEM when full.
+ *
+ *  Connecting to an unknown address keeps initiating until the host cancels.
+ */
+int bt_loopback_peer_add(const bt_addr_le_t *addr, enum bt_loopback_peer_mode mode);
+
+/** Removes every peer, only while closed */
+void bt_loopback_peer_clear(void);
+
+/** Sends an L2CAP frame from a connected peer to the host.
+ *
+ *  The frame is split into ACL fragments of up to 251 bytes that go through
+ *  the same link model as host data.
+ *
+ *  @return 0, -ENOTCONN if the peer is not connected, -ENETDOWN if the
+ *          transport is closed or -ENOBUFS if no fragment buffer was free
+ *          within timeout.
+ */
+int bt_loopback_inject_acl(const bt_addr_le_t *peer, const void *data, uint16_t len,
+			   os_timeout_t timeout);
+
+/** Disconnects a peer as if the remote user terminated the link, -ENOTCONN or -ENETDOWN */
+int bt_loopback_peer_disconnect(const bt_addr_le_t *peer);
+
+/** Controller to host ACL flow control as the controller sees it.
+ *
+ *  The counters are cumulative since open(), the state follows the last
+ *  HCI Reset.
+ */
+struct bt_loopback_host_flow_stats {
+	/** Set Controller To Host Flow Control turned ACL flow control on */
+	bool enabled;
+	/** ACL buffers announced with Host Buffer Size */
+	uint16_t acl_pkts;
+	/** ACL packets delivered and not yet reported back as completed */
+	uint16_t in_use;
+	/** Host Number Of Completed Packets commands and the packets they reported */
+	uint32_t nocp_cmds;
+	uint32_t nocp_packets;
+	/** Reports for handles no longer connected, which are ignored */
+	uint32_t nocp_stale;
+	/** Reports of more packets than a connection had outstanding */
+	uint32_t nocp_errors;
+	/** Times ACL data waited because the host had no buffer left */
+	uint32_t stalls;
+};
+
+/** Copies the host flow control counters, consistent once the host is idle */
+void bt_loopback_host_flow_stats_get(struct bt_loopback_host_flow_stats *stats);
+
+/** HCI commands as the controller sees them, cumulative since open(). */
+struct bt_loopback_cmd_stats {
+	/** Commands received, Host Number Of Completed Packets excluded */
+	uint32_t cmds;
+	/** Commands whose Command Complete or Status has not reached the host yet */
+	uint8_t outstanding;
+	uint8_t max_outstanding;
+};
+
+/** Copies the command counters, consistent once the host is idle */
+void bt_loopback_cmd_stats_get(struct bt_loopback_cmd_stats *stats);
+
+int bt_driver_loopback_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INCLUDE_BLUETOOTH_DRIVERS_LOOPBACK_H_ */
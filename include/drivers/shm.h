@@ -0,0 +1,104 @@
+/** @file
+ *  @brief Shared-memory HCI transport for controllers in another process.
+ *
+ *  SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __INCLUDE_BLUETOOTH_DRIVERS_SHM_H_
+#define __INCLUDE_BLUETOOTH_DRIVERS_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <drivers/bluetooth.h>
+#include <osdep/os.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Bytes in each direction's ring, a power of two */
+#ifndef CONFIG_BT_SHM_RING_SIZE
+#define CONFIG_BT_SHM_RING_SIZE 65536
+#endif
+
+/** File descriptors of one host-controller channel.
+ *
+ *  The segment holds a single-producer/single-consumer ring for each
+ *  direction. The doorbells are eventfds that are only written when the
+ *  other side is about to sleep, so a busy link runs without syscalls.
+ */
+struct bt_shm_channel {
+	/** memfd holding both rings */
+	int mem_fd;
+	/** Host waits here for frames from the controller */
+	int host_rx_bell;
+	/** Host waits here for room towards the controller */
+	int host_tx_bell;
+	/** Controller waits here for frames and for room */
+	int peer_bell;
+};
+
+/** Creates a channel with rings of ring_size bytes, 0 or -errno */
+int bt_shm_channel_create(uint32_t ring_size, struct bt_shm_channel *ch);
+
+/** Closes every descriptor and sets them to -1 */
+void bt_shm_channel_close(struct bt_shm_channel *ch);
+
+/** Passes the descriptors over a Unix socket, 0 or -errno */
+int bt_shm_channel_send(int sock, const struct bt_shm_channel *ch);
+
+/** Receives descriptors sent by bt_shm_channel_send(), 0 or -errno */
+int bt_shm_channel_recv(int sock, struct bt_shm_channel *ch);
+
+extern const struct bt_hci_transport shm_transport;
+
+/** Makes the transport use ch from the next open on.
+ *
+ *  The descriptors are duplicated, so the caller may close its copy.
+ *  Returns -EBUSY while open.
+ */
+int bt_shm_configure(const struct bt_shm_channel *ch);
+
+int bt_driver_shm_init(void);
+
+/** What the reference peer does with frames from the host. */
+enum bt_shm_peer_mode {
+	/** Answers commands with a successful Command Complete, discards data */
+	BT_SHM_PEER_SINK,
+	/** Like SINK, but sends ACL and ISO frames back unchanged */
+	BT_SHM_PEER_ECHO,
+};
+
+/** Controller side of a channel served by a thread, for tests and benchmarks */
+struct bt_shm_peer {
+	enum bt_shm_peer_mode mode;
+	/** Frames received from the host */
+	uint32_t rx_frames;
+	/** Frames sent to the host */
+	uint32_t tx_frames;
+	/** Doorbells the peer had to wait on */
+	uint32_t waits;
+	/* Private */
+	void *priv;
+};
+
+/** Maps ch and starts serving it, 0 or -errno */
+int bt_shm_peer_start(struct bt_shm_peer *peer, const struct bt_shm_channel *ch,
+		      enum bt_shm_peer_mode mode);
+
+/** Sends an H4 frame to the host, waiting for room.
+ *
+ *  @return 0, -EMSGSIZE if the frame can never fit or -ECANCELED once the
+ *          peer is stopping.
+ */
+int bt_shm_peer_send(struct bt_shm_peer *peer, const void *frame, uint32_t len);
+
+/** Stops the thread and unmaps the channel */
+void bt_shm_peer_stop(struct bt_shm_peer *peer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INCLUDE_BLUETOOTH_DRIVERS_SHM_H_ */
@@ -259,6 +259,15 @@ static inline unsigned long os_atomic_word_fetch_xor(unsigned long *obj, unsigne
 #endif
 }
 
+static inline void os_atomic_thread_fence(enum os_atomic_order order)
+{
+#if OS_ATOMIC_HAVE_GNU_BUILTINS
+	__atomic_thread_fence(os_atomic__gnu_order(order));
+#else
+	(void)order;
+#endif
+}
+
 static inline void *os_atomic_ptr_get(void *volatile *ptr)
 {
 #if OS_ATOMIC_HAVE_GNU_BUILTINS
@@ -12,13 +12,27 @@
 #include "semphr.h"
 #include "event_groups.h"
 
-/* Internal helper: ms to ticks */
-static TickType_t ms_to_ticks(int32_t timeout_ms)
+/* Internal helper: nanosecond timeout to ticks, rounded up so that a
+ * non-zero timeout never waits less than requested.
+ */
+static TickType_t timeout_to_ticks(os_timeout_t timeout)
 {
-	if (timeout_ms < 0) {
+	uint64_t ticks;
+
+	if (timeout < 0) {
 		return portMAX_DELAY;
 	}
-	return (timeout_ms == 0) ? 0 : pdMS_TO_TICKS((uint32_t)timeout_ms);
+
+	if (timeout == 0) {
+		return 0;
+	}
+
+	ticks = ((uint64_t)timeout * configTICK_RATE_HZ + 999999999ULL) / 1000000000ULL;
+	if (ticks >= portMAX_DELAY) {
+		return portMAX_DELAY - 1;
+	}
+
+	return (TickType_t)ticks;
 }
 
 /* Semaphore */
@@ -37,17 +51,17 @@ int os_sem_init(os_sem_t *sem, unsigned int initial_count, unsigned int limit)
 	return 0;
 }
 
-int os_sem_take(os_sem_t *sem, int32_t timeout_ms)
+int os_sem_take(os_sem_t *sem, os_timeout_t timeout)
 {
 	if (!sem || !sem->handle) {
 		return -EINVAL;
 	}
-	TickType_t ticks = ms_to_ticks(timeout_ms);
+	TickType_t ticks = timeout_to_ticks(timeout);
 	BaseType_t ok = xSemaphoreTake(sem->handle, ticks);
 	if (ok == pdTRUE) {
 		return 0;
 	}
-	return (timeout_ms == OS_TIMEOUT_NO_WAIT) ? -ETIMEDOUT : -ETIMEDOUT;
+	return (timeout == OS_TIMEOUT_NO_WAIT) ? -ETIMEDOUT : -ETIMEDOUT;
 }
 
 int os_sem_give(os_sem_t *sem)
@@ -101,17 +115,17 @@ int os_mutex_init(os_mutex_t *mutex)
 	return 0;
 }
 
-int os_mutex_lock(os_mutex_t *mutex, int32_t timeout_ms)
+int os_mutex_lock(os_mutex_t *mutex, os_timeout_t timeout)
 {
 	if (!mutex || *mutex == NULL) {
 		return -EINVAL;
 	}
-	TickType_t ticks = ms_to_ticks(timeout_ms);
+	TickType_t ticks = timeout_to_ticks(timeout);
 	BaseType_t ok = xSemaphoreTake(*mutex, ticks);
 	if (ok == pdTRUE) {
 		return 0;
 	}
-	return (timeout_ms == OS_TIMEOUT_NO_WAIT) ? -ETIMEDOUT : -ETIMEDOUT;
+	return (timeout == OS_TIMEOUT_NO_WAIT) ? -ETIMEDOUT : -ETIMEDOUT;
 }
 
 int os_mutex_unlock(os_mutex_t *mutex)
@@ -138,7 +152,7 @@ int os_cond_init(os_cond_t *cond)
 	return 0;
 }
 
-int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex, int32_t timeout_ms)
+int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex, os_timeout_t timeout)
 {
 	if (!cond || cond->group == NULL) {
 		return -EINVAL;
@@ -146,7 +160,7 @@ int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex, int32_t timeout_ms)
 	(void)mutex; /* No native association; caller must hold/unhold externally if needed */
 	/* Clear the bit before waiting to ensure fresh wait */
 	xEventGroupClearBits(cond->group, cond->bit);
-	TickType_t ticks = ms_to_ticks(timeout_ms);
+	TickType_t ticks = timeout_to_ticks(timeout);
 	EventBits_t bits = xEventGroupWaitBits(cond->group, cond->bit, pdTRUE /*clear on exit*/,
 					       pdFALSE /*any*/, ticks);
 	if ((bits & cond->bit) != 0) {
@@ -276,12 +290,12 @@ int os_thread_cancel(os_thread_t *thr)
 	return 0;
 }
 
-int os_thread_join(os_thread_t *thr, int32_t timeout_ms)
+int os_thread_join(os_thread_t *thr, os_timeout_t timeout)
 {
 	if (!thr || thr->join_group == NULL) {
 		return -EINVAL;
 	}
-	TickType_t ticks = ms_to_ticks(timeout_ms);
+	TickType_t ticks = timeout_to_ticks(timeout);
 	EventBits_t bits = xEventGroupWaitBits(thr->join_group, thr->join_bit, pdTRUE /*clear*/,
 					       pdFALSE, ticks);
 	if ((bits & thr->join_bit) != 0) {
@@ -315,6 +329,78 @@ int os_thread_name_set(os_thread_t *thr, const char *name)
 	return 0;
 }
 
+int os_thread_affinity_set(os_thread_t *thr, uint32_t cpu_mask)
+{
+	if (!thr || !thr->task || cpu_mask == 0) {
+		return -EINVAL;
+	}
+
+#if (configUSE_CORE_AFFINITY == 1) && (configNUMBER_OF_CORES > 1)
+	vTaskCoreAffinitySet(thr->task, (UBaseType_t)cpu_mask);
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int os_thread_stats_get(os_thread_t *thr, struct os_thread_stats *stats)
+{
+	if (!thr || !stats) {
+		return -EINVAL;
+	}
+	if (thr->task == NULL) {
+		return -ESRCH;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	strncpy(stats->name, pcTaskGetName(thr->task), sizeof(stats->name) - 1);
+	stats->priority = (int)uxTaskPriorityGet(thr->task);
+	stats->sched_priority = stats->priority;
+#if (configUSE_CORE_AFFINITY == 1) && (configNUMBER_OF_CORES > 1)
+	stats->cpu_mask = (uint32_t)vTaskCoreAffinityGet(thr->task);
+#endif
+
+	return 0;
+}
+
+int os_thread_foreach(void (*cb)(const struct os_thread_stats *stats, void *user_data),
+		      void *user_data)
+{
+	(void)cb;
+	(void)user_data;
+	return -ENOTSUP;
+}
+
+/* Thread-local storage */
+int os_tls_create(os_tls_t *tls, void (*destructor)(void *))
+{
+	static BaseType_t next_index;
+
+	(void)destructor; /* No task exit hook available */
+	if (!tls) {
+		return -EINVAL;
+	}
+	taskENTER_CRITICAL();
+	if (next_index >= configNUM_THREAD_LOCAL_STORAGE_POINTERS) {
+		taskEXIT_CRITICAL();
+		return -ENOMEM;
+	}
+	tls->index = next_index++;
+	taskEXIT_CRITICAL();
+	return 0;
+}
+
+void *os_tls_get(os_tls_t *tls)
+{
+	return pvTaskGetThreadLocalStoragePointer(NULL, tls->index);
+}
+
+int os_tls_set(os_tls_t *tls, void *value)
+{
+	vTaskSetThreadLocalStoragePointer(NULL, tls->index, value);
+	return 0;
+}
+
 void os_enter_critical(void)
 {
 	taskENTER_CRITICAL();
@@ -337,7 +423,7 @@ void os_sched_unlock(void)
 
 void os_sleep_ms(uint32_t ms)
 {
-	vTaskDelay(ms_to_ticks(ms));
+	vTaskDelay(timeout_to_ticks(OS_MSEC(ms)));
 }
 
 uint64_t os_time_get_ms(void)
@@ -347,16 +433,29 @@ uint64_t os_time_get_ms(void)
 	return (uint64_t)ticks * portTICK_PERIOD_MS;
 }
 
-int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg)
+uint64_t os_time_get_ns(void)
 {
-	if (!timer || !cb) {
-		return -EINVAL;
+	TickType_t ticks = xTaskGetTickCount();
+
+	return (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+}
+
+static void timer_expired(TimerHandle_t handle)
+{
+	os_timer_t *timer = (os_timer_t *)pvTimerGetTimerID(handle);
+
+	if (timer->cb) {
+		timer->cb(timer, timer->arg);
 	}
+}
 
-	timer->cb = cb;
-	timer->arg = arg;
+static int timer_handle_ensure(os_timer_t *timer)
+{
+	if (timer->handle) {
+		return 0;
+	}
 
-	timer->handle = xTimerCreate(NULL, pdMS_TO_TICKS(1), pdFALSE, timer, );
+	timer->handle = xTimerCreate(NULL, pdMS_TO_TICKS(1), pdFALSE, timer, timer_expired);
 	if (timer->handle == NULL) {
 		return -ENOMEM;
 	}
@@ -364,13 +463,40 @@ int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg)
 	return 0;
 }
 
-int os_timer_start(os_timer_t *timer, uint32_t timeout_ms)
+int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg)
 {
+	if (!timer || !cb) {
+		return -EINVAL;
+	}
+
+	timer->cb = cb;
+	timer->arg = arg;
+	timer->handle = NULL;
+
+	return timer_handle_ensure(timer);
+}
+
+int os_timer_start(os_timer_t *timer, os_timeout_t timeout)
+{
+	TickType_t ticks;
+	int err;
+
 	if (!timer) {
 		return -EINVAL;
 	}
 
-	xTimerChangePeriod(timer->handle, pdMS_TO_TICKS(timeout_ms));
+	if (timeout < 0) {
+		return 0;
+	}
+
+	err = timer_handle_ensure(timer);
+	if (err) {
+		return err;
+	}
+
+	/* FreeRTOS timers cannot have a zero period */
+	ticks = timeout_to_ticks(timeout);
+	xTimerChangePeriod(timer->handle, ticks ? ticks : 1, portMAX_DELAY);
 
 	return xTimerStart(timer->handle, portMAX_DELAY);
 }
@@ -381,6 +507,10 @@ int os_timer_stop(os_timer_t *timer)
 		return -EINVAL;
 	}
 
+	if (!timer->handle) {
+		return 0;
+	}
+
 	return xTimerStop(timer->handle, portMAX_DELAY);
 }
 
@@ -390,6 +520,10 @@ int os_timer_delete(os_timer_t *timer)
 		return -EINVAL;
 	}
 
+	if (!timer->handle) {
+		return 0;
+	}
+
 	return xTimerDelete(timer->handle, portMAX_DELAY);
 }
 
@@ -400,6 +534,10 @@ uint64_t os_timer_remaining_ms(const os_timer_t *timer)
 		return -EINVAL;
 	}
 
+	if (!timer->handle || xTimerIsTimerActive(timer->handle) == pdFALSE) {
+		return 0;
+	}
+
 	remaining_ticks = xTimerGetExpiryTime(timer->handle) - xTaskGetTickCount();
 
 	return (uint64_t)(remaining_ticks * portTICK_PERIOD_MS);
@@ -22,20 +22,32 @@
 extern "C" {
 #endif
 
-/* Timeout helpers (milliseconds) */
-/* Timeout helpers (milliseconds) */
-typedef int32_t os_timeout_t;
+/*
+ * Timeouts are signed 64-bit nanosecond counts, matching the POSIX port.
+ * They are rounded up to whole ticks. Negative values wait forever.
+ */
+typedef int64_t os_timeout_t;
 
 #define OS_TIMEOUT_NO_WAIT ((os_timeout_t)0)
 #define OS_TIMEOUT_FOREVER ((os_timeout_t) - 1)
 
-#define OS_USEC(us)     ((os_timeout_t)(((us) + 999) / 1000))
-#define OS_MSEC(ms)     ((os_timeout_t)(ms))
-#define OS_SECONDS(sec) ((os_timeout_t)((sec) * 1000))
-#define OS_HOURS(h)     ((os_timeout_t)((h) * 60 * 60 * 1000))
+#define OS_NSEC(ns)     ((os_timeout_t)(ns))
+#define OS_USEC(us)     ((os_timeout_t)(us) * 1000)
+#define OS_MSEC(ms)     ((os_timeout_t)(ms) * 1000 * 1000)
+#define OS_SECONDS(sec) ((os_timeout_t)(sec) * 1000 * 1000 * 1000)
+#define OS_HOURS(h)     (OS_SECONDS(h) * 60 * 60)
+
+/* Finite timeout in whole milliseconds, rounded up */
+#define OS_TIMEOUT_MS(t) (((t) + 999999) / 1000000)
 
 #define OS_SEM_MAX_LIMIT (UINT32_MAX)
 
+/* Scatter-gather element, layout compatible with POSIX <sys/uio.h> */
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
 /* Semaphore: wrapper structure to track limit and FreeRTOS handle */
 typedef struct os_sem {
 	SemaphoreHandle_t handle; /* Counting semaphore handle */
@@ -70,6 +82,10 @@ typedef struct os_cond {
 	}
 
 #define OS_PRIORITY(prio) (prio > configMAX_PRIORITIES ? (configMAX_PRIORITIES - 1) : (prio))
+/* All FreeRTOS tasks are preemptive, cooperative priorities map onto the same range */
+#define OS_PRIORITY_COOP(prio) OS_PRIORITY(prio)
+
+#define OS_THREAD_NAME_MAX configMAX_TASK_NAME_LEN
 /* Thread abstraction */
 typedef struct os_thread {
 	TaskHandle_t task;
@@ -78,9 +94,26 @@ typedef struct os_thread {
 	StaticTask_t task_buffer;      /* Buffer for static task allocation */
 } os_thread_t;
 
+/* Scheduling parameters and CPU usage of a running thread */
+struct os_thread_stats {
+	char name[OS_THREAD_NAME_MAX];
+	int priority;       /* Current FreeRTOS priority */
+	int policy;         /* Always 0 */
+	int sched_priority; /* Same as priority */
+	uint32_t cpu_mask;  /* 0 unless built with core affinity */
+	size_t stack_size;  /* 0: unknown */
+	uint64_t cpu_time_ns; /* 0: run-time stats are in port-specific units */
+	uint64_t uptime_ns;   /* 0: unknown */
+};
+
 /* Thread ID type */
 typedef TaskHandle_t os_tid_t;
 
+/* Thread-local storage slot (index into the task's TLS pointer array) */
+typedef struct os_tls {
+	BaseType_t index;
+} os_tls_t;
+
 typedef struct os_timer os_timer_t;
 typedef void (*os_timer_cb_t)(os_timer_t *timer, void *arg);
 /* Timer structure */
@@ -90,9 +123,15 @@ typedef struct os_timer {
 	void *arg;
 } os_timer_t;
 
+/* The handle is created on first start for statically initialised timers */
+#define OS_TIMER_INITIALIZER(_cb, _arg)                                                            \
+	{                                                                                          \
+		.handle = NULL, .cb = (_cb), .arg = (_arg),                                        \
+	}
+
 /* Timer functions */
 int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg);
-int os_timer_start(os_timer_t *timer, uint32_t timeout_ms);
+int os_timer_start(os_timer_t *timer, os_timeout_t timeout);
 int os_timer_stop(os_timer_t *timer);
 int os_timer_delete(os_timer_t *timer);
 uint64_t os_timer_remaining_ms(const os_timer_t *timer);
@@ -100,20 +139,20 @@ uint64_t os_timer_remaining_ms(const os_timer_t *timer);
 /* Semaphore functions */
 int os_sem_init(os_sem_t *sem, unsigned int initial_count, unsigned int limit);
 int os_sem_take(os_sem_t *sem,
-		int32_t timeout_ms);          /* 0 success, -ETIMEDOUT timeout, other -errno */
+		os_timeout_t timeout);          /* 0 success, -ETIMEDOUT timeout, other -errno */
 int os_sem_give(os_sem_t *sem);               /* 0 success, -errno on failure */
 unsigned int os_sem_count_get(os_sem_t *sem); /* via uxSemaphoreGetCount */
 int os_sem_reset(os_sem_t *sem);              /* drain to zero */
 
 /* Mutex functions */
 int os_mutex_init(os_mutex_t *mutex);
-int os_mutex_lock(os_mutex_t *mutex, int32_t timeout_ms); /* 0 success, -ETIMEDOUT, other -errno */
+int os_mutex_lock(os_mutex_t *mutex, os_timeout_t timeout); /* 0 success, -ETIMEDOUT, other -errno */
 int os_mutex_unlock(os_mutex_t *mutex);                   /* 0 success, -errno */
 
 /* Condition variable functions */
 int os_cond_init(os_cond_t *cond);
 int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex,
-		 int32_t timeout_ms); /* 0 success, -ETIMEDOUT or -errno */
+		 os_timeout_t timeout); /* 0 success, -ETIMEDOUT or -errno */
 int os_cond_signal(os_cond_t *cond);
 int os_cond_broadcast(os_cond_t *cond);
 
@@ -122,11 +161,20 @@ int os_thread_create(os_thread_t *thr, void (*start_routine)(void *), void *arg,
 		     int priority, size_t stack_size);
 int os_thread_start(os_thread_t *thr);  /* No-op: FreeRTOS tasks run when created */
 int os_thread_cancel(os_thread_t *thr); /* 0 success, -EINVAL or -EPERM */
-int os_thread_join(os_thread_t *thr, int32_t timeout_ms); /* 0 success, -ETIMEDOUT or -errno */
+int os_thread_join(os_thread_t *thr, os_timeout_t timeout); /* 0 success, -ETIMEDOUT or -errno */
 os_tid_t os_thread_self(void);
 bool os_thread_is_current(os_thread_t *thr);
 int os_thread_yield(void);
 int os_thread_name_set(os_thread_t *thr, const char *name); /* Best-effort no-op */
+int os_thread_affinity_set(os_thread_t *thr, uint32_t cpu_mask); /* SMP builds only */
+int os_thread_stats_get(os_thread_t *thr, struct os_thread_stats *stats);
+int os_thread_foreach(void (*cb)(const struct os_thread_stats *stats, void *user_data),
+		      void *user_data); /* -ENOTSUP: no task registry */
+
+/* Thread-local storage functions (destructors are not supported on FreeRTOS) */
+int os_tls_create(os_tls_t *tls, void (*destructor)(void *));
+void *os_tls_get(os_tls_t *tls);
+int os_tls_set(os_tls_t *tls, void *value);
 
 /* Critical section functions */
 void os_enter_critical(void);
@@ -139,6 +187,7 @@ void os_sched_unlock(void);
 /* Time functions */
 void os_sleep_ms(uint32_t ms);
 uint64_t os_time_get_ms(void);
+uint64_t os_time_get_ns(void);
 
 /* Memory allocation functions */
 void *os_malloc(size_t size);
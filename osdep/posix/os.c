@@ -9,27 +9,38 @@
 #include <sched.h>
 #include <errno.h>
 #include <time.h>
-#include <signal.h>
+#include <sys/resource.h>
 #include <osdep/os.h>
 
-/* Internal helper: convert ms to absolute timespec for timed waits (CLOCK_REALTIME) */
-static int ms_to_abs_timespec(int32_t timeout_ms, struct timespec *ts_out)
+/*
+ * Timed waits take their deadline on CLOCK_MONOTONIC so that wall-clock
+ * steps (NTP, settimeofday) neither stretch nor cut timeouts. The
+ * clock-selecting wait variants appeared in glibc 2.30; older C libraries
+ * fall back to CLOCK_REALTIME deadlines.
+ */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+#define OS_HAVE_CLOCKWAIT 1
+#define OS_WAIT_CLOCK     CLOCK_MONOTONIC
+#else
+#define OS_WAIT_CLOCK CLOCK_REALTIME
+#endif
+
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC 1000000000U
+#endif
+
+/* Internal helper: convert a finite timeout to an absolute OS_WAIT_CLOCK deadline */
+static void timeout_to_abs_timespec(os_timeout_t timeout, struct timespec *ts_out)
 {
-	if (timeout_ms < 0) {
-		return -1; /* forever */
-	}
 	struct timespec now;
-	if (clock_gettime(CLOCK_REALTIME, &now) != 0) {
-		return -errno;
-	}
-	int64_t nsec_add = (int64_t)timeout_ms * 1000000LL;
-	ts_out->tv_sec = now.tv_sec + (time_t)(nsec_add / 1000000000LL);
-	ts_out->tv_nsec = now.tv_nsec + (long)(nsec_add % 1000000000LL);
-	if (ts_out->tv_nsec >= 1000000000L) {
+
+	clock_gettime(OS_WAIT_CLOCK, &now);
+	ts_out->tv_sec = now.tv_sec + (time_t)(timeout / NSEC_PER_SEC);
+	ts_out->tv_nsec = now.tv_nsec + (long)(timeout % NSEC_PER_SEC);
+	if (ts_out->tv_nsec >= NSEC_PER_SEC) {
 		ts_out->tv_sec += 1;
-		ts_out->tv_nsec -= 1000000000L;
+		ts_out->tv_nsec -= NSEC_PER_SEC;
 	}
-	return 0;
 }
 
 /* Semaphore */
@@ -45,18 +56,21 @@ int os_sem_init(os_sem_t *sem, unsigned int initial_count, unsigned int limit)
 	return 0;
 }
 
-int os_sem_take(os_sem_t *sem, int32_t timeout_ms)
+int os_sem_take(os_sem_t *sem, os_timeout_t timeout)
 {
+	struct timespec abstime;
+
 	if (!sem) {
 		return -EINVAL;
 	}
-	if (timeout_ms == OS_TIMEOUT_NO_WAIT) {
+	if (timeout == OS_TIMEOUT_NO_WAIT) {
 		if (sem_trywait(&sem->sem) == 0) {
 			return 0;
 		}
 		return (errno == EAGAIN) ? -ETIMEDOUT : -errno;
 	}
-	if (timeout_ms == OS_TIMEOUT_FOREVER) {
+	if (timeout < 0) {
+		/* OS_TIMEOUT_FOREVER */
 		while (1) {
 			if (sem_wait(&sem->sem) == 0) {
 				return 0;
@@ -67,29 +81,22 @@ int os_sem_take(os_sem_t *sem, int32_t timeout_ms)
 			return -errno;
 		}
 	}
-	struct timespec abstime;
-	int rc = ms_to_abs_timespec(timeout_ms, &abstime);
-	if (rc < 0) {
-		/* treat as forever if conversion failed due to negative */
-		while (1) {
-			if (sem_wait(&sem->sem) == 0) {
-				return 0;
-			}
-			if (errno == EINTR) {
-				continue;
-			}
-			return -errno;
+
+	timeout_to_abs_timespec(timeout, &abstime);
+	while (1) {
+#if defined(OS_HAVE_CLOCKWAIT)
+		int rc = sem_clockwait(&sem->sem, OS_WAIT_CLOCK, &abstime);
+#else
+		int rc = sem_timedwait(&sem->sem, &abstime);
+#endif
+		if (rc == 0) {
+			return 0;
 		}
-	} else if (rc != 0) {
-		return rc;
-	}
-	if (sem_timedwait(&sem->sem, &abstime) == 0) {
-		return 0;
-	}
-	if (errno == ETIMEDOUT) {
-		return -ETIMEDOUT;
+		if (errno == EINTR) {
+			continue;
+		}
+		return (errno == ETIMEDOUT) ? -ETIMEDOUT : -errno;
 	}
-	return -errno;
 }
 
 int os_sem_give(os_sem_t *sem)
@@ -155,19 +162,20 @@ int os_mutex_init(os_mutex_t *mutex)
 	return rc == 0 ? 0 : -errno;
 }
 
-int os_mutex_lock(os_mutex_t *mutex, int32_t timeout_ms)
+int os_mutex_lock(os_mutex_t *mutex, os_timeout_t timeout)
 {
 	if (!mutex) {
 		return -EINVAL;
 	}
-	if (timeout_ms == OS_TIMEOUT_NO_WAIT) {
+	if (timeout == OS_TIMEOUT_NO_WAIT) {
 		int rc = pthread_mutex_trylock(mutex);
 		if (rc == 0) {
 			return 0;
 		}
 		return (rc == EBUSY) ? -ETIMEDOUT : -rc;
 	}
-	if (timeout_ms == OS_TIMEOUT_FOREVER) {
+	if (timeout < 0) {
+		/* OS_TIMEOUT_FOREVER */
 		int rc;
 		while ((rc = pthread_mutex_lock(mutex)) == EINTR) {
 		}
@@ -175,18 +183,18 @@ int os_mutex_lock(os_mutex_t *mutex, int32_t timeout_ms)
 	}
 #if defined(_POSIX_TIMEOUTS) && (_POSIX_TIMEOUTS >= 200112L)
 	struct timespec abstime;
-	int conv = ms_to_abs_timespec(timeout_ms, &abstime);
-	if (conv != 0) {
-		return conv;
-	}
+	timeout_to_abs_timespec(timeout, &abstime);
+#if defined(OS_HAVE_CLOCKWAIT)
+	int rc = pthread_mutex_clocklock(mutex, OS_WAIT_CLOCK, &abstime);
+#else
 	int rc = pthread_mutex_timedlock(mutex, &abstime);
+#endif
 	if (rc == 0) {
 		return 0;
 	}
 	return (rc == ETIMEDOUT) ? -ETIMEDOUT : -rc;
 #else
 	/* Fallback: blocking lock for lack of timedlock */
-	(void)timeout_ms;
 	int rc;
 	while ((rc = pthread_mutex_lock(mutex)) == EINTR) {
 	}
@@ -213,33 +221,40 @@ int os_cond_init(os_cond_t *cond)
 	if (pthread_condattr_init(&attr) != 0) {
 		return -errno;
 	}
-	/* Default clock REALTIME */
+	/* Only matters for the pthread_cond_timedwait() fallback */
+	(void)pthread_condattr_setclock(&attr, OS_WAIT_CLOCK);
 	int rc = pthread_cond_init(cond, &attr);
 	pthread_condattr_destroy(&attr);
 	return rc == 0 ? 0 : -errno;
 }
 
-int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex, int32_t timeout_ms)
+int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex, os_timeout_t timeout)
 {
 	if (!cond || !mutex) {
 		return -EINVAL;
 	}
-	if (timeout_ms == OS_TIMEOUT_NO_WAIT) {
+	if (timeout == OS_TIMEOUT_NO_WAIT) {
 		/* Non-blocking wait is meaningless; return timeout */
 		return -ETIMEDOUT;
 	}
-	if (timeout_ms == OS_TIMEOUT_FOREVER) {
+	if (timeout < 0) {
+		/* OS_TIMEOUT_FOREVER */
 		int rc;
 		while ((rc = pthread_cond_wait(cond, mutex)) == EINTR) {
 		}
 		return rc == 0 ? 0 : -rc;
 	}
 	struct timespec abstime;
-	int conv = ms_to_abs_timespec(timeout_ms, &abstime);
-	if (conv != 0) {
-		return conv;
-	}
+	timeout_to_abs_timespec(timeout, &abstime);
+	/*
+	 * The clock is passed explicitly: conditions set up with
+	 * OS_COND_INITIALIZER carry the default CLOCK_REALTIME attribute.
+	 */
+#if defined(OS_HAVE_CLOCKWAIT)
+	int rc = pthread_cond_clockwait(cond, mutex, OS_WAIT_CLOCK, &abstime);
+#else
 	int rc = pthread_cond_timedwait(cond, mutex, &abstime);
+#endif
 	if (rc == 0) {
 		return 0;
 	}
@@ -265,20 +280,133 @@ int os_cond_broadcast(os_cond_t *cond)
 }
 
 /* Thread */
-struct os_thread_start_pair {
-	void (*fn)(void *);
-	void *arg;
-};
-static void *start_trampoline(void *arg_pair)
+
+/* Running threads, for os_thread_foreach() */
+static pthread_mutex_t thread_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static os_thread_t *thread_list;
+
+static void thread_name_apply(const char *name)
+{
+	if (!name[0]) {
+		return;
+	}
+#if defined(__APPLE__) || defined(__MACH__)
+	(void)pthread_setname_np(name);
+#elif defined(__linux__)
+	(void)pthread_setname_np(pthread_self(), name);
+#endif
+}
+
+static void thread_list_add(os_thread_t *thr)
+{
+	pthread_mutex_lock(&thread_list_lock);
+	/*
+	 * Naming from inside the thread cannot race with a short-lived thread
+	 * exiting; the lock orders it against os_thread_name_set().
+	 */
+	thread_name_apply(thr->name);
+	thr->next = thread_list;
+	thread_list = thr;
+	thr->running = true;
+	pthread_mutex_unlock(&thread_list_lock);
+}
+
+static void thread_list_remove(void *arg)
+{
+	os_thread_t *thr = (os_thread_t *)arg;
+	os_thread_t **pp;
+
+	pthread_mutex_lock(&thread_list_lock);
+	for (pp = &thread_list; *pp; pp = &(*pp)->next) {
+		if (*pp == thr) {
+			*pp = thr->next;
+			break;
+		}
+	}
+	thr->running = false;
+	pthread_mutex_unlock(&thread_list_lock);
+}
+
+static int clamp_int(int val, int lo, int hi)
+{
+	return val < lo ? lo : (val > hi ? hi : val);
+}
+
+static int thread_nice_set(int nice_val)
 {
-	struct os_thread_start_pair *pp = (struct os_thread_start_pair *)arg_pair;
-	void (*fn)(void *) = pp->fn;
-	void *arg = pp->arg;
-	/* Free the trampoline argument storage before invoking user fn to avoid leak */
-	free(pp);
-	if (fn) {
-		fn(arg);
+#if defined(__linux__)
+	/* Linux keeps the nice value per thread */
+	if (setpriority(PRIO_PROCESS, (id_t)gettid(), clamp_int(nice_val, -20, 19)) != 0) {
+		return -errno;
 	}
+	return 0;
+#else
+	(void)nice_val;
+	return -ENOTSUP;
+#endif
+}
+
+/* Apply the priority from the calling (new) thread, see OS_PRIORITY() */
+static void thread_sched_apply(os_thread_t *thr)
+{
+	struct sched_param param = {0};
+	int prio;
+
+	if (thr->priority < 0) {
+		/* Cooperative: real-time, or the most favourable nice value we may use */
+		int policy = OS_THREAD_RT_POLICY;
+
+		prio = -1 - thr->priority;
+		param.sched_priority = clamp_int(OS_THREAD_RT_PRIO_BASE - prio,
+						 sched_get_priority_min(policy),
+						 sched_get_priority_max(policy));
+		if (pthread_setschedparam(pthread_self(), policy, &param) == 0) {
+			thr->policy = policy;
+			thr->sched_priority = param.sched_priority;
+			return;
+		}
+
+		thr->policy = SCHED_OTHER;
+		thr->sched_priority = 0;
+		if (thread_nice_set(prio - 20) == 0) {
+			thr->sched_priority = clamp_int(prio - 20, -20, 19);
+		}
+		return;
+	}
+
+	if (thr->priority > 0) {
+		/* Preemptible: drop a policy inherited from a real-time creator */
+		prio = thr->priority - OS_PRIORITY(0);
+		(void)pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+		thr->policy = SCHED_OTHER;
+		thr->sched_priority = 0;
+		if (thread_nice_set(prio) == 0) {
+			thr->sched_priority = clamp_int(prio, -20, 19);
+		}
+		return;
+	}
+
+	/* No preference: report what was inherited */
+	(void)pthread_getschedparam(pthread_self(), &thr->policy, &param);
+	thr->sched_priority = param.sched_priority;
+#if defined(__linux__)
+	if (thr->policy == SCHED_OTHER) {
+		thr->sched_priority = getpriority(PRIO_PROCESS, (id_t)gettid());
+	}
+#endif
+}
+
+static void *start_trampoline(void *arg)
+{
+	os_thread_t *thr = (os_thread_t *)arg;
+
+	thr->start_ns = os_time_get_ns();
+	thread_sched_apply(thr);
+
+	thread_list_add(thr);
+	pthread_cleanup_push(thread_list_remove, thr);
+	thr->entry(thr->arg);
+	pthread_cleanup_pop(1);
 
 	return NULL;
 }
@@ -286,42 +414,56 @@ static void *start_trampoline(void *arg_pair)
 int os_thread_create(os_thread_t *thr, void (*start_routine)(void *), void *arg, const char *name,
 		     int priority, size_t stack_size)
 {
-	(void)priority;   /* POSIX priority not managed here */
-	(void)stack_size; /* Stack size can be set via attributes if needed */
-	/* Delay is not supported natively; best-effort: start immediately */
+	pthread_attr_t attr;
+	int rc;
+
 	if (!thr || !start_routine) {
 		return -EINVAL;
 	}
 
-	pthread_attr_t attr;
-	if (pthread_attr_init(&attr) != 0) {
-		return -errno;
+	rc = pthread_attr_init(&attr);
+	if (rc != 0) {
+		return -rc;
 	}
 
 	if (stack_size > 0) {
-		(void)pthread_attr_setstacksize(&attr, stack_size);
-	}
+		long page = sysconf(_SC_PAGESIZE);
+		size_t min = OS_THREAD_STACK_MIN;
 
-	struct os_thread_start_pair *pair = (struct os_thread_start_pair *)malloc(sizeof(*pair));
-	if (!pair) {
-		pthread_attr_destroy(&attr);
-		return -ENOMEM;
-	}
-	pair->fn = start_routine;
-	pair->arg = arg;
-	int rc = pthread_create(&thr->thread, &attr, start_trampoline, (void *)pair);
-	if (rc != 0) {
-		pthread_attr_destroy(&attr);
-		return -rc;
+		if (min < (size_t)PTHREAD_STACK_MIN) {
+			min = PTHREAD_STACK_MIN;
+		}
+		stack_size = stack_size < min ? min : stack_size;
+		if (page > 0) {
+			stack_size = (stack_size + (size_t)page - 1) & ~((size_t)page - 1);
+		}
+
+		rc = pthread_attr_setstacksize(&attr, stack_size);
+		if (rc != 0) {
+			pthread_attr_destroy(&attr);
+			return -rc;
+		}
 	}
 
-	if (name && pthread_setname_np(thr->thread, name) != 0) {
-		pthread_cancel(thr->thread);
-		pthread_attr_destroy(&attr);
-		return -errno;
+	(void)pthread_attr_getstacksize(&attr, &thr->stack_size);
+
+	thr->entry = start_routine;
+	thr->arg = arg;
+	thr->next = NULL;
+	thr->running = false;
+	thr->priority = priority;
+	thr->policy = SCHED_OTHER;
+	thr->sched_priority = 0;
+	thr->start_ns = 0;
+	thr->name[0] = '\0';
+	if (name) {
+		strncpy(thr->name, name, sizeof(thr->name) - 1);
+		thr->name[sizeof(thr->name) - 1] = '\0';
 	}
 
+	rc = pthread_create(&thr->thread, &attr, start_trampoline, thr);
 	pthread_attr_destroy(&attr);
+
 	return rc == 0 ? 0 : -rc;
 }
 
@@ -341,19 +483,28 @@ int os_thread_cancel(os_thread_t *thr)
 	return rc == 0 ? 0 : -rc;
 }
 
-int os_thread_join(os_thread_t *thr, int32_t timeout_ms)
+int os_thread_join(os_thread_t *thr, os_timeout_t timeout)
 {
 	if (!thr) {
 		return -EINVAL;
 	}
-	if (timeout_ms == OS_TIMEOUT_NO_WAIT) {
+	if (timeout == OS_TIMEOUT_NO_WAIT) {
 		return -ETIMEDOUT; /* non-blocking join not supported */
 	}
-	/* POSIX pthread_join does not support timeout. For interface completeness,
-	 * implement blocking join irrespective of timeout.
-	 */
+
 	void *ret = NULL;
-	int rc = pthread_join(thr->thread, &ret);
+	int rc;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 31))
+	if (timeout > 0) {
+		struct timespec abstime;
+
+		timeout_to_abs_timespec(timeout, &abstime);
+		rc = pthread_clockjoin_np(thr->thread, &ret, OS_WAIT_CLOCK, &abstime);
+		return rc == 0 ? 0 : -rc;
+	}
+#endif
+	/* Without a timed join, block irrespective of the timeout */
+	rc = pthread_join(thr->thread, &ret);
 	return rc == 0 ? 0 : -rc;
 }
 
@@ -382,7 +533,18 @@ int os_thread_name_set(os_thread_t *thr, const char *name)
 	if (!thr || !name) {
 		return -EINVAL;
 	}
-	int rc = pthread_setname_np(thr->thread, name);
+
+	/* Holding the registry lock keeps a running thread from exiting underneath us */
+	int rc = 0;
+
+	pthread_mutex_lock(&thread_list_lock);
+	strncpy(thr->name, name, sizeof(thr->name) - 1);
+	thr->name[sizeof(thr->name) - 1] = '\0';
+	if (thr->running) {
+		rc = pthread_setname_np(thr->thread, thr->name);
+	}
+	pthread_mutex_unlock(&thread_list_lock);
+
 	return rc == 0 ? 0 : -rc;
 #else
 	(void)thr;
@@ -391,6 +553,123 @@ int os_thread_name_set(os_thread_t *thr, const char *name)
 #endif
 }
 
+int os_thread_affinity_set(os_thread_t *thr, uint32_t cpu_mask)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+
+	if (!thr || cpu_mask == 0) {
+		return -EINVAL;
+	}
+
+	CPU_ZERO(&set);
+	for (int cpu = 0; cpu < 32; cpu++) {
+		if (cpu_mask & (1UL << cpu)) {
+			CPU_SET(cpu, &set);
+		}
+	}
+
+	int rc = pthread_setaffinity_np(thr->thread, sizeof(set), &set);
+	return rc == 0 ? 0 : -rc;
+#else
+	(void)thr;
+	(void)cpu_mask;
+	return -ENOTSUP;
+#endif
+}
+
+static void thread_stats_locked(os_thread_t *thr, struct os_thread_stats *stats)
+{
+	struct timespec ts;
+	clockid_t cid;
+
+	memcpy(stats->name, thr->name, sizeof(stats->name));
+	stats->priority = thr->priority;
+	stats->policy = thr->policy;
+	stats->sched_priority = thr->sched_priority;
+	stats->stack_size = thr->stack_size;
+	stats->uptime_ns = os_time_get_ns() - thr->start_ns;
+	stats->cpu_time_ns = 0;
+	stats->cpu_mask = 0;
+
+	if (pthread_getcpuclockid(thr->thread, &cid) == 0 && clock_gettime(cid, &ts) == 0) {
+		stats->cpu_time_ns = (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+	}
+
+#if defined(__linux__)
+	cpu_set_t set;
+
+	if (pthread_getaffinity_np(thr->thread, sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < 32; cpu++) {
+			if (CPU_ISSET(cpu, &set)) {
+				stats->cpu_mask |= 1UL << cpu;
+			}
+		}
+	}
+#endif
+}
+
+int os_thread_stats_get(os_thread_t *thr, struct os_thread_stats *stats)
+{
+	int err = 0;
+
+	if (!thr || !stats) {
+		return -EINVAL;
+	}
+
+	/* A registered thread cannot finish exiting while we hold the list lock */
+	pthread_mutex_lock(&thread_list_lock);
+	if (thr->running) {
+		thread_stats_locked(thr, stats);
+	} else {
+		err = -ESRCH;
+	}
+	pthread_mutex_unlock(&thread_list_lock);
+
+	return err;
+}
+
+int os_thread_foreach(void (*cb)(const struct os_thread_stats *stats, void *user_data),
+		      void *user_data)
+{
+	struct os_thread_stats stats;
+	os_thread_t *thr;
+
+	if (!cb) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&thread_list_lock);
+	for (thr = thread_list; thr; thr = thr->next) {
+		thread_stats_locked(thr, &stats);
+		cb(&stats, user_data);
+	}
+	pthread_mutex_unlock(&thread_list_lock);
+
+	return 0;
+}
+
+/* Thread-local storage */
+int os_tls_create(os_tls_t *tls, void (*destructor)(void *))
+{
+	if (!tls) {
+		return -EINVAL;
+	}
+	int rc = pthread_key_create(&tls->key, destructor);
+	return rc == 0 ? 0 : -rc;
+}
+
+void *os_tls_get(os_tls_t *tls)
+{
+	return pthread_getspecific(tls->key);
+}
+
+int os_tls_set(os_tls_t *tls, void *value)
+{
+	int rc = pthread_setspecific(tls->key, value);
+	return rc == 0 ? 0 : -rc;
+}
+
 static pthread_mutex_t os_critical = PTHREAD_MUTEX_INITIALIZER;
 
 void os_enter_critical(void)
@@ -426,57 +705,297 @@ uint64_t os_time_get_ms(void)
 	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
 }
 
-static void timer_notify_callback(union sigval value)
+uint64_t os_time_get_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Timer wheel
+ *
+ * All os_timer_t instances are driven by one lazily started thread that
+ * runs a hierarchical timing wheel with a 1 ms tick: TIMER_WHEEL_LEVELS
+ * levels of TIMER_WHEEL_SLOTS buckets, each level covering 64 times the
+ * span of the one below. Starting and stopping a timer is an O(1) list
+ * insert/unlink under the wheel lock; timers in an upper level are
+ * cascaded down when the lower levels wrap around. Expiry callbacks run
+ * on the timer thread without the wheel lock held, so they may re-arm or
+ * stop any timer, including their own.
+ */
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1U << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   ((uint64_t)TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_RANGE  (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+#define TIMER_TICK_NS      1000000ULL
+#define TIMER_IDLE         UINT64_MAX
+
+static struct {
+	pthread_once_t once;
+	int init_err;
+	pthread_mutex_t lock;
+	/* Wakes the timer thread, waits against CLOCK_MONOTONIC */
+	pthread_cond_t wake_cond;
+	/* Signalled when a callback returns and os_timer_delete() waits */
+	pthread_cond_t idle_cond;
+	os_thread_t thread;
+	/* CLOCK_MONOTONIC time of tick 0 */
+	uint64_t base_ns;
+	/* Next tick to be processed */
+	uint64_t tick;
+	/* Tick the timer thread sleeps until */
+	uint64_t wake;
+	size_t pending;
+	unsigned int deleters;
+	os_timer_t *running;
+	os_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} wheel = {
+	.once = PTHREAD_ONCE_INIT,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.idle_cond = PTHREAD_COND_INITIALIZER,
+	.wake = TIMER_IDLE,
+};
+
+static uint64_t timer_now_tick(void)
+{
+	return (os_time_get_ns() - wheel.base_ns) / TIMER_TICK_NS;
+}
+
+static void timer_link(os_timer_t **head, os_timer_t *timer)
 {
-	os_timer_t *timer = (os_timer_t *)value.sival_ptr;
+	timer->next = *head;
+	if (timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = head;
+	*head = timer;
+}
 
-	if (timer->cb) {
-		timer->cb(timer, timer->arg);
+static void timer_unlink(os_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
 	}
+	timer->next = NULL;
+	timer->pprev = NULL;
 }
 
-static int os_timer_activate(os_timer_t *timer, uint32_t timeout_ms)
+/* Place a timer in the lowest level whose span covers its remaining delay */
+static void wheel_insert(os_timer_t *timer)
 {
-	struct itimerspec itp = {};
+	uint64_t expires = timer->expires < wheel.tick ? wheel.tick : timer->expires;
+	uint64_t delta = expires - wheel.tick;
+	int level = 0;
+
+	if (delta >= TIMER_WHEEL_RANGE) {
+		/* Parked in the top level and re-inserted when cascaded */
+		expires = wheel.tick + TIMER_WHEEL_RANGE - 1;
+		delta = TIMER_WHEEL_RANGE - 1;
+	}
 
-	itp.it_value.tv_sec = timeout_ms / 1000;
-	itp.it_value.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+	while (delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+		level++;
+	}
 
-	return timer_settime(timer->posix_timer, 0, &itp, NULL);
+	timer_link(&wheel.slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK],
+		   timer);
 }
 
-int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg)
+static void wheel_cascade(int level)
 {
-	struct sigevent sev;
+	os_timer_t **slot =
+		&wheel.slots[level][(wheel.tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	os_timer_t *list = *slot;
 
-	if (!timer || !cb) {
-		return -EINVAL;
+	*slot = NULL;
+	while (list) {
+		os_timer_t *timer = list;
+
+		list = timer->next;
+		wheel_insert(timer);
 	}
+}
 
-	timer->cb = cb;
-	timer->arg = arg;
+/* Process wheel.tick; called and returns with the wheel lock held */
+static void wheel_expire_tick(void)
+{
+	os_timer_t **slot = &wheel.slots[0][wheel.tick & TIMER_WHEEL_MASK];
+	os_timer_t *expired;
 
-	memset(&sev, 0, sizeof(sev));
-	sev.sigev_notify = SIGEV_THREAD;
-	sev.sigev_signo = SIGALRM;
-	sev.sigev_notify_function = timer_notify_callback;
-	sev.sigev_notify_attributes = NULL;
-	sev.sigev_value.sival_ptr = timer;
-	if (timer_create(CLOCK_MONOTONIC, &sev, &timer->posix_timer) != 0) {
-		return -errno;
+	if ((wheel.tick & TIMER_WHEEL_MASK) == 0) {
+		for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			wheel_cascade(level);
+			if (((wheel.tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK) != 0) {
+				break;
+			}
+		}
 	}
 
-	/* Success */
+	/*
+	 * Detach the bucket before advancing so that timers armed by the
+	 * callbacks below cannot land in it; os_timer_stop() still unlinks
+	 * from the local list through pprev.
+	 */
+	expired = *slot;
+	*slot = NULL;
+	if (expired) {
+		expired->pprev = &expired;
+	}
+	wheel.tick++;
+
+	while (expired) {
+		os_timer_t *timer = expired;
+
+		timer_unlink(timer);
+		wheel.pending--;
+		wheel.running = timer;
+		pthread_mutex_unlock(&wheel.lock);
+
+		if (timer->cb) {
+			timer->cb(timer, timer->arg);
+		}
+
+		pthread_mutex_lock(&wheel.lock);
+		wheel.running = NULL;
+		if (wheel.deleters) {
+			pthread_cond_broadcast(&wheel.idle_cond);
+		}
+	}
+}
+
+/* Earliest tick at which any bucket holding a timer is processed */
+static uint64_t wheel_next_tick(void)
+{
+	uint64_t next = TIMER_IDLE;
+
+	if (!wheel.pending) {
+		return TIMER_IDLE;
+	}
+
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		uint64_t span = 1ULL << (TIMER_WHEEL_BITS * (level + 1));
+
+		for (uint64_t i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+			uint64_t at;
+
+			if (!wheel.slots[level][i]) {
+				continue;
+			}
+
+			at = (wheel.tick & ~(span - 1)) | (i << (TIMER_WHEEL_BITS * level));
+			if (at < wheel.tick) {
+				at += span;
+			}
+			if (at < next) {
+				next = at;
+			}
+		}
+	}
+
+	return next;
+}
+
+static void timer_thread(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&wheel.lock);
+	while (1) {
+		uint64_t now = timer_now_tick();
+
+		if (!wheel.pending) {
+			/* Nothing armed: skip the idle ticks instead of walking them */
+			wheel.tick = now + 1;
+		}
+
+		while (wheel.tick <= now) {
+			wheel_expire_tick();
+		}
+
+		wheel.wake = wheel_next_tick();
+		if (wheel.wake == TIMER_IDLE) {
+			pthread_cond_wait(&wheel.wake_cond, &wheel.lock);
+		} else {
+			uint64_t ns = wheel.base_ns + wheel.wake * TIMER_TICK_NS;
+			struct timespec abstime = {
+				.tv_sec = (time_t)(ns / 1000000000ULL),
+				.tv_nsec = (long)(ns % 1000000000ULL),
+			};
+
+			(void)pthread_cond_timedwait(&wheel.wake_cond, &wheel.lock, &abstime);
+		}
+	}
+}
+
+static void timer_wheel_init(void)
+{
+	pthread_condattr_t attr;
+	int rc;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	rc = pthread_cond_init(&wheel.wake_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if (rc != 0) {
+		wheel.init_err = -rc;
+		return;
+	}
+
+	wheel.base_ns = os_time_get_ns();
+	wheel.init_err = os_thread_create(&wheel.thread, timer_thread, NULL, "os_timer",
+					 OS_PRIORITY_COOP(0), 0);
+}
+
+int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg)
+{
+	if (!timer || !cb) {
+		return -EINVAL;
+	}
+
+	*timer = (os_timer_t)OS_TIMER_INITIALIZER(cb, arg);
+
 	return 0;
 }
 
-int os_timer_start(os_timer_t *timer, uint32_t timeout_ms)
+int os_timer_start(os_timer_t *timer, os_timeout_t timeout)
 {
 	if (!timer) {
 		return -EINVAL;
 	}
 
-	return os_timer_activate(timer, timeout_ms);
+	pthread_once(&wheel.once, timer_wheel_init);
+	if (wheel.init_err) {
+		return wheel.init_err;
+	}
+
+	pthread_mutex_lock(&wheel.lock);
+	if (timer->pprev) {
+		timer_unlink(timer);
+		wheel.pending--;
+	}
+
+	if (timeout < 0) {
+		/* OS_TIMEOUT_FOREVER: never expires */
+		pthread_mutex_unlock(&wheel.lock);
+		return 0;
+	}
+
+	/* Round up so that a timer never fires before the timeout has elapsed */
+	timer->expires = (os_time_get_ns() - wheel.base_ns + (uint64_t)timeout + TIMER_TICK_NS - 1) /
+			 TIMER_TICK_NS;
+	wheel_insert(timer);
+	wheel.pending++;
+
+	if (timer->expires < wheel.wake) {
+		pthread_cond_signal(&wheel.wake_cond);
+	}
+	pthread_mutex_unlock(&wheel.lock);
+
+	return 0;
 }
 
 int os_timer_stop(os_timer_t *timer)
@@ -485,7 +1004,14 @@ int os_timer_stop(os_timer_t *timer)
 		return -EINVAL;
 	}
 
-	return os_timer_activate(timer, 0);
+	pthread_mutex_lock(&wheel.lock);
+	if (timer->pprev) {
+		timer_unlink(timer);
+		wheel.pending--;
+	}
+	pthread_mutex_unlock(&wheel.lock);
+
+	return 0;
 }
 
 int os_timer_delete(os_timer_t *timer)
@@ -494,19 +1020,43 @@ int os_timer_delete(os_timer_t *timer)
 		return -EINVAL;
 	}
 
-	return timer_delete(timer->posix_timer);
+	pthread_mutex_lock(&wheel.lock);
+	if (timer->pprev) {
+		timer_unlink(timer);
+		wheel.pending--;
+	}
+
+	/* The storage may be reused once we return: let a running callback finish */
+	if (!pthread_equal(pthread_self(), wheel.thread.thread)) {
+		wheel.deleters++;
+		while (wheel.running == timer) {
+			pthread_cond_wait(&wheel.idle_cond, &wheel.lock);
+		}
+		wheel.deleters--;
+	}
+	pthread_mutex_unlock(&wheel.lock);
+
+	return 0;
 }
 
 uint64_t os_timer_remaining_ms(const os_timer_t *timer)
 {
+	uint64_t remaining = 0;
+
 	if (!timer) {
 		return 0;
 	}
 
-	struct itimerspec itp = {};
-	timer_gettime((timer_t)timer->posix_timer, &itp);
+	pthread_mutex_lock(&wheel.lock);
+	if (timer->pprev) {
+		uint64_t due_ns = wheel.base_ns + timer->expires * TIMER_TICK_NS;
+		uint64_t now_ns = os_time_get_ns();
+
+		remaining = due_ns > now_ns ? (due_ns - now_ns) / TIMER_TICK_NS : 0;
+	}
+	pthread_mutex_unlock(&wheel.lock);
 
-	return (uint64_t)(itp.it_value.tv_sec * 1000 + itp.it_value.tv_nsec / 1000000);
+	return remaining;
 }
 
 void *os_malloc(size_t size)
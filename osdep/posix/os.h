@@ -6,22 +6,31 @@
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Timeout helpers (milliseconds) */
-typedef int32_t os_timeout_t;
+/*
+ * Timeouts are signed 64-bit nanosecond counts, measured against
+ * CLOCK_MONOTONIC. Negative values wait forever.
+ */
+typedef int64_t os_timeout_t;
 
 #define OS_TIMEOUT_NO_WAIT ((os_timeout_t)0)
 #define OS_TIMEOUT_FOREVER ((os_timeout_t) - 1)
 
-#define OS_USEC(us)     ((os_timeout_t)(((us) + 999) / 1000))
-#define OS_MSEC(ms)     ((os_timeout_t)(ms))
-#define OS_SECONDS(sec) ((os_timeout_t)((sec) * 1000))
-#define OS_HOURS(h)     ((os_timeout_t)((h) * 60 * 60 * 1000))
+#define OS_NSEC(ns)     ((os_timeout_t)(ns))
+#define OS_USEC(us)     ((os_timeout_t)(us) * 1000)
+#define OS_MSEC(ms)     ((os_timeout_t)(ms) * 1000 * 1000)
+#define OS_SECONDS(sec) ((os_timeout_t)(sec) * 1000 * 1000 * 1000)
+#define OS_HOURS(h)     (OS_SECONDS(h) * 60 * 60)
+
+/* Finite timeout in whole milliseconds, rounded up */
+#define OS_TIMEOUT_MS(t) (((t) + 999999) / 1000000)
 
 /* Semaphore: wrapper structure to track optional limit and use POSIX sem */
 typedef struct os_sem {
@@ -48,27 +57,97 @@ typedef pthread_cond_t os_cond_t;
 /* Note: relies on GCC/Clang constructor extension. */
 #define OS_SEM_DEFINE(name, initial, max_limit) os_sem_t name
 
-#define OS_PRIORITY(prio) (100 + (prio))
-/* Thread abstraction */
+/*
+ * Thread priorities follow the Kconfig convention: lower values are more
+ * urgent. OS_PRIORITY() threads are preemptible and run SCHED_OTHER with the
+ * priority as nice value. OS_PRIORITY_COOP() threads run real-time
+ * (OS_THREAD_RT_POLICY at OS_THREAD_RT_PRIO_BASE - prio), falling back to a
+ * negative nice value when the process may not use real-time scheduling.
+ * A priority of 0 keeps the creator's scheduling.
+ */
+#define OS_PRIORITY(prio)      (100 + (prio))
+#define OS_PRIORITY_COOP(prio) (-1 - (prio))
+
+#ifndef OS_THREAD_RT_POLICY
+#define OS_THREAD_RT_POLICY SCHED_FIFO
+#endif
+
+#ifndef OS_THREAD_RT_PRIO_BASE
+#define OS_THREAD_RT_PRIO_BASE 50
+#endif
+
+/*
+ * Kconfig stack sizes are sized for the MCU ports; smaller requests are
+ * raised to this floor so that libc calls keep working.
+ */
+#ifndef OS_THREAD_STACK_MIN
+#define OS_THREAD_STACK_MIN (64 * 1024)
+#endif
+
+#define OS_THREAD_NAME_MAX 16
+
+/*
+ * Thread abstraction. The object must stay valid while the thread runs; it
+ * carries the start arguments and the bookkeeping for os_thread_stats_get().
+ */
 typedef struct os_thread {
 	pthread_t thread;
+	void (*entry)(void *);
+	void *arg;
+	struct os_thread *next; /* Registry of running threads */
+	bool running;
+	int priority;
+	int policy;
+	int sched_priority;
+	size_t stack_size;
+	uint64_t start_ns;
+	char name[OS_THREAD_NAME_MAX];
 } os_thread_t;
 
+/* Scheduling parameters and CPU usage of a running thread */
+struct os_thread_stats {
+	char name[OS_THREAD_NAME_MAX];
+	int priority;       /* As passed to os_thread_create() */
+	int policy;         /* Effective SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+	int sched_priority; /* Real-time priority, or nice value for SCHED_OTHER */
+	uint32_t cpu_mask;  /* Bit n: CPU n */
+	size_t stack_size;
+	uint64_t cpu_time_ns; /* CPU time consumed so far */
+	uint64_t uptime_ns;   /* Time since the thread started */
+};
+
 /* Thread ID type */
 typedef pthread_t os_tid_t;
 
+/* Thread-local storage slot */
+typedef struct os_tls {
+	pthread_key_t key;
+} os_tls_t;
+
 typedef struct os_timer os_timer_t;
 typedef void (*os_timer_cb_t)(os_timer_t *timer, void *arg);
 
+/*
+ * One-shot timer driven by the shared timer wheel thread. The linkage is
+ * owned by the wheel; a zero-initialised timer is valid and idle, so
+ * OS_TIMER_INITIALIZER() can be used for statically allocated timers.
+ */
 typedef struct os_timer {
-	timer_t posix_timer;
+	struct os_timer *next;
+	struct os_timer **pprev;
+	uint64_t expires;
 	os_timer_cb_t cb;
 	void *arg;
 } os_timer_t;
 
+#define OS_TIMER_INITIALIZER(_cb, _arg)                                                            \
+	{                                                                                          \
+		.cb = (_cb), .arg = (_arg),                                                        \
+	}
+
 /* Timer functions */
 int os_timer_create(os_timer_t *timer, os_timer_cb_t cb, void *arg);
-int os_timer_start(os_timer_t *timer, uint32_t timeout_ms);
+int os_timer_start(os_timer_t *timer, os_timeout_t timeout); /* FOREVER: never expires */
 int os_timer_stop(os_timer_t *timer);
 int os_timer_delete(os_timer_t *timer);
 uint64_t os_timer_remaining_ms(const os_timer_t *timer);
@@ -76,20 +155,20 @@ uint64_t os_timer_remaining_ms(const os_timer_t *timer);
 /* Semaphore functions */
 int os_sem_init(os_sem_t *sem, unsigned int initial_count, unsigned int limit);
 int os_sem_take(os_sem_t *sem,
-		int32_t timeout_ms);          /* 0 success, -ETIMEDOUT timeout, other -errno */
+		os_timeout_t timeout);        /* 0 success, -ETIMEDOUT timeout, other -errno */
 int os_sem_give(os_sem_t *sem);               /* 0 success, -errno on failure */
 unsigned int os_sem_count_get(os_sem_t *sem); /* Best-effort via sem_getvalue */
 int os_sem_reset(os_sem_t *sem);              /* Set count to 0 by draining */
 
 /* Mutex functions */
 int os_mutex_init(os_mutex_t *mutex);
-int os_mutex_lock(os_mutex_t *mutex, int32_t timeout_ms); /* 0 success, -ETIMEDOUT, other -errno */
+int os_mutex_lock(os_mutex_t *mutex, os_timeout_t timeout); /* 0 success, -ETIMEDOUT, other -errno */
 int os_mutex_unlock(os_mutex_t *mutex);                   /* 0 success, -errno */
 
 /* Condition variable functions */
 int os_cond_init(os_cond_t *cond);
 int os_cond_wait(os_cond_t *cond, os_mutex_t *mutex,
-		 int32_t timeout_ms); /* 0 success, -ETIMEDOUT or -errno */
+		 os_timeout_t timeout); /* 0 success, -ETIMEDOUT or -errno */
 int os_cond_signal(os_cond_t *cond);
 int os_cond_broadcast(os_cond_t *cond);
 
@@ -98,11 +177,21 @@ int os_thread_create(os_thread_t *thr, void (*start_routine)(void *), void *arg,
 		     int priority, size_t stack_size);
 int os_thread_start(os_thread_t *thr);  /* No-op for POSIX (thread starts in create) */
 int os_thread_cancel(os_thread_t *thr); /* 0 success, -EINVAL or -EPERM */
-int os_thread_join(os_thread_t *thr, int32_t timeout_ms); /* 0 success, -ETIMEDOUT or -errno */
+int os_thread_join(os_thread_t *thr, os_timeout_t timeout); /* 0 success, -ETIMEDOUT or -errno */
 os_tid_t os_thread_self(void);
 bool os_thread_is_current(os_thread_t *thr);
 int os_thread_yield(void);
 int os_thread_name_set(os_thread_t *thr, const char *name);
+int os_thread_affinity_set(os_thread_t *thr, uint32_t cpu_mask); /* Bit n: CPU n */
+int os_thread_stats_get(os_thread_t *thr, struct os_thread_stats *stats); /* -ESRCH if not running */
+/* Runs cb for every thread started by os_thread_create(); cb must not create or join threads */
+int os_thread_foreach(void (*cb)(const struct os_thread_stats *stats, void *user_data),
+		      void *user_data);
+
+/* Thread-local storage functions (destructor runs on thread exit for non-NULL values) */
+int os_tls_create(os_tls_t *tls, void (*destructor)(void *));
+void *os_tls_get(os_tls_t *tls);
+int os_tls_set(os_tls_t *tls, void *value);
 
 /* Critical section functions */
 void os_enter_critical(void);
@@ -115,6 +204,7 @@ void os_sched_unlock(void);
 /* Time functions */
 void os_sleep_ms(uint32_t ms);
 uint64_t os_time_get_ms(void);
+uint64_t os_time_get_ns(void); /* CLOCK_MONOTONIC */
 
 /* Memory allocation functions */
 void *os_malloc(size_t size);
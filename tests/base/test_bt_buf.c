@@ -21,10 +21,35 @@
 /* Forwards (new tests) */
 static void test_buf_alloc_free_concurrent(void **state);
 static void test_buf_wait_alloc(void **state);
+static void test_var_alloc_len_and_stats(void **state);
+static void test_var_fragmentation_stats(void **state);
+static void test_var_alloc_timeout(void **state);
+static void test_var_clone_and_wait(void **state);
+static void test_heap_alloc_len(void **state);
+static void test_buf_shared_ref_stress(void **state);
+static void test_iovec_and_cursor(void **state);
+static void test_append_ref(void **state);
 
 /* Define a fixed buffer pool: 8 buffers, data size 64, user_data 16 */
 BT_BUF_POOL_DEFINE(test_pool, 16, 64, 16, NULL);
 
+/* Variable-size pools: 8 buffers sharing 1 KiB (4 slab pages) of data */
+BT_BUF_POOL_VAR_DEFINE(var_pool, 8, 4 * CONFIG_BT_BUF_SLAB_PAGE_SIZE, 8, NULL);
+BT_BUF_POOL_VAR_ALIGN_DEFINE(var_align_pool, 4, 4 * CONFIG_BT_BUF_SLAB_PAGE_SIZE, 0, NULL, 64);
+BT_BUF_POOL_HEAP_DEFINE(heap_pool, 4, 8, NULL);
+
+/* Stress pool: every buffer that goes back to the pool is counted by the destroy callback */
+static bt_atomic_t stress_allocs;
+static bt_atomic_t stress_destroys;
+
+static void stress_destroy(struct bt_buf *buf)
+{
+	bt_atomic_inc(&stress_destroys);
+	bt_buf_destroy(buf);
+}
+
+BT_BUF_POOL_DEFINE(stress_pool, 12, 32, 0, stress_destroy);
+
 static int pool_prepare(void)
 {
 	/* do nothing */
@@ -300,6 +325,396 @@ static void test_buf_wait_alloc(void **state)
 	}
 }
 
+static void test_var_alloc_len_and_stats(void **state)
+{
+	(void)state;
+	struct bt_buf_pool_var_stats st;
+
+	assert_int_equal(bt_buf_pool_var_stats_get(&test_pool, &st), -EINVAL);
+
+	/* Small request comes from a size class, not a worst-case MTU slot */
+	struct bt_buf *small = bt_buf_alloc_len(&var_pool, 10, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(small);
+	assert_true(small->size >= 10);
+	assert_true(small->size < BT_BUF_SLAB_MIN_CHUNK);
+
+	/* Large request spans a run of pages */
+	struct bt_buf *large = bt_buf_alloc_len(&var_pool, 700, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(large);
+	assert_true(large->size >= 700);
+	memset(bt_buf_add(large, 700), 0xA5, 700);
+
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.total, 4 * CONFIG_BT_BUF_SLAB_PAGE_SIZE);
+	assert_int_equal(st.requested, 710);
+	assert_int_equal(st.allocs, 2);
+	assert_true(st.allocated >= 710 && st.allocated <= st.total);
+	assert_int_equal(st.high_water, st.allocated);
+	size_t peak = st.allocated;
+
+	/* More than the whole budget fails immediately, even when allowed to wait */
+	struct bt_buf *huge = bt_buf_alloc_len(&var_pool, 4 * CONFIG_BT_BUF_SLAB_PAGE_SIZE,
+					       OS_TIMEOUT_FOREVER);
+	assert_null(huge);
+
+	bt_buf_unref(small);
+	bt_buf_unref(large);
+
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.requested, 0);
+	assert_int_equal(st.allocated, 0);
+	assert_int_equal(st.allocs, 0);
+	assert_int_equal(st.high_water, peak);
+	assert_int_equal(st.largest_free, st.total);
+	assert_int_equal(st.external_frag, 0);
+
+	/* Aligned variant */
+	struct bt_buf *al = bt_buf_alloc_len(&var_align_pool, 5, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(al);
+	assert_int_equal((uintptr_t)al->__buf % 64, 0);
+	bt_buf_unref(al);
+}
+
+static void test_var_fragmentation_stats(void **state)
+{
+	(void)state;
+	struct bt_buf_pool_var_stats st;
+	struct bt_buf *b[4];
+	const size_t page_len = CONFIG_BT_BUF_SLAB_PAGE_SIZE / 2 + 1;
+
+	/* One page each */
+	for (int i = 0; i < 4; ++i) {
+		b[i] = bt_buf_alloc_len(&var_pool, page_len, OS_TIMEOUT_NO_WAIT);
+		assert_non_null(b[i]);
+	}
+	assert_null(bt_buf_alloc_len(&var_pool, 1, OS_TIMEOUT_NO_WAIT));
+
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.failures, 1);
+	assert_int_equal(st.largest_free, 0);
+
+	/* Free two non-adjacent pages: half the free space is unusable for a 2-page run */
+	bt_buf_unref(b[0]);
+	bt_buf_unref(b[2]);
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.largest_free, CONFIG_BT_BUF_SLAB_PAGE_SIZE);
+	assert_int_equal(st.external_frag, 50);
+	assert_null(bt_buf_alloc_len(&var_pool, CONFIG_BT_BUF_SLAB_PAGE_SIZE, OS_TIMEOUT_NO_WAIT));
+
+	/* Small chunks share a page */
+	struct bt_buf *s1 = bt_buf_alloc_len(&var_pool, 8, OS_TIMEOUT_NO_WAIT);
+	struct bt_buf *s2 = bt_buf_alloc_len(&var_pool, 8, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(s1);
+	assert_non_null(s2);
+	assert_true(s2->__buf - s1->__buf < CONFIG_BT_BUF_SLAB_PAGE_SIZE &&
+		    s1->__buf - s2->__buf < CONFIG_BT_BUF_SLAB_PAGE_SIZE);
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_true(st.internal_frag > 0);
+
+	bt_buf_unref(s1);
+	bt_buf_unref(s2);
+	bt_buf_unref(b[1]);
+	bt_buf_unref(b[3]);
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.allocated, 0);
+	assert_int_equal(st.largest_free, st.total);
+}
+
+static void test_var_alloc_timeout(void **state)
+{
+	(void)state;
+	struct bt_buf_pool_var_stats st;
+	struct bt_buf *b[4];
+	uint32_t failures;
+	uint64_t start;
+
+	for (int i = 0; i < 4; ++i) {
+		b[i] = bt_buf_alloc_len(&var_pool, CONFIG_BT_BUF_SLAB_PAGE_SIZE / 2 + 1,
+					OS_TIMEOUT_NO_WAIT);
+		assert_non_null(b[i]);
+	}
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	failures = st.failures;
+
+	/* A finite timeout on exhausted data memory fails instead of blocking */
+	start = os_time_get_ms();
+	assert_null(bt_buf_alloc_len(&var_pool, 1, OS_MSEC(30)));
+	assert_true(os_time_get_ms() - start >= 25);
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.failures, failures + 1);
+
+	for (int i = 0; i < 4; ++i) {
+		bt_buf_unref(b[i]);
+	}
+	b[0] = bt_buf_alloc_len(&var_pool, 1, OS_MSEC(30));
+	assert_non_null(b[0]);
+	bt_buf_unref(b[0]);
+}
+
+struct var_waiter_arg {
+	struct bt_buf *out;
+};
+static void var_waiter_thread(void *arg)
+{
+	struct var_waiter_arg *wa = (struct var_waiter_arg *)arg;
+
+	wa->out = bt_buf_alloc_len(&var_pool, 3 * CONFIG_BT_BUF_SLAB_PAGE_SIZE, OS_TIMEOUT_FOREVER);
+}
+
+static void test_var_clone_and_wait(void **state)
+{
+	(void)state;
+	struct bt_buf_pool_var_stats st;
+	const uint8_t payload[] = {1, 2, 3, 4};
+
+	struct bt_buf *b = bt_buf_alloc_len(&var_pool, 2 * CONFIG_BT_BUF_SLAB_PAGE_SIZE,
+					    OS_TIMEOUT_NO_WAIT);
+	assert_non_null(b);
+	bt_buf_add_mem(b, payload, sizeof(payload));
+
+	/* Clones reference the same data */
+	struct bt_buf *c = bt_buf_clone(b, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(c);
+	assert_ptr_equal(c->data, b->data);
+	assert_int_equal(bt_buf_pool_var_stats_get(&var_pool, &st), 0);
+	assert_int_equal(st.allocs, 1);
+
+	/* A waiter blocks until the shared data is released by both buffers */
+	struct var_waiter_arg wa = {0};
+	os_thread_t wt;
+	assert_int_equal(os_thread_create(&wt, var_waiter_thread, &wa, "var_wait", OS_PRIORITY(0),
+					  0),
+			 0);
+	os_sleep_ms(20);
+	bt_buf_unref(b);
+	os_sleep_ms(20);
+	assert_null(wa.out);
+	assert_memory_equal(c->data, payload, sizeof(payload));
+	bt_buf_unref(c);
+	assert_int_equal(os_thread_join(&wt, OS_TIMEOUT_FOREVER), 0);
+	assert_non_null(wa.out);
+	bt_buf_unref(wa.out);
+}
+
+static void test_heap_alloc_len(void **state)
+{
+	(void)state;
+	struct bt_buf *b = bt_buf_alloc_len(&heap_pool, 1500, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(b);
+	assert_int_equal(b->size, 1500);
+	memset(bt_buf_add(b, 1500), 0x3C, 1500);
+
+	struct bt_buf *c = bt_buf_clone(b, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(c);
+	assert_ptr_equal(c->data, b->data);
+	bt_buf_unref(b);
+	assert_int_equal(c->data[1499], 0x3C);
+	bt_buf_unref(c);
+}
+
+static void test_iovec_and_cursor(void **state)
+{
+	(void)state;
+	const uint8_t h[] = {1, 2, 3};
+	const uint8_t f2[] = {4, 5, 6, 7, 8};
+	struct bt_buf *head = bt_buf_alloc_len(&test_pool, 16, OS_TIMEOUT_NO_WAIT);
+	struct bt_buf *empty = bt_buf_alloc_len(&test_pool, 16, OS_TIMEOUT_NO_WAIT);
+	struct bt_buf *frag = bt_buf_alloc_len(&test_pool, 16, OS_TIMEOUT_NO_WAIT);
+	struct bt_buf_cursor cur;
+	struct iovec iov[4];
+	uint8_t scratch[8];
+	uint8_t out[8];
+	uint8_t *p;
+
+	assert_non_null(head);
+	assert_non_null(empty);
+	assert_non_null(frag);
+	bt_buf_add_mem(head, h, sizeof(h));
+	bt_buf_add_mem(frag, f2, sizeof(f2));
+	bt_buf_frag_add(head, empty);
+	bt_buf_frag_add(head, frag);
+	assert_int_equal(bt_buf_frags_count(head), 3);
+
+	/* Empty fragments are skipped, offset and length are honoured */
+	assert_int_equal(bt_buf_iovec_get(head, 0, SIZE_MAX, iov, ARRAY_SIZE(iov)), 2);
+	assert_ptr_equal(iov[0].iov_base, head->data);
+	assert_int_equal(iov[0].iov_len, 3);
+	assert_ptr_equal(iov[1].iov_base, frag->data);
+	assert_int_equal(iov[1].iov_len, 5);
+	assert_int_equal(bt_buf_iovec_get(head, 2, 3, iov, ARRAY_SIZE(iov)), 2);
+	assert_ptr_equal(iov[0].iov_base, head->data + 2);
+	assert_int_equal(iov[0].iov_len, 1);
+	assert_int_equal(iov[1].iov_len, 2);
+	assert_int_equal(bt_buf_iovec_get(head, 0, SIZE_MAX, iov, 1), 1);
+	assert_int_equal(bt_buf_iovec_get(head, 8, SIZE_MAX, iov, ARRAY_SIZE(iov)), 0);
+
+	/* Contiguous access points into the fragment, straddling data is gathered */
+	bt_buf_cursor_init(&cur, head);
+	p = bt_buf_cursor_pull_mem(&cur, 2, scratch);
+	assert_ptr_equal(p, head->data);
+	p = bt_buf_cursor_pull_mem(&cur, 3, scratch);
+	assert_ptr_equal(p, scratch);
+	assert_memory_equal(p, ((uint8_t[]){3, 4, 5}), 3);
+	assert_int_equal(cur.off, 5);
+	assert_null(bt_buf_cursor_pull_mem(&cur, 4, scratch));
+	assert_int_equal(cur.off, 5);
+	assert_int_equal(bt_buf_cursor_pull(&cur, out, sizeof(out)), 3);
+	assert_memory_equal(out, ((uint8_t[]){6, 7, 8}), 3);
+	assert_null(cur.frag);
+
+	/* Push writes backwards across the boundary */
+	assert_int_equal(bt_buf_cursor_seek(&cur, 4), 0);
+	assert_int_equal(bt_buf_cursor_push(&cur, ((uint8_t[]){0xa, 0xb, 0xc}), 3), 0);
+	assert_int_equal(cur.off, 1);
+	assert_int_equal(bt_buf_cursor_push(&cur, ((uint8_t[]){0xd, 0xe}), 2), -EINVAL);
+	assert_int_equal(bt_buf_linearize(out, sizeof(out), head, 0, sizeof(out)), 8);
+	assert_memory_equal(out, ((uint8_t[]){1, 0xa, 0xb, 0xc, 5, 6, 7, 8}), 8);
+
+	assert_int_equal(bt_buf_cursor_seek(&cur, 8), 0);
+	assert_int_equal(bt_buf_cursor_seek(&cur, 9), -EINVAL);
+	assert_int_equal(cur.off, 8);
+
+	bt_buf_unref(head);
+}
+
+static int ext_destroyed;
+static void *ext_destroyed_data;
+
+static void ext_destroy(struct bt_buf *buf, void *data)
+{
+	(void)buf;
+	ext_destroyed++;
+	ext_destroyed_data = data;
+}
+
+static void test_append_ref(void **state)
+{
+	(void)state;
+	static uint8_t payload[1024];
+	struct bt_buf *head = bt_buf_alloc_len(&test_pool, 16, OS_TIMEOUT_NO_WAIT);
+	struct bt_buf *frag;
+	struct iovec iov[2];
+
+	assert_non_null(head);
+	bt_buf_add_u8(head, 0x42);
+	memset(payload, 0x5a, sizeof(payload));
+
+	ext_destroyed = 0;
+	assert_int_equal(bt_buf_append_ref(head, NULL, payload, sizeof(payload), ext_destroy,
+					   OS_TIMEOUT_NO_WAIT),
+			 0);
+	assert_int_equal(bt_buf_frags_len(head), 1 + sizeof(payload));
+
+	/* The payload is referenced, not copied */
+	assert_int_equal(bt_buf_iovec_get(head, 0, SIZE_MAX, iov, ARRAY_SIZE(iov)), 2);
+	assert_ptr_equal(iov[1].iov_base, payload);
+	assert_int_equal(iov[1].iov_len, sizeof(payload));
+
+	/* Released only when the last reference to the fragment goes away */
+	frag = bt_buf_ref(head->frags);
+	bt_buf_unref(head);
+	assert_int_equal(ext_destroyed, 0);
+	bt_buf_unref(frag);
+	assert_int_equal(ext_destroyed, 1);
+	assert_ptr_equal(ext_destroyed_data, payload);
+
+	/* Recycled buffers do not inherit the callback */
+	frag = bt_buf_alloc_with_data(&test_pool, payload, 8, OS_TIMEOUT_NO_WAIT);
+	assert_non_null(frag);
+	bt_buf_unref(frag);
+	assert_int_equal(ext_destroyed, 1);
+}
+
+static bt_atomic_ptr_t stress_slots[N_THREADS];
+
+struct stress_arg {
+	uint8_t id;
+	int corrupt;
+};
+
+static void stress_thread(void *arg)
+{
+	struct stress_arg *a = arg;
+
+	for (int i = 0; i < M_ITERS * 4; ++i) {
+		struct bt_buf *b = bt_buf_alloc_len(&stress_pool, 2, OS_TIMEOUT_FOREVER);
+		struct bt_buf *prev;
+
+		if (!b) {
+			continue;
+		}
+
+		bt_atomic_inc(&stress_allocs);
+		bt_buf_add_u8(b, a->id);
+		bt_buf_add_u8(b, (uint8_t)~a->id);
+
+		/* Hand a second reference to a neighbour and drop whatever it left for us */
+		prev = bt_atomic_ptr_set(&stress_slots[(a->id + i) % N_THREADS], bt_buf_ref(b));
+		if (prev) {
+			if (prev->len != 2 || prev->data[0] != (uint8_t)~prev->data[1]) {
+				a->corrupt++;
+			}
+			bt_buf_unref(prev);
+		}
+
+		bt_buf_unref(b);
+	}
+}
+
+static void test_buf_shared_ref_stress(void **state)
+{
+	(void)state;
+	os_thread_t th[N_THREADS];
+	struct stress_arg args[N_THREADS];
+	struct bt_buf *arr[12];
+	size_t cnt = 0;
+
+	memset(args, 0, sizeof(args));
+	for (int i = 0; i < N_THREADS; ++i) {
+		args[i].id = i;
+		assert_int_equal(os_thread_create(&th[i], stress_thread, &args[i], "buf_stress",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	for (int i = 0; i < N_THREADS; ++i) {
+		assert_int_equal(os_thread_join(&th[i], OS_TIMEOUT_FOREVER), 0);
+		assert_int_equal(args[i].corrupt, 0);
+	}
+
+	ARRAY_FOR_EACH(stress_slots, i) {
+		struct bt_buf *b = bt_atomic_ptr_clear(&stress_slots[i]);
+
+		if (b) {
+			assert_int_equal(bt_atomic_get(&b->ref), 1);
+			bt_buf_unref(b);
+		}
+	}
+
+	/* Every allocation came back exactly once: no leaks and no double frees */
+	assert_int_equal(bt_atomic_get(&stress_allocs), bt_atomic_get(&stress_destroys));
+
+	/* And the whole pool is allocatable again, each buffer handed out once */
+	while (cnt < ARRAY_SIZE(arr)) {
+		struct bt_buf *b = bt_buf_alloc_fixed(&stress_pool, OS_TIMEOUT_NO_WAIT);
+
+		if (!b) {
+			break;
+		}
+		for (size_t i = 0; i < cnt; ++i) {
+			assert_ptr_not_equal(arr[i], b);
+		}
+		arr[cnt++] = b;
+	}
+	assert_int_equal(cnt, stress_pool.buf_count);
+	assert_false(bt_buf_pool_has_free(&stress_pool));
+	assert_null(bt_buf_alloc_fixed(&stress_pool, OS_TIMEOUT_NO_WAIT));
+
+	for (size_t i = 0; i < cnt; ++i) {
+		bt_buf_unref(arr[i]);
+	}
+	assert_true(bt_buf_pool_has_free(&stress_pool));
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -309,6 +724,14 @@ int main(void)
 		cmocka_unit_test(test_append_bytes),
 		cmocka_unit_test(test_buf_alloc_free_concurrent),
 		cmocka_unit_test(test_buf_wait_alloc),
+		cmocka_unit_test(test_var_alloc_len_and_stats),
+		cmocka_unit_test(test_var_fragmentation_stats),
+		cmocka_unit_test(test_var_clone_and_wait),
+		cmocka_unit_test(test_var_alloc_timeout),
+		cmocka_unit_test(test_heap_alloc_len),
+		cmocka_unit_test(test_buf_shared_ref_stress),
+		cmocka_unit_test(test_iovec_and_cursor),
+		cmocka_unit_test(test_append_ref),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
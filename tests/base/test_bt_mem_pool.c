@@ -21,6 +21,9 @@
 /* Forwards */
 static void test_mem_pool_alloc_waiting(void **state);
 static void test_mem_pool_alloc_free_concurrent(void **state);
+static void test_mem_pool_blocking_alloc(void **state);
+static void test_mem_pool_exclusive_ownership_concurrent(void **state);
+static void test_mem_pool_independent_pools_concurrent(void **state);
 
 static void test_bt_mem_pool_alloc_free(void **state)
 {
@@ -174,12 +177,218 @@ static void test_mem_pool_alloc_free_concurrent(void **state)
 	}
 }
 
+struct mp_block_arg {
+	struct bt_mem_pool *mp;
+	os_timeout_t timeout;
+	int rc;
+	void *out;
+};
+static void mp_block_thread(void *arg)
+{
+	struct mp_block_arg *ba = (struct mp_block_arg *)arg;
+
+	ba->rc = bt_mem_pool_alloc(ba->mp, &ba->out, ba->timeout);
+}
+
+static void test_mem_pool_blocking_alloc(void **state)
+{
+	(void)state;
+	const uint32_t blocks = 2;
+	const size_t block_size = 32;
+	char buffer[blocks * WB_UP(block_size)];
+	struct bt_mem_pool mp = {0};
+	void *held[2];
+	assert_int_equal(bt_mem_pool_init(&mp, buffer, block_size, blocks), 0);
+	assert_int_equal(bt_mem_pool_alloc(&mp, &held[0], OS_TIMEOUT_NO_WAIT), 0);
+	assert_int_equal(bt_mem_pool_alloc(&mp, &held[1], OS_TIMEOUT_NO_WAIT), 0);
+
+	/* Timed wait expires while the pool stays empty */
+	void *blk = (void *)0x1;
+	assert_int_equal(bt_mem_pool_alloc(&mp, &blk, OS_MSEC(20)), -ETIMEDOUT);
+	assert_null(blk);
+
+	/* Blocked allocators are woken by frees, without holding any pool-global lock */
+	struct mp_block_arg ba[2] = {
+		{.mp = &mp, .timeout = OS_TIMEOUT_FOREVER},
+		{.mp = &mp, .timeout = OS_TIMEOUT_FOREVER},
+	};
+	os_thread_t th[2];
+	for (int i = 0; i < 2; ++i) {
+		assert_int_equal(os_thread_create(&th[i], mp_block_thread, &ba[i], "mp_blk",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	os_sleep_ms(30);
+	bt_mem_pool_free(&mp, held[0]);
+	bt_mem_pool_free(&mp, held[1]);
+	for (int i = 0; i < 2; ++i) {
+		assert_int_equal(os_thread_join(&th[i], OS_TIMEOUT_FOREVER), 0);
+		assert_int_equal(ba[i].rc, 0);
+		assert_non_null(ba[i].out);
+	}
+	assert_ptr_not_equal(ba[0].out, ba[1].out);
+	assert_int_equal(bt_mem_pool_num_free_get(&mp), 0);
+	bt_mem_pool_free(&mp, ba[0].out);
+	bt_mem_pool_free(&mp, ba[1].out);
+	assert_int_equal(bt_mem_pool_num_free_get(&mp), blocks);
+}
+
+struct mp_owner_arg {
+	struct bt_mem_pool *mp;
+	uint32_t id;
+	int corrupt;
+};
+static void mp_owner_thread(void *arg)
+{
+	struct mp_owner_arg *a = (struct mp_owner_arg *)arg;
+	uint32_t *held[4];
+
+	for (int i = 0; i < M_ITERS; ++i) {
+		int n = 1 + (i % 4);
+
+		for (int j = 0; j < n; ++j) {
+			assert_int_equal(bt_mem_pool_alloc(a->mp, (void **)&held[j],
+							   OS_TIMEOUT_FOREVER),
+					 0);
+			/* Stamp the whole block; a block handed out twice gets overwritten */
+			for (int k = 0; k < 8; ++k) {
+				held[j][k] = a->id;
+			}
+		}
+		(void)os_thread_yield();
+		for (int j = 0; j < n; ++j) {
+			for (int k = 0; k < 8; ++k) {
+				if (held[j][k] != a->id) {
+					a->corrupt++;
+				}
+			}
+			bt_mem_pool_free(a->mp, held[j]);
+		}
+	}
+	bt_mem_pool_cache_flush();
+}
+
+static void test_mem_pool_exclusive_ownership_concurrent(void **state)
+{
+	(void)state;
+	/* Enough blocks for every thread to hold its maximum at once */
+	const uint32_t blocks = N_THREADS * 4;
+	const size_t block_size = 8 * sizeof(uint32_t);
+	static char buffer[N_THREADS * 4 * 32] __aligned(sizeof(void *));
+	struct bt_mem_pool mp = {0};
+	assert_int_equal(bt_mem_pool_init(&mp, buffer, block_size, blocks), 0);
+
+	os_thread_t th[N_THREADS];
+	struct mp_owner_arg args[N_THREADS];
+	memset(args, 0, sizeof(args));
+	for (int i = 0; i < N_THREADS; ++i) {
+		args[i].mp = &mp;
+		args[i].id = 0x1000 + i;
+		assert_int_equal(os_thread_create(&th[i], mp_owner_thread, &args[i], "mp_own",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	for (int i = 0; i < N_THREADS; ++i) {
+		assert_int_equal(os_thread_join(&th[i], OS_TIMEOUT_FOREVER), 0);
+		assert_int_equal(args[i].corrupt, 0);
+	}
+	assert_int_equal(bt_mem_pool_num_free_get(&mp), blocks);
+
+	/* Every block made it back to the pool exactly once */
+	void *arr[N_THREADS * 4];
+	uint32_t cnt = 0;
+	void *blk = NULL;
+	while (bt_mem_pool_alloc(&mp, &blk, OS_TIMEOUT_NO_WAIT) == 0) {
+		for (uint32_t i = 0; i < cnt; ++i) {
+			assert_ptr_not_equal(arr[i], blk);
+		}
+		arr[cnt++] = blk;
+	}
+	assert_int_equal(cnt, blocks);
+	for (uint32_t i = 0; i < cnt; ++i) {
+		bt_mem_pool_free(&mp, arr[i]);
+	}
+}
+
+static void test_mem_pool_independent_pools_concurrent(void **state)
+{
+	(void)state;
+	const uint32_t blocks = 4;
+	const size_t block_size = 8 * sizeof(uint32_t);
+	static char buffer[N_THREADS][4 * 32] __aligned(sizeof(void *));
+	struct bt_mem_pool mp[N_THREADS];
+	memset(mp, 0, sizeof(mp));
+
+	os_thread_t th[N_THREADS];
+	struct mp_owner_arg args[N_THREADS];
+	memset(args, 0, sizeof(args));
+	for (int i = 0; i < N_THREADS; ++i) {
+		assert_int_equal(bt_mem_pool_init(&mp[i], buffer[i], block_size, blocks), 0);
+		args[i].mp = &mp[i];
+		args[i].id = 0x2000 + i;
+		assert_int_equal(os_thread_create(&th[i], mp_owner_thread, &args[i], "mp_ind",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	for (int i = 0; i < N_THREADS; ++i) {
+		assert_int_equal(os_thread_join(&th[i], OS_TIMEOUT_FOREVER), 0);
+		assert_int_equal(args[i].corrupt, 0);
+		assert_int_equal(bt_mem_pool_num_free_get(&mp[i]), blocks);
+	}
+}
+
+BT_MEM_POOL_DEFINE_STATIC(static_pool, 32, 4, sizeof(void *));
+
+static void static_pool_waiter(void *arg)
+{
+	void **mem = arg;
+
+	assert_int_equal(bt_mem_pool_alloc(&static_pool, mem, OS_TIMEOUT_FOREVER), 0);
+}
+
+static void test_mem_pool_static_define(void **state)
+{
+	(void)state;
+	void *ptrs[4];
+	void *extra = NULL;
+	os_thread_t th;
+
+	/* Usable without bt_mem_pool_init(), blocks are handed out in buffer order */
+	for (int i = 0; i < 4; ++i) {
+		assert_int_equal(bt_mem_pool_alloc(&static_pool, &ptrs[i], OS_TIMEOUT_NO_WAIT), 0);
+		assert_ptr_equal(ptrs[i], _bt_mem_pool_buf_static_pool + i * 32);
+	}
+	assert_int_equal(bt_mem_pool_alloc(&static_pool, &extra, OS_TIMEOUT_NO_WAIT), -ENOMEM);
+	assert_int_equal(bt_mem_pool_num_free_get(&static_pool), 0);
+
+	/* The first blocking allocator sets up the wakeup path */
+	assert_int_equal(os_thread_create(&th, static_pool_waiter, &extra, "mp_static",
+					  OS_PRIORITY(0), 0),
+			 0);
+	os_sleep_ms(20);
+	bt_mem_pool_free(&static_pool, ptrs[1]);
+	assert_int_equal(os_thread_join(&th, OS_TIMEOUT_FOREVER), 0);
+	assert_ptr_equal(extra, ptrs[1]);
+
+	bt_mem_pool_free(&static_pool, extra);
+	for (int i = 0; i < 4; ++i) {
+		if (i != 1) {
+			bt_mem_pool_free(&static_pool, ptrs[i]);
+		}
+	}
+	assert_int_equal(bt_mem_pool_num_free_get(&static_pool), 4);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_bt_mem_pool_alloc_free),
 		cmocka_unit_test(test_mem_pool_alloc_waiting),
 		cmocka_unit_test(test_mem_pool_alloc_free_concurrent),
+		cmocka_unit_test(test_mem_pool_blocking_alloc),
+		cmocka_unit_test(test_mem_pool_exclusive_ownership_concurrent),
+		cmocka_unit_test(test_mem_pool_independent_pools_concurrent),
+		cmocka_unit_test(test_mem_pool_static_define),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 #endif
 
 #include <base/queue/bt_queue.h>
+#include <base/bt_poll.h>
 #include <utils/bt_slist.h>
 #include <osdep/os.h>
 
@@ -23,6 +24,21 @@
 /* Forwards */
 static void test_queue_producers_consumers(void **state);
 static void test_queue_unique_append_concurrent(void **state);
+static void test_queue_poll_and_cancel(void **state);
+static void test_queue_contention_bench(void **state);
+
+/* Tests taking a prestate run once per queue variant */
+static bool locked_mode;
+static bool mpsc_mode = true;
+
+static void queue_init(struct bt_queue *q, void **state)
+{
+	if (*state && *(bool *)*state) {
+		bt_queue_init_mpsc(q);
+	} else {
+		bt_queue_init(q);
+	}
+}
 
 struct item {
 	bt_snode_t node;
@@ -31,9 +47,8 @@ struct item {
 
 static void test_queue_basic_ops(void **state)
 {
-	(void)state;
 	struct bt_queue q;
-	bt_queue_init(&q);
+	queue_init(&q, state);
 	assert_true(bt_queue_is_empty(&q));
 
 	struct item a = {.value = 1}, b = {.value = 2}, c = {.value = 3};
@@ -77,6 +92,40 @@ static void test_queue_basic_ops(void **state)
 	assert_false(removed);
 }
 
+/* A producer preempted between swapping the tail and linking its node holds up
+ * the items behind it, the consumer must not wait for it.
+ */
+static void test_queue_mpsc_unlinked_producer(void **state)
+{
+	struct bt_queue q;
+	struct item a = {.value = 1}, b = {.value = 2}, c = {.value = 3};
+	bt_snode_t *prev;
+
+	(void)state;
+	bt_queue_init_mpsc(&q);
+
+	/* Half an append onto the stub */
+	b.node.next = NULL;
+	prev = q.tail;
+	q.tail = &b.node;
+	assert_null(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT));
+	assert_null(bt_queue_get(&q, OS_MSEC(10)));
+	prev->next = &b.node;
+	assert_ptr_equal(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT), &b);
+
+	/* And behind a linked item, which cannot be detached before it */
+	bt_queue_append(&q, &a);
+	c.node.next = NULL;
+	prev = q.tail;
+	q.tail = &c.node;
+	assert_null(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT));
+	assert_null(bt_queue_peek_head(&q));
+	prev->next = &c.node;
+	assert_ptr_equal(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT), &a);
+	assert_ptr_equal(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT), &c);
+	assert_true(bt_queue_is_empty(&q));
+}
+
 /* ===== Concurrent queue tests ===== */
 struct prod_item {
 	bt_snode_t node;
@@ -122,9 +171,8 @@ static void consumer_thread(void *arg)
 
 static void test_queue_producers_consumers(void **state)
 {
-	(void)state;
 	struct bt_queue q;
-	bt_queue_init(&q);
+	queue_init(&q, state);
 	os_thread_t prod_th[N_THREADS];
 	struct prod_item items[N_THREADS][M_ITERS];
 	memset(items, 0, sizeof(items));
@@ -153,7 +201,7 @@ static void test_queue_producers_consumers(void **state)
 
 	/* Prepend order test (single-thread) */
 	struct item a = {.value = 11}, b = {.value = 22}, c = {.value = 33};
-	bt_queue_init(&q);
+	queue_init(&q, state);
 	bt_queue_prepend(&q, &a);
 	bt_queue_prepend(&q, &b);
 	bt_queue_prepend(&q, &c);
@@ -179,9 +227,8 @@ static void uniq_thread(void *arg)
 
 static void test_queue_unique_append_concurrent(void **state)
 {
-	(void)state;
 	struct bt_queue q;
-	bt_queue_init(&q);
+	queue_init(&q, state);
 	bt_snode_t shared;
 	memset(&shared, 0, sizeof(shared));
 	os_thread_t th[N_THREADS];
@@ -204,12 +251,143 @@ static void test_queue_unique_append_concurrent(void **state)
 	(void)bt_queue_remove(&q, &shared);
 }
 
+struct delayed_arg {
+	struct bt_queue *q;
+	void *item;
+	void *got;
+};
+
+static void delayed_append_thread(void *arg)
+{
+	struct delayed_arg *da = arg;
+
+	os_sleep_ms(20);
+	bt_queue_append(da->q, da->item);
+}
+
+static void delayed_cancel_thread(void *arg)
+{
+	struct delayed_arg *da = arg;
+
+	os_sleep_ms(20);
+	bt_queue_cancel_wait(da->q);
+}
+
+static void blocked_get_thread(void *arg)
+{
+	struct delayed_arg *da = arg;
+
+	da->got = bt_queue_get(da->q, OS_TIMEOUT_FOREVER);
+}
+
+static void test_queue_poll_and_cancel(void **state)
+{
+	struct bt_queue q;
+	struct item a = {.value = 1};
+	struct delayed_arg da = {.q = &q, .item = &a, .got = &a};
+	struct bt_poll_event ev;
+	os_thread_t th;
+
+	queue_init(&q, state);
+
+	/* bt_poll() wakes up once another thread appends */
+	bt_poll_event_init(&ev, BT_POLL_TYPE_FIFO_DATA_AVAILABLE, BT_POLL_MODE_NOTIFY_ONLY, &q);
+	assert_int_equal(
+		os_thread_create(&th, delayed_append_thread, &da, "append", OS_PRIORITY(0), 0), 0);
+	assert_int_equal(bt_poll(&ev, 1, OS_SECONDS(5)), 0);
+	assert_int_equal(ev.state, BT_POLL_STATE_FIFO_DATA_AVAILABLE);
+	assert_int_equal(os_thread_join(&th, OS_TIMEOUT_FOREVER), 0);
+	assert_ptr_equal(bt_queue_get(&q, OS_TIMEOUT_NO_WAIT), &a);
+
+	/* ... and reports cancellation */
+	bt_poll_event_init(&ev, BT_POLL_TYPE_FIFO_DATA_AVAILABLE, BT_POLL_MODE_NOTIFY_ONLY, &q);
+	assert_int_equal(
+		os_thread_create(&th, delayed_cancel_thread, &da, "cancel", OS_PRIORITY(0), 0), 0);
+	assert_int_equal(bt_poll(&ev, 1, OS_SECONDS(5)), 0);
+	assert_int_equal(ev.state, BT_POLL_STATE_CANCELLED);
+	assert_int_equal(os_thread_join(&th, OS_TIMEOUT_FOREVER), 0);
+
+	/* A blocked get returns NULL when cancelled */
+	assert_int_equal(os_thread_create(&th, blocked_get_thread, &da, "get", OS_PRIORITY(0), 0),
+			 0);
+	while (!bt_atomic_get(&q.waiters)) {
+		os_sleep_ms(1);
+	}
+	bt_queue_cancel_wait(&q);
+	assert_int_equal(os_thread_join(&th, OS_TIMEOUT_FOREVER), 0);
+	assert_null(da.got);
+	assert_true(bt_queue_is_empty(&q));
+}
+
+#define BENCH_ITERS (M_ITERS * 20)
+
+struct bench_arg {
+	struct bt_queue *q;
+	struct prod_item *items;
+};
+
+static void bench_producer_thread(void *arg)
+{
+	struct bench_arg *ba = arg;
+
+	for (int i = 0; i < BENCH_ITERS; ++i) {
+		bt_queue_append(ba->q, &ba->items[i]);
+	}
+}
+
+static uint64_t bench_run(void **state)
+{
+	static struct prod_item items[N_THREADS][BENCH_ITERS];
+	struct bench_arg args[N_THREADS];
+	os_thread_t th[N_THREADS];
+	struct bt_queue q;
+	uint64_t start;
+
+	queue_init(&q, state);
+	start = os_time_get_ms();
+	for (int p = 0; p < N_THREADS; ++p) {
+		args[p].q = &q;
+		args[p].items = items[p];
+		assert_int_equal(os_thread_create(&th[p], bench_producer_thread, &args[p], "bench",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	for (int n = 0; n < N_THREADS * BENCH_ITERS; ++n) {
+		assert_non_null(bt_queue_get(&q, OS_TIMEOUT_FOREVER));
+	}
+	for (int p = 0; p < N_THREADS; ++p) {
+		assert_int_equal(os_thread_join(&th[p], OS_TIMEOUT_FOREVER), 0);
+	}
+	assert_true(bt_queue_is_empty(&q));
+
+	return os_time_get_ms() - start;
+}
+
+static void test_queue_contention_bench(void **state)
+{
+	void *locked = &locked_mode;
+	void *mpsc = &mpsc_mode;
+	uint64_t locked_ms = bench_run(&locked);
+	uint64_t mpsc_ms = bench_run(&mpsc);
+
+	(void)state;
+	print_message("%d producers x %d items: locked %llu ms, mpsc %llu ms\n", N_THREADS,
+		      BENCH_ITERS, (unsigned long long)locked_ms, (unsigned long long)mpsc_ms);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
-		cmocka_unit_test(test_queue_basic_ops),
-		cmocka_unit_test(test_queue_producers_consumers),
-		cmocka_unit_test(test_queue_unique_append_concurrent),
+		cmocka_unit_test_prestate(test_queue_basic_ops, &locked_mode),
+		cmocka_unit_test_prestate(test_queue_basic_ops, &mpsc_mode),
+		cmocka_unit_test(test_queue_mpsc_unlinked_producer),
+		cmocka_unit_test_prestate(test_queue_producers_consumers, &locked_mode),
+		cmocka_unit_test_prestate(test_queue_producers_consumers, &mpsc_mode),
+		/* MPSC unique_append is consumer-only, so only the locked variant races it */
+		cmocka_unit_test_prestate(test_queue_unique_append_concurrent, &locked_mode),
+		cmocka_unit_test_prestate(test_queue_poll_and_cancel, &locked_mode),
+		cmocka_unit_test_prestate(test_queue_poll_and_cancel, &mpsc_mode),
+		cmocka_unit_test(test_queue_contention_bench),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
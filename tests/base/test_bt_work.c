@@ -257,6 +257,126 @@ static void test_delayable_concurrent(void **state)
 	assert_int_equal(bt_work_queue_stop(&q, OS_TIMEOUT_FOREVER), 0);
 }
 
+/* ===== Multi-worker queue tests ===== */
+#define MW_WORKERS 4
+#define MW_ITEMS   8
+#define MW_ROUNDS  400
+
+struct mw_item {
+	struct bt_work work;
+	atomic_int in_flight;
+	atomic_int runs;
+};
+
+static atomic_int mw_overlaps;
+static atomic_int mw_running;
+static atomic_int mw_max_running;
+
+static void mw_handler(struct bt_work *work)
+{
+	struct mw_item *item = CONTAINER_OF(work, struct mw_item, work);
+	int running = atomic_fetch_add(&mw_running, 1) + 1;
+	int max = atomic_load(&mw_max_running);
+
+	while (running > max && !atomic_compare_exchange_weak(&mw_max_running, &max, running)) {
+	}
+
+	if (atomic_fetch_add(&item->in_flight, 1) != 0) {
+		atomic_fetch_add(&mw_overlaps, 1);
+	}
+	os_sleep_ms(1);
+	atomic_fetch_sub(&item->in_flight, 1);
+	atomic_fetch_add(&item->runs, 1);
+	atomic_fetch_sub(&mw_running, 1);
+}
+
+struct mw_submit_arg {
+	struct bt_work_q *q[2];
+	struct mw_item *items;
+	unsigned int seed;
+};
+
+static void mw_submit_thread(void *arg)
+{
+	struct mw_submit_arg *sa = (struct mw_submit_arg *)arg;
+
+	for (int i = 0; i < MW_ROUNDS; i++) {
+		sa->seed = sa->seed * 1103515245u + 12345u;
+		struct mw_item *item = &sa->items[(sa->seed >> 8) % MW_ITEMS];
+		/* Mostly the multi-worker queue, sometimes the second one */
+		struct bt_work_q *q = ((sa->seed >> 4) % 8) == 0 ? sa->q[1] : sa->q[0];
+		int rc = bt_work_submit_to_queue(q, &item->work);
+
+		assert_true(rc >= 0);
+		if ((i % 64) == 0) {
+			struct bt_work_sync sync;
+
+			/* Other submitters may queue it again right away */
+			(void)bt_work_flush(&item->work, &sync);
+		}
+	}
+}
+
+static void test_work_queue_multi_worker(void **state)
+{
+	(void)state;
+	struct bt_work_q q, q2;
+	struct mw_item items[MW_ITEMS];
+	os_thread_t th[N_THREADS];
+	struct mw_submit_arg args[N_THREADS];
+	const struct bt_work_queue_config cfg = {
+		.name = "mwq",
+		.num_workers = MW_WORKERS,
+	};
+	const struct bt_work_queue_config cfg2 = {.name = "mwq2"};
+
+	atomic_store(&mw_overlaps, 0);
+	atomic_store(&mw_running, 0);
+	atomic_store(&mw_max_running, 0);
+
+	bt_work_queue_init(&q);
+	bt_work_queue_init(&q2);
+	bt_work_queue_start(&q, 2048, OS_PRIORITY(0), &cfg);
+	bt_work_queue_start(&q2, 2048, OS_PRIORITY(0), &cfg2);
+
+	for (int i = 0; i < MW_ITEMS; i++) {
+		bt_work_init(&items[i].work, mw_handler);
+		atomic_store(&items[i].in_flight, 0);
+		atomic_store(&items[i].runs, 0);
+	}
+
+	for (int i = 0; i < N_THREADS; i++) {
+		args[i].q[0] = &q;
+		args[i].q[1] = &q2;
+		args[i].items = items;
+		args[i].seed = 0x9e3779b9u * (i + 1);
+		assert_int_equal(os_thread_create(&th[i], mw_submit_thread, &args[i], "mwsub",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	for (int i = 0; i < N_THREADS; i++) {
+		assert_int_equal(os_thread_join(&th[i], OS_TIMEOUT_FOREVER), 0);
+	}
+
+	for (int i = 0; i < MW_ITEMS; i++) {
+		struct bt_work_sync sync;
+
+		(void)bt_work_flush(&items[i].work, &sync);
+		assert_int_equal(bt_work_busy_get(&items[i].work), 0);
+		assert_true(atomic_load(&items[i].runs) > 0);
+	}
+
+	/* Distinct items ran in parallel, no item ever overlapped itself */
+	assert_int_equal(atomic_load(&mw_overlaps), 0);
+	assert_true(atomic_load(&mw_max_running) > 1);
+	assert_true(atomic_load(&mw_max_running) <= MW_WORKERS + 1);
+
+	assert_int_equal(bt_work_queue_drain(&q, true), 0);
+	assert_int_equal(bt_work_queue_stop(&q, OS_TIMEOUT_FOREVER), 0);
+	assert_int_equal(bt_work_queue_drain(&q2, true), 0);
+	assert_int_equal(bt_work_queue_stop(&q2, OS_TIMEOUT_FOREVER), 0);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -264,6 +384,7 @@ int main(void)
 		cmocka_unit_test(test_delayable_schedule_reschedule_and_cancel),
 		cmocka_unit_test(test_work_submit_concurrent),
 		cmocka_unit_test(test_delayable_concurrent),
+		cmocka_unit_test(test_work_queue_multi_worker),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,485 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <osdep/os.h>
+
+#include "drivers/h4_rx.h"
+
+#define RX_BUF_SIZE 4096
+#define MAX_FRAMES  16
+
+BT_BUF_POOL_DEFINE(rx_pool, 8, RX_BUF_SIZE, 0, NULL);
+
+struct rx_log {
+	bool no_buf;   /* Make alloc fail */
+	bool keep;     /* Record frames, otherwise just count them */
+	int count;
+	uint64_t bytes;
+	size_t len[MAX_FRAMES];
+	uint8_t data[MAX_FRAMES][RX_BUF_SIZE];
+};
+
+static struct rx_log rx_log;
+
+/* Mirrors bt_buf_get_rx(): the buffer starts with the H4 type */
+static struct bt_buf *log_alloc(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct rx_log *log = user_data;
+	struct bt_buf *buf;
+
+	if (log->no_buf) {
+		return NULL;
+	}
+
+	buf = bt_buf_alloc_fixed(&rx_pool, OS_TIMEOUT_NO_WAIT);
+	if (buf) {
+		bt_buf_add_u8(buf, frame[0]);
+	}
+
+	return buf;
+}
+
+static void log_recv(struct bt_buf *buf, void *user_data)
+{
+	struct rx_log *log = user_data;
+
+	if (log->keep && log->count < MAX_FRAMES) {
+		memcpy(log->data[log->count], buf->data, buf->len);
+		log->len[log->count] = buf->len;
+	}
+	log->count++;
+	log->bytes += buf->len;
+	bt_buf_unref(buf);
+}
+
+/* Event: Command Complete, 4 byte payload */
+static const uint8_t pkt_evt[] = {0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00};
+/* ACL: handle 0x0001, 5 byte payload (little-endian length) */
+static const uint8_t pkt_acl[] = {0x02, 0x01, 0x20, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05};
+/* SCO: handle 0x0002, 3 byte payload */
+static const uint8_t pkt_sco[] = {0x03, 0x02, 0x00, 0x03, 0xaa, 0xbb, 0xcc};
+/* ISO: handle 0x0003, PB/TS flags set, 2 byte payload; upper length bits are RFU */
+static const uint8_t pkt_iso[] = {0x05, 0x03, 0x60, 0x02, 0xc0, 0x11, 0x22};
+
+static const struct {
+	const uint8_t *data;
+	size_t len;
+} pkts[] = {
+	{pkt_evt, sizeof(pkt_evt)},
+	{pkt_acl, sizeof(pkt_acl)},
+	{pkt_sco, sizeof(pkt_sco)},
+	{pkt_iso, sizeof(pkt_iso)},
+};
+
+#define N_PKTS (sizeof(pkts) / sizeof(pkts[0]))
+
+static size_t make_acl(uint8_t *out, uint16_t payload_len, uint8_t seed)
+{
+	out[0] = 0x02;
+	out[1] = 0x01;
+	out[2] = 0x20;
+	out[3] = payload_len & 0xff;
+	out[4] = payload_len >> 8;
+	for (size_t i = 0; i < payload_len; i++) {
+		out[5 + i] = (uint8_t)(seed + i);
+	}
+
+	return 5 + payload_len;
+}
+
+static void expect_frame(int idx, const uint8_t *data, size_t len)
+{
+	assert_int_equal(rx_log.len[idx], len);
+	assert_memory_equal(rx_log.data[idx], data, len);
+}
+
+static void expect_all_pkts(int first)
+{
+	for (size_t i = 0; i < N_PKTS; i++) {
+		expect_frame(first + i, pkts[i].data, pkts[i].len);
+	}
+}
+
+static int setup(void **state)
+{
+	(void)state;
+	memset(&rx_log, 0, sizeof(rx_log));
+	rx_log.keep = true;
+	return 0;
+}
+
+static void test_frame_len(void **state)
+{
+	(void)state;
+
+	for (size_t i = 0; i < N_PKTS; i++) {
+		for (size_t n = 0; n < pkts[i].len; n++) {
+			assert_int_equal(h4_rx_frame_len(pkts[i].data, n), 0);
+		}
+		assert_int_equal(h4_rx_frame_len(pkts[i].data, pkts[i].len), pkts[i].len);
+	}
+
+	const uint8_t bad[] = {0x42, 0x00, 0x00};
+
+	assert_int_equal(h4_rx_frame_len(bad, sizeof(bad)), -EBADMSG);
+}
+
+static void test_stream_split_and_coalesced(void **state)
+{
+	(void)state;
+	static struct h4_rx rx;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+	assert_false(rx.datagram);
+
+	/* Nothing queued: returns without blocking */
+	assert_int_equal(h4_rx_drain(&rx), 0);
+
+	/* One byte at a time: a frame is only delivered once complete */
+	for (size_t i = 0; i < N_PKTS; i++) {
+		for (size_t n = 0; n < pkts[i].len; n++) {
+			assert_int_equal(write(sv[1], &pkts[i].data[n], 1), 1);
+			assert_int_equal(h4_rx_drain(&rx), n + 1 == pkts[i].len ? 1 : 0);
+		}
+	}
+	assert_int_equal(rx_log.count, 4);
+	expect_all_pkts(0);
+
+	/* All four in one write, plus half of a fifth frame */
+	uint8_t burst[64];
+	size_t len = 0;
+
+	for (size_t i = 0; i < N_PKTS; i++) {
+		memcpy(&burst[len], pkts[i].data, pkts[i].len);
+		len += pkts[i].len;
+	}
+	memcpy(&burst[len], pkt_acl, 7);
+	len += 7;
+
+	assert_int_equal(write(sv[1], burst, len), (ssize_t)len);
+	assert_int_equal(h4_rx_drain(&rx), 4);
+	expect_all_pkts(4);
+
+	assert_int_equal(write(sv[1], &pkt_acl[7], sizeof(pkt_acl) - 7), sizeof(pkt_acl) - 7);
+	assert_int_equal(h4_rx_drain(&rx), 1);
+	expect_frame(8, pkt_acl, sizeof(pkt_acl));
+	assert_int_equal(rx.stats.frames, 9);
+	assert_int_equal(rx.stats.dropped, 0);
+
+	/* Peer close is reported once everything queued was delivered */
+	close(sv[1]);
+	assert_int_equal(h4_rx_drain(&rx), -ECONNRESET);
+	close(sv[0]);
+}
+
+static void test_stream_large_frames_direct(void **state)
+{
+	(void)state;
+	static struct h4_rx rx;
+	static uint8_t big[2][RX_BUF_SIZE];
+	size_t big_len[2];
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+
+	/* Well beyond the old 1021 byte frame limit */
+	big_len[0] = make_acl(big[0], 3000, 1);
+	big_len[1] = make_acl(big[1], RX_BUF_SIZE - 5, 7);
+
+	for (int f = 0; f < 2; f++) {
+		/* Header and a little payload first, then the rest in chunks */
+		assert_int_equal(write(sv[1], big[f], 9), 9);
+		assert_int_equal(h4_rx_drain(&rx), 0);
+		for (size_t off = 9; off < big_len[f]; off += 1000) {
+			size_t n = big_len[f] - off < 1000 ? big_len[f] - off : 1000;
+
+			assert_int_equal(write(sv[1], &big[f][off], n), (ssize_t)n);
+			assert_int_equal(h4_rx_drain(&rx), off + n == big_len[f] ? 1 : 0);
+		}
+		expect_frame(f, big[f], big_len[f]);
+	}
+
+	/* Only the header and the bytes that shared its read went through staging */
+	assert_int_equal(rx.stats.bytes_copied, 2 * 8);
+	assert_int_equal(rx.stats.bytes_direct, big_len[0] + big_len[1] - 2 * 9);
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+static void test_stream_drop_and_resync(void **state)
+{
+	(void)state;
+	static struct h4_rx rx;
+	static uint8_t big[RX_BUF_SIZE + 64];
+	const uint8_t junk[] = {0x42, 0x01, 0x02};
+	size_t len;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+
+	/* Unknown packet type: everything buffered is dropped */
+	assert_int_equal(write(sv[1], junk, sizeof(junk)), sizeof(junk));
+	assert_int_equal(h4_rx_drain(&rx), 0);
+	assert_int_equal(rx.stats.dropped, 1);
+	assert_int_equal(rx.staged, 0);
+
+	/* Larger than the buffer: skipped without losing framing */
+	len = make_acl(big, RX_BUF_SIZE + 16, 3);
+	assert_int_equal(write(sv[1], big, len), (ssize_t)len);
+	assert_int_equal(write(sv[1], pkt_evt, sizeof(pkt_evt)), sizeof(pkt_evt));
+	assert_int_equal(h4_rx_drain(&rx), 1);
+	assert_int_equal(rx.stats.oversize, 1);
+	expect_frame(0, pkt_evt, sizeof(pkt_evt));
+
+	/* No buffer available: the frame is consumed and dropped */
+	rx_log.no_buf = true;
+	assert_int_equal(write(sv[1], pkt_acl, sizeof(pkt_acl)), sizeof(pkt_acl));
+	assert_int_equal(h4_rx_drain(&rx), 0);
+	assert_int_equal(rx.stats.no_buf, 1);
+	rx_log.no_buf = false;
+
+	assert_int_equal(write(sv[1], pkt_iso, sizeof(pkt_iso)), sizeof(pkt_iso));
+	assert_int_equal(h4_rx_drain(&rx), 1);
+	expect_frame(1, pkt_iso, sizeof(pkt_iso));
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+static void test_feed(void **state)
+{
+	(void)state;
+	static struct h4_rx rx;
+	static uint8_t stream[3 * RX_BUF_SIZE];
+	size_t len = 0;
+	int sv[2];
+
+	/* Stream: the same bytes in every chunk size arrive as the same frames */
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	for (size_t i = 0; i < N_PKTS; i++) {
+		memcpy(&stream[len], pkts[i].data, pkts[i].len);
+		len += pkts[i].len;
+	}
+	len += make_acl(&stream[len], 1500, 7);
+
+	for (size_t chunk = 1; chunk < len; chunk = chunk * 3 + 1) {
+		size_t frames = 0;
+
+		memset(&rx_log, 0, sizeof(rx_log));
+		rx_log.keep = true;
+		assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+
+		for (size_t off = 0; off < len; off += chunk) {
+			frames += h4_rx_feed(&rx, &stream[off], MIN(chunk, len - off));
+		}
+
+		assert_int_equal(frames, N_PKTS + 1);
+		expect_all_pkts(0);
+		expect_frame(N_PKTS, &stream[len - 1505], 1505);
+		assert_int_equal(rx.stats.reads, 0);
+	}
+	close(sv[0]);
+	close(sv[1]);
+
+	/* Datagram: one packet per call, anything else is dropped */
+	memset(&rx_log, 0, sizeof(rx_log));
+	rx_log.keep = true;
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+
+	assert_int_equal(h4_rx_feed(&rx, pkt_evt, sizeof(pkt_evt) - 1), 0);
+	assert_int_equal(h4_rx_feed(&rx, stream, pkts[0].len + pkts[1].len), 0);
+	for (size_t i = 0; i < N_PKTS; i++) {
+		assert_int_equal(h4_rx_feed(&rx, pkts[i].data, pkts[i].len), 1);
+	}
+	expect_all_pkts(0);
+	assert_int_equal(rx.stats.dropped, 2);
+
+	rx_log.no_buf = true;
+	assert_int_equal(h4_rx_feed(&rx, pkt_acl, sizeof(pkt_acl)), 0);
+	assert_int_equal(rx.stats.no_buf, 1);
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static void test_datagram(void **state)
+{
+	(void)state;
+	static struct h4_rx rx;
+	static uint8_t big[RX_BUF_SIZE + 64];
+	const uint8_t junk[] = {0x42, 0x01, 0x02};
+	size_t big_len;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+	assert_true(rx.datagram);
+
+	assert_int_equal(h4_rx_drain(&rx), 0);
+
+	for (size_t i = 0; i < N_PKTS; i++) {
+		assert_int_equal(send(sv[1], pkts[i].data, pkts[i].len, 0), pkts[i].len);
+	}
+	big_len = make_acl(big, 3000, 5);
+	assert_int_equal(send(sv[1], big, big_len, 0), (ssize_t)big_len);
+
+	assert_int_equal(h4_rx_drain(&rx), 5);
+	expect_all_pkts(0);
+	expect_frame(4, big, big_len);
+	assert_int_equal(rx.stats.bytes_direct, (sizeof(pkt_acl) - 1) + (sizeof(pkt_sco) - 1) +
+							(sizeof(pkt_iso) - 1) + (big_len - 1));
+	assert_int_equal(rx.stats.bytes_copied, sizeof(pkt_evt) - 1);
+
+	/* Bad type, short payload, oversized and no buffer are each dropped alone */
+	assert_int_equal(send(sv[1], junk, sizeof(junk), 0), sizeof(junk));
+	assert_int_equal(send(sv[1], pkt_acl, sizeof(pkt_acl) - 2, 0), sizeof(pkt_acl) - 2);
+	big_len = make_acl(big, RX_BUF_SIZE + 16, 5);
+	assert_int_equal(send(sv[1], big, big_len, 0), (ssize_t)big_len);
+	assert_int_equal(send(sv[1], pkt_evt, sizeof(pkt_evt), 0), sizeof(pkt_evt));
+	assert_int_equal(h4_rx_drain(&rx), 1);
+	expect_frame(5, pkt_evt, sizeof(pkt_evt));
+	assert_int_equal(rx.stats.dropped, 2);
+	assert_int_equal(rx.stats.oversize, 1);
+
+	rx_log.no_buf = true;
+	assert_int_equal(send(sv[1], pkt_acl, sizeof(pkt_acl), 0), sizeof(pkt_acl));
+	assert_int_equal(send(sv[1], pkt_evt, sizeof(pkt_evt), 0), sizeof(pkt_evt));
+	assert_int_equal(h4_rx_drain(&rx), 0);
+	assert_int_equal(rx.stats.no_buf, 2);
+	rx_log.no_buf = false;
+
+	assert_int_equal(send(sv[1], pkt_sco, sizeof(pkt_sco), 0), sizeof(pkt_sco));
+	assert_int_equal(h4_rx_drain(&rx), 1);
+	expect_frame(6, pkt_sco, sizeof(pkt_sco));
+
+	close(sv[1]);
+	assert_int_equal(h4_rx_drain(&rx), -ECONNRESET);
+	close(sv[0]);
+}
+
+/* ----------------------- Throughput ----------------------- */
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+struct bench_arg {
+	int fd;
+	const uint8_t *stream;
+	size_t len;
+	size_t total;
+};
+
+static void bench_writer(void *arg)
+{
+	struct bench_arg *ba = arg;
+	size_t sent = 0;
+
+	while (sent < ba->total) {
+		size_t off = sent % ba->len;
+		ssize_t n = write(ba->fd, ba->stream + off, ba->len - off);
+
+		if (n <= 0) {
+			break;
+		}
+		sent += n;
+	}
+	close(ba->fd);
+}
+
+static void bench_run(uint16_t payload_len)
+{
+	static uint8_t stream[64 * 1024];
+	static struct h4_rx rx;
+	struct bench_arg ba;
+	struct pollfd pfd;
+	os_thread_t th;
+	uint64_t start_ns;
+	uint64_t elapsed_ns;
+	size_t frame_len = 5 + payload_len;
+	int sv[2];
+	int ret;
+
+	/* A whole number of frames so the stream wraps on a frame boundary */
+	ba.len = 0;
+	while (ba.len + frame_len <= sizeof(stream)) {
+		ba.len += make_acl(&stream[ba.len], payload_len, (uint8_t)ba.len);
+	}
+	ba.stream = stream;
+	ba.total = (BENCH_BYTES / ba.len) * ba.len;
+
+	memset(&rx_log, 0, sizeof(rx_log));
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&rx, sv[0], log_alloc, log_recv, &rx_log), 0);
+	ba.fd = sv[1];
+
+	start_ns = os_time_get_ns();
+	assert_int_equal(os_thread_create(&th, bench_writer, &ba, "h4_bench", OS_PRIORITY(0), 0),
+			 0);
+
+	pfd.fd = sv[0];
+	pfd.events = POLLIN;
+	do {
+		assert_true(poll(&pfd, 1, -1) >= 0);
+		ret = h4_rx_drain(&rx);
+	} while (ret >= 0);
+
+	elapsed_ns = os_time_get_ns() - start_ns;
+	assert_int_equal(ret, -ECONNRESET);
+	assert_int_equal(os_thread_join(&th, OS_TIMEOUT_FOREVER), 0);
+	assert_int_equal(rx_log.bytes, ba.total);
+	assert_int_equal(rx.stats.dropped + rx.stats.no_buf + rx.stats.oversize, 0);
+
+	print_message("ACL %4u B: %6.1f MB/s, %7u frames, %6u reads, %3u%% copied\n",
+		      payload_len, (double)ba.total * 1000.0 / (double)elapsed_ns,
+		      rx.stats.frames, rx.stats.reads,
+		      (unsigned int)(rx.stats.bytes_copied * 100 /
+				     (rx.stats.bytes_copied + rx.stats.bytes_direct)));
+	close(sv[0]);
+}
+
+static void test_throughput_bench(void **state)
+{
+	(void)state;
+
+	bench_run(27);
+	bench_run(251);
+	bench_run(1021);
+	bench_run(4000);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_frame_len, setup),
+		cmocka_unit_test_setup(test_stream_split_and_coalesced, setup),
+		cmocka_unit_test_setup(test_stream_large_frames_direct, setup),
+		cmocka_unit_test_setup(test_stream_drop_and_resync, setup),
+		cmocka_unit_test_setup(test_datagram, setup),
+		cmocka_unit_test_setup(test_feed, setup),
+		cmocka_unit_test(test_throughput_bench),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <osdep/os.h>
+
+#include "drivers/h4_rx.h"
+#include "drivers/h4_tx.h"
+
+#define PKT_PAYLOAD 32
+#define PKT_LEN     (5 + PKT_PAYLOAD)
+
+BT_BUF_POOL_DEFINE(tx_pool, 64, PKT_LEN, 0, NULL);
+
+/* ACL packet carrying the producer id and a sequence number */
+static struct bt_buf *make_pkt(uint8_t producer, uint32_t seq)
+{
+	struct bt_buf *buf = bt_buf_alloc_fixed(&tx_pool, OS_TIMEOUT_FOREVER);
+	uint8_t *p;
+
+	assert_non_null(buf);
+	p = bt_buf_add(buf, PKT_LEN);
+	p[0] = 0x02;
+	p[1] = producer;
+	p[2] = 0x00;
+	p[3] = PKT_PAYLOAD;
+	p[4] = 0x00;
+	memcpy(&p[5], &seq, sizeof(seq));
+	memset(&p[5 + sizeof(seq)], producer, PKT_PAYLOAD - sizeof(seq));
+
+	return buf;
+}
+
+static void check_pkt(const uint8_t *p, uint32_t *next_seq)
+{
+	uint32_t seq;
+
+	assert_int_equal(h4_rx_frame_len(p, PKT_LEN), PKT_LEN);
+	memcpy(&seq, &p[5], sizeof(seq));
+	assert_int_equal(seq, next_seq[p[1]]);
+	next_seq[p[1]]++;
+}
+
+static size_t read_full(int fd, uint8_t *data, size_t len)
+{
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n = read(fd, data + got, len - got);
+
+		if (n <= 0) {
+			break;
+		}
+		got += n;
+	}
+
+	return got;
+}
+
+static void test_stream_order_and_stats(void **state)
+{
+	(void)state;
+	static struct h4_tx tx;
+	uint8_t pkt[PKT_LEN];
+	uint32_t next_seq[1] = {0};
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+	assert_true(tx.socket);
+	assert_false(tx.datagram);
+
+	for (uint32_t i = 0; i < 10; i++) {
+		h4_tx_send(&tx, make_pkt(0, i));
+	}
+
+	for (int i = 0; i < 10; i++) {
+		assert_int_equal(read_full(sv[1], pkt, sizeof(pkt)), sizeof(pkt));
+		check_pkt(pkt, next_seq);
+	}
+
+	assert_int_equal(tx.stats.packets, 10);
+	assert_int_equal(tx.stats.bytes, 10 * PKT_LEN);
+	assert_int_equal(tx.stats.syscalls, 10);
+	assert_int_equal(tx.stats.errors, 0);
+	assert_true(bt_queue_is_empty(&tx.queue));
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+static void test_batch_one_write(void **state)
+{
+	(void)state;
+	static struct h4_tx tx;
+	struct bt_buf *bufs[8];
+	uint8_t pkt[PKT_LEN];
+	uint32_t next_seq[1] = {0};
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+
+	for (uint32_t i = 0; i < ARRAY_SIZE(bufs); i++) {
+		bufs[i] = make_pkt(0, i);
+	}
+	h4_tx_send_batch(&tx, bufs, ARRAY_SIZE(bufs));
+
+	for (int i = 0; i < ARRAY_SIZE(bufs); i++) {
+		assert_int_equal(read_full(sv[1], pkt, sizeof(pkt)), sizeof(pkt));
+		check_pkt(pkt, next_seq);
+	}
+
+	/* Queued before the flush, so written together */
+	assert_int_equal(tx.stats.packets, ARRAY_SIZE(bufs));
+	assert_int_equal(tx.stats.syscalls, 1);
+	assert_true(bt_queue_is_empty(&tx.queue));
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+static void test_datagram_one_packet_per_message(void **state)
+{
+	(void)state;
+	static struct h4_tx tx;
+	uint8_t pkt[PKT_LEN * 2];
+	uint32_t next_seq[1] = {0};
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+	assert_true(tx.datagram);
+
+	for (uint32_t i = 0; i < 5; i++) {
+		h4_tx_send(&tx, make_pkt(0, i));
+	}
+
+	for (int i = 0; i < 5; i++) {
+		assert_int_equal(recv(sv[1], pkt, sizeof(pkt), 0), PKT_LEN);
+		check_pkt(pkt, next_seq);
+	}
+	assert_int_equal(tx.stats.packets, 5);
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+static void test_write_error_drops(void **state)
+{
+	(void)state;
+	static struct h4_tx tx;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+	close(sv[1]);
+
+	/* No SIGPIPE, the buffer is consumed and the error recorded */
+	h4_tx_send(&tx, make_pkt(0, 0));
+	assert_int_equal(tx.err, -EPIPE);
+	assert_int_equal(tx.stats.errors, 1);
+	assert_int_equal(tx.stats.packets, 0);
+
+	close(sv[0]);
+}
+
+/* ----------------------- Coalescing under backpressure ----------------------- */
+
+#define N_PRODUCERS 4
+#define N_PKTS      5000
+
+struct producer_arg {
+	struct h4_tx *tx;
+	uint8_t id;
+};
+
+static void producer_thread(void *arg)
+{
+	struct producer_arg *pa = arg;
+
+	for (uint32_t i = 0; i < N_PKTS; i++) {
+		h4_tx_send(pa->tx, make_pkt(pa->id, i));
+	}
+}
+
+static void reader_thread(void *arg)
+{
+	int fd = *(int *)arg;
+	static uint8_t pkt[PKT_LEN];
+	uint32_t next_seq[N_PRODUCERS] = {0};
+
+	/* Let the socket fill up so senders hit EAGAIN and the queue builds */
+	os_sleep_ms(20);
+
+	for (int i = 0; i < N_PRODUCERS * N_PKTS; i++) {
+		assert_int_equal(read_full(fd, pkt, sizeof(pkt)), sizeof(pkt));
+		check_pkt(pkt, next_seq);
+	}
+}
+
+static void test_coalescing_backpressure(void **state)
+{
+	(void)state;
+	static struct h4_tx tx;
+	struct producer_arg pa[N_PRODUCERS];
+	os_thread_t prod[N_PRODUCERS];
+	os_thread_t reader;
+	int sndbuf = 4096;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)), 0);
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+
+	assert_int_equal(os_thread_create(&reader, reader_thread, &sv[1], "h4_reader",
+					  OS_PRIORITY(0), 0),
+			 0);
+	for (int p = 0; p < N_PRODUCERS; p++) {
+		pa[p].tx = &tx;
+		pa[p].id = p;
+		assert_int_equal(os_thread_create(&prod[p], producer_thread, &pa[p], "h4_producer",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+
+	for (int p = 0; p < N_PRODUCERS; p++) {
+		assert_int_equal(os_thread_join(&prod[p], OS_TIMEOUT_FOREVER), 0);
+	}
+	assert_int_equal(os_thread_join(&reader, OS_TIMEOUT_FOREVER), 0);
+
+	assert_int_equal(tx.stats.packets, N_PRODUCERS * N_PKTS);
+	assert_int_equal(tx.stats.errors, 0);
+	assert_true(tx.stats.waits > 0);
+	/* Packets queued while the socket was full went out together */
+	assert_true(tx.stats.syscalls < tx.stats.packets);
+	assert_true(bt_queue_is_empty(&tx.queue));
+
+	print_message("%d producers x %d packets: %.2f syscalls/packet, %.0f bytes/syscall, "
+		      "%u POLLOUT waits\n",
+		      N_PRODUCERS, N_PKTS, (double)tx.stats.syscalls / tx.stats.packets,
+		      (double)tx.stats.bytes / tx.stats.syscalls, tx.stats.waits);
+
+	close(sv[1]);
+	close(sv[0]);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_stream_order_and_stats),
+		cmocka_unit_test(test_batch_one_write),
+		cmocka_unit_test(test_datagram_one_packet_per_message),
+		cmocka_unit_test(test_write_error_drops),
+		cmocka_unit_test(test_coalescing_backpressure),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
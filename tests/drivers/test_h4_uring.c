@@ -0,0 +1,745 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <base/byteorder.h>
+#include <base/queue/bt_queue.h>
+#include <osdep/os.h>
+
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/loopback.h>
+
+#include "drivers/hci_sock.h"
+
+#if defined(CONFIG_BT_H4_IO_URING)
+
+#include "drivers/h4_uring.h"
+
+#define MAX_FRAMES   16
+#define BURST_FRAMES 200
+
+BT_BUF_POOL_DEFINE(rx_pool, 16, 300, 0, NULL);
+BT_BUF_POOL_DEFINE(tx_pool, 16, 300, 0, NULL);
+
+struct rx_log {
+	pthread_mutex_t lock;
+	int count;
+	size_t len[MAX_FRAMES];
+	uint8_t data[MAX_FRAMES][300];
+};
+
+static struct bt_buf *log_alloc(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct bt_buf *buf = bt_buf_alloc_fixed(&rx_pool, OS_TIMEOUT_NO_WAIT);
+
+	if (buf) {
+		bt_buf_add_u8(buf, frame[0]);
+	}
+
+	return buf;
+}
+
+static void log_recv(struct bt_buf *buf, void *user_data)
+{
+	struct rx_log *log = user_data;
+
+	pthread_mutex_lock(&log->lock);
+	if (log->count < MAX_FRAMES) {
+		memcpy(log->data[log->count], buf->data, buf->len);
+		log->len[log->count] = buf->len;
+	}
+	log->count++;
+	pthread_mutex_unlock(&log->lock);
+	bt_buf_unref(buf);
+}
+
+/* Event: Command Complete, 4 byte payload */
+static const uint8_t pkt_evt[] = {0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00};
+/* ACL: handle 0x0001, 5 byte payload (little-endian length) */
+static const uint8_t pkt_acl[] = {0x02, 0x01, 0x20, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05};
+/* SCO: handle 0x0002, 3 byte payload */
+static const uint8_t pkt_sco[] = {0x03, 0x02, 0x00, 0x03, 0xaa, 0xbb, 0xcc};
+/* ISO: handle 0x0003, PB/TS flags set, 2 byte payload */
+static const uint8_t pkt_iso[] = {0x05, 0x03, 0x60, 0x02, 0xc0, 0x11, 0x22};
+
+static const struct {
+	const uint8_t *data;
+	size_t len;
+} pkts[] = {
+	{pkt_evt, sizeof(pkt_evt)},
+	{pkt_acl, sizeof(pkt_acl)},
+	{pkt_sco, sizeof(pkt_sco)},
+	{pkt_iso, sizeof(pkt_iso)},
+};
+
+#define NUM_PKTS (sizeof(pkts) / sizeof(pkts[0]))
+
+static void expect_all_pkts(struct rx_log *log, int first)
+{
+	for (size_t i = 0; i < NUM_PKTS; i++) {
+		assert_int_equal(log->len[first + i], pkts[i].len);
+		assert_memory_equal(log->data[first + i], pkts[i].data, pkts[i].len);
+	}
+}
+
+struct loop_ctx {
+	int stop_fd;
+	struct h4_rx rx;
+	struct rx_log log;
+	int ret;
+};
+
+static void *loop_thread(void *arg)
+{
+	struct loop_ctx *ctx = arg;
+
+	ctx->ret = h4_uring_rx_loop(&ctx->rx, ctx->stop_fd);
+	return NULL;
+}
+
+static int log_count(struct rx_log *log)
+{
+	int count;
+
+	pthread_mutex_lock(&log->lock);
+	count = log->count;
+	pthread_mutex_unlock(&log->lock);
+	return count;
+}
+
+static void wait_count(struct rx_log *log, int count)
+{
+	for (int i = 0; i < 2000 && log_count(log) < count; i++) {
+		usleep(1000);
+	}
+	assert_int_equal(log_count(log), count);
+}
+
+static void loop_start(struct loop_ctx *ctx, pthread_t *thread, int fd)
+{
+	memset(&ctx->log, 0, sizeof(ctx->log));
+	pthread_mutex_init(&ctx->log.lock, NULL);
+	assert_int_equal(h4_rx_init(&ctx->rx, fd, log_alloc, log_recv, &ctx->log), 0);
+	ctx->stop_fd = eventfd(0, EFD_CLOEXEC);
+	assert_true(ctx->stop_fd >= 0);
+	ctx->ret = 1;
+	assert_int_equal(pthread_create(thread, NULL, loop_thread, ctx), 0);
+}
+
+static void loop_stop(struct loop_ctx *ctx, pthread_t thread)
+{
+	assert_int_equal(eventfd_write(ctx->stop_fd, 1), 0);
+	assert_int_equal(pthread_join(thread, NULL), 0);
+	assert_int_equal(ctx->ret, 0);
+	close(ctx->stop_fd);
+}
+
+static void test_rx_stream(void **state)
+{
+	static struct loop_ctx ctx;
+	uint8_t burst[BURST_FRAMES * sizeof(pkt_acl)];
+	pthread_t thread;
+	int sv[2];
+
+	(void)state;
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	loop_start(&ctx, &thread, sv[0]);
+
+	/* Split across writes with the loop waiting in between */
+	for (size_t i = 0; i < NUM_PKTS; i++) {
+		size_t half = pkts[i].len / 2;
+
+		assert_int_equal(write(sv[1], pkts[i].data, half), (ssize_t)half);
+		usleep(2000);
+		assert_int_equal(write(sv[1], pkts[i].data + half, pkts[i].len - half),
+				 (ssize_t)(pkts[i].len - half));
+		wait_count(&ctx.log, i + 1);
+	}
+	expect_all_pkts(&ctx.log, 0);
+
+	/* Many frames from one completion */
+	for (int i = 0; i < BURST_FRAMES; i++) {
+		memcpy(&burst[i * sizeof(pkt_acl)], pkt_acl, sizeof(pkt_acl));
+	}
+	assert_int_equal(write(sv[1], burst, sizeof(burst)), (ssize_t)sizeof(burst));
+	wait_count(&ctx.log, NUM_PKTS + BURST_FRAMES);
+	assert_true(ctx.rx.stats.reads < NUM_PKTS * 2 + 10);
+
+	loop_stop(&ctx, thread);
+
+	/* A second run ends on peer close */
+	loop_start(&ctx, &thread, sv[0]);
+	close(sv[1]);
+	assert_int_equal(pthread_join(thread, NULL), 0);
+	assert_int_equal(ctx.ret, -ECONNRESET);
+
+	close(ctx.stop_fd);
+	close(sv[0]);
+}
+
+static void test_rx_datagram(void **state)
+{
+	static struct loop_ctx ctx;
+	static uint8_t big[H4_URING_RX_BUF_SIZE + 64];
+	const uint8_t truncated[] = {0x04, 0x0e, 0x04, 0x01};
+	pthread_t thread;
+	int sv[2];
+
+	(void)state;
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+	loop_start(&ctx, &thread, sv[0]);
+	assert_true(ctx.rx.datagram);
+
+	/* Bad datagrams are dropped without disturbing the ones around them */
+	assert_int_equal(write(sv[1], truncated, sizeof(truncated)), sizeof(truncated));
+	big[0] = BT_HCI_H4_ACL;
+	sys_put_le16(sizeof(big) - 5, &big[3]);
+	assert_int_equal(write(sv[1], big, sizeof(big)), sizeof(big));
+	for (size_t i = 0; i < NUM_PKTS; i++) {
+		assert_int_equal(write(sv[1], pkts[i].data, pkts[i].len), (ssize_t)pkts[i].len);
+	}
+
+	wait_count(&ctx.log, NUM_PKTS);
+	expect_all_pkts(&ctx.log, 0);
+	assert_int_equal(ctx.rx.stats.dropped, 2);
+
+	loop_stop(&ctx, thread);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static void test_rx_pipe(void **state)
+{
+	static struct loop_ctx ctx;
+	pthread_t thread;
+	int p[2];
+
+	(void)state;
+	assert_int_equal(pipe2(p, O_CLOEXEC | O_NONBLOCK), 0);
+	loop_start(&ctx, &thread, p[0]);
+	assert_false(ctx.rx.socket);
+
+	for (size_t i = 0; i < NUM_PKTS; i++) {
+		assert_int_equal(write(p[1], pkts[i].data, pkts[i].len), (ssize_t)pkts[i].len);
+	}
+	wait_count(&ctx.log, NUM_PKTS);
+	expect_all_pkts(&ctx.log, 0);
+
+	loop_stop(&ctx, thread);
+	close(p[0]);
+	close(p[1]);
+}
+
+struct sink_ctx {
+	int fd;
+	bool datagram;
+	int frames;
+	size_t bytes;
+	bool slow;
+	bool ok;
+};
+
+/* Reads back what the TX side sent, checking every frame is an intact pkt_acl */
+static void *sink_thread(void *arg)
+{
+	struct sink_ctx *s = arg;
+	uint8_t buf[4096];
+	size_t have = 0;
+	ssize_t n;
+
+	s->ok = true;
+	while ((n = read(s->fd, &buf[have], sizeof(buf) - have)) > 0) {
+		size_t off = 0;
+
+		s->bytes += n;
+		have += n;
+		if (s->datagram && (size_t)n != sizeof(pkt_acl)) {
+			s->ok = false;
+		}
+
+		while (have - off >= sizeof(pkt_acl)) {
+			if (memcmp(&buf[off], pkt_acl, sizeof(pkt_acl)) != 0) {
+				s->ok = false;
+			}
+			s->frames++;
+			off += sizeof(pkt_acl);
+		}
+
+		memmove(buf, &buf[off], have - off);
+		have -= off;
+
+		if (s->slow) {
+			usleep(200);
+		}
+	}
+
+	return NULL;
+}
+
+#define TX_PIPE 0
+
+/* type is a socket type or TX_PIPE for a non-socket fd */
+static void tx_run(int type, bool slow, int frames)
+{
+	struct sink_ctx sink = {.slow = slow};
+	struct h4_tx tx;
+	pthread_t thread;
+	int sndbuf = 512;
+	int sv[2];
+
+	if (type == TX_PIPE) {
+		assert_int_equal(pipe2(sv, O_CLOEXEC | O_NONBLOCK), 0);
+		/* Swap so sv[0] is the write end like for sockets */
+		int rd = sv[0];
+
+		sv[0] = sv[1];
+		sv[1] = rd;
+		assert_true(fcntl(sv[0], F_SETPIPE_SZ, 4096) > 0);
+	} else {
+		assert_int_equal(socketpair(AF_UNIX, type | SOCK_NONBLOCK, 0, sv), 0);
+		assert_int_equal(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)),
+				 0);
+	}
+	assert_int_equal(fcntl(sv[1], F_SETFL, 0), 0);
+	sink.fd = sv[1];
+	sink.datagram = (type == SOCK_SEQPACKET);
+	assert_int_equal(pthread_create(&thread, NULL, sink_thread, &sink), 0);
+
+	assert_int_equal(h4_tx_init(&tx, sv[0]), 0);
+	assert_int_equal(h4_uring_tx_attach(&tx), 0);
+	assert_non_null(tx.uring);
+
+	for (int i = 0; i < frames; i++) {
+		struct bt_buf *buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+
+		bt_buf_add_mem(buf, pkt_acl, sizeof(pkt_acl));
+		h4_tx_send(&tx, buf);
+	}
+
+	assert_int_equal(tx.stats.packets, frames);
+	assert_int_equal(tx.stats.bytes, frames * sizeof(pkt_acl));
+	assert_int_equal(tx.stats.errors, 0);
+
+	h4_uring_tx_detach(&tx);
+	assert_null(tx.uring);
+	close(sv[0]);
+	assert_int_equal(pthread_join(thread, NULL), 0);
+	close(sv[1]);
+
+	assert_true(sink.ok);
+	assert_int_equal(sink.frames, frames);
+	assert_int_equal(sink.bytes, frames * sizeof(pkt_acl));
+}
+
+static void test_tx_linked(void **state)
+{
+	(void)state;
+	tx_run(SOCK_STREAM, false, BURST_FRAMES);
+	tx_run(SOCK_SEQPACKET, false, BURST_FRAMES);
+	tx_run(TX_PIPE, false, BURST_FRAMES);
+	/* A slow reader keeps the fd full so sends wait for room */
+	tx_run(SOCK_STREAM, true, BURST_FRAMES);
+	tx_run(SOCK_SEQPACKET, true, BURST_FRAMES);
+	tx_run(TX_PIPE, true, 2000);
+}
+
+/* Makes io_uring_setup() fail as it does under a container's seccomp policy */
+static int deny_io_uring(void)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {.len = ARRAY_SIZE(filter), .filter = filter};
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+		return -errno;
+	}
+
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) < 0 ? -errno : 0;
+}
+
+static int fallback_child(void)
+{
+	static struct loop_ctx ctx;
+	struct h4_tx tx;
+	struct bt_buf *buf;
+	int sv[2];
+
+	if (deny_io_uring() < 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		return 1;
+	}
+
+	ctx.stop_fd = -1;
+	pthread_mutex_init(&ctx.log.lock, NULL);
+	if (h4_rx_init(&ctx.rx, sv[0], log_alloc, log_recv, &ctx.log) < 0 ||
+	    h4_uring_rx_loop(&ctx.rx, -1) != -EOPNOTSUPP) {
+		return 2;
+	}
+
+	if (h4_tx_init(&tx, sv[1]) < 0 || h4_uring_tx_attach(&tx) != -EOPNOTSUPP || tx.uring) {
+		return 3;
+	}
+
+	/* The plain writer still works */
+	buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+	bt_buf_add_mem(buf, pkt_evt, sizeof(pkt_evt));
+	h4_tx_send(&tx, buf);
+	if (tx.stats.packets != 1 || h4_rx_drain(&ctx.rx) != 1) {
+		return 4;
+	}
+
+	return 0;
+}
+
+static void test_fallback(void **state)
+{
+	int status;
+	pid_t pid;
+
+	(void)state;
+	pid = fork();
+	assert_true(pid >= 0);
+	if (pid == 0) {
+		_exit(fallback_child());
+	}
+
+	assert_int_equal(waitpid(pid, &status, 0), pid);
+	assert_true(WIFEXITED(status));
+	assert_int_equal(WEXITSTATUS(status), 0);
+}
+
+/* Ping-pong with a few frames in flight, as a host does against a controller */
+#define BENCH_FRAMES  20000
+#define BENCH_WINDOW  4
+#define BENCH_PAYLOAD 27
+#define BENCH_LEN     (1 + 4 + BENCH_PAYLOAD)
+
+enum bench_path {
+	BENCH_EPOLL,
+	BENCH_URING,
+	BENCH_LOOPBACK,
+};
+
+static const char *const bench_names[] = {
+	[BENCH_EPOLL] = "socketpair epoll/sendmmsg",
+	[BENCH_URING] = "socketpair io_uring",
+	[BENCH_LOOPBACK] = "virtual controller",
+};
+
+struct bench {
+	enum bench_path path;
+	os_sem_t window;
+	uint32_t received;
+	uint32_t lat_ns[BENCH_FRAMES];
+	/* Socketpair paths */
+	int sv[2];
+	int stop_fd;
+	struct h4_rx rx;
+	struct h4_tx tx;
+	pthread_t echo_thread;
+	pthread_t rx_thread;
+	int ret;
+	/* Loopback path */
+	struct bt_queue q;
+	bool measuring;
+	uint16_t handle;
+};
+
+static struct bench bench;
+
+static void bench_fill(uint8_t *frame, uint16_t handle, uint32_t seq)
+{
+	frame[0] = BT_HCI_H4_ACL;
+	sys_put_le16(bt_acl_handle_pack(handle, BT_ACL_START), &frame[1]);
+	sys_put_le16(BENCH_PAYLOAD, &frame[3]);
+	memset(&frame[5], 0, BENCH_PAYLOAD);
+	sys_put_le64(os_time_get_ns(), &frame[5]);
+	sys_put_le32(seq, &frame[13]);
+}
+
+static void bench_sample(const uint8_t *frame)
+{
+	uint64_t sent = sys_get_le64(&frame[5]);
+	uint32_t seq = sys_get_le32(&frame[13]);
+
+	if (seq < BENCH_FRAMES) {
+		bench.lat_ns[seq] = (uint32_t)(os_time_get_ns() - sent);
+	}
+	bench.received++;
+	os_sem_give(&bench.window);
+}
+
+static struct bt_buf *bench_alloc(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct bt_buf *buf = bt_buf_alloc_fixed(&rx_pool, OS_TIMEOUT_NO_WAIT);
+
+	if (buf) {
+		bt_buf_add_u8(buf, frame[0]);
+	}
+
+	return buf;
+}
+
+static void bench_recv(struct bt_buf *buf, void *user_data)
+{
+	bench_sample(buf->data);
+	bt_buf_unref(buf);
+}
+
+static void *bench_rx_thread(void *arg)
+{
+	if (bench.path == BENCH_URING) {
+		bench.ret = h4_uring_rx_loop(&bench.rx, bench.stop_fd);
+	} else {
+		bench.ret = hci_sock_rx_loop(&bench.rx, bench.stop_fd);
+	}
+
+	return NULL;
+}
+
+/* The controller end: sends every datagram straight back */
+static void *bench_echo_thread(void *arg)
+{
+	uint8_t frame[BENCH_LEN];
+	ssize_t n;
+
+	while ((n = read(bench.sv[1], frame, sizeof(frame))) > 0) {
+		if (write(bench.sv[1], frame, n) != n) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int bench_lb_recv(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	if (bench.measuring && buf->data[0] == BT_HCI_H4_ACL) {
+		bench_sample(buf->data);
+		bt_buf_unref(buf);
+	} else if (bench.measuring) {
+		/* Number of Completed Packets */
+		bt_buf_unref(buf);
+	} else {
+		bt_queue_append(&bench.q, buf);
+	}
+
+	return 0;
+}
+
+static void bench_lb_send(uint8_t type, const void *data, size_t len)
+{
+	struct bt_buf *buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+
+	bt_buf_add_u8(buf, type);
+	bt_buf_add_mem(buf, data, len);
+	assert_int_equal(bt_hci_send(&loopback_transport, buf), 0);
+}
+
+static void bench_lb_connect(const bt_addr_le_t *addr)
+{
+	uint8_t cmd[3 + sizeof(struct bt_hci_cp_le_create_conn)];
+	struct bt_hci_cp_le_create_conn *cp = (void *)&cmd[3];
+	struct bt_buf *buf;
+
+	memset(cmd, 0, sizeof(cmd));
+	sys_put_le16(BT_HCI_OP_LE_CREATE_CONN, cmd);
+	cmd[2] = sizeof(*cp);
+	cp->conn_interval_min = sys_cpu_to_le16(6);
+	cp->conn_interval_max = sys_cpu_to_le16(6);
+	cp->supervision_timeout = sys_cpu_to_le16(400);
+	bt_addr_le_copy(&cp->peer_addr, addr);
+	bench_lb_send(BT_HCI_H4_CMD, cmd, sizeof(cmd));
+
+	/* Command Status, then LE Connection Complete */
+	while (bench.handle == 0 && (buf = bt_queue_get(&bench.q, OS_SECONDS(2))) != NULL) {
+		if (buf->data[1] == BT_HCI_EVT_LE_META_EVENT &&
+		    buf->data[3] == BT_HCI_EVT_LE_CONN_COMPLETE) {
+			struct bt_hci_evt_le_conn_complete *evt = (void *)&buf->data[4];
+
+			assert_int_equal(evt->status, BT_HCI_ERR_SUCCESS);
+			bench.handle = sys_le16_to_cpu(evt->handle);
+		}
+		bt_buf_unref(buf);
+	}
+
+	assert_int_not_equal(bench.handle, 0);
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void bench_setup(void)
+{
+	static const bt_addr_le_t peer = {
+		.type = BT_ADDR_LE_RANDOM, .a = {{0x02, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+	struct bt_loopback_config cfg;
+
+	if (bench.path == BENCH_LOOPBACK) {
+		bt_queue_init(&bench.q);
+		bt_driver_loopback_init();
+		bt_loopback_config_default(&cfg);
+		assert_int_equal(bt_loopback_configure(&cfg), 0);
+		bt_loopback_peer_clear();
+		assert_int_equal(bt_loopback_peer_add(&peer, BT_LOOPBACK_PEER_ECHO), 0);
+		assert_int_equal(bt_hci_open(&loopback_transport, bench_lb_recv), 0);
+		bench_lb_connect(&peer);
+		bench.measuring = true;
+		return;
+	}
+
+	/* Datagrams, like the HCI User Channel */
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bench.sv), 0);
+	assert_int_equal(fcntl(bench.sv[1], F_SETFL, 0), 0);
+	bench.stop_fd = eventfd(0, EFD_CLOEXEC);
+	assert_int_equal(h4_rx_init(&bench.rx, bench.sv[0], bench_alloc, bench_recv, NULL), 0);
+	assert_int_equal(h4_tx_init(&bench.tx, bench.sv[0]), 0);
+	if (bench.path == BENCH_URING) {
+		assert_int_equal(h4_uring_tx_attach(&bench.tx), 0);
+	}
+
+	assert_int_equal(pthread_create(&bench.echo_thread, NULL, bench_echo_thread, NULL), 0);
+	assert_int_equal(pthread_create(&bench.rx_thread, NULL, bench_rx_thread, NULL), 0);
+}
+
+static void bench_run(enum bench_path path)
+{
+	struct bt_hci_driver_stats stats;
+	uint64_t start, elapsed;
+	uint32_t syscalls;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.path = path;
+	os_sem_init(&bench.window, BENCH_WINDOW, BENCH_WINDOW);
+	bench_setup();
+
+	start = os_time_get_ns();
+	for (uint32_t seq = 0; seq < BENCH_FRAMES; seq++) {
+		struct bt_buf *buf;
+
+		assert_int_equal(os_sem_take(&bench.window, OS_SECONDS(5)), 0);
+		buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+		bench_fill(bt_buf_add(buf, BENCH_LEN), bench.handle, seq);
+		if (path == BENCH_LOOPBACK) {
+			assert_int_equal(bt_hci_send(&loopback_transport, buf), 0);
+		} else {
+			h4_tx_send(&bench.tx, buf);
+		}
+	}
+	for (int i = 0; i < BENCH_WINDOW; i++) {
+		assert_int_equal(os_sem_take(&bench.window, OS_SECONDS(5)), 0);
+	}
+	elapsed = os_time_get_ns() - start;
+	assert_int_equal(bench.received, BENCH_FRAMES);
+
+	memset(&stats, 0, sizeof(stats));
+	if (path == BENCH_LOOPBACK) {
+		bench.measuring = false;
+		(void)bt_hci_get_stats(&loopback_transport, &stats);
+		assert_int_equal(bt_hci_close(&loopback_transport), 0);
+	} else {
+		h4_rx_stats_fill(&bench.rx, &stats);
+		h4_tx_stats_fill(&bench.tx, &stats);
+		assert_int_equal(eventfd_write(bench.stop_fd, 1), 0);
+		assert_int_equal(pthread_join(bench.rx_thread, NULL), 0);
+		assert_int_equal(bench.ret, 0);
+		/* EOF ends the echo thread */
+		shutdown(bench.sv[0], SHUT_WR);
+		assert_int_equal(pthread_join(bench.echo_thread, NULL), 0);
+		h4_uring_tx_detach(&bench.tx);
+		close(bench.sv[0]);
+		close(bench.sv[1]);
+		close(bench.stop_fd);
+	}
+
+	qsort(bench.lat_ns, BENCH_FRAMES, sizeof(bench.lat_ns[0]), lat_cmp);
+	syscalls = stats.rx_syscalls + stats.tx_syscalls;
+	print_message("%-26s %6.2f us/frame, p50 %6.1f us, p99 %6.1f us, "
+		      "%5u syscalls/1k frames (rx %u, tx %u)\n",
+		      bench_names[path], (double)elapsed / BENCH_FRAMES / 1000.0,
+		      bench.lat_ns[BENCH_FRAMES / 2] / 1000.0,
+		      bench.lat_ns[BENCH_FRAMES * 99 / 100] / 1000.0,
+		      (uint32_t)((uint64_t)syscalls * 1000 / BENCH_FRAMES),
+		      (uint32_t)((uint64_t)stats.rx_syscalls * 1000 / BENCH_FRAMES),
+		      (uint32_t)((uint64_t)stats.tx_syscalls * 1000 / BENCH_FRAMES));
+
+	if (path != BENCH_LOOPBACK) {
+		assert_int_equal(stats.rx_packets, BENCH_FRAMES);
+		assert_int_equal(stats.tx_packets, BENCH_FRAMES);
+		assert_int_equal(stats.rx_dropped, 0);
+	}
+}
+
+static void test_benchmark(void **state)
+{
+	(void)state;
+	bench_run(BENCH_EPOLL);
+	bench_run(BENCH_URING);
+	bench_run(BENCH_LOOPBACK);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_rx_stream),
+		cmocka_unit_test(test_rx_datagram),
+		cmocka_unit_test(test_rx_pipe),
+		cmocka_unit_test(test_tx_linked),
+		cmocka_unit_test(test_fallback),
+		cmocka_unit_test(test_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+#else /* !CONFIG_BT_H4_IO_URING */
+
+static void test_disabled(void **state)
+{
+	(void)state;
+	skip();
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_disabled),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+#endif /* CONFIG_BT_H4_IO_URING */
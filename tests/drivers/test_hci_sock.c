@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <osdep/os.h>
+
+#include "drivers/hci_sock.h"
+
+#define MAX_FRAMES 16
+
+BT_BUF_POOL_DEFINE(rx_pool, 4, 64, 0, NULL);
+
+struct rx_log {
+	pthread_mutex_t lock;
+	int count;
+	size_t len[MAX_FRAMES];
+	uint8_t data[MAX_FRAMES][64];
+};
+
+static struct bt_buf *log_alloc(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct bt_buf *buf = bt_buf_alloc_fixed(&rx_pool, OS_TIMEOUT_NO_WAIT);
+
+	if (buf) {
+		bt_buf_add_u8(buf, frame[0]);
+	}
+
+	return buf;
+}
+
+static void log_recv(struct bt_buf *buf, void *user_data)
+{
+	struct rx_log *log = user_data;
+
+	pthread_mutex_lock(&log->lock);
+	if (log->count < MAX_FRAMES) {
+		memcpy(log->data[log->count], buf->data, buf->len);
+		log->len[log->count] = buf->len;
+	}
+	log->count++;
+	pthread_mutex_unlock(&log->lock);
+	bt_buf_unref(buf);
+}
+
+/* Event: Command Complete, 4 byte payload */
+static const uint8_t pkt_evt[] = {0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00};
+/* ACL: handle 0x0001, 5 byte payload (little-endian length) */
+static const uint8_t pkt_acl[] = {0x02, 0x01, 0x20, 0x05, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05};
+/* SCO: handle 0x0002, 3 byte payload */
+static const uint8_t pkt_sco[] = {0x03, 0x02, 0x00, 0x03, 0xaa, 0xbb, 0xcc};
+/* ISO: handle 0x0003, PB/TS flags set, 2 byte payload; upper length bits are RFU */
+static const uint8_t pkt_iso[] = {0x05, 0x03, 0x60, 0x02, 0xc0, 0x11, 0x22};
+
+static const struct {
+	const uint8_t *data;
+	size_t len;
+} pkts[] = {
+	{pkt_evt, sizeof(pkt_evt)},
+	{pkt_acl, sizeof(pkt_acl)},
+	{pkt_sco, sizeof(pkt_sco)},
+	{pkt_iso, sizeof(pkt_iso)},
+};
+
+static void expect_all_pkts(struct rx_log *log, int first)
+{
+	for (size_t i = 0; i < sizeof(pkts) / sizeof(pkts[0]); i++) {
+		assert_int_equal(log->len[first + i], pkts[i].len);
+		assert_memory_equal(log->data[first + i], pkts[i].data, pkts[i].len);
+	}
+}
+
+struct loop_ctx {
+	int stop_fd;
+	struct h4_rx rx;
+	struct rx_log log;
+	int ret;
+};
+
+static void *loop_thread(void *arg)
+{
+	struct loop_ctx *ctx = arg;
+
+	ctx->ret = hci_sock_rx_loop(&ctx->rx, ctx->stop_fd);
+	return NULL;
+}
+
+static int log_count(struct rx_log *log)
+{
+	int count;
+
+	pthread_mutex_lock(&log->lock);
+	count = log->count;
+	pthread_mutex_unlock(&log->lock);
+	return count;
+}
+
+static void wait_count(struct rx_log *log, int count)
+{
+	for (int i = 0; i < 2000 && log_count(log) < count; i++) {
+		usleep(1000);
+	}
+	assert_int_equal(log_count(log), count);
+}
+
+static void test_loop_stop_and_eof(void **state)
+{
+	(void)state;
+	static struct loop_ctx ctx = {.log = {.lock = PTHREAD_MUTEX_INITIALIZER}};
+	pthread_t thread;
+	int sv[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+	assert_int_equal(h4_rx_init(&ctx.rx, sv[0], log_alloc, log_recv, &ctx.log), 0);
+	ctx.stop_fd = eventfd(0, EFD_CLOEXEC);
+	assert_true(ctx.stop_fd >= 0);
+	ctx.ret = 1;
+
+	assert_int_equal(pthread_create(&thread, NULL, loop_thread, &ctx), 0);
+
+	/* Split across writes with the loop blocked in between */
+	for (size_t i = 0; i < sizeof(pkts) / sizeof(pkts[0]); i++) {
+		size_t half = pkts[i].len / 2;
+
+		assert_int_equal(write(sv[1], pkts[i].data, half), (ssize_t)half);
+		usleep(2000);
+		assert_int_equal(write(sv[1], pkts[i].data + half, pkts[i].len - half),
+				 (ssize_t)(pkts[i].len - half));
+		wait_count(&ctx.log, i + 1);
+	}
+	expect_all_pkts(&ctx.log, 0);
+
+	/* Shutdown through the eventfd while the socket stays open */
+	assert_int_equal(eventfd_write(ctx.stop_fd, 1), 0);
+	assert_int_equal(pthread_join(thread, NULL), 0);
+	assert_int_equal(ctx.ret, 0);
+
+	/* A second run ends on peer close */
+	eventfd_t v;
+
+	assert_int_equal(eventfd_read(ctx.stop_fd, &v), 0);
+	ctx.ret = 1;
+	assert_int_equal(pthread_create(&thread, NULL, loop_thread, &ctx), 0);
+	close(sv[1]);
+	assert_int_equal(pthread_join(thread, NULL), 0);
+	assert_int_equal(ctx.ret, -ECONNRESET);
+
+	close(ctx.stop_fd);
+	close(sv[0]);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_loop_stop_and_eof),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
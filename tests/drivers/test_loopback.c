@@ -0,0 +1,817 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <base/byteorder.h>
+#include <base/queue/bt_queue.h>
+#include <osdep/os.h>
+
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/loopback.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include "host/conn_internal.h"
+#include "host/hci_core.h"
+#include "host/l2cap_internal.h"
+
+#define CMD_BUF_SIZE 300
+
+BT_BUF_POOL_DEFINE(cmd_pool, 16, CMD_BUF_SIZE, 0, NULL);
+
+static struct bt_queue rx_q;
+
+static const bt_addr_le_t peer_sink = {
+	.type = BT_ADDR_LE_RANDOM, .a = {{0x01, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+static const bt_addr_le_t peer_echo = {
+	.type = BT_ADDR_LE_RANDOM, .a = {{0x02, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+static const bt_addr_le_t peer_absent = {
+	.type = BT_ADDR_LE_RANDOM, .a = {{0x03, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+
+static int recv_cb(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	bt_queue_append(&rx_q, buf);
+	return 0;
+}
+
+static int setup(void **state)
+{
+	struct bt_loopback_config cfg;
+
+	(void)state;
+	bt_queue_init(&rx_q);
+	bt_driver_loopback_init();
+	bt_loopback_config_default(&cfg);
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+	bt_loopback_peer_clear();
+	assert_int_equal(bt_loopback_peer_add(&peer_sink, BT_LOOPBACK_PEER_SINK), 0);
+	assert_int_equal(bt_loopback_peer_add(&peer_echo, BT_LOOPBACK_PEER_ECHO), 0);
+
+	return 0;
+}
+
+static void send_pkt(uint8_t type, const void *data, size_t len)
+{
+	struct bt_buf *buf = bt_buf_alloc(&cmd_pool, OS_TIMEOUT_FOREVER);
+
+	assert_non_null(buf);
+	bt_buf_add_u8(buf, type);
+	bt_buf_add_mem(buf, data, len);
+	assert_int_equal(bt_hci_send(&loopback_transport, buf), 0);
+}
+
+static void send_cmd(uint16_t opcode, const void *params, uint8_t len)
+{
+	uint8_t cmd[3 + UINT8_MAX];
+
+	sys_put_le16(opcode, cmd);
+	cmd[2] = len;
+	memcpy(&cmd[3], params, len);
+	send_pkt(BT_HCI_H4_CMD, cmd, 3 + len);
+}
+
+static void send_acl(uint16_t handle, uint8_t pb, uint16_t len, uint8_t fill)
+{
+	uint8_t acl[4 + 251];
+
+	sys_put_le16(bt_acl_handle_pack(handle, pb), acl);
+	sys_put_le16(len, &acl[2]);
+	memset(&acl[4], fill, len);
+	send_pkt(BT_HCI_H4_ACL, acl, 4 + len);
+}
+
+static struct bt_buf *get_pkt(uint8_t type)
+{
+	struct bt_buf *buf = bt_queue_get(&rx_q, OS_SECONDS(2));
+
+	assert_non_null(buf);
+	assert_int_equal(buf->data[0], type);
+	bt_buf_pull(buf, 1);
+
+	return buf;
+}
+
+/* Pulls the event header and checks the event code */
+static struct bt_buf *get_evt(uint8_t evt)
+{
+	struct bt_buf *buf = get_pkt(BT_HCI_H4_EVT);
+
+	assert_int_equal(buf->data[0], evt);
+	assert_int_equal(buf->data[1], buf->len - 2);
+	bt_buf_pull(buf, 2);
+
+	return buf;
+}
+
+/* Returns the return parameters, starting with the status */
+static struct bt_buf *get_cc(uint16_t opcode)
+{
+	struct bt_buf *buf = get_evt(BT_HCI_EVT_CMD_COMPLETE);
+
+	assert_int_equal(sys_get_le16(&buf->data[1]), opcode);
+	bt_buf_pull(buf, sizeof(struct bt_hci_evt_cmd_complete));
+
+	return buf;
+}
+
+static void expect_cc_status(uint16_t opcode, uint8_t status)
+{
+	struct bt_buf *buf = get_cc(opcode);
+
+	assert_int_equal(buf->data[0], status);
+	bt_buf_unref(buf);
+}
+
+static void expect_cs(uint16_t opcode, uint8_t status)
+{
+	struct bt_buf *buf = get_evt(BT_HCI_EVT_CMD_STATUS);
+	struct bt_hci_evt_cmd_status *cs = (void *)buf->data;
+
+	assert_int_equal(cs->status, status);
+	assert_int_equal(sys_le16_to_cpu(cs->opcode), opcode);
+	bt_buf_unref(buf);
+}
+
+static struct bt_buf *get_le_evt(uint8_t subevent)
+{
+	struct bt_buf *buf = get_evt(BT_HCI_EVT_LE_META_EVENT);
+
+	assert_int_equal(buf->data[0], subevent);
+	bt_buf_pull(buf, 1);
+
+	return buf;
+}
+
+static void expect_nocp(uint16_t handle)
+{
+	struct bt_buf *buf = get_evt(BT_HCI_EVT_NUM_COMPLETED_PACKETS);
+
+	assert_int_equal(buf->data[0], 1);
+	assert_int_equal(sys_get_le16(&buf->data[1]), handle);
+	assert_int_equal(sys_get_le16(&buf->data[3]), 1);
+	bt_buf_unref(buf);
+}
+
+static void expect_empty(void)
+{
+	assert_null(bt_queue_get(&rx_q, OS_MSEC(20)));
+}
+
+static uint16_t connect(const bt_addr_le_t *addr)
+{
+	struct bt_hci_cp_le_create_conn cp = {
+		.conn_interval_min = sys_cpu_to_le16(6),
+		.conn_interval_max = sys_cpu_to_le16(6),
+		.supervision_timeout = sys_cpu_to_le16(400),
+	};
+	struct bt_hci_evt_le_conn_complete *evt;
+	struct bt_buf *buf;
+	uint16_t handle;
+
+	bt_addr_le_copy(&cp.peer_addr, addr);
+	send_cmd(BT_HCI_OP_LE_CREATE_CONN, &cp, sizeof(cp));
+	expect_cs(BT_HCI_OP_LE_CREATE_CONN, BT_HCI_ERR_SUCCESS);
+
+	/* The default LE event mask only enables the legacy event */
+	buf = get_le_evt(BT_HCI_EVT_LE_CONN_COMPLETE);
+	evt = (void *)buf->data;
+	assert_int_equal(evt->status, BT_HCI_ERR_SUCCESS);
+	assert_int_equal(evt->role, BT_HCI_ROLE_CENTRAL);
+	assert_true(bt_addr_le_eq(&evt->peer_addr, addr));
+	assert_int_equal(sys_le16_to_cpu(evt->interval), 6);
+	handle = sys_le16_to_cpu(evt->handle);
+	assert_int_not_equal(handle, 0);
+	bt_buf_unref(buf);
+
+	return handle;
+}
+
+static void disconnect(uint16_t handle)
+{
+	struct bt_hci_cp_disconnect cp = {
+		.handle = sys_cpu_to_le16(handle),
+		.reason = BT_HCI_ERR_REMOTE_USER_TERM_CONN,
+	};
+	struct bt_buf *buf;
+
+	send_cmd(BT_HCI_OP_DISCONNECT, &cp, sizeof(cp));
+	expect_cs(BT_HCI_OP_DISCONNECT, BT_HCI_ERR_SUCCESS);
+	buf = get_evt(BT_HCI_EVT_DISCONN_COMPLETE);
+	assert_int_equal(sys_get_le16(&buf->data[1]), handle);
+	assert_int_equal(buf->data[3], BT_HCI_ERR_LOCALHOST_TERM_CONN);
+	bt_buf_unref(buf);
+}
+
+static void test_init_sequence(void **state)
+{
+	struct bt_hci_rp_le_read_buffer_size *bs;
+	struct bt_buf *buf;
+	uint8_t *feat;
+
+	(void)state;
+	assert_true(bt_hci_is_ready(&loopback_transport));
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+
+	send_cmd(BT_HCI_OP_RESET, NULL, 0);
+	expect_cc_status(BT_HCI_OP_RESET, BT_HCI_ERR_SUCCESS);
+
+	send_cmd(BT_HCI_OP_READ_LOCAL_FEATURES, NULL, 0);
+	buf = get_cc(BT_HCI_OP_READ_LOCAL_FEATURES);
+	assert_int_equal(buf->len, sizeof(struct bt_hci_rp_read_local_features));
+	assert_true(buf->data[1 + 4] & BIT(6)); /* LE */
+	assert_true(buf->data[1 + 4] & BIT(5)); /* No BR/EDR */
+	bt_buf_unref(buf);
+
+	send_cmd(BT_HCI_OP_READ_SUPPORTED_COMMANDS, NULL, 0);
+	buf = get_cc(BT_HCI_OP_READ_SUPPORTED_COMMANDS);
+	feat = &buf->data[1];
+	assert_true(BT_CMD_LE_STATES(feat));
+	bt_buf_unref(buf);
+
+	send_cmd(BT_HCI_OP_LE_READ_LOCAL_FEATURES, NULL, 0);
+	buf = get_cc(BT_HCI_OP_LE_READ_LOCAL_FEATURES);
+	feat = &buf->data[1];
+	assert_true(BT_FEAT_LE_DLE(feat));
+	assert_true(BT_FEAT_LE_CIS_CENTRAL(feat));
+	bt_buf_unref(buf);
+
+	send_cmd(BT_HCI_OP_LE_READ_BUFFER_SIZE, NULL, 0);
+	buf = get_cc(BT_HCI_OP_LE_READ_BUFFER_SIZE);
+	bs = (void *)buf->data;
+	assert_int_equal(sys_le16_to_cpu(bs->le_max_len), 251);
+	assert_int_equal(bs->le_max_num, 8);
+	bt_buf_unref(buf);
+
+	/* Vendor commands are rejected so the host skips its vendor setup */
+	send_cmd(BT_OP(BT_OGF_VS, 0x0001), NULL, 0);
+	expect_cc_status(BT_OP(BT_OGF_VS, 0x0001), BT_HCI_ERR_UNKNOWN_CMD);
+
+	/* Anything else succeeds with zeroed return parameters */
+	send_cmd(BT_HCI_OP_LE_READ_FAL_SIZE, NULL, 0);
+	expect_cc_status(BT_HCI_OP_LE_READ_FAL_SIZE, BT_HCI_ERR_SUCCESS);
+
+	expect_empty();
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+}
+
+static void test_connect_acl_flow(void **state)
+{
+	struct bt_hci_driver_stats stats;
+	uint16_t sink, echo;
+	struct bt_buf *buf;
+	uint8_t frame[600];
+
+	(void)state;
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+
+	sink = connect(&peer_sink);
+	echo = connect(&peer_echo);
+	assert_int_not_equal(sink, echo);
+
+	/* A peer takes one connection at a time */
+	{
+		struct bt_hci_cp_le_create_conn cp = {0};
+
+		bt_addr_le_copy(&cp.peer_addr, &peer_sink);
+		send_cmd(BT_HCI_OP_LE_CREATE_CONN, &cp, sizeof(cp));
+		expect_cs(BT_HCI_OP_LE_CREATE_CONN, BT_HCI_ERR_CONN_ALREADY_EXISTS);
+	}
+
+	/* Sink peers only complete, echo peers send the data back as a start fragment */
+	send_acl(sink, BT_ACL_START_NO_FLUSH, 100, 0xaa);
+	expect_nocp(sink);
+	expect_empty();
+
+	send_acl(echo, BT_ACL_START_NO_FLUSH, 100, 0xbb);
+	expect_nocp(echo);
+	buf = get_pkt(BT_HCI_H4_ACL);
+	assert_int_equal(buf->len, 4 + 100);
+	assert_int_equal(sys_get_le16(buf->data), bt_acl_handle_pack(echo, BT_ACL_START));
+	assert_int_equal(buf->data[4], 0xbb);
+	bt_buf_unref(buf);
+
+	/* Peer data is fragmented like a controller would */
+	memset(frame, 0x5a, sizeof(frame));
+	assert_int_equal(bt_loopback_inject_acl(&peer_sink, frame, sizeof(frame), OS_SECONDS(1)),
+			 0);
+	for (int i = 0, left = sizeof(frame); left > 0; i++) {
+		buf = get_pkt(BT_HCI_H4_ACL);
+		assert_int_equal(sys_get_le16(buf->data),
+				 bt_acl_handle_pack(sink, i ? BT_ACL_CONT : BT_ACL_START));
+		assert_int_equal(sys_get_le16(&buf->data[2]), MIN(left, 251));
+		left -= MIN(left, 251);
+		bt_buf_unref(buf);
+	}
+	assert_int_equal(bt_loopback_inject_acl(&peer_absent, frame, 10, OS_TIMEOUT_NO_WAIT), -ENOTCONN);
+
+	/* Nobody answers at an unknown address until the host cancels */
+	{
+		struct bt_hci_cp_le_create_conn cp = {0};
+		struct bt_hci_evt_le_conn_complete *evt;
+
+		bt_addr_le_copy(&cp.peer_addr, &peer_absent);
+		send_cmd(BT_HCI_OP_LE_CREATE_CONN, &cp, sizeof(cp));
+		expect_cs(BT_HCI_OP_LE_CREATE_CONN, BT_HCI_ERR_SUCCESS);
+		expect_empty();
+
+		send_cmd(BT_HCI_OP_LE_CREATE_CONN_CANCEL, NULL, 0);
+		expect_cc_status(BT_HCI_OP_LE_CREATE_CONN_CANCEL, BT_HCI_ERR_SUCCESS);
+		buf = get_le_evt(BT_HCI_EVT_LE_CONN_COMPLETE);
+		evt = (void *)buf->data;
+		assert_int_equal(evt->status, BT_HCI_ERR_UNKNOWN_CONN_ID);
+		bt_buf_unref(buf);
+	}
+
+	disconnect(sink);
+
+	/* The peer can hang up too */
+	assert_int_equal(bt_loopback_peer_disconnect(&peer_echo), 0);
+	buf = get_evt(BT_HCI_EVT_DISCONN_COMPLETE);
+	assert_int_equal(sys_get_le16(&buf->data[1]), echo);
+	assert_int_equal(buf->data[3], BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	bt_buf_unref(buf);
+	assert_int_equal(bt_loopback_peer_disconnect(&peer_echo), -ENOTCONN);
+
+	expect_empty();
+
+	assert_int_equal(bt_hci_get_stats(&loopback_transport, &stats), 0);
+	assert_int_equal(stats.rx_dropped, 0);
+	assert_true(stats.tx_packets >= 8);
+
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+}
+
+static void test_iso_data_path(void **state)
+{
+	struct {
+		struct bt_hci_cp_le_set_cig_params cp;
+		struct bt_hci_cis_params cis;
+	} __packed cig = {
+		.cp.cig_id = 1,
+		.cp.num_cis = 1,
+		.cis.cis_id = 0,
+		.cis.c_sdu = sys_cpu_to_le16(100),
+		.cis.p_sdu = sys_cpu_to_le16(100),
+	};
+	struct {
+		struct bt_hci_cp_le_create_cis cp;
+		struct bt_hci_cis cis;
+	} __packed create = {
+		.cp.num_cis = 1,
+	};
+	struct bt_hci_cp_le_setup_iso_path path = {0};
+	struct bt_hci_evt_le_cis_established *est;
+	uint8_t iso[4 + 4 + 40];
+	uint16_t acl, cis;
+	struct bt_buf *buf;
+
+	(void)state;
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+	acl = connect(&peer_echo);
+
+	send_cmd(BT_HCI_OP_LE_SET_CIG_PARAMS, &cig, sizeof(cig));
+	buf = get_cc(BT_HCI_OP_LE_SET_CIG_PARAMS);
+	assert_int_equal(buf->data[0], BT_HCI_ERR_SUCCESS);
+	assert_int_equal(buf->data[2], 1);
+	cis = sys_get_le16(&buf->data[3]);
+	bt_buf_unref(buf);
+
+	create.cis.cis_handle = sys_cpu_to_le16(cis);
+	create.cis.acl_handle = sys_cpu_to_le16(acl);
+	send_cmd(BT_HCI_OP_LE_CREATE_CIS, &create, sizeof(create));
+	expect_cs(BT_HCI_OP_LE_CREATE_CIS, BT_HCI_ERR_SUCCESS);
+	buf = get_le_evt(BT_HCI_EVT_LE_CIS_ESTABLISHED);
+	est = (void *)buf->data;
+	assert_int_equal(est->status, BT_HCI_ERR_SUCCESS);
+	assert_int_equal(sys_le16_to_cpu(est->conn_handle), cis);
+	bt_buf_unref(buf);
+
+	path.handle = sys_cpu_to_le16(cis);
+	send_cmd(BT_HCI_OP_LE_SETUP_ISO_PATH, &path, sizeof(path));
+	buf = get_cc(BT_HCI_OP_LE_SETUP_ISO_PATH);
+	assert_int_equal(buf->data[0], BT_HCI_ERR_SUCCESS);
+	assert_int_equal(sys_get_le16(&buf->data[1]), cis);
+	bt_buf_unref(buf);
+
+	/* Single SDU without timestamp: sequence number, SDU length, payload */
+	sys_put_le16(bt_iso_handle_pack(cis, BT_ISO_SINGLE, 0), iso);
+	sys_put_le16(sizeof(iso) - 4, &iso[2]);
+	sys_put_le16(7, &iso[4]);
+	sys_put_le16(40, &iso[6]);
+	memset(&iso[8], 0x33, 40);
+	send_pkt(BT_HCI_H4_ISO, iso, sizeof(iso));
+
+	expect_nocp(cis);
+	buf = get_pkt(BT_HCI_H4_ISO);
+	assert_memory_equal(buf->data, iso, sizeof(iso));
+	bt_buf_unref(buf);
+
+	/* Dropping the ACL takes the CIS with it */
+	{
+		struct bt_hci_cp_disconnect cp = {
+			.handle = sys_cpu_to_le16(acl),
+			.reason = BT_HCI_ERR_REMOTE_USER_TERM_CONN,
+		};
+
+		send_cmd(BT_HCI_OP_DISCONNECT, &cp, sizeof(cp));
+		expect_cs(BT_HCI_OP_DISCONNECT, BT_HCI_ERR_SUCCESS);
+		buf = get_evt(BT_HCI_EVT_DISCONN_COMPLETE);
+		assert_int_equal(sys_get_le16(&buf->data[1]), cis);
+		bt_buf_unref(buf);
+		buf = get_evt(BT_HCI_EVT_DISCONN_COMPLETE);
+		assert_int_equal(sys_get_le16(&buf->data[1]), acl);
+		bt_buf_unref(buf);
+	}
+
+	send_cmd(BT_HCI_OP_LE_REMOVE_CIG, &cig.cp.cig_id, 1);
+	buf = get_cc(BT_HCI_OP_LE_REMOVE_CIG);
+	assert_int_equal(buf->data[0], BT_HCI_ERR_SUCCESS);
+	bt_buf_unref(buf);
+
+	expect_empty();
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+}
+
+static void test_link_rate_and_latency(void **state)
+{
+	struct bt_loopback_config cfg;
+	uint64_t start, elapsed;
+	uint16_t sink;
+	const int n = 10;
+
+	(void)state;
+	bt_loopback_config_default(&cfg);
+	cfg.link_rate_bps = 1000000;
+	cfg.latency_us = 2000;
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+	assert_int_equal(bt_loopback_configure(&cfg), -EBUSY);
+
+	start = os_time_get_ns();
+	send_cmd(BT_HCI_OP_RESET, NULL, 0);
+	expect_cc_status(BT_HCI_OP_RESET, BT_HCI_ERR_SUCCESS);
+	assert_true(os_time_get_ns() - start >= 2000000U);
+
+	sink = connect(&peer_sink);
+
+	/* 10 x 104 bytes at 1 Mbit/s is 8.32 ms of air time, plus 2 ms to report it */
+	start = os_time_get_ns();
+	for (int i = 0; i < n; i++) {
+		send_acl(sink, BT_ACL_START_NO_FLUSH, 100, i);
+	}
+	for (int i = 0; i < n; i++) {
+		expect_nocp(sink);
+	}
+	elapsed = os_time_get_ns() - start;
+
+	print_message("%d x 104 bytes at 1 Mbit/s + 2 ms: last completion after %.2f ms\n", n,
+		      elapsed / 1e6);
+	assert_true(elapsed >= n * 832000U + 2000000U);
+	assert_true(elapsed < 200000000U);
+
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+
+	bt_loopback_config_default(&cfg);
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+}
+
+static void test_cmd_credits(void **state)
+{
+	static const uint16_t ops[] = {BT_HCI_OP_READ_LOCAL_VERSION_INFO, BT_HCI_OP_READ_BD_ADDR,
+				       BT_HCI_OP_LE_READ_SUPP_STATES};
+	struct bt_loopback_cmd_stats stats;
+	struct bt_loopback_config cfg;
+	struct bt_buf *buf;
+
+	(void)state;
+	bt_loopback_config_default(&cfg);
+	cfg.cmd_credits = 0;
+	assert_int_equal(bt_loopback_configure(&cfg), -EINVAL);
+	cfg.cmd_credits = ARRAY_SIZE(ops);
+	cfg.latency_us = 5000;
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+
+	/* All of them are answered before the first answer arrives */
+	for (size_t i = 0; i < ARRAY_SIZE(ops); i++) {
+		send_cmd(ops[i], NULL, 0);
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(ops); i++) {
+		buf = get_evt(BT_HCI_EVT_CMD_COMPLETE);
+		assert_int_equal(buf->data[0], ARRAY_SIZE(ops));
+		assert_int_equal(sys_get_le16(&buf->data[1]), ops[i]);
+		bt_buf_unref(buf);
+	}
+
+	bt_loopback_cmd_stats_get(&stats);
+	assert_int_equal(stats.cmds, ARRAY_SIZE(ops));
+	assert_int_equal(stats.outstanding, 0);
+	assert_int_equal(stats.max_outstanding, ARRAY_SIZE(ops));
+
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+
+	bt_loopback_config_default(&cfg);
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+}
+
+/* More echoes than the controller has pending slots for */
+#define FLOW_ECHOES 96
+
+BT_BUF_POOL_DEFINE(echo_pool, FLOW_ECHOES, 1 + 4 + 8, 0, NULL);
+
+static void send_host_nocp(uint16_t handle)
+{
+	uint8_t cp[1 + sizeof(struct bt_hci_handle_count)] = {1};
+
+	sys_put_le16(handle, &cp[1]);
+	sys_put_le16(1, &cp[3]);
+	send_cmd(BT_HCI_OP_HOST_NUM_COMPLETED_PACKETS, cp, sizeof(cp));
+}
+
+static void test_host_flow_throttle(void **state)
+{
+	struct bt_hci_cp_host_buffer_size cp = {
+		.acl_mtu = sys_cpu_to_le16(251),
+		.acl_pkts = sys_cpu_to_le16(2),
+	};
+	uint8_t enable = 0x01;
+	struct bt_hci_driver_stats stats;
+	int echoes = 0, nocps = 0, unacked = 0;
+	bool stalled = false;
+	uint16_t echo;
+
+	(void)state;
+	assert_int_equal(bt_hci_open(&loopback_transport, recv_cb), 0);
+
+	send_cmd(BT_HCI_OP_HOST_BUFFER_SIZE, &cp, sizeof(cp));
+	expect_cc_status(BT_HCI_OP_HOST_BUFFER_SIZE, BT_HCI_ERR_SUCCESS);
+	send_cmd(BT_HCI_OP_SET_CTL_TO_HOST_FLOW, &enable, 1);
+	expect_cc_status(BT_HCI_OP_SET_CTL_TO_HOST_FLOW, BT_HCI_ERR_SUCCESS);
+	echo = connect(&peer_echo);
+
+	/* Echoes beyond the host's two buffers fill the pending list */
+	for (int i = 0; i < FLOW_ECHOES; i++) {
+		struct bt_buf *buf = bt_buf_alloc(&echo_pool, OS_TIMEOUT_FOREVER);
+
+		bt_buf_add_u8(buf, BT_HCI_H4_ACL);
+		bt_buf_add_le16(buf, bt_acl_handle_pack(echo, BT_ACL_START_NO_FLUSH));
+		bt_buf_add_le16(buf, 8);
+		memset(bt_buf_add(buf, 8), i, 8);
+		assert_int_equal(bt_hci_send(&loopback_transport, buf), 0);
+	}
+
+	while (echoes < FLOW_ECHOES || nocps < FLOW_ECHOES) {
+		struct bt_buf *buf = bt_queue_get(&rx_q, OS_MSEC(100));
+
+		/* Throttled with the host's buffers taken, completions still get
+		 * through and let the rest drain in order.
+		 */
+		if (!buf) {
+			assert_false(stalled);
+			assert_int_equal(bt_hci_get_stats(&loopback_transport, &stats), 0);
+			assert_true(stats.tx_waits > 0);
+			assert_int_equal(unacked, 2);
+			for (; unacked; unacked--) {
+				send_host_nocp(echo);
+			}
+			stalled = true;
+			continue;
+		}
+
+		if (buf->data[0] == BT_HCI_H4_ACL) {
+			assert_int_equal(buf->data[5], echoes);
+			echoes++;
+			if (stalled) {
+				send_host_nocp(echo);
+			} else {
+				unacked++;
+			}
+		} else {
+			assert_int_equal(buf->data[0], BT_HCI_H4_EVT);
+			assert_int_equal(buf->data[1], BT_HCI_EVT_NUM_COMPLETED_PACKETS);
+			nocps++;
+		}
+		bt_buf_unref(buf);
+	}
+	assert_true(stalled);
+	expect_empty();
+
+	/* Commands that are answered get through again too */
+	disconnect(echo);
+
+	assert_int_equal(bt_hci_get_stats(&loopback_transport, &stats), 0);
+	assert_int_equal(stats.rx_dropped, 0);
+	assert_int_equal(bt_hci_close(&loopback_transport), 0);
+}
+
+#define HOST_TX_THREADS 4
+#define HOST_TX_PDUS 200
+#define HOST_RX_PDUS 200
+
+extern int bt_work_main_work_init(void);
+
+static struct bt_conn *host_conn;
+static bt_atomic_t host_tx_done;
+static bt_atomic_t host_tx_err;
+static os_sem_t host_conn_sem;
+
+static void host_connected(struct bt_conn *conn, uint8_t err)
+{
+	assert_int_equal(err, 0);
+	os_sem_give(&host_conn_sem);
+}
+
+static void host_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	os_sem_give(&host_conn_sem);
+}
+
+static struct bt_conn_cb host_conn_cb = {
+	.connected = host_connected,
+	.disconnected = host_disconnected,
+};
+
+static void host_tx_cb(struct bt_conn *conn, void *user_data, int err)
+{
+	bt_atomic_inc(&host_tx_done);
+	if (err) {
+		bt_atomic_inc(&host_tx_err);
+	}
+}
+
+static void host_tx_thread(void *arg)
+{
+	struct bt_l2cap_chan *chan = bt_l2cap_le_lookup_tx_cid(host_conn, BT_L2CAP_CID_ATT);
+	uintptr_t id = (uintptr_t)arg;
+
+	for (int i = 0; i < HOST_TX_PDUS; i++) {
+		struct bt_buf *buf = bt_l2cap_create_pdu(NULL, 0);
+
+		/* ATT Write Command to a handle nobody serves, ignored on echo */
+		bt_buf_add_u8(buf, 0x52);
+		bt_buf_add_le16(buf, 0xfff0);
+		memset(bt_buf_add(buf, 16), id, 16);
+
+		if (bt_l2cap_send_pdu(BT_L2CAP_LE_CHAN(chan), buf, host_tx_cb, NULL)) {
+			bt_buf_unref(buf);
+			bt_atomic_inc(&host_tx_done);
+			bt_atomic_inc(&host_tx_err);
+		}
+	}
+}
+
+static void host_inject_thread(void *arg)
+{
+	/* L2CAP basic frame carrying the same kind of ATT Write Command */
+	uint8_t pdu[4 + 3 + 16] = {3 + 16, 0x00, BT_L2CAP_CID_ATT, 0x00, 0x52, 0xf0, 0xff};
+
+	(void)arg;
+	for (int i = 0; i < HOST_RX_PDUS; i++) {
+		memset(&pdu[7], i, 16);
+		assert_int_equal(bt_loopback_inject_acl(&peer_echo, pdu, sizeof(pdu),
+							OS_TIMEOUT_FOREVER),
+				 0);
+	}
+}
+
+static void test_host_stack_traffic(void **state)
+{
+	os_thread_t tx[HOST_TX_THREADS], injector;
+	struct bt_hci_driver_stats before, after;
+	struct bt_hci_rx_stats rx_before, rx_after;
+	struct bt_loopback_host_flow_stats flow_before, flow_after;
+	struct bt_loopback_cmd_stats cmd_stats;
+	struct bt_loopback_config cfg;
+	int64_t deadline;
+
+	(void)state;
+	bt_loopback_config_default(&cfg);
+	cfg.br_edr = IS_ENABLED(CONFIG_BT_CLASSIC);
+	/* Lets the host pipeline its commands across the latency */
+	cfg.cmd_credits = CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT;
+	cfg.latency_us = 500;
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+
+	bt_work_main_work_init();
+	assert_int_equal(bt_enable(NULL), 0);
+
+	/* The controller's first reads were sent at once */
+	bt_loopback_cmd_stats_get(&cmd_stats);
+	assert_true(cmd_stats.max_outstanding >= MIN(2, CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT));
+	assert_true(cmd_stats.max_outstanding <= CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT);
+	os_sem_init(&host_conn_sem, 0, 1);
+	assert_int_equal(bt_conn_cb_register(&host_conn_cb), 0);
+
+	assert_int_equal(bt_conn_le_create(&peer_echo, BT_CONN_LE_CREATE_CONN,
+					   BT_LE_CONN_PARAM_DEFAULT, &host_conn),
+			 0);
+	assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+
+	/* Let the host finish its own feature, PHY and data length procedures */
+	os_sleep_ms(50);
+	assert_int_equal(bt_hci_get_stats(&loopback_transport, &before), 0);
+	bt_hci_rx_stats_get(&rx_before);
+	bt_loopback_host_flow_stats_get(&flow_before);
+
+	for (uintptr_t i = 0; i < HOST_TX_THREADS; i++) {
+		assert_int_equal(os_thread_create(&tx[i], host_tx_thread, (void *)i, "lb_tx",
+						  OS_PRIORITY(0), 0),
+				 0);
+	}
+	assert_int_equal(os_thread_create(&injector, host_inject_thread, NULL, "lb_inject",
+					  OS_PRIORITY(0), 0),
+			 0);
+	for (int i = 0; i < HOST_TX_THREADS; i++) {
+		assert_int_equal(os_thread_join(&tx[i], OS_TIMEOUT_FOREVER), 0);
+	}
+	assert_int_equal(os_thread_join(&injector, OS_TIMEOUT_FOREVER), 0);
+
+	deadline = os_time_get_ns() + 10000000000LL;
+	while (bt_atomic_get(&host_tx_done) < HOST_TX_THREADS * HOST_TX_PDUS) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+	assert_int_equal(bt_atomic_get(&host_tx_err), 0);
+
+	/* Every PDU fits one ACL packet, which comes back as a NOCP and an echo */
+	deadline = os_time_get_ns() + 10000000000LL;
+	do {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+		assert_int_equal(bt_hci_get_stats(&loopback_transport, &after), 0);
+	} while (after.rx_packets - before.rx_packets <
+		 2 * HOST_TX_THREADS * HOST_TX_PDUS + HOST_RX_PDUS);
+	assert_true(after.tx_packets - before.tx_packets >= HOST_TX_THREADS * HOST_TX_PDUS);
+	assert_int_equal(after.rx_dropped, before.rx_dropped);
+
+	/* Every echoed and injected ACL packet is handed back to the controller,
+	 * several at a time.
+	 */
+	bt_loopback_host_flow_stats_get(&flow_after);
+	if (IS_ENABLED(CONFIG_BT_HCI_ACL_FLOW_CONTROL)) {
+		assert_true(flow_before.enabled);
+		assert_int_equal(flow_before.in_use, 0);
+
+		deadline = os_time_get_ns() + 1000000000LL;
+		while (flow_after.in_use ||
+		       flow_after.nocp_packets - flow_before.nocp_packets <
+			       HOST_TX_THREADS * HOST_TX_PDUS + HOST_RX_PDUS) {
+			assert_true(os_time_get_ns() < deadline);
+			os_sleep_ms(1);
+			bt_loopback_host_flow_stats_get(&flow_after);
+		}
+		assert_int_equal(flow_after.nocp_packets - flow_before.nocp_packets,
+				 HOST_TX_THREADS * HOST_TX_PDUS + HOST_RX_PDUS);
+		assert_true(flow_after.nocp_cmds - flow_before.nocp_cmds <
+			    (flow_after.nocp_packets - flow_before.nocp_packets) / 2);
+		assert_int_equal(flow_after.nocp_errors, 0);
+		assert_int_equal(flow_after.nocp_stale, 0);
+	} else {
+		assert_false(flow_after.enabled);
+		assert_int_equal(flow_after.nocp_cmds, 0);
+	}
+
+	assert_int_equal(bt_conn_disconnect(host_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN), 0);
+	assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+	bt_conn_unref(host_conn);
+	bt_conn_cb_unregister(&host_conn_cb);
+
+	/* The disconnection was processed after every echo, all in budgeted batches */
+	bt_hci_rx_stats_get(&rx_after);
+	assert_true(rx_after.packets - rx_before.packets >=
+		    HOST_TX_THREADS * HOST_TX_PDUS + HOST_RX_PDUS);
+	assert_true(rx_after.max_batch <= CONFIG_BT_RECV_BATCH_BUDGET);
+	assert_true((uint64_t)rx_after.batches * CONFIG_BT_RECV_BATCH_BUDGET >= rx_after.packets);
+	assert_true(rx_after.takes >= 1 && rx_after.takes <= rx_after.packets);
+	assert_true(rx_after.residency_max_ns * rx_after.takes >= rx_after.residency_ns);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_init_sequence, setup),
+		cmocka_unit_test_setup(test_connect_acl_flow, setup),
+		cmocka_unit_test_setup(test_iso_data_path, setup),
+		cmocka_unit_test_setup(test_link_rate_and_latency, setup),
+		cmocka_unit_test_setup(test_cmd_credits, setup),
+		cmocka_unit_test_setup(test_host_flow_throttle, setup),
+		/* Enables the host stack, keep it last */
+		cmocka_unit_test_setup(test_host_stack_traffic, setup),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,418 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_buf.h>
+#include <base/byteorder.h>
+#include <base/queue/bt_queue.h>
+#include <osdep/os.h>
+
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/shm.h>
+
+#include "drivers/shm_ring.h"
+
+#define ACL_PAYLOAD   27
+#define ACL_LEN       (1 + 4 + ACL_PAYLOAD)
+#define BENCH_PACKETS 200000
+
+BT_BUF_POOL_DEFINE(tx_pool, 32, 300, 0, NULL);
+
+static struct bt_queue rx_q;
+
+static int recv_cb(const struct bt_hci_transport *transport, struct bt_buf *buf)
+{
+	bt_queue_append(&rx_q, buf);
+	return 0;
+}
+
+static bool bell_pending(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	eventfd_t v;
+
+	if (poll(&pfd, 1, 0) != 1) {
+		return false;
+	}
+
+	return eventfd_read(fd, &v) == 0;
+}
+
+static void fill_acl(uint8_t *frame, uint32_t seq)
+{
+	frame[0] = BT_HCI_H4_ACL;
+	sys_put_le16(bt_acl_handle_pack(1, BT_ACL_START), &frame[1]);
+	sys_put_le16(ACL_PAYLOAD, &frame[3]);
+	for (int i = 0; i < ACL_PAYLOAD; i++) {
+		frame[5 + i] = (uint8_t)(seq + i);
+	}
+}
+
+static struct bt_buf *acl_buf(uint32_t seq)
+{
+	struct bt_buf *buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+
+	assert_non_null(buf);
+	fill_acl(bt_buf_add(buf, ACL_LEN), seq);
+
+	return buf;
+}
+
+static void send_acl(uint32_t seq)
+{
+	assert_int_equal(bt_hci_send(&shm_transport, acl_buf(seq)), 0);
+}
+
+static void expect_acl(uint32_t seq)
+{
+	struct bt_buf *buf = bt_queue_get(&rx_q, OS_SECONDS(2));
+	uint8_t frame[ACL_LEN];
+
+	assert_non_null(buf);
+	fill_acl(frame, seq);
+	assert_int_equal(buf->len, ACL_LEN);
+	assert_memory_equal(buf->data, frame, ACL_LEN);
+	bt_buf_unref(buf);
+}
+
+static void test_ring_records(void **state)
+{
+	struct bt_shm_channel ch;
+	struct shm_ring_end host_tx, host_rx, peer_tx, peer_rx;
+	struct shm_seg *seg;
+	size_t seg_len;
+	uint8_t frame[256], out[256];
+	uint8_t *rec;
+	uint32_t len;
+	bool rang;
+
+	(void)state;
+	assert_int_equal(bt_shm_channel_create(100, &ch), -EINVAL);
+	assert_int_equal(ch.mem_fd, -1);
+	assert_int_equal(bt_shm_channel_create(256, &ch), 0);
+	assert_int_equal(shm_seg_map(&ch, &seg, &seg_len), 0);
+	assert_int_equal(seg_len, shm_seg_size(256));
+	shm_seg_ends(seg, &ch, true, &host_tx, &host_rx);
+	shm_seg_ends(seg, &ch, false, &peer_tx, &peer_rx);
+	assert_ptr_equal(host_tx.ring, peer_rx.ring);
+	assert_ptr_equal(host_rx.ring, peer_tx.ring);
+
+	assert_int_equal(shm_ring_peek(&peer_rx, &len), -EAGAIN);
+	assert_int_equal(shm_ring_put(&host_tx, frame, 256 - SHM_REC_HDR + 1, &rang), -EMSGSIZE);
+
+	/* Odd sizes walk the records across the end of the ring many times */
+	for (uint32_t n = 1; n < 2000; n++) {
+		len = 1 + (n * 37) % 120;
+		for (uint32_t i = 0; i < len; i++) {
+			frame[i] = (uint8_t)(n ^ i);
+		}
+		assert_int_equal(shm_ring_put(&host_tx, frame, len, &rang), 0);
+		assert_false(rang);
+
+		assert_int_equal(shm_ring_peek(&peer_rx, &len), 0);
+		assert_int_equal(len, 1 + (n * 37) % 120);
+		shm_ring_read(&peer_rx, 0, out, len);
+		assert_memory_equal(out, frame, len);
+		assert_false(shm_ring_consume(&peer_rx, len));
+	}
+	assert_true(shm_ring_empty(&peer_rx));
+
+	/* Full ring, then a sleeping producer is woken by the consumer */
+	while (shm_ring_put(&host_tx, frame, 60, &rang) == 0) {
+	}
+	assert_int_equal(shm_ring_put(&host_tx, frame, 60, &rang), -EAGAIN);
+	assert_true(shm_ring_space(&host_tx) < 60 + SHM_REC_HDR);
+	bt_atomic_set(&host_tx.ring->producer_waiting, 1);
+	assert_int_equal(shm_ring_peek(&peer_rx, &len), 0);
+	assert_true(shm_ring_consume(&peer_rx, len));
+	assert_true(bell_pending(ch.host_tx_bell));
+	assert_int_equal(bt_atomic_get(&host_tx.ring->producer_waiting), 0);
+
+	/* Only a consumer that announced its sleep gets a doorbell */
+	assert_int_equal(shm_ring_put(&peer_tx, frame, 10, &rang), 0);
+	assert_false(rang);
+	assert_false(bell_pending(ch.host_rx_bell));
+	bt_atomic_set(&host_rx.ring->consumer_waiting, 1);
+	assert_int_equal(shm_ring_put(&peer_tx, frame, 10, &rang), 0);
+	assert_true(rang);
+	assert_true(bell_pending(ch.host_rx_bell));
+
+	/* A length running past the published head is refused, flushing recovers */
+	while (shm_ring_peek(&host_rx, &len) == 0) {
+		(void)shm_ring_consume(&host_rx, len);
+	}
+	assert_int_equal(shm_ring_put(&peer_tx, frame, 10, &rang), 0);
+	rec = &peer_tx.data[bt_atomic_get(&peer_tx.ring->tail) & (256 - 1)];
+	sys_put_le32(11, rec);
+	assert_int_equal(shm_ring_peek(&host_rx, &len), -EBADMSG);
+	sys_put_le32(UINT32_MAX, rec);
+	assert_int_equal(shm_ring_peek(&host_rx, &len), -EBADMSG);
+	bt_atomic_set(&peer_tx.ring->head, bt_atomic_get(&peer_tx.ring->tail) + 256 + 1);
+	assert_int_equal(shm_ring_peek(&host_rx, &len), -EBADMSG);
+	bt_atomic_set(&host_rx.ring->producer_waiting, 1);
+	assert_true(shm_ring_flush(&host_rx));
+	assert_true(bell_pending(ch.peer_bell));
+	assert_true(shm_ring_empty(&host_rx));
+	assert_int_equal(shm_ring_peek(&host_rx, &len), -EAGAIN);
+	assert_int_equal(shm_ring_put(&peer_tx, frame, 10, &rang), 0);
+	assert_int_equal(shm_ring_peek(&host_rx, &len), 0);
+	assert_int_equal(len, 10);
+
+	assert_int_equal(shm_bell_wait(ch.host_rx_bell, -1, 0), -ETIMEDOUT);
+	assert_int_equal(shm_bell_ring(ch.host_rx_bell), 0);
+	assert_int_equal(shm_bell_wait(ch.host_rx_bell, -1, 0), 0);
+
+	/* A segment that was not formatted is refused */
+	seg->magic = 0;
+	assert_int_equal(shm_seg_map(&ch, &seg, &seg_len), -EINVAL);
+
+	(void)munmap(seg, seg_len);
+	bt_shm_channel_close(&ch);
+	assert_int_equal(ch.peer_bell, -1);
+}
+
+static void test_transport_echo(void **state)
+{
+	struct bt_shm_channel ch;
+	struct bt_shm_peer peer;
+	struct bt_hci_driver_stats stats;
+	struct bt_buf *buf;
+	uint8_t cmd[] = {BT_HCI_H4_CMD, 0x03, 0x0c, 0};
+
+	(void)state;
+	bt_queue_init(&rx_q);
+	assert_int_equal(bt_driver_shm_init(), 0);
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), -ENODEV);
+
+	assert_int_equal(bt_shm_channel_create(4096, &ch), 0);
+	assert_int_equal(bt_shm_peer_start(&peer, &ch, BT_SHM_PEER_ECHO), 0);
+	assert_int_equal(bt_shm_configure(&ch), 0);
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), 0);
+	assert_int_equal(bt_shm_configure(&ch), -EBUSY);
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), -EALREADY);
+
+	/* Commands are completed, data comes back unchanged */
+	buf = bt_buf_alloc(&tx_pool, OS_TIMEOUT_FOREVER);
+	bt_buf_add_mem(buf, cmd, sizeof(cmd));
+	assert_int_equal(bt_hci_send(&shm_transport, buf), 0);
+	buf = bt_queue_get(&rx_q, OS_SECONDS(2));
+	assert_non_null(buf);
+	assert_int_equal(buf->len, 7);
+	assert_int_equal(buf->data[0], BT_HCI_H4_EVT);
+	assert_int_equal(buf->data[1], BT_HCI_EVT_CMD_COMPLETE);
+	assert_int_equal(sys_get_le16(&buf->data[4]), BT_HCI_OP_RESET);
+	assert_int_equal(buf->data[6], BT_HCI_ERR_SUCCESS);
+	bt_buf_unref(buf);
+
+	/* Windows stay within the host RX pool; the total wraps the ring many times */
+	for (uint32_t i = 0; i < 1000; i += 8) {
+		for (uint32_t j = i; j < i + 8; j++) {
+			send_acl(j);
+		}
+		for (uint32_t j = i; j < i + 8; j++) {
+			expect_acl(j);
+		}
+	}
+	assert_null(bt_queue_get(&rx_q, OS_MSEC(20)));
+
+	/* A frame bigger than the ring is refused and stays with the caller */
+	buf = bt_buf_alloc_len(&tx_pool, 300, OS_TIMEOUT_FOREVER);
+	assert_non_null(buf);
+	bt_buf_add_u8(buf, BT_HCI_H4_ACL);
+	bt_buf_add(buf, bt_buf_tailroom(buf));
+
+	assert_int_equal(bt_hci_get_stats(&shm_transport, &stats), 0);
+	assert_int_equal(stats.tx_packets, 1001);
+	assert_int_equal(stats.rx_packets, 1001);
+	assert_int_equal(stats.tx_bytes, sizeof(cmd) + 1000 * ACL_LEN);
+	assert_int_equal(stats.rx_dropped, 0);
+	assert_int_equal(peer.rx_frames, 1001);
+	assert_int_equal(peer.tx_frames, 1001);
+
+	assert_int_equal(bt_hci_close(&shm_transport), 0);
+	assert_int_equal(bt_hci_close(&shm_transport), -ENETDOWN);
+	assert_int_equal(bt_hci_send(&shm_transport, buf), -ENETDOWN);
+	bt_buf_unref(buf);
+
+	bt_shm_peer_stop(&peer);
+	bt_shm_channel_close(&ch);
+}
+
+static void test_transport_corrupt_record(void **state)
+{
+	struct bt_shm_channel ch;
+	struct bt_shm_peer peer;
+	struct bt_hci_driver_stats stats;
+	struct shm_ring_end peer_tx, peer_rx;
+	struct shm_seg *seg;
+	size_t seg_len;
+	bt_atomic_val_t head;
+	uint8_t hdr[SHM_REC_HDR];
+
+	(void)state;
+	bt_queue_init(&rx_q);
+	assert_int_equal(bt_shm_channel_create(4096, &ch), 0);
+	assert_int_equal(bt_shm_peer_start(&peer, &ch, BT_SHM_PEER_ECHO), 0);
+	assert_int_equal(bt_shm_configure(&ch), 0);
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), 0);
+
+	send_acl(0);
+	expect_acl(0);
+
+	/* Publish a record claiming more bytes than the ring holds */
+	assert_int_equal(shm_seg_map(&ch, &seg, &seg_len), 0);
+	shm_seg_ends(seg, &ch, false, &peer_tx, &peer_rx);
+	head = bt_atomic_get(&peer_tx.ring->head);
+	sys_put_le32(4096, hdr);
+	for (int i = 0; i < SHM_REC_HDR; i++) {
+		peer_tx.data[(head + i) & (4096 - 1)] = hdr[i];
+	}
+	bt_atomic_set(&peer_tx.ring->head, head + SHM_REC_HDR + 8);
+	if (bt_atomic_cas(&peer_tx.ring->consumer_waiting, 1, 0)) {
+		assert_int_equal(shm_bell_ring(peer_tx.data_bell), 0);
+	}
+
+	/* The host drops it and keeps receiving */
+	for (uint32_t i = 1; i < 100; i++) {
+		send_acl(i);
+		expect_acl(i);
+	}
+	assert_null(bt_queue_get(&rx_q, OS_MSEC(20)));
+
+	assert_int_equal(bt_hci_get_stats(&shm_transport, &stats), 0);
+	assert_int_equal(stats.rx_dropped, 1);
+	assert_int_equal(stats.rx_packets, 100);
+
+	assert_int_equal(bt_hci_close(&shm_transport), 0);
+	(void)munmap(seg, seg_len);
+	bt_shm_peer_stop(&peer);
+	bt_shm_channel_close(&ch);
+}
+
+static void test_transport_other_process(void **state)
+{
+	struct bt_shm_channel ch;
+	int sv[2];
+	pid_t pid;
+	int status;
+
+	(void)state;
+	bt_queue_init(&rx_q);
+	assert_int_equal(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv), 0);
+
+	pid = fork();
+	assert_true(pid >= 0);
+	if (pid == 0) {
+		struct bt_shm_peer peer;
+		char c;
+
+		close(sv[0]);
+		if (bt_shm_channel_recv(sv[1], &ch) < 0 ||
+		    bt_shm_peer_start(&peer, &ch, BT_SHM_PEER_ECHO) < 0) {
+			_exit(1);
+		}
+
+		/* Serve until the host hangs up */
+		(void)read(sv[1], &c, 1);
+		bt_shm_peer_stop(&peer);
+		_exit(peer.rx_frames == 2000 ? 0 : 2);
+	}
+
+	close(sv[1]);
+	assert_int_equal(bt_shm_channel_create(8192, &ch), 0);
+	assert_int_equal(bt_shm_channel_send(sv[0], &ch), 0);
+	assert_int_equal(bt_shm_configure(&ch), 0);
+	bt_shm_channel_close(&ch);
+
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), 0);
+	for (uint32_t i = 0; i < 2000; i++) {
+		send_acl(i);
+		expect_acl(i);
+	}
+	assert_int_equal(bt_hci_close(&shm_transport), 0);
+
+	close(sv[0]);
+	assert_int_equal(waitpid(pid, &status, 0), pid);
+	assert_true(WIFEXITED(status));
+	assert_int_equal(WEXITSTATUS(status), 0);
+}
+
+static void bench_sender(void *arg)
+{
+	for (uint32_t i = 0; i < BENCH_PACKETS; i++) {
+		send_acl(i);
+	}
+}
+
+static void test_transport_throughput(void **state)
+{
+	struct bt_shm_channel ch;
+	struct bt_shm_peer peer;
+	struct bt_hci_driver_stats stats;
+	os_thread_t sender;
+	uint64_t start, elapsed;
+
+	(void)state;
+	bt_queue_init(&rx_q);
+	assert_int_equal(bt_shm_channel_create(CONFIG_BT_SHM_RING_SIZE, &ch), 0);
+	assert_int_equal(bt_shm_peer_start(&peer, &ch, BT_SHM_PEER_ECHO), 0);
+	assert_int_equal(bt_shm_configure(&ch), 0);
+	assert_int_equal(bt_hci_open(&shm_transport, recv_cb), 0);
+
+	start = os_time_get_ns();
+	assert_int_equal(os_thread_create(&sender, bench_sender, NULL, "shm_bench", OS_PRIORITY(0),
+					  0),
+			 0);
+	for (uint32_t i = 0; i < BENCH_PACKETS; i++) {
+		struct bt_buf *buf = bt_queue_get(&rx_q, OS_SECONDS(5));
+
+		assert_non_null(buf);
+		bt_buf_unref(buf);
+	}
+	elapsed = os_time_get_ns() - start;
+	assert_int_equal(os_thread_join(&sender, OS_TIMEOUT_FOREVER), 0);
+
+	assert_int_equal(bt_hci_get_stats(&shm_transport, &stats), 0);
+	print_message("%u echoed %u byte frames: %.0f ns per frame, %u+%u doorbells, "
+		      "%u host waits\n",
+		      BENCH_PACKETS, ACL_LEN, (double)elapsed / BENCH_PACKETS, stats.tx_syscalls,
+		      stats.rx_syscalls, stats.tx_waits);
+	assert_int_equal(stats.rx_packets, BENCH_PACKETS);
+	assert_int_equal(stats.rx_dropped, 0);
+
+	assert_int_equal(bt_hci_close(&shm_transport), 0);
+	bt_shm_peer_stop(&peer);
+	bt_shm_channel_close(&ch);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_ring_records),
+		cmocka_unit_test(test_transport_echo),
+		cmocka_unit_test(test_transport_corrupt_record),
+		cmocka_unit_test(test_transport_other_process),
+		cmocka_unit_test(test_transport_throughput),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <setjmp.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_atomic.h>
+#include <osdep/os.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include "host/conn_internal.h"
+
+#define BENCH_MAX_CONNS 256
+#define BENCH_LOOKUPS 200000
+
+static struct bt_conn conns[BENCH_MAX_CONNS];
+static bt_atomic_ptr_t slots[2 * BENCH_MAX_CONNS];
+static struct bt_conn_handle_map map;
+
+static void conn_setup(struct bt_conn *conn, uint16_t handle)
+{
+	memset(conn, 0, sizeof(*conn));
+	conn->handle = handle;
+	conn->type = BT_CONN_TYPE_LE;
+	conn->state = BT_CONN_CONNECTED;
+	bt_atomic_set(&conn->ref, 1);
+}
+
+static void expect_lookup(uint16_t handle, struct bt_conn *expected)
+{
+	struct bt_conn *conn = bt_conn_handle_map_lookup(&map, handle);
+
+	assert_ptr_equal(conn, expected);
+	if (conn) {
+		assert_int_equal(bt_atomic_get(&conn->ref), 2);
+		bt_conn_unref(conn);
+	}
+}
+
+/* The next handle after prev that starts probing at the same slot as prev */
+static uint16_t colliding_handle(uint16_t prev)
+{
+	uint16_t handle = prev + 1;
+
+	while (bt_conn_handle_map_home(&map, handle) != bt_conn_handle_map_home(&map, prev)) {
+		handle++;
+	}
+
+	return handle;
+}
+
+static void test_lookup_add_remove(void **state)
+{
+	(void)state;
+	bt_conn_handle_map_init(&map, slots, 8);
+
+	size_t home = bt_conn_handle_map_home(&map, 0x0001);
+	uint16_t h0 = 0x0001;
+	uint16_t h1 = colliding_handle(h0);
+	uint16_t h2 = colliding_handle(h1);
+	uint16_t h3 = colliding_handle(h2);
+	uint16_t other = 0x0002;
+
+	while (bt_conn_handle_map_home(&map, other) == home) {
+		other++;
+	}
+
+	conn_setup(&conns[0], h0);
+	conn_setup(&conns[1], h1);
+	conn_setup(&conns[2], h2);
+	conn_setup(&conns[3], other);
+	for (int i = 0; i < 4; i++) {
+		bt_conn_handle_map_add(&map, &conns[i]);
+	}
+	bt_conn_handle_map_add(&map, &conns[0]);
+
+	for (int i = 0; i < 4; i++) {
+		expect_lookup(conns[i].handle, &conns[i]);
+	}
+	expect_lookup(h3, NULL);
+	expect_lookup(0x0eff, NULL);
+
+	/* Later entries of a probe sequence stay reachable */
+	bt_conn_handle_map_remove(&map, &conns[0]);
+	expect_lookup(h0, NULL);
+	expect_lookup(h1, &conns[1]);
+	expect_lookup(h2, &conns[2]);
+
+	/* And the tombstone is reused */
+	conn_setup(&conns[4], h3);
+	bt_conn_handle_map_add(&map, &conns[4]);
+	assert_ptr_equal(bt_atomic_ptr_get(&slots[home]), &conns[4]);
+	expect_lookup(h3, &conns[4]);
+
+	/* Entries are checked, not trusted */
+	conns[1].state = BT_CONN_DISCONNECTED;
+	expect_lookup(h1, NULL);
+	conns[1].state = BT_CONN_CONNECTED;
+	bt_atomic_set(&conns[2].ref, 0);
+	expect_lookup(h2, NULL);
+	bt_atomic_set(&conns[2].ref, 1);
+
+	/* Removing a whole probe sequence leaves the table empty */
+	bt_conn_handle_map_remove(&map, &conns[2]);
+	bt_conn_handle_map_remove(&map, &conns[1]);
+	bt_conn_handle_map_remove(&map, &conns[4]);
+	bt_conn_handle_map_remove(&map, &conns[3]);
+	bt_conn_handle_map_remove(&map, &conns[3]);
+	for (int i = 0; i < 8; i++) {
+		assert_null(bt_atomic_ptr_get(&slots[i]));
+	}
+}
+
+static void test_handle_changed(void **state)
+{
+	(void)state;
+	bt_conn_handle_map_init(&map, slots, 8);
+
+	conn_setup(&conns[0], 0x0005);
+	bt_conn_handle_map_add(&map, &conns[0]);
+
+	/* The stale entry does not answer for either handle, and can still go */
+	conns[0].handle = 0x0006;
+	expect_lookup(0x0005, NULL);
+	expect_lookup(0x0006, NULL);
+	bt_conn_handle_map_remove(&map, &conns[0]);
+	for (int i = 0; i < 8; i++) {
+		assert_null(bt_atomic_ptr_get(&slots[i]));
+	}
+}
+
+/* What bt_conn_lookup_handle() did before the map */
+static struct bt_conn *linear_lookup(size_t count, uint16_t handle)
+{
+	for (size_t i = 0; i < count; i++) {
+		struct bt_conn *conn = bt_conn_ref(&conns[i]);
+
+		if (!conn) {
+			continue;
+		}
+
+		if (bt_conn_is_handle_valid(conn) && conn->handle == handle) {
+			return conn;
+		}
+
+		bt_conn_unref(conn);
+	}
+
+	return NULL;
+}
+
+static void bench(size_t count)
+{
+	uint64_t start, map_ns, linear_ns;
+	uint32_t seed = 1;
+	uint16_t handles[64];
+
+	bt_conn_handle_map_init(&map, slots, 2 * count);
+
+	/* ACL handles from 0, CIS handles from 0x100 as controllers hand them out */
+	for (size_t i = 0; i < count; i++) {
+		conn_setup(&conns[i], (i % 2) ? 0x0100 + i / 2 : i / 2);
+		bt_conn_handle_map_add(&map, &conns[i]);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(handles); i++) {
+		seed = seed * 1103515245U + 12345U;
+		handles[i] = conns[(seed >> 16) % count].handle;
+	}
+
+	start = os_time_get_ns();
+	for (int i = 0; i < BENCH_LOOKUPS; i++) {
+		struct bt_conn *conn = bt_conn_handle_map_lookup(&map, handles[i % 64]);
+
+		assert_non_null(conn);
+		bt_conn_unref(conn);
+	}
+	map_ns = os_time_get_ns() - start;
+
+	start = os_time_get_ns();
+	for (int i = 0; i < BENCH_LOOKUPS; i++) {
+		struct bt_conn *conn = linear_lookup(count, handles[i % 64]);
+
+		assert_non_null(conn);
+		bt_conn_unref(conn);
+	}
+	linear_ns = os_time_get_ns() - start;
+
+	print_message("%3zu connections: map %.1f ns/lookup, linear scan %.1f ns/lookup\n", count,
+		      (double)map_ns / BENCH_LOOKUPS, (double)linear_ns / BENCH_LOOKUPS);
+	assert_true(map_ns < linear_ns);
+}
+
+static void test_lookup_bench(void **state)
+{
+	(void)state;
+	bench(64);
+	bench(256);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_lookup_add_remove),
+		cmocka_unit_test(test_handle_changed),
+		cmocka_unit_test(test_lookup_bench),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,1019 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <setjmp.h>
+
+#if defined(__has_include)
+#if __has_include(<cmocka.h>)
+#include <cmocka.h>
+#else
+#include <cmocka.h>
+#endif
+#else
+#include <cmocka.h>
+#endif
+
+#include <base/bt_atomic.h>
+#include <base/bt_buf.h>
+#include <base/byteorder.h>
+#include <osdep/os.h>
+
+#include <bluetooth/hci.h>
+#include <drivers/bluetooth.h>
+#include <drivers/loopback.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include "host/conn_internal.h"
+#include "host/hci_core.h"
+#include "host/l2cap_internal.h"
+
+extern int bt_work_main_work_init(void);
+
+static const bt_addr_le_t peer_sink = {
+	.type = BT_ADDR_LE_RANDOM, .a = {{0x01, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+static const bt_addr_le_t peer_echo = {
+	.type = BT_ADDR_LE_RANDOM, .a = {{0x02, 0x00, 0x00, 0x00, 0x00, 0xc0}}};
+
+static struct bt_conn *host_conn;
+static bt_atomic_t host_tx_done;
+static bt_atomic_t host_tx_err;
+static os_sem_t host_conn_sem;
+
+static void host_connected(struct bt_conn *conn, uint8_t err)
+{
+	assert_int_equal(err, 0);
+	os_sem_give(&host_conn_sem);
+}
+
+static void host_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	os_sem_give(&host_conn_sem);
+}
+
+static struct bt_conn_cb host_conn_cb = {
+	.connected = host_connected,
+	.disconnected = host_disconnected,
+};
+
+static void host_tx_cb(struct bt_conn *conn, void *user_data, int err)
+{
+	bt_atomic_inc(&host_tx_done);
+	if (err) {
+		bt_atomic_inc(&host_tx_err);
+	}
+}
+
+/* Connects host_conn to peer, with host_conn_cb registered until
+ * host_disconnect().
+ */
+static void host_connect(const bt_addr_le_t *peer)
+{
+	os_sem_init(&host_conn_sem, 0, 1);
+	assert_int_equal(bt_conn_cb_register(&host_conn_cb), 0);
+	host_conn = NULL;
+	assert_int_equal(bt_conn_le_create(peer, BT_CONN_LE_CREATE_CONN,
+					   BT_LE_CONN_PARAM_DEFAULT, &host_conn),
+			 0);
+	assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+
+	/* Let the host finish its own feature, PHY and data length procedures */
+	os_sleep_ms(50);
+}
+
+static void host_disconnect(void)
+{
+	assert_int_equal(bt_conn_disconnect(host_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN), 0);
+	assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+	bt_conn_unref(host_conn);
+	host_conn = NULL;
+	bt_conn_cb_unregister(&host_conn_cb);
+}
+
+#if defined(CONFIG_BT_HCI_VS_EVT_USER)
+static os_sem_t vnd_evt_sem;
+static uint8_t vnd_evt_data[2];
+
+static void vnd_evt_handler(struct bt_buf_simple *buf)
+{
+	assert_int_equal(buf->len, sizeof(vnd_evt_data));
+	memcpy(vnd_evt_data, buf->data, buf->len);
+	os_sem_give(&vnd_evt_sem);
+}
+
+static void send_vnd_evt(uint8_t subevent, uint8_t a, uint8_t b)
+{
+	struct bt_buf *buf = bt_buf_get_evt(BT_HCI_EVT_VENDOR, false, OS_TIMEOUT_FOREVER);
+
+	assert_non_null(buf);
+	bt_buf_add_u8(buf, BT_HCI_EVT_VENDOR);
+	bt_buf_add_u8(buf, 3);
+	bt_buf_add_u8(buf, subevent);
+	bt_buf_add_u8(buf, a);
+	bt_buf_add_u8(buf, b);
+	assert_int_equal(bt_hci_recv(&loopback_transport, buf), 0);
+}
+#endif /* CONFIG_BT_HCI_VS_EVT_USER */
+
+static void test_host_event_dispatch(void **state)
+{
+	(void)state;
+
+#if defined(CONFIG_BT_HCI_EVT_STATS)
+	struct bt_hci_evt_stats cc, cc_prio, disconn, disconn_prio, meta, conn, enh_conn;
+	struct bt_hci_evt_stats conn_prio, enh_conn_prio;
+
+	/* Count from a reset, over some commands and one connection */
+	bt_hci_evt_stats_reset();
+	for (int i = 0; i < 10; i++) {
+		assert_int_equal(bt_hci_cmd_send_sync(BT_HCI_OP_READ_BD_ADDR, NULL, NULL), 0);
+	}
+	host_connect(&peer_echo);
+	host_disconnect();
+
+	bt_hci_evt_stats_get(BT_HCI_EVT_CMD_COMPLETE, &cc);
+	bt_hci_evt_prio_stats_get(BT_HCI_EVT_CMD_COMPLETE, &cc_prio);
+	bt_hci_evt_stats_get(BT_HCI_EVT_DISCONN_COMPLETE, &disconn);
+	bt_hci_evt_prio_stats_get(BT_HCI_EVT_DISCONN_COMPLETE, &disconn_prio);
+	bt_hci_evt_stats_get(BT_HCI_EVT_LE_META_EVENT, &meta);
+	bt_hci_le_evt_stats_get(BT_HCI_EVT_LE_CONN_COMPLETE, &conn);
+	bt_hci_le_evt_stats_get(BT_HCI_EVT_LE_ENH_CONN_COMPLETE, &enh_conn);
+	bt_hci_le_evt_prio_stats_get(BT_HCI_EVT_LE_CONN_COMPLETE, &conn_prio);
+	bt_hci_le_evt_prio_stats_get(BT_HCI_EVT_LE_ENH_CONN_COMPLETE, &enh_conn_prio);
+
+	/* Command Complete is only handled in the driver RX context */
+	assert_int_equal(cc.count, 0);
+	assert_true(cc_prio.count >= 10);
+	assert_int_equal(cc_prio.dropped, 0);
+	assert_true(cc_prio.time_ns >= cc_prio.max_ns && cc_prio.max_ns > 0);
+	/* Once in each context, not twice in either */
+	assert_int_equal(disconn.count, 1);
+	assert_int_equal(disconn_prio.count, 1);
+	assert_int_equal(conn.count + enh_conn.count, 1);
+	assert_int_equal(conn_prio.count + enh_conn_prio.count, 1);
+	assert_true(meta.count >= 1);
+#endif /* CONFIG_BT_HCI_EVT_STATS */
+
+#if defined(CONFIG_BT_HCI_VS_EVT_USER)
+	struct bt_hci_vnd_evt_handler h = {
+		.subevent = 0x42,
+		.min_len = sizeof(vnd_evt_data),
+		.handler = vnd_evt_handler,
+	};
+	struct bt_hci_vnd_evt_handler dup = h;
+
+	os_sem_init(&vnd_evt_sem, 0, 1);
+	assert_int_equal(bt_hci_vnd_evt_handler_register(&h), 0);
+	assert_int_equal(bt_hci_vnd_evt_handler_register(&dup), -EALREADY);
+
+	send_vnd_evt(0x42, 0xaa, 0xbb);
+	assert_int_equal(os_sem_take(&vnd_evt_sem, OS_MSEC(1000)), 0);
+	assert_int_equal(vnd_evt_data[0], 0xaa);
+	assert_int_equal(vnd_evt_data[1], 0xbb);
+
+	/* Other subevents, and short events, do not reach the handler */
+	send_vnd_evt(0x43, 0x01, 0x02);
+	h.min_len = 3;
+	send_vnd_evt(0x42, 0x03, 0x04);
+	assert_int_not_equal(os_sem_take(&vnd_evt_sem, OS_MSEC(50)), 0);
+
+	assert_int_equal(bt_hci_vnd_evt_handler_unregister(&h), 0);
+	assert_int_equal(bt_hci_vnd_evt_handler_unregister(&h), -ENOENT);
+	h.min_len = sizeof(vnd_evt_data);
+	send_vnd_evt(0x42, 0x05, 0x06);
+	assert_int_not_equal(os_sem_take(&vnd_evt_sem, OS_MSEC(50)), 0);
+
+#if defined(CONFIG_BT_HCI_EVT_STATS)
+	struct bt_hci_evt_stats vnd;
+
+	bt_hci_evt_stats_get(BT_HCI_EVT_VENDOR, &vnd);
+	assert_int_equal(vnd.count, 4);
+	bt_hci_evt_stats_reset();
+	bt_hci_evt_stats_get(BT_HCI_EVT_VENDOR, &vnd);
+	assert_int_equal(vnd.count, 0);
+	bt_hci_evt_prio_stats_get(BT_HCI_EVT_CMD_COMPLETE, &vnd);
+	assert_int_equal(vnd.count, 0);
+
+	/* Counting starts over from the reset */
+	send_vnd_evt(0x42, 0x07, 0x08);
+	for (int i = 0; i < 100 && !vnd.count; i++) {
+		os_sleep_ms(1);
+		bt_hci_evt_stats_get(BT_HCI_EVT_VENDOR, &vnd);
+	}
+	assert_int_equal(vnd.count, 1);
+#endif /* CONFIG_BT_HCI_EVT_STATS */
+#endif /* CONFIG_BT_HCI_VS_EVT_USER */
+}
+
+#define ASYNC_CMDS 4
+
+static os_sem_t async_sem;
+static struct {
+	uint16_t opcode;
+	uint8_t status;
+	uint8_t len;
+	bt_addr_t addr;
+} async_done[ASYNC_CMDS];
+static bt_atomic_t async_count;
+
+static void async_cmd_cb(uint16_t opcode, uint8_t status, struct bt_buf *rsp, void *user_data)
+{
+	uintptr_t i = (uintptr_t)user_data;
+
+	/* Runs in the driver RX context, checked by the test thread */
+	async_done[i].opcode = opcode;
+	async_done[i].status = status;
+	async_done[i].len = rsp->len;
+	if (opcode == BT_HCI_OP_READ_BD_ADDR && rsp->len >= sizeof(struct bt_hci_rp_read_bd_addr)) {
+		bt_addr_copy(&async_done[i].addr,
+			     &((struct bt_hci_rp_read_bd_addr *)rsp->data)->bdaddr);
+	}
+	bt_atomic_inc(&async_count);
+	os_sem_give(&async_sem);
+}
+
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+static void cmd_stats_count(const struct bt_hci_cmd_stats *stats, void *user_data)
+{
+	(*(int *)user_data)++;
+}
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+
+static void test_host_cmd_async(void **state)
+{
+	/* The second Read BD_ADDR waits for the first, the others overlap */
+	static const uint16_t ops[ASYNC_CMDS] = {
+		BT_HCI_OP_READ_LOCAL_VERSION_INFO, BT_HCI_OP_READ_BD_ADDR,
+		BT_HCI_OP_READ_BD_ADDR, BT_HCI_OP_LE_READ_SUPP_STATES};
+	struct bt_loopback_config cfg;
+
+	(void)state;
+	bt_loopback_config_default(&cfg);
+	os_sem_init(&async_sem, 0, ASYNC_CMDS);
+	bt_atomic_set(&async_count, 0);
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+	bt_hci_cmd_stats_reset();
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+
+	for (uintptr_t i = 0; i < ASYNC_CMDS; i++) {
+		assert_int_equal(bt_hci_cmd_send_async(ops[i], NULL, async_cmd_cb, (void *)i), 0);
+	}
+	for (int i = 0; i < ASYNC_CMDS; i++) {
+		assert_int_equal(os_sem_take(&async_sem, OS_MSEC(2000)), 0);
+	}
+	assert_int_equal(bt_atomic_get(&async_count), ASYNC_CMDS);
+
+	for (int i = 0; i < ASYNC_CMDS; i++) {
+		assert_int_equal(async_done[i].opcode, ops[i]);
+		assert_int_equal(async_done[i].status, BT_HCI_ERR_SUCCESS);
+		assert_true(async_done[i].len >= 1);
+	}
+	assert_true(bt_addr_eq(&async_done[1].addr, &cfg.public_addr));
+	assert_true(bt_addr_eq(&async_done[2].addr, &cfg.public_addr));
+
+#if defined(CONFIG_BT_HCI_CMD_STATS)
+	struct bt_hci_cmd_stats stats;
+	uint32_t hist = 0;
+	int opcodes = 0;
+
+	/* Twice above, since the reset */
+	assert_int_equal(bt_hci_cmd_stats_get(BT_HCI_OP_READ_BD_ADDR, &stats), 0);
+	assert_int_equal(stats.opcode, BT_HCI_OP_READ_BD_ADDR);
+	assert_int_equal(stats.count, 2);
+	assert_int_equal(stats.failed, 0);
+	assert_true(stats.max_ns > 0 && stats.time_ns >= stats.max_ns);
+	for (int i = 0; i < BT_HCI_CMD_LATENCY_BUCKETS; i++) {
+		hist += stats.hist[i];
+	}
+	assert_int_equal(hist, stats.count);
+	/* Every answer took at least the 500 us of latency, the 256 us bucket */
+	for (int i = 0; i < 8; i++) {
+		assert_int_equal(stats.hist[i], 0);
+	}
+
+	assert_int_equal(bt_hci_cmd_stats_get(0x0000, &stats), -ENOENT);
+	bt_hci_cmd_stats_foreach(cmd_stats_count, &opcodes);
+	assert_true(opcodes >= ASYNC_CMDS - 1);
+
+	bt_hci_cmd_stats_reset();
+	assert_int_equal(bt_hci_cmd_stats_get(BT_HCI_OP_READ_BD_ADDR, &stats), -ENOENT);
+#endif /* CONFIG_BT_HCI_CMD_STATS */
+}
+
+#define SCHED_PDUS 12
+/* ATT Write Command with 16 bytes of value, as in host_tx_thread */
+#define SCHED_PDU_LEN (3 + 16)
+
+BT_BUF_POOL_DEFINE(sched_pool, 2 * SCHED_PDUS, BT_L2CAP_BUF_SIZE(SCHED_PDU_LEN),
+		   CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+static struct bt_conn *sched_conns[2];
+/* Which connection each completed PDU was sent on, in completion order */
+static struct bt_conn *sched_order[2 * SCHED_PDUS];
+static bt_atomic_t sched_done;
+static bt_atomic_t sched_err;
+static os_sem_t sched_hold;
+static struct bt_work sched_hold_work;
+
+static void sched_tx_cb(struct bt_conn *conn, void *user_data, int err)
+{
+	bt_atomic_val_t i = bt_atomic_inc(&sched_done);
+
+	if (err || i >= ARRAY_SIZE(sched_order)) {
+		bt_atomic_inc(&sched_err);
+		return;
+	}
+	sched_order[i] = conn;
+}
+
+static void sched_hold_handler(struct bt_work *work)
+{
+	os_sem_take(&sched_hold, OS_TIMEOUT_FOREVER);
+}
+
+/* Queues SCHED_PDUS on both connections while the TX processor, which runs on
+ * the main work queue, is held behind sched_hold_work, then lets it run and
+ * waits for every PDU to complete.
+ */
+static void sched_run(void)
+{
+	int64_t deadline;
+
+	bt_atomic_set(&sched_done, 0);
+	bt_work_submit(&sched_hold_work);
+
+	for (int i = 0; i < SCHED_PDUS; i++) {
+		for (int c = 0; c < ARRAY_SIZE(sched_conns); c++) {
+			struct bt_l2cap_chan *chan =
+				bt_l2cap_le_lookup_tx_cid(sched_conns[c], BT_L2CAP_CID_ATT);
+			struct bt_buf *buf = bt_l2cap_create_pdu(&sched_pool, 0);
+
+			assert_non_null(buf);
+			bt_buf_add_u8(buf, 0x52);
+			bt_buf_add_le16(buf, 0xfff0);
+			memset(bt_buf_add(buf, 16), i, 16);
+			assert_int_equal(bt_l2cap_send_pdu(BT_L2CAP_LE_CHAN(chan), buf, sched_tx_cb,
+							   NULL),
+					 0);
+		}
+	}
+
+	os_sem_give(&sched_hold);
+
+	deadline = os_time_get_ns() + 5000000000LL;
+	while (bt_atomic_get(&sched_done) < 2 * SCHED_PDUS) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+	assert_int_equal(bt_atomic_get(&sched_err), 0);
+}
+
+/* Completions of the first connection among the first n */
+static int sched_first_count(int n)
+{
+	int count = 0;
+
+	for (int i = 0; i < n; i++) {
+		count += sched_order[i] == sched_conns[0];
+	}
+
+	return count;
+}
+
+static int sched_last(struct bt_conn *conn)
+{
+	for (int i = 2 * SCHED_PDUS - 1; i >= 0; i--) {
+		if (sched_order[i] == conn) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void test_host_tx_sched(void **state)
+{
+	static const bt_addr_le_t *peers[] = {&peer_sink, &peer_echo};
+
+	(void)state;
+	os_sem_init(&host_conn_sem, 0, 1);
+	os_sem_init(&sched_hold, 0, 1);
+	bt_work_init(&sched_hold_work, sched_hold_handler);
+	assert_int_equal(bt_conn_cb_register(&host_conn_cb), 0);
+
+	for (int c = 0; c < ARRAY_SIZE(sched_conns); c++) {
+		assert_int_equal(bt_conn_le_create(peers[c], BT_CONN_LE_CREATE_CONN,
+						   BT_LE_CONN_PARAM_DEFAULT, &sched_conns[c]),
+				 0);
+		assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+	}
+	os_sleep_ms(50);
+
+	assert_int_equal(bt_conn_tx_sched_set((enum bt_conn_tx_sched)3), -EINVAL);
+	assert_int_equal(bt_conn_tx_weight_set(sched_conns[0], 0), -EINVAL);
+
+	/* Round-robin: turns of a few buffers each */
+	assert_int_equal(bt_conn_tx_sched_set(BT_CONN_TX_SCHED_RR), 0);
+	sched_run();
+	assert_true(sched_first_count(SCHED_PDUS) >= SCHED_PDUS / 4);
+	assert_true(sched_first_count(SCHED_PDUS) <= SCHED_PDUS * 3 / 4);
+
+	/* Strict priority: the first connection drains before the second starts,
+	 * give or take the order in which completions of both are reported.
+	 */
+	assert_int_equal(bt_conn_tx_sched_set(BT_CONN_TX_SCHED_PRIO), 0);
+	assert_int_equal(bt_conn_tx_weight_set(sched_conns[0], 2), 0);
+	sched_run();
+	assert_true(sched_first_count(SCHED_PDUS) >= SCHED_PDUS - CONFIG_BT_CONN_TX_MAX);
+
+	/* Weighted fair queuing: three PDUs of the first for one of the second */
+	assert_int_equal(bt_conn_tx_sched_set(BT_CONN_TX_SCHED_WFQ), 0);
+	assert_int_equal(bt_conn_tx_weight_set(sched_conns[0], 3), 0);
+	sched_run();
+	assert_true(sched_first_count(SCHED_PDUS) >= SCHED_PDUS * 3 / 4 - 2);
+	assert_true(sched_first_count(SCHED_PDUS) <= SCHED_PDUS * 3 / 4 + 2);
+
+	/* With a quota of one buffer, priority no longer holds the second back */
+	assert_int_equal(bt_conn_tx_sched_set(BT_CONN_TX_SCHED_PRIO), 0);
+	assert_int_equal(bt_conn_tx_quota_set(sched_conns[0], 1), 0);
+	bt_conn_tx_stats_reset(sched_conns[0]);
+	sched_run();
+	assert_true(sched_last(sched_conns[1]) < sched_last(sched_conns[0]));
+
+#if defined(CONFIG_BT_CONN_TX_STATS)
+	struct bt_conn_tx_stats stats;
+
+	assert_int_equal(bt_conn_tx_stats_get(sched_conns[0], &stats), 0);
+	assert_int_equal(stats.frags, SCHED_PDUS);
+	assert_int_equal(stats.bytes, SCHED_PDUS * (BT_L2CAP_HDR_SIZE + SCHED_PDU_LEN));
+	assert_true(stats.quota_hits > 0);
+	assert_true(stats.waits >= 1 && stats.waits <= SCHED_PDUS);
+	assert_true(stats.delay_max_ns > 0);
+	assert_true(stats.delay_max_ns * stats.waits >= stats.delay_ns);
+
+	assert_int_equal(bt_conn_tx_stats_get(sched_conns[1], &stats), 0);
+	assert_int_equal(stats.frags, 4 * SCHED_PDUS);
+	assert_int_equal(stats.quota_hits, 0);
+#else
+	struct bt_conn_tx_stats stats;
+
+	assert_int_equal(bt_conn_tx_stats_get(sched_conns[0], &stats), -ENOTSUP);
+#endif /* CONFIG_BT_CONN_TX_STATS */
+
+	assert_int_equal(bt_conn_tx_sched_set(BT_CONN_TX_SCHED_RR), 0);
+	for (int c = 0; c < ARRAY_SIZE(sched_conns); c++) {
+		assert_int_equal(bt_conn_disconnect(sched_conns[c],
+						    BT_HCI_ERR_REMOTE_USER_TERM_CONN),
+				 0);
+		assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+		bt_conn_unref(sched_conns[c]);
+	}
+	bt_conn_cb_unregister(&host_conn_cb);
+}
+
+#define BURST_PDUS 256
+/* ATT Write Command that just fits one ACL packet of the loopback controller */
+#define BURST_PDU_LEN (251 - BT_L2CAP_HDR_SIZE)
+
+BT_BUF_POOL_DEFINE(burst_pool, BURST_PDUS, BT_L2CAP_BUF_SIZE(BURST_PDU_LEN),
+		   CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+static void burst_tx_cb(struct bt_conn *conn, void *user_data, int err)
+{
+	bt_atomic_inc(&host_tx_done);
+	if (err) {
+		bt_atomic_inc(&host_tx_err);
+	}
+}
+
+/* Sends BURST_PDUS on host_conn with the TX processor sending up to burst
+ * fragments per run, returns the driver hand-offs per packet.
+ */
+static double burst_run(size_t burst)
+{
+	struct bt_l2cap_chan *chan = bt_l2cap_le_lookup_tx_cid(host_conn, BT_L2CAP_CID_ATT);
+	struct bt_hci_driver_stats before, after;
+	struct timespec cpu_start, cpu_end;
+	uint64_t start, wall_ns, cpu_ns;
+	double mb = (double)BURST_PDUS * BURST_PDU_LEN / 1e6;
+	int64_t deadline;
+
+	bt_conn_tx_burst_set(burst);
+	bt_atomic_set(&host_tx_done, 0);
+	assert_int_equal(bt_hci_get_stats(&loopback_transport, &before), 0);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	start = os_time_get_ns();
+
+	for (int i = 0; i < BURST_PDUS; i++) {
+		struct bt_buf *buf = bt_l2cap_create_pdu(&burst_pool, 0);
+
+		assert_non_null(buf);
+		bt_buf_add_u8(buf, 0x52);
+		bt_buf_add_le16(buf, 0xfff0);
+		memset(bt_buf_add(buf, BURST_PDU_LEN - 3), i, BURST_PDU_LEN - 3);
+		assert_int_equal(bt_l2cap_send_pdu(BT_L2CAP_LE_CHAN(chan), buf, burst_tx_cb, NULL),
+				 0);
+	}
+
+	deadline = os_time_get_ns() + 10000000000LL;
+	while (bt_atomic_get(&host_tx_done) < BURST_PDUS) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+	assert_int_equal(bt_atomic_get(&host_tx_err), 0);
+
+	wall_ns = os_time_get_ns() - start;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+	cpu_ns = (cpu_end.tv_sec - cpu_start.tv_sec) * 1000000000LL +
+		 (cpu_end.tv_nsec - cpu_start.tv_nsec);
+	assert_int_equal(bt_hci_get_stats(&loopback_transport, &after), 0);
+	assert_true(after.tx_packets - before.tx_packets >= BURST_PDUS);
+
+	print_message("burst %2zu: %.1f MB/s, %.1f ms CPU/MB, %.2f hand-offs/packet\n", burst,
+		      mb * 1e9 / wall_ns, cpu_ns / 1e6 / mb,
+		      (double)(after.tx_syscalls - before.tx_syscalls) /
+			      (after.tx_packets - before.tx_packets));
+
+	return (double)(after.tx_syscalls - before.tx_syscalls) /
+	       (after.tx_packets - before.tx_packets);
+}
+
+static void test_host_tx_burst(void **state)
+{
+	double single, burst;
+
+	(void)state;
+	host_connect(&peer_sink);
+
+	bt_atomic_set(&host_tx_err, 0);
+	single = burst_run(1);
+	burst = burst_run(CONFIG_BT_CONN_TX_BURST);
+
+	/* Host commands share the driver, so not exactly one per packet */
+	assert_true(single >= 0.9);
+	if (CONFIG_BT_CONN_TX_BURST > 1) {
+		assert_true(burst < single);
+	}
+
+	bt_conn_tx_burst_set(CONFIG_BT_CONN_TX_BURST);
+	host_disconnect();
+}
+
+#define READY_THREADS 6
+#define READY_ROUNDS 100
+#define READY_PDUS 4
+
+static struct bt_conn *ready_conns[2];
+static bt_atomic_t ready_stop;
+
+static void ready_tx_thread(void *arg)
+{
+	uintptr_t id = (uintptr_t)arg;
+
+	for (int i = 0; i < READY_PDUS; i++) {
+		struct bt_conn *conn = ready_conns[(id + i) % ARRAY_SIZE(ready_conns)];
+		struct bt_l2cap_chan *chan = bt_l2cap_le_lookup_tx_cid(conn, BT_L2CAP_CID_ATT);
+		struct bt_buf *buf = bt_l2cap_create_pdu(NULL, 0);
+
+		bt_buf_add_u8(buf, 0x52);
+		bt_buf_add_le16(buf, 0xfff0);
+		memset(bt_buf_add(buf, 16), id, 16);
+
+		if (bt_l2cap_send_pdu(BT_L2CAP_LE_CHAN(chan), buf, host_tx_cb, NULL)) {
+			bt_buf_unref(buf);
+			bt_atomic_inc(&host_tx_done);
+			bt_atomic_inc(&host_tx_err);
+		}
+
+		if ((id + i) % 3 == 0) {
+			(void)os_thread_yield();
+		}
+	}
+}
+
+/* Marks connections and their ATT channels ready with nothing to send, so
+ * they keep going on and off the ready queues under the other producers.
+ */
+static void ready_spurious_thread(void *arg)
+{
+	(void)arg;
+	while (!bt_atomic_get(&ready_stop)) {
+		for (int c = 0; c < ARRAY_SIZE(ready_conns); c++) {
+			struct bt_l2cap_chan *chan =
+				bt_l2cap_le_lookup_tx_cid(ready_conns[c], BT_L2CAP_CID_ATT);
+
+			bt_l2cap_le_chan_data_ready(BT_L2CAP_LE_CHAN(chan));
+			bt_conn_data_ready(ready_conns[c]);
+		}
+		(void)os_thread_yield();
+	}
+}
+
+static void test_host_ready_stress(void **state)
+{
+	static const bt_addr_le_t *peers[] = {&peer_sink, &peer_echo};
+	os_thread_t tx[READY_THREADS], spurious;
+	int64_t deadline;
+
+	(void)state;
+	os_sem_init(&host_conn_sem, 0, 1);
+	assert_int_equal(bt_conn_cb_register(&host_conn_cb), 0);
+	for (int c = 0; c < ARRAY_SIZE(ready_conns); c++) {
+		assert_int_equal(bt_conn_le_create(peers[c], BT_CONN_LE_CREATE_CONN,
+						   BT_LE_CONN_PARAM_DEFAULT, &ready_conns[c]),
+				 0);
+		assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+	}
+	os_sleep_ms(50);
+
+	/* Every round ends idle with nobody marking connections ready any more,
+	 * so a wakeup lost on the last PDUs stalls it.
+	 */
+	bt_atomic_set(&host_tx_done, 0);
+	bt_atomic_set(&host_tx_err, 0);
+	for (int round = 1; round <= READY_ROUNDS; round++) {
+		bt_atomic_set(&ready_stop, 0);
+		assert_int_equal(os_thread_create(&spurious, ready_spurious_thread, NULL,
+						  "lb_ready", OS_PRIORITY(0), 0),
+				 0);
+		for (uintptr_t i = 0; i < READY_THREADS; i++) {
+			assert_int_equal(os_thread_create(&tx[i], ready_tx_thread,
+							  (void *)(i + round), "lb_tx",
+							  OS_PRIORITY(0), 0),
+					 0);
+		}
+		for (int i = 0; i < READY_THREADS; i++) {
+			assert_int_equal(os_thread_join(&tx[i], OS_TIMEOUT_FOREVER), 0);
+		}
+		bt_atomic_set(&ready_stop, 1);
+		assert_int_equal(os_thread_join(&spurious, OS_TIMEOUT_FOREVER), 0);
+
+		deadline = os_time_get_ns() + 2000000000LL;
+		while (bt_atomic_get(&host_tx_done) < round * READY_THREADS * READY_PDUS) {
+			assert_true(os_time_get_ns() < deadline);
+			os_sleep_ms(1);
+		}
+	}
+	assert_int_equal(bt_atomic_get(&host_tx_done), READY_ROUNDS * READY_THREADS * READY_PDUS);
+	assert_int_equal(bt_atomic_get(&host_tx_err), 0);
+
+	/* Once idle, the TX processor has taken everything off the ready lists */
+	deadline = os_time_get_ns() + 1000000000LL;
+	for (int c = 0; c < ARRAY_SIZE(ready_conns); c++) {
+		struct bt_l2cap_chan *chan =
+			bt_l2cap_le_lookup_tx_cid(ready_conns[c], BT_L2CAP_CID_ATT);
+
+		while (bt_atomic_test_bit(ready_conns[c]->flags, BT_CONN_TX_READY) ||
+		       bt_atomic_get(&BT_L2CAP_LE_CHAN(chan)->_pdu_ready_lock)) {
+			assert_true(os_time_get_ns() < deadline);
+			os_sleep_ms(1);
+		}
+	}
+
+	for (int c = 0; c < ARRAY_SIZE(ready_conns); c++) {
+		assert_int_equal(bt_conn_disconnect(ready_conns[c],
+						    BT_HCI_ERR_REMOTE_USER_TERM_CONN),
+				 0);
+		assert_int_equal(os_sem_take(&host_conn_sem, OS_MSEC(5000)), 0);
+		bt_conn_unref(ready_conns[c]);
+	}
+	bt_conn_cb_unregister(&host_conn_cb);
+}
+
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+#define COC_MTU 3998
+#define COC_SDUS 200
+
+BT_BUF_POOL_DEFINE(coc_sdu_pool, 2, BT_L2CAP_SDU_BUF_SIZE(COC_MTU), 8, NULL);
+
+/* Copying, chaining, then three chaining channels holding their SDUs */
+static struct bt_l2cap_le_chan coc_chans[5];
+static struct bt_l2cap_le_chan *coc_accepting;
+static const struct bt_l2cap_chan_ops *coc_accepting_ops;
+static bt_atomic_t coc_connected;
+static bt_atomic_t coc_bytes;
+static bt_atomic_t coc_frags;
+static bt_atomic_t coc_bad;
+/* RX thread CPU time at the first and the last SDU of a run */
+static int64_t coc_cpu_first, coc_cpu_last;
+static struct bt_buf *coc_held_bufs[3];
+static bt_atomic_t coc_held;
+
+static struct bt_buf *coc_alloc_buf(struct bt_l2cap_chan *chan)
+{
+	return bt_buf_alloc(&coc_sdu_pool, OS_TIMEOUT_FOREVER);
+}
+
+static int coc_recv(struct bt_l2cap_chan *chan, struct bt_buf *buf)
+{
+	struct iovec iov[8];
+	struct timespec cpu;
+	size_t len = bt_buf_frags_len(buf);
+	int cnt = bt_buf_iovec_get(buf, 0, len, iov, ARRAY_SIZE(iov));
+	size_t off = 0;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	coc_cpu_last = cpu.tv_sec * 1000000000LL + cpu.tv_nsec;
+	if (!bt_atomic_get(&coc_bytes)) {
+		coc_cpu_first = coc_cpu_last;
+	}
+
+	for (int i = 0; i < cnt; i++) {
+		const uint8_t *data = iov[i].iov_base;
+
+		for (size_t j = 0; j < iov[i].iov_len; j++, off++) {
+			if (data[j] != (uint8_t)off) {
+				bt_atomic_inc(&coc_bad);
+				return 0;
+			}
+		}
+	}
+	if (off != COC_MTU) {
+		bt_atomic_inc(&coc_bad);
+	}
+
+	bt_atomic_add(&coc_frags, cnt);
+	bt_atomic_add(&coc_bytes, len);
+	return 0;
+}
+
+static int coc_hold_recv(struct bt_l2cap_chan *chan, struct bt_buf *buf)
+{
+	coc_held_bufs[BT_L2CAP_LE_CHAN(chan) - &coc_chans[2]] = buf;
+	bt_atomic_inc(&coc_held);
+	return -EINPROGRESS;
+}
+
+static void coc_chan_connected(struct bt_l2cap_chan *chan)
+{
+	bt_atomic_inc(&coc_connected);
+}
+
+static const struct bt_l2cap_chan_ops coc_copy_ops = {
+	.connected = coc_chan_connected,
+	.alloc_buf = coc_alloc_buf,
+	.recv = coc_recv,
+};
+
+static const struct bt_l2cap_chan_ops coc_chain_ops = {
+	.connected = coc_chan_connected,
+	.recv = coc_recv,
+};
+
+static const struct bt_l2cap_chan_ops coc_hold_ops = {
+	.connected = coc_chan_connected,
+	.recv = coc_hold_recv,
+};
+
+static int coc_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+		      struct bt_l2cap_chan **chan)
+{
+	memset(coc_accepting, 0, sizeof(*coc_accepting));
+	coc_accepting->chan.ops = coc_accepting_ops;
+	coc_accepting->rx.mtu = COC_MTU;
+	*chan = &coc_accepting->chan;
+	return 0;
+}
+
+static struct bt_l2cap_server coc_server = {
+	.psm = 0x0080,
+	.sec_level = BT_SECURITY_L1,
+	.accept = coc_accept,
+};
+
+/* Connects a channel as the peer and returns it once the host accepted */
+static struct bt_l2cap_le_chan *coc_connect(struct bt_l2cap_le_chan *chan,
+					    const struct bt_l2cap_chan_ops *ops, uint16_t scid)
+{
+	uint8_t req[4 + 4 + 10];
+	long connected = bt_atomic_get(&coc_connected);
+	int64_t deadline;
+
+	coc_accepting = chan;
+	coc_accepting_ops = ops;
+	sys_put_le16(sizeof(req) - 4, &req[0]);
+	sys_put_le16(BT_L2CAP_CID_LE_SIG, &req[2]);
+	req[4] = BT_L2CAP_LE_CONN_REQ;
+	req[5] = scid;
+	sys_put_le16(10, &req[6]);
+	sys_put_le16(coc_server.psm, &req[8]);
+	sys_put_le16(scid, &req[10]);
+	sys_put_le16(COC_MTU, &req[12]);
+	sys_put_le16(BT_L2CAP_RX_MTU, &req[14]);
+	sys_put_le16(100, &req[16]);
+	assert_int_equal(bt_loopback_inject_acl(&peer_sink, req, sizeof(req), OS_SECONDS(1)), 0);
+
+	deadline = os_time_get_ns() + 1000000000LL;
+	while (bt_atomic_get(&coc_connected) == connected) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+
+	return chan;
+}
+
+/* Injects K-frames of at most frame_len bytes carrying a full-MTU SDU from
+ * byte off on, frames of them at most. Returns the offset reached.
+ */
+static size_t coc_send(struct bt_l2cap_le_chan *chan, size_t off, size_t frame_len, int frames)
+{
+	static uint8_t frame[4 + BT_L2CAP_RX_MTU];
+
+	while (off < COC_MTU && frames--) {
+		uint8_t *p = &frame[4];
+		size_t len;
+
+		if (!off) {
+			sys_put_le16(COC_MTU, p);
+			p += BT_L2CAP_SDU_HDR_SIZE;
+		}
+		len = MIN(COC_MTU - off, frame_len - (p - &frame[4]));
+		for (size_t j = 0; j < len; j++) {
+			p[j] = (uint8_t)(off + j);
+		}
+		off += len;
+		len += p - &frame[4];
+
+		sys_put_le16(len, &frame[0]);
+		sys_put_le16(chan->rx.cid, &frame[2]);
+		assert_int_equal(bt_loopback_inject_acl(&peer_sink, frame, 4 + len, OS_SECONDS(1)),
+				 0);
+	}
+
+	return off;
+}
+
+/* Waits for the host to take the channel's first credit */
+static void coc_wait_credits(struct bt_l2cap_le_chan *chan)
+{
+	int64_t deadline = os_time_get_ns() + 1000000000LL;
+
+	while (bt_atomic_get(&chan->rx.credits) == 1) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+}
+
+static void coc_wait(bt_atomic_t *cnt, long n)
+{
+	int64_t deadline = os_time_get_ns() + 1000000000LL;
+
+	while (bt_atomic_get(cnt) < n) {
+		assert_true(os_time_get_ns() < deadline);
+		os_sleep_ms(1);
+	}
+}
+
+/* Sends COC_SDUS full-MTU SDUs as K-frames of frame_len, returns the number
+ * of fragments the application saw. Wall time includes building and
+ * injecting the frames, the RX thread's CPU time is what the host spends on
+ * them.
+ */
+static long coc_run(const char *name, struct bt_l2cap_le_chan *chan, size_t frame_len)
+{
+	int64_t start, wall_ns, deadline;
+	/* The RX thread CPU time is taken from the first SDU on */
+	double mb = (double)(COC_SDUS - 1) * COC_MTU / 1e6;
+
+	bt_atomic_set(&coc_bytes, 0);
+	bt_atomic_set(&coc_frags, 0);
+	bt_atomic_set(&coc_bad, 0);
+
+	start = os_time_get_ns();
+	for (int i = 0; i < COC_SDUS; i++) {
+		(void)coc_send(chan, 0, frame_len, INT_MAX);
+	}
+
+	deadline = os_time_get_ns() + 10000000000LL;
+	while (bt_atomic_get(&coc_bytes) < COC_SDUS * COC_MTU) {
+		assert_true(os_time_get_ns() < deadline);
+		assert_int_equal(bt_atomic_get(&coc_bad), 0);
+		os_sleep_ms(1);
+	}
+	assert_int_equal(bt_atomic_get(&coc_bad), 0);
+	assert_int_equal(bt_atomic_get(&coc_bytes), COC_SDUS * COC_MTU);
+
+	wall_ns = os_time_get_ns() - start;
+
+	print_message("%s: %.1f MB/s, %.2f ms RX thread CPU/MB, %.1f fragments/SDU\n", name,
+		      mb * 1e9 / wall_ns, (coc_cpu_last - coc_cpu_first) / 1e6 / mb,
+		      (double)bt_atomic_get(&coc_frags) / COC_SDUS);
+
+	return bt_atomic_get(&coc_frags);
+}
+
+static void test_host_coc_sdu_chain(void **state)
+{
+	struct bt_l2cap_le_chan *copy, *chain, *hold[3];
+	size_t off;
+
+	(void)state;
+	host_connect(&peer_sink);
+
+	assert_int_equal(bt_l2cap_server_register(&coc_server), 0);
+	copy = coc_connect(&coc_chans[0], &coc_copy_ops, 0x0040);
+	chain = coc_connect(&coc_chans[1], &coc_chain_ops, 0x0041);
+	assert_int_equal(copy->rx.mtu, COC_MTU);
+	assert_int_equal(chain->rx.mtu, COC_MTU);
+
+	/* One contiguous buffer per SDU against one fragment per K-frame */
+	assert_int_equal(coc_run("copy ", copy, copy->rx.mps), COC_SDUS);
+	assert_int_equal(coc_run("chain", chain, chain->rx.mps),
+			 COC_SDUS * DIV_ROUND_UP(BT_L2CAP_SDU_HDR_SIZE + COC_MTU, chain->rx.mps));
+
+	/* Short K-frames are packed, the SDU takes no more buffers. Each one
+	 * costs a credit PDU, so go one SDU at a time.
+	 */
+	bt_atomic_set(&coc_bytes, 0);
+	bt_atomic_set(&coc_frags, 0);
+	for (int i = 0; i < 20; i++) {
+		(void)coc_send(chain, 0, chain->rx.mps / 2 + 1, INT_MAX);
+		coc_wait(&coc_bytes, (i + 1) * COC_MTU);
+	}
+	assert_int_equal(bt_atomic_get(&coc_bad), 0);
+	assert_int_equal(bt_atomic_get(&coc_frags),
+			 20 * DIV_ROUND_UP(BT_L2CAP_SDU_HDR_SIZE + COC_MTU, chain->rx.mps));
+
+#if CONFIG_BT_L2CAP_SDU_CHAIN_BUDGET / (CONFIG_BT_L2CAP_SDU_CHAIN_FRAMES - 1) == 2
+	/* Held SDUs keep their K-frames, the budget takes two of them */
+	for (int i = 0; i < ARRAY_SIZE(hold); i++) {
+		hold[i] = coc_connect(&coc_chans[2 + i], &coc_hold_ops, 0x0042 + i);
+	}
+	bt_atomic_set(&coc_held, 0);
+	(void)coc_send(hold[0], 0, hold[0]->rx.mps, INT_MAX);
+	(void)coc_send(hold[1], 0, hold[1]->rx.mps, INT_MAX);
+	coc_wait(&coc_held, 2);
+
+	/* The third SDU's credits wait for one of them */
+	off = coc_send(hold[2], 0, hold[2]->rx.mps, 1);
+	coc_wait_credits(hold[2]);
+	os_sleep_ms(20);
+	assert_int_equal(bt_atomic_get(&hold[2]->rx.credits), 0);
+	assert_int_equal(bt_atomic_get(&coc_held), 2);
+
+	assert_int_equal(bt_l2cap_chan_recv_complete(&hold[0]->chan, coc_held_bufs[0]), 0);
+	assert_true(bt_atomic_get(&hold[2]->rx.credits) > 0);
+	(void)coc_send(hold[2], off, hold[2]->rx.mps, INT_MAX);
+	coc_wait(&coc_held, 3);
+	assert_int_equal(bt_buf_frags_len(coc_held_bufs[2]), COC_MTU);
+
+	/* Completing the others returns the whole budget */
+	assert_int_equal(bt_l2cap_chan_recv_complete(&hold[1]->chan, coc_held_bufs[1]), 0);
+	assert_int_equal(bt_l2cap_chan_recv_complete(&hold[2]->chan, coc_held_bufs[2]), 0);
+	(void)coc_send(hold[0], 0, hold[0]->rx.mps, INT_MAX);
+	(void)coc_send(hold[1], 0, hold[1]->rx.mps, INT_MAX);
+	coc_wait(&coc_held, 5);
+	assert_int_equal(bt_l2cap_chan_recv_complete(&hold[0]->chan, coc_held_bufs[0]), 0);
+	assert_int_equal(bt_l2cap_chan_recv_complete(&hold[1]->chan, coc_held_bufs[1]), 0);
+#endif
+
+	host_disconnect();
+}
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+
+static int group_setup(void **state)
+{
+	struct bt_loopback_config cfg;
+
+	(void)state;
+	bt_driver_loopback_init();
+	bt_loopback_config_default(&cfg);
+	cfg.br_edr = IS_ENABLED(CONFIG_BT_CLASSIC);
+	cfg.cmd_credits = CONFIG_BT_HCI_CMD_MAX_IN_FLIGHT;
+	/* Every command answer takes at least this long, see test_host_cmd_async */
+	cfg.latency_us = 500;
+	assert_int_equal(bt_loopback_configure(&cfg), 0);
+	bt_loopback_peer_clear();
+	assert_int_equal(bt_loopback_peer_add(&peer_sink, BT_LOOPBACK_PEER_SINK), 0);
+	assert_int_equal(bt_loopback_peer_add(&peer_echo, BT_LOOPBACK_PEER_ECHO), 0);
+
+	bt_work_main_work_init();
+	assert_int_equal(bt_enable(NULL), 0);
+
+	return 0;
+}
+
+static int group_teardown(void **state)
+{
+	(void)state;
+	return bt_disable();
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_host_event_dispatch),
+		cmocka_unit_test(test_host_cmd_async),
+		cmocka_unit_test(test_host_tx_sched),
+		cmocka_unit_test(test_host_tx_burst),
+		cmocka_unit_test(test_host_ready_stress),
+#if defined(CONFIG_BT_L2CAP_SDU_CHAIN)
+		cmocka_unit_test(test_host_coc_sdu_chain),
+#endif /* CONFIG_BT_L2CAP_SDU_CHAIN */
+	};
+
+	return cmocka_run_group_tests(tests, group_setup, group_teardown);
+}
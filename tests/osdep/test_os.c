@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <setjmp.h>
+#include <time.h>
 
 #if defined(__has_include)
 #if __has_include(<cmocka.h>)
@@ -328,6 +329,127 @@ static void test_thread_self_and_is_current(void **state)
 	assert_int_equal(os_thread_join(&thr, OS_TIMEOUT_FOREVER), 0);
 }
 
+#define STATS_SPIN_NS OS_MSEC(20)
+
+struct stats_ctx {
+	os_sem_t ready;
+	os_sem_t release;
+	bool spin;
+};
+
+static void stats_worker(void *arg)
+{
+	struct stats_ctx *ctx = (struct stats_ctx *)arg;
+
+	if (ctx->spin) {
+		struct timespec ts;
+
+		do {
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		} while ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec < STATS_SPIN_NS);
+	}
+
+	os_sem_give(&ctx->ready);
+	os_sem_take(&ctx->release, OS_TIMEOUT_FOREVER);
+}
+
+static void stats_count_cb(const struct os_thread_stats *stats, void *user_data)
+{
+	int *found = (int *)user_data;
+
+	if (!strcmp(stats->name, "prio5") || !strcmp(stats->name, "coop3")) {
+		(*found)++;
+	}
+}
+
+static void test_thread_priority_and_stats(void **state)
+{
+	(void)state;
+	struct stats_ctx pre = {.spin = true}, coop = {.spin = false};
+	struct os_thread_stats st;
+	os_thread_t thr_pre, thr_coop;
+	int found = 0;
+
+	assert_int_equal(os_sem_init(&pre.ready, 0, 1), 0);
+	assert_int_equal(os_sem_init(&pre.release, 0, 1), 0);
+	assert_int_equal(os_sem_init(&coop.ready, 0, 1), 0);
+	assert_int_equal(os_sem_init(&coop.release, 0, 1), 0);
+
+	/* Kconfig-sized stacks are honoured, raised to the host floor */
+	assert_int_equal(os_thread_create(&thr_pre, stats_worker, &pre, "prio5", OS_PRIORITY(5),
+					  1024),
+			 0);
+	assert_int_equal(os_thread_create(&thr_coop, stats_worker, &coop, "coop3",
+					  OS_PRIORITY_COOP(3), 0),
+			 0);
+	assert_int_equal(os_sem_take(&pre.ready, OS_TIMEOUT_FOREVER), 0);
+	assert_int_equal(os_sem_take(&coop.ready, OS_TIMEOUT_FOREVER), 0);
+
+	/* Preemptible: SCHED_OTHER with the priority as nice value */
+	assert_int_equal(os_thread_stats_get(&thr_pre, &st), 0);
+	assert_string_equal(st.name, "prio5");
+	assert_int_equal(st.priority, OS_PRIORITY(5));
+	assert_int_equal(st.policy, SCHED_OTHER);
+	assert_int_equal(st.sched_priority, 5);
+	assert_true(st.stack_size >= OS_THREAD_STACK_MIN);
+	assert_true(st.cpu_time_ns >= (uint64_t)STATS_SPIN_NS);
+	/* Thread start-up runs on the CPU clock before the uptime stamp */
+	assert_true(st.uptime_ns + OS_MSEC(1) >= st.cpu_time_ns);
+	assert_true(st.cpu_mask != 0);
+
+	/* Cooperative: real-time when permitted, otherwise a favourable nice value */
+	assert_int_equal(os_thread_stats_get(&thr_coop, &st), 0);
+	assert_int_equal(st.priority, OS_PRIORITY_COOP(3));
+	if (st.policy == OS_THREAD_RT_POLICY) {
+		assert_int_equal(st.sched_priority, OS_THREAD_RT_PRIO_BASE - 3);
+	} else {
+		assert_int_equal(st.policy, SCHED_OTHER);
+		assert_true(st.sched_priority <= 0);
+	}
+
+	/* Affinity changes show up in the stats */
+	assert_int_equal(os_thread_affinity_set(&thr_coop, 0x1), 0);
+	assert_int_equal(os_thread_stats_get(&thr_coop, &st), 0);
+	assert_int_equal(st.cpu_mask, 0x1);
+
+	assert_int_equal(os_thread_foreach(stats_count_cb, &found), 0);
+	assert_int_equal(found, 2);
+
+	os_sem_give(&pre.release);
+	os_sem_give(&coop.release);
+	assert_int_equal(os_thread_join(&thr_pre, OS_TIMEOUT_FOREVER), 0);
+	assert_int_equal(os_thread_join(&thr_coop, OS_TIMEOUT_FOREVER), 0);
+
+	/* Exited threads leave the registry */
+	assert_int_equal(os_thread_stats_get(&thr_pre, &st), -ESRCH);
+	found = 0;
+	assert_int_equal(os_thread_foreach(stats_count_cb, &found), 0);
+	assert_int_equal(found, 0);
+}
+
+static void short_worker(void *arg)
+{
+	(void)arg;
+}
+
+static void test_thread_create_short_lived(void **state)
+{
+	(void)state;
+	os_thread_t thr[32];
+
+	/* Threads that exit immediately must not fail creation */
+	for (int round = 0; round < 20; round++) {
+		for (size_t i = 0; i < sizeof(thr) / sizeof(thr[0]); i++) {
+			assert_int_equal(os_thread_create(&thr[i], short_worker, NULL, "short",
+							  OS_PRIORITY(0), 0),
+					 0);
+		}
+		for (size_t i = 0; i < sizeof(thr) / sizeof(thr[0]); i++) {
+			assert_int_equal(os_thread_join(&thr[i], OS_TIMEOUT_FOREVER), 0);
+		}
+	}
+}
+
 /* ----------------------- Scheduler/Critical ----------------------- */
 
 static void test_sched_lock_unlock_and_critical(void **state)
@@ -358,7 +480,7 @@ static void test_timer_start_stop_remaining(void **state)
 	timer_hits = 0;
 	os_timer_t t;
 	assert_int_equal(os_timer_create(&t, timer_cb, NULL), 0);
-	assert_int_equal(os_timer_start(&t, 30), 0);
+	assert_int_equal(os_timer_start(&t, OS_MSEC(30)), 0);
 	/* Wait until callback fires */
 	for (int i = 0; i < 12 && timer_hits == 0; i++) {
 		os_sleep_ms(5);
@@ -383,7 +505,7 @@ static void test_timer_stop_before_expiry(void **state)
 	volatile int hits = 0;
 	os_timer_t t;
 	assert_int_equal(os_timer_create(&t, timer_nohit_cb, (void *)&hits), 0);
-	assert_int_equal(os_timer_start(&t, 200), 0);
+	assert_int_equal(os_timer_start(&t, OS_MSEC(200)), 0);
 	/* Immediately stop */
 	assert_int_equal(os_timer_stop(&t), 0);
 	/* Short wait to ensure callback does not fire */
@@ -392,6 +514,149 @@ static void test_timer_stop_before_expiry(void **state)
 	assert_int_equal(os_timer_delete(&t), 0);
 }
 
+#define WHEEL_TIMERS       100000
+#define WHEEL_MAX_DELAY_MS 3000
+/* Generous bound: the suite also runs on loaded single-core CI hosts */
+#define WHEEL_MAX_LATE_MS  100
+
+struct wheel_probe {
+	os_timer_t timer;
+	uint64_t armed_ms;
+	uint64_t fired_ms;
+	uint32_t delay_ms;
+	uint32_t hits;
+	bool stopped;
+};
+
+static struct {
+	os_mutex_t lock;
+	os_cond_t done;
+	uint32_t fired;
+} wheel_ctx = {OS_MUTEX_INITIALIZER, OS_COND_INITIALIZER, 0};
+
+static void wheel_probe_cb(os_timer_t *t, void *arg)
+{
+	struct wheel_probe *p = (struct wheel_probe *)arg;
+	uint64_t now = os_time_get_ms();
+
+	(void)t;
+	os_mutex_lock(&wheel_ctx.lock, OS_TIMEOUT_FOREVER);
+	p->fired_ms = now;
+	p->hits++;
+	wheel_ctx.fired++;
+	os_cond_signal(&wheel_ctx.done);
+	os_mutex_unlock(&wheel_ctx.lock);
+}
+
+static void test_timer_wheel_100k(void **state)
+{
+	(void)state;
+	struct wheel_probe *probes = os_calloc(WHEEL_TIMERS, sizeof(*probes));
+	uint32_t seed = 0x12345678u;
+	uint32_t expected = 0;
+	uint64_t late_sum = 0, late_max = 0;
+
+	assert_non_null(probes);
+	wheel_ctx.fired = 0;
+
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i++) {
+		struct wheel_probe *p = &probes[i];
+
+		seed = seed * 1664525u + 1013904223u;
+		p->delay_ms = (seed >> 8) % WHEEL_MAX_DELAY_MS;
+		assert_int_equal(os_timer_create(&p->timer, wheel_probe_cb, p), 0);
+	}
+
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i++) {
+		struct wheel_probe *p = &probes[i];
+
+		os_mutex_lock(&wheel_ctx.lock, OS_TIMEOUT_FOREVER);
+		p->armed_ms = os_time_get_ms();
+		os_mutex_unlock(&wheel_ctx.lock);
+		assert_int_equal(os_timer_start(&p->timer, OS_MSEC(p->delay_ms)), 0);
+	}
+
+	/* Cancel every tenth timer that is still far enough from expiry */
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i += 10) {
+		struct wheel_probe *p = &probes[i];
+
+		if (os_timer_remaining_ms(&p->timer) > 200) {
+			assert_int_equal(os_timer_stop(&p->timer), 0);
+			os_mutex_lock(&wheel_ctx.lock, OS_TIMEOUT_FOREVER);
+			p->stopped = p->hits == 0;
+			os_mutex_unlock(&wheel_ctx.lock);
+		}
+	}
+
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i++) {
+		expected += probes[i].stopped ? 0 : 1;
+	}
+
+	os_mutex_lock(&wheel_ctx.lock, OS_TIMEOUT_FOREVER);
+	while (wheel_ctx.fired < expected) {
+		if (os_cond_wait(&wheel_ctx.done, &wheel_ctx.lock,
+				 OS_MSEC(WHEEL_MAX_DELAY_MS + 5 * WHEEL_MAX_LATE_MS)) == -ETIMEDOUT) {
+			break;
+		}
+	}
+	os_mutex_unlock(&wheel_ctx.lock);
+
+	/* Stopped timers must stay silent past their original deadline */
+	os_sleep_ms(WHEEL_MAX_LATE_MS);
+
+	os_mutex_lock(&wheel_ctx.lock, OS_TIMEOUT_FOREVER);
+	assert_int_equal(wheel_ctx.fired, expected);
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i++) {
+		struct wheel_probe *p = &probes[i];
+		uint64_t due = p->armed_ms + p->delay_ms;
+
+		if (p->stopped) {
+			assert_int_equal(p->hits, 0);
+			continue;
+		}
+
+		assert_int_equal(p->hits, 1);
+		/* armed_ms was sampled before start: never early */
+		assert_true(p->fired_ms >= due);
+		late_sum += p->fired_ms - due;
+		if (p->fired_ms - due > late_max) {
+			late_max = p->fired_ms - due;
+		}
+	}
+	os_mutex_unlock(&wheel_ctx.lock);
+
+	print_message("timer wheel: %u fired, lateness avg %.2f ms max %llu ms\n", expected,
+		      (double)late_sum / expected, (unsigned long long)late_max);
+	assert_true(late_max <= WHEEL_MAX_LATE_MS);
+
+	for (uint32_t i = 0; i < WHEEL_TIMERS; i++) {
+		assert_int_equal(os_timer_delete(&probes[i].timer), 0);
+	}
+	os_free(probes);
+}
+
+static void test_timer_static_init_and_rearm(void **state)
+{
+	(void)state;
+	volatile int hits = 0;
+	os_timer_t t = OS_TIMER_INITIALIZER(timer_nohit_cb, (void *)&hits);
+
+	assert_int_equal(os_timer_remaining_ms(&t), 0);
+	assert_int_equal(os_timer_start(&t, OS_MSEC(500)), 0);
+	assert_true(os_timer_remaining_ms(&t) > 400);
+	/* Re-arming a pending timer replaces its deadline */
+	assert_int_equal(os_timer_start(&t, OS_MSEC(20)), 0);
+	assert_true(os_timer_remaining_ms(&t) <= 20);
+	for (int i = 0; i < 40 && hits == 0; i++) {
+		os_sleep_ms(5);
+	}
+	assert_int_equal(hits, 1);
+	assert_int_equal(os_timer_remaining_ms(&t), 0);
+	os_sleep_ms(30);
+	assert_int_equal(hits, 1);
+	assert_int_equal(os_timer_delete(&t), 0);
+}
+
 /* ----------------------- Time ----------------------- */
 
 static void test_time_sleep_monotonic(void **state)
@@ -403,6 +668,123 @@ static void test_time_sleep_monotonic(void **state)
 	assert_true(t1 > t0);
 }
 
+static void test_timeout_units(void **state)
+{
+	(void)state;
+	assert_true(OS_NSEC(1) == 1);
+	assert_true(OS_USEC(1) == 1000);
+	assert_true(OS_MSEC(1) == 1000 * 1000);
+	assert_true(OS_SECONDS(3) == 3000LL * 1000 * 1000);
+	/* Must not overflow a 32-bit intermediate */
+	assert_true(OS_HOURS(1000) == 3600LL * 1000 * OS_SECONDS(1));
+	assert_true(OS_TIMEOUT_MS(OS_USEC(1)) == 1);
+	assert_true(OS_TIMEOUT_MS(OS_MSEC(7)) == 7);
+	assert_true(OS_TIMEOUT_MS(OS_MSEC(7) + 1) == 8);
+
+	uint64_t ms = os_time_get_ms();
+	uint64_t ns = os_time_get_ns();
+	assert_true(ns / 1000000 >= ms);
+	assert_true(ns / 1000000 - ms <= 1);
+}
+
+#define TIMEOUT_ROUNDS      20
+#define TIMEOUT_MAX_LATE_NS OS_MSEC(50)
+
+struct timeout_case {
+	os_sem_t sem;
+	os_mutex_t mutex;
+	os_cond_t cond;
+};
+
+enum timeout_prim {
+	TIMEOUT_SEM,
+	TIMEOUT_MUTEX,
+	TIMEOUT_COND,
+};
+
+static int64_t timed_wait_ns(struct timeout_case *tc, enum timeout_prim prim,
+			     os_timeout_t timeout)
+{
+	uint64_t t0 = os_time_get_ns();
+	int rc = -EINVAL;
+
+	switch (prim) {
+	case TIMEOUT_SEM:
+		rc = os_sem_take(&tc->sem, timeout);
+		break;
+	case TIMEOUT_MUTEX:
+		/* Held by this thread, so the non-recursive lock times out */
+		rc = os_mutex_lock(&tc->mutex, timeout);
+		break;
+	case TIMEOUT_COND:
+		rc = os_cond_wait(&tc->cond, &tc->mutex, timeout);
+		break;
+	}
+
+	assert_int_equal(rc, -ETIMEDOUT);
+
+	return (int64_t)(os_time_get_ns() - t0);
+}
+
+static void test_timeout_accuracy(void **state)
+{
+	(void)state;
+	static const os_timeout_t timeouts[] = {OS_USEC(200), OS_USEC(1500), OS_MSEC(5)};
+	struct timeout_case tc;
+
+	assert_int_equal(os_sem_init(&tc.sem, 0, 1), 0);
+	assert_int_equal(os_mutex_init(&tc.mutex), 0);
+	assert_int_equal(os_cond_init(&tc.cond), 0);
+	assert_int_equal(os_mutex_lock(&tc.mutex, OS_TIMEOUT_FOREVER), 0);
+
+	for (int prim = TIMEOUT_SEM; prim <= TIMEOUT_COND; prim++) {
+		for (size_t i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++) {
+			int64_t best = INT64_MAX;
+
+			for (int r = 0; r < TIMEOUT_ROUNDS; r++) {
+				int64_t elapsed = timed_wait_ns(&tc, prim, timeouts[i]);
+
+				/* Never early, and only boundedly late */
+				assert_true(elapsed >= timeouts[i]);
+				assert_true(elapsed <= timeouts[i] + TIMEOUT_MAX_LATE_NS);
+				best = elapsed < best ? elapsed : best;
+			}
+
+			/* Sub-millisecond parts are honoured, not rounded up to whole ms */
+			if (timeouts[i] % OS_MSEC(1)) {
+				assert_true(best < OS_TIMEOUT_MS(timeouts[i]) * OS_MSEC(1));
+			}
+			print_message("prim %d timeout %lld ns: best %lld ns\n", prim,
+				      (long long)timeouts[i], (long long)best);
+		}
+	}
+
+	assert_int_equal(os_mutex_unlock(&tc.mutex), 0);
+}
+
+static void sleep_worker(void *arg)
+{
+	os_sleep_ms((uint32_t)(uintptr_t)arg);
+}
+
+static void test_thread_join_timeout(void **state)
+{
+	(void)state;
+	os_thread_t thr;
+
+	assert_int_equal(os_thread_create(&thr, sleep_worker, (void *)(uintptr_t)100, "sleeper", 0,
+					  0),
+			 0);
+
+	uint64_t t0 = os_time_get_ns();
+	assert_int_equal(os_thread_join(&thr, OS_USEC(2500)), -ETIMEDOUT);
+	int64_t elapsed = (int64_t)(os_time_get_ns() - t0);
+	assert_true(elapsed >= OS_USEC(2500));
+	assert_true(elapsed <= OS_USEC(2500) + TIMEOUT_MAX_LATE_NS);
+
+	assert_int_equal(os_thread_join(&thr, OS_TIMEOUT_FOREVER), 0);
+}
+
 /* ----------------------- Memory ----------------------- */
 
 static void test_mem_alloc_free(void **state)
@@ -440,13 +822,20 @@ int main(void)
 		cmocka_unit_test(test_thread_create_join_name),
 		cmocka_unit_test(test_thread_cancel_behavior),
 		cmocka_unit_test(test_thread_self_and_is_current),
+		cmocka_unit_test(test_thread_priority_and_stats),
+		cmocka_unit_test(test_thread_create_short_lived),
 		/* Scheduler/Critical */
 		cmocka_unit_test(test_sched_lock_unlock_and_critical),
 		/* Timer */
 		cmocka_unit_test(test_timer_start_stop_remaining),
 		cmocka_unit_test(test_timer_stop_before_expiry),
+		cmocka_unit_test(test_timer_static_init_and_rearm),
+		cmocka_unit_test(test_timer_wheel_100k),
 		/* Time */
 		cmocka_unit_test(test_time_sleep_monotonic),
+		cmocka_unit_test(test_timeout_units),
+		cmocka_unit_test(test_timeout_accuracy),
+		cmocka_unit_test(test_thread_join_timeout),
 		/* Memory */
 		cmocka_unit_test(test_mem_alloc_free),
 	};